@@ -0,0 +1,29 @@
+#!/bin/sh
+# Time each MySQL load method against a local server
+#
+# Usage: mysql_benchmark.sh <database.xml> [driller options...]
+# For example:
+#   mysql_benchmark.sh Databases/Dentrix.xml --username=root --database=test
+
+DRILLER="${DRILLER:-./src/driller}"
+RUNS="${RUNS:-3}"
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <database.xml> [driller options...]" >&2
+  exit 1
+fi
+
+DATABASE="$1"
+shift
+
+for METHOD in insert prepared infile; do
+  RUN=1
+  while [ $RUN -le $RUNS ]; do
+    START=`date +%s.%N`
+    "$DRILLER" "$@" --load=$METHOD "$DATABASE" || exit 1
+    END=`date +%s.%N`
+
+    echo "$METHOD run $RUN: `echo "$END - $START" | bc` seconds"
+    RUN=`expr $RUN + 1`
+  done
+done
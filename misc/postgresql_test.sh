@@ -0,0 +1,176 @@
+#!/bin/sh
+# Load a database into a throwaway PostgreSQL server, once on one connection
+# and once on several, and check that both loads hold exactly the values the
+# file sink writes for the same database
+#
+# Usage: postgresql_test.sh [database.xml] [driller options...]
+# Without a database, a small one covering every type the file sink and
+# PostgreSQL agree on is generated. The server's programs, such as initdb
+# and pg_ctl, must be in PATH
+
+DRILLER="${DRILLER:-./src/driller}"
+PORT="${PORT:-54329}"
+
+DIR=`mktemp -d` || exit 1
+trap 'pg_ctl -D "$DIR/data" -m immediate stop >/dev/null 2>&1; rm -rf "$DIR"' 0
+
+TAB=`printf '\t'`
+
+# Print a number as little-endian bytes
+#
+# Usage: bytes <count> <number>
+bytes() {
+  COUNT=$1
+  VALUE=$2
+  while [ $COUNT -gt 0 ]; do
+    printf "\\`printf %03o $((VALUE & 255))`"
+    VALUE=$((VALUE >> 8))
+    COUNT=$((COUNT - 1))
+  done
+}
+
+# Write Test.xml and test.dat, 200 rows of 32 bytes
+generate_database() {
+  cat > "$DIR/Test.xml" <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<database name="PostgreSQL test">
+  <table name="Test" file="test.dat" data_offset="0" row_length="32">
+    <uint32 name="id" offset="0"/>
+    <int32 name="int32_col" offset="4"/>
+    <bool name="bool_col" offset="8"/>
+    <string name="string_col" offset="9" length="8"/>
+    <date name="date_col" offset="17"/>
+    <currency name="currency_col" offset="21"/>
+    <enum name="enum_col" offset="25">
+      <case id="0" value="first case"/>
+      <case id="1" value="second case"/>
+    </enum>
+    <blob name="blob_col" offset="26" length="2"/>
+    <int16 name="int16_col" offset="28"/>
+    <uint16 name="uint16_col" offset="30"/>
+  </table>
+</database>
+EOF
+
+  ROW=0
+  while [ $ROW -lt 200 ]; do
+    bytes 4 $ROW
+    bytes 4 $((ROW * 7919 - 500000))
+    bytes 1 $((ROW % 2))
+    # Fill the whole string, with a Latin-1 e acute in some rows
+    case $((ROW % 3)) in
+      0) printf 'n%06d\351' $ROW;;
+      1) printf 'name%03d\000' $ROW;;
+      2) printf 'row%05d' $ROW;;
+    esac
+    bytes 4 $((100000 + ROW * 37))
+    bytes 4 $((ROW * 12345 - 1000000))
+    bytes 1 $((ROW % 2))
+    bytes 2 $((ROW * 311))
+    bytes 2 $((ROW * 127 - 12000))
+    bytes 2 $((ROW * 300))
+    ROW=$((ROW + 1))
+  done > "$DIR/test.dat"
+}
+
+if [ $# -gt 0 ] && [ "${1#-}" = "$1" ]; then
+  DATABASE="$1"
+  shift
+else
+  generate_database
+  DATABASE="$DIR/Test.xml"
+
+  # Driller finds data files through the path saved in its settings
+  printf '[Driller]\ndata_path = %s\n' "$DIR" > "$DIR/.driller.ini"
+  HOME="$DIR"
+  export HOME
+fi
+
+initdb -D "$DIR/data" -U driller -A trust -E UTF8 >"$DIR/initdb.log" 2>&1 || {
+  cat "$DIR/initdb.log" >&2
+  exit 1
+}
+
+# Only listen on a socket in the temporary directory
+pg_ctl -D "$DIR/data" -l "$DIR/server.log" -w \
+  -o "-k $DIR -p $PORT -c listen_addresses=''" start >/dev/null || {
+  cat "$DIR/server.log" >&2
+  exit 1
+}
+
+createdb -h "$DIR" -p $PORT -U driller driller_test || exit 1
+
+# The file sink writes the data files' Latin-1 text as it is
+query() {
+  PGCLIENTENCODING=LATIN1 psql -h "$DIR" -p $PORT -U driller \
+    -d driller_test -X -q -A -t -F "$TAB" -c "$1"
+}
+
+# Print the expression formatting a column the way the file sink does
+#
+# Usage: column_text <column> <PostgreSQL type>
+column_text() {
+  NAME="\"$1\""
+  case "$2" in
+    boolean) echo "CASE WHEN $NAME THEN 'True' ELSE 'False' END";;
+    date) echo "to_char($NAME, 'FMYYYY-FMMM-FMDD')";;
+    bytea) echo "upper(regexp_replace(encode($NAME, 'hex'), '(..)(?!\$)', '\\1 ', 'g'))";;
+    *) echo "$NAME::text";;
+  esac
+}
+
+# Write every loaded table to <directory>/<table>.txt, as the file sink
+# would, sorted since rows are loaded in no particular order
+#
+# Usage: dump_tables <directory>
+dump_tables() {
+  mkdir -p "$1"
+  query "SELECT table_name FROM information_schema.tables
+    WHERE table_schema = 'public' ORDER BY table_name" |
+  while read TABLE; do
+    COLUMNS=`query "SELECT column_name, data_type
+      FROM information_schema.columns
+      WHERE table_schema = 'public' AND table_name = '$TABLE'
+      ORDER BY ordinal_position" |
+    while IFS="$TAB" read COLUMN TYPE; do
+      column_text "$COLUMN" "$TYPE"
+    done | paste -s -d ,`
+
+    # The file sink ends every value with a tab
+    query "SELECT $COLUMNS FROM \"$TABLE\" ORDER BY 1" |
+      sed "s/\$/$TAB/" | LC_ALL=C sort > "$1/$TABLE.txt"
+  done
+}
+
+mkdir "$DIR/expected"
+"$DRILLER" "$@" --sink=file --output="$DIR/expected" "$DATABASE" || exit 1
+for FILE in "$DIR/expected"/*.txt; do
+  LC_ALL=C sort "$FILE" > "$FILE.sorted" && mv "$FILE.sorted" "$FILE"
+done
+
+STATUS=0
+for CONNECTIONS in 1 4; do
+  "$DRILLER" "$@" --sink=postgresql --host="$DIR" --port=$PORT \
+    --username=driller --database=driller_test --connections=$CONNECTIONS \
+    "$DATABASE" || exit 1
+  dump_tables "$DIR/loaded.$CONNECTIONS"
+
+  if ! ls "$DIR/loaded.$CONNECTIONS" | grep -q .; then
+    echo "No tables were loaded" >&2
+    exit 1
+  fi
+
+  if ! diff -r "$DIR/expected" "$DIR/loaded.$CONNECTIONS" >&2; then
+    echo "Values loaded on $CONNECTIONS connections differ from the file sink" >&2
+    STATUS=1
+  fi
+done
+
+if [ $STATUS -ne 0 ]; then
+  exit 1
+fi
+
+for FILE in "$DIR/expected"/*.txt; do
+  echo "`basename "$FILE" .txt` `wc -l < "$FILE"`"
+done
+echo "PostgreSQL load test passed"
@@ -0,0 +1,604 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * batch_extraction.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "batch_extraction.h"
+#include "json_format.h"
+#include "database/table_cost.h"
+#include "process_pool.h"
+#include "timer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace Driller {
+
+/**
+  Quote a string for a JSON summary
+
+  @param text The string
+
+  @return The string, escaped and in quotes
+*/
+static std::string json_string(const std::string& text) throw (){
+  std::vector<char> out((6 * text.size()) + 1);
+  const unsigned int length = escape_json_string(text.data(),
+    static_cast<unsigned int>(text.size()), &out[0]);
+  return "\"" + std::string(&out[0], length) + "\"";
+}
+
+/**
+  Describe the exception being handled
+
+  @return The exception's message
+*/
+static std::string current_error() throw (){
+  try {
+    throw;
+  }
+
+  catch (const Errors::BaseError& error){
+    return error.error_message();
+  }
+
+  catch (const std::exception& error){
+    return error.what();
+  }
+
+  catch (...){
+    return "Unknown error";
+  }
+}
+
+/**
+  A table being extracted, in one part or as several ranges of rows
+*/
+class TableRun {
+public:
+  TableRun(const Database& db, const Table& _table, const unsigned int _parts)
+    throw ():
+
+    table(_table),
+    parts(_parts),
+    unfinished(_parts){
+
+    outcome.database = db.get_name();
+    outcome.table = table.get_name();
+    outcome.succeeded = false;
+    outcome.seconds = 0;
+  }
+
+  const Table table;
+
+  /** How many parts the table is extracted in */
+  const unsigned int parts;
+
+  /** How many parts haven't finished yet */
+  unsigned int unfinished;
+
+  /** How the table went. Its time is summed over every part */
+  TableOutcome outcome;
+};
+
+/**
+  Finish a table once every part has, joining its ranges if it was split
+  and they all succeeded, or else removing them. Nothing else touches the
+  outcome by then
+
+  @param run The table
+  @param sink A sink of the kind which wrote the ranges
+*/
+static void finish_table(TableRun& run, DataSink* sink) throw (){
+  TableOutcome& outcome = run.outcome;
+
+  if (run.parts > 1){
+    Timer timer;
+    if (outcome.error.empty()){
+      try {
+        sink->join_ranges(run.table, run.parts);
+      }
+
+      catch (...){
+        outcome.error = current_error();
+      }
+    }
+
+    if (!outcome.error.empty()){
+      sink->discard_ranges(run.table, run.parts);
+    }
+    outcome.seconds += timer.elapsed();
+  }
+
+  outcome.succeeded = outcome.error.empty();
+}
+
+/**
+  Extracts a table, or one range of a table's rows, with whichever sink is
+  free
+*/
+class TableJob : public Job {
+public:
+  TableJob(
+    BatchExtraction& _batch,
+    TableRun& _run,
+    const unsigned int _first_row,
+    const unsigned int _row_count,
+    const unsigned int _part,
+    const double _cost) throw ():
+
+    batch(_batch),
+    run_state(_run),
+    first_row(_first_row),
+    row_count(_row_count),
+    part(_part),
+    cost(_cost){
+
+    // A tuned pool's throughput is measured in estimated cost
+    work = cost;
+  }
+
+  /**
+    Extract this job's table or range
+
+    @param sink The sink to extract with
+
+    @return Why it failed, or nothing if it succeeded
+  */
+  std::string run_part(DataSink* sink) throw () {
+    try {
+      if (run_state.parts == 1){
+        sink->output_table(run_state.table, batch.row_limit);
+      }
+
+      else {
+        sink->output_range(run_state.table, first_row, row_count, part);
+      }
+    }
+
+    catch (...){
+      return current_error();
+    }
+
+    return "";
+  }
+
+  void run() {
+    DataSink* sink = batch.lease_sink();
+    Timer timer;
+
+    // Failures are kept with the outcome, so the job itself never fails
+    const std::string error = run_part(sink);
+    if (batch.finish_part(run_state, error, timer.elapsed())){
+      finish_table(run_state, sink);
+    }
+
+    batch.return_sink(sink);
+  }
+
+  BatchExtraction& batch;
+  TableRun& run_state;
+  const unsigned int first_row;
+  const unsigned int row_count;
+  const unsigned int part;
+
+  /** The estimated cost of this job, which orders it against the others */
+  const double cost;
+};
+
+/**
+  Runs a batch's jobs in worker processes. Each worker creates a sink of its
+  own, and reports how each job went as its time and any error
+*/
+class BatchProcessTask : public ProcessTask {
+public:
+  BatchProcessTask(BatchExtraction& _batch,
+    const std::vector<TableJob*>& _jobs) throw ():
+
+    batch(_batch),
+    jobs(_jobs),
+    sink(NULL){}
+
+  void start_worker(){
+    sink = batch.factory.create_sink(batch.processes);
+  }
+
+  std::string run_unit(const unsigned int unit) throw (){
+    Timer timer;
+    const std::string error = jobs[unit]->run_part(sink);
+
+    char seconds[32];
+    sprintf(seconds, "%.6f ", timer.elapsed());
+    return seconds + error;
+  }
+
+  void stop_worker(){
+    batch.factory.finish_sink(sink);
+    delete sink;
+  }
+
+  void unit_finished(const unsigned int unit, const std::string& result)
+    throw (){
+
+    const std::string::size_type space = result.find(' ');
+    batch.finish_part(jobs[unit]->run_state,
+      (space == std::string::npos) ? "" : result.substr(space + 1),
+      strtod(result.c_str(), NULL));
+  }
+
+  void unit_failed(const unsigned int unit, const std::string& error)
+    throw (){
+
+    batch.finish_part(jobs[unit]->run_state, error, 0);
+  }
+
+  BatchExtraction& batch;
+  const std::vector<TableJob*>& jobs;
+
+  /** The worker's sink, only ever set in a worker */
+  DataSink* sink;
+};
+
+/** Orders jobs by falling cost */
+static bool more_costly(const TableJob* a, const TableJob* b) throw (){
+  return a->cost > b->cost;
+}
+
+// Small enough that a table a few times larger than the rest is split, and
+// large enough that each range is worth a job
+const unsigned int BatchExtraction::default_min_range_rows = 100000;
+
+SinkFactory::SinkFactory() throw (){}
+
+SinkFactory::~SinkFactory() throw (){}
+
+void SinkFactory::finish_sink(DataSink*){}
+
+unsigned int SinkFactory::max_workers() const throw (){
+  return 0;
+}
+
+BatchExtraction::BatchExtraction(SinkFactory& _factory,
+  const unsigned int jobs) throw ():
+
+  factory(_factory),
+  workers(std::max(1u, _factory.max_workers() ?
+    std::min(jobs, _factory.max_workers()) : jobs)),
+  pool(NULL),
+  min_workers(workers),
+  adaptive_log(NULL),
+  controller(NULL),
+  processes(0),
+  max_attempts(ProcessPool::default_max_attempts),
+  worker_restarts(0),
+  can_split_sinks(-1),
+  row_limit(0),
+  min_range_rows(default_min_range_rows){}
+
+BatchExtraction::~BatchExtraction() throw (){
+  delete controller;
+  delete pool;
+
+  for (unsigned int ii = 0; ii < sinks.size(); ii++){
+    delete sinks[ii];
+  }
+}
+
+void BatchExtraction::include_table(const std::string& name) throw (){
+  included.insert(name);
+}
+
+void BatchExtraction::exclude_table(const std::string& name) throw (){
+  excluded.insert(name);
+}
+
+bool BatchExtraction::is_selected(const std::string& name) const throw (){
+  if (excluded.count(name)){
+    return false;
+  }
+
+  return included.empty() || included.count(name);
+}
+
+void BatchExtraction::set_row_limit(const unsigned int rows) throw (){
+  row_limit = rows;
+}
+
+void BatchExtraction::set_min_range_rows(const unsigned int rows) throw (){
+  min_range_rows = std::max(1u, rows);
+}
+
+void BatchExtraction::set_adaptive(const unsigned int _min_workers,
+  std::ostream* log) throw (){
+
+  min_workers = std::max(1u, std::min(_min_workers, workers));
+  adaptive_log = log;
+}
+
+void BatchExtraction::set_processes(const unsigned int _processes,
+  const unsigned int attempts) throw (){
+
+  processes = (_processes && factory.max_workers()) ?
+    std::min(_processes, factory.max_workers()) : _processes;
+  max_attempts = attempts;
+}
+
+unsigned int BatchExtraction::get_worker_restarts() const throw (){
+  return worker_restarts;
+}
+
+void BatchExtraction::extract(const Database& db){
+  if (processes){
+    // Each worker creates its own sinks, and none may be running threads
+    // when workers are forked, so a sink is only made to ask it this
+    if (can_split_sinks < 0){
+      DataSink* sink = factory.create_sink(processes);
+      can_split_sinks = sink->can_output_ranges() ? 1 : 0;
+      delete sink;
+    }
+  }
+
+  else if (sinks.empty()){
+    for (unsigned int ii = 0; ii < workers; ii++){
+      sinks.push_back(factory.create_sink(workers));
+    }
+    idle_sinks = sinks;
+
+    if (workers > 1){
+      pool = new ThreadPool(workers);
+    }
+
+    if (min_workers < workers){
+      controller = new ConcurrencyController("Jobs", min_workers, workers);
+      controller->set_log(adaptive_log);
+    }
+  }
+
+  std::vector<Table> tables;
+  for (unsigned int ii = 0; ii < db.table_count(); ii++){
+    const Table& table = db.table_at(ii);
+    if (is_selected(table.get_name())){
+      found.insert(table.get_name());
+      tables.push_back(table);
+    }
+  }
+
+  std::vector<double> costs;
+  double total_cost = 0;
+  for (unsigned int ii = 0; ii < tables.size(); ii++){
+    costs.push_back(estimate_table_cost(tables[ii], row_limit));
+    total_cost += costs.back();
+  }
+
+  // A table costing more than a worker's share of the database would keep
+  // one worker busy after the rest are done, so it's split into ranges. Only
+  // fixed length rows can be found without reading the file. A tuned pool
+  // needs jobs to finish regularly, so it gets several shares a worker.
+  // Worker processes are split for too, so that a crashed worker loses less
+  const unsigned int units = processes ? processes : workers;
+  const bool can_split = (units > 1 && (processes ? can_split_sinks == 1 :
+    sinks[0]->can_output_ranges()));
+  const unsigned int shares = (controller || processes) ? 4 * units : units;
+  const double share = total_cost / shares;
+
+  std::vector<TableRun*> runs;
+  std::vector<TableJob*> jobs;
+  for (unsigned int ii = 0; ii < tables.size(); ii++){
+    const Table& table = tables[ii];
+    unsigned int rows = estimate_row_count(table);
+    if (row_limit && rows > row_limit){
+      rows = row_limit;
+    }
+
+    unsigned int parts = 1;
+    if (can_split && costs[ii] > share && table.get_row_length() &&
+      table.get_snapshot_file().empty()){
+
+      parts = std::min(shares,
+        static_cast<unsigned int>((costs[ii] / share) + 1));
+      parts = std::max(1u, std::min(parts, rows / min_range_rows));
+    }
+
+    runs.push_back(new TableRun(db, table, parts));
+
+    // The last range runs to the end of the table, in case the estimate was
+    // short
+    const unsigned int range_rows = rows / parts;
+    for (unsigned int part = 0; part < parts; part++){
+      const unsigned int first_row = part * range_rows;
+      const unsigned int row_count = (part + 1 < parts) ? range_rows :
+        (row_limit ? rows - first_row : 0);
+
+      jobs.push_back(new TableJob(*this, *runs.back(), first_row, row_count,
+        part, costs[ii] / parts));
+    }
+  }
+
+  // Longest processing time first. The pool hands each job to whichever
+  // worker frees up first, so the small jobs fill in around the large ones.
+  // A single worker keeps the database's order, which streams and scripts
+  // follow
+  if (units > 1){
+    std::stable_sort(jobs.begin(), jobs.end(), more_costly);
+  }
+
+  if (processes){
+    run_processes(jobs, runs);
+  }
+
+  else {
+    for (unsigned int ii = 0; ii < jobs.size(); ii++){
+      if (pool){
+        pool->add_job(jobs[ii]);
+      }
+
+      else {
+        jobs[ii]->run();
+      }
+    }
+
+    if (controller){
+      controller->wait_all(*pool);
+    }
+
+    else if (pool){
+      pool->wait_all();
+    }
+  }
+
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    delete jobs[ii];
+  }
+
+  for (unsigned int ii = 0; ii < runs.size(); ii++){
+    outcomes.push_back(runs[ii]->outcome);
+    delete runs[ii];
+  }
+}
+
+void BatchExtraction::run_processes(const std::vector<TableJob*>& jobs,
+  const std::vector<TableRun*>& runs){
+
+  std::vector<unsigned int> order;
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    order.push_back(ii);
+  }
+
+  BatchProcessTask task(*this, jobs);
+  ProcessPool workers(processes, max_attempts);
+  worker_restarts += workers.run(task, order);
+
+  // The workers have exited, so a sink can be made here to join ranges
+  DataSink* sink = NULL;
+  for (unsigned int ii = 0; ii < runs.size(); ii++){
+    if (runs[ii]->parts > 1 && !sink){
+      sink = factory.create_sink(processes);
+    }
+    finish_table(*runs[ii], sink);
+  }
+  delete sink;
+}
+
+void BatchExtraction::record_error(const std::string& message) throw (){
+  errors.push_back(message);
+}
+
+void BatchExtraction::finish() throw (){
+  for (unsigned int ii = 0; ii < sinks.size(); ii++){
+    try {
+      factory.finish_sink(sinks[ii]);
+    }
+
+    catch (...){
+      errors.push_back(current_error());
+    }
+  }
+
+  std::set<std::string>::const_iterator name;
+  for (name = included.begin(); name != included.end(); name++){
+    if (!found.count(*name) && !excluded.count(*name)){
+      errors.push_back("No table named '" + *name + "' was found");
+    }
+  }
+}
+
+const std::vector<TableOutcome>& BatchExtraction::get_outcomes() const
+  throw (){
+
+  return outcomes;
+}
+
+const std::vector<std::string>& BatchExtraction::get_errors() const throw (){
+  return errors;
+}
+
+unsigned int BatchExtraction::failure_count() const throw (){
+  unsigned int failed = static_cast<unsigned int>(errors.size());
+  for (unsigned int ii = 0; ii < outcomes.size(); ii++){
+    if (!outcomes[ii].succeeded){
+      ++failed;
+    }
+  }
+
+  return failed;
+}
+
+std::string BatchExtraction::summary(const double seconds) const throw (){
+  char number[64];
+  unsigned int failed = 0;
+
+  std::string tables;
+  for (unsigned int ii = 0; ii < outcomes.size(); ii++){
+    const TableOutcome& outcome = outcomes[ii];
+    if (!outcome.succeeded){
+      ++failed;
+    }
+
+    sprintf(number, "%.3f", outcome.seconds);
+    tables += std::string(ii ? "," : "") +
+      "{\"database\":" + json_string(outcome.database) +
+      ",\"table\":" + json_string(outcome.table) +
+      ",\"status\":" + (outcome.succeeded ? "\"ok\"" : "\"failed\"") +
+      ",\"seconds\":" + number;
+
+    if (!outcome.succeeded){
+      tables += ",\"error\":" + json_string(outcome.error);
+    }
+    tables += "}";
+  }
+
+  std::string error_list;
+  for (unsigned int ii = 0; ii < errors.size(); ii++){
+    error_list += (ii ? "," : "") + json_string(errors[ii]);
+  }
+
+  sprintf(number, "{\"succeeded\":%u,\"failed\":%u,\"seconds\":%.3f",
+    static_cast<unsigned int>(outcomes.size()) - failed, failed, seconds);
+
+  return number + std::string(",\"tables\":[") + tables +
+    "],\"errors\":[" + error_list + "]}";
+}
+
+DataSink* BatchExtraction::lease_sink() throw (){
+  MutexLocker lock(sinks_mutex);
+
+  // There are as many sinks as workers, so one is always idle
+  DataSink* sink = idle_sinks.back();
+  idle_sinks.pop_back();
+  return sink;
+}
+
+void BatchExtraction::return_sink(DataSink* sink) throw (){
+  MutexLocker lock(sinks_mutex);
+  idle_sinks.push_back(sink);
+}
+
+bool BatchExtraction::finish_part(TableRun& run, const std::string& error,
+  const double seconds) throw (){
+
+  MutexLocker lock(sinks_mutex);
+
+  run.outcome.seconds += seconds;
+  if (!error.empty() && run.outcome.error.empty()){
+    run.outcome.error = error;
+  }
+
+  return --run.unfinished == 0;
+}
+
+} // namespace
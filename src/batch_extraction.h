@@ -0,0 +1,368 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * batch_extraction.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_BATCH_EXTRACTION_H
+#define DRILLER_BATCH_EXTRACTION_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include "concurrency_controller.h"
+#include "data_sink.h"
+#include "errors.h"
+#include "process_pool.h"
+#include "threads.h"
+
+namespace Driller {
+
+/**
+  Creates the sinks a BatchExtraction writes to. Each worker gets a sink of
+  its own, so sinks never need to be shared between threads
+*/
+class SinkFactory {
+public:
+  /** Default constructor */
+  SinkFactory() throw ();
+
+  /** Default destructor */
+  virtual ~SinkFactory() throw ();
+
+  /**
+    Create a sink for one worker. Every sink is created before any table is
+    extracted, on the thread which started the extraction, so that problems
+    such as a refused connection are found straight away
+
+    @param workers How many workers there will be in all, so that each
+    sink's own threads can share the processors with the others
+
+    @return A new sink, which the extraction deletes
+  */
+  virtual DataSink* create_sink(const unsigned int workers) = 0;
+
+  /**
+    Finish with a sink, once every table has been extracted. By default,
+    this does nothing
+
+    @param sink A sink returned by create_sink()
+  */
+  virtual void finish_sink(DataSink* sink);
+
+  /**
+    Get the most workers this factory's sinks can be used by, such as 1 for
+    sinks which all write to the same file
+
+    @return The most workers, or 0 if there is no limit
+  */
+  virtual unsigned int max_workers() const throw ();
+};
+
+/**
+  How extracting a single table went
+*/
+struct TableOutcome {
+  /** The name of the database the table belongs to */
+  std::string database;
+
+  /** The name of the table */
+  std::string table;
+
+  /** Whether every row was extracted */
+  bool succeeded;
+
+  /** Why the table failed, if it did */
+  std::string error;
+
+  /** How long extracting the table took, in seconds, summed over its parts */
+  double seconds;
+};
+
+class TableJob;
+class TableJob;
+class TableRun;
+
+/**
+  A BatchExtraction extracts a selection of tables from one or more
+  databases, several at once if asked. A table which fails doesn't stop the
+  others; every outcome is kept so it can be summarized at the end.
+
+  With several workers, tables are started most costly first, as estimated
+  from their files' sizes and their columns, so that no large table is left
+  until the end. A table costing more than its share of the work is split
+  into ranges of rows, if the sinks can write them.
+
+  The number of workers can also be left to a ConcurrencyController, which
+  raises or lowers it between bounds as throughput is sampled. Tables are
+  then split more finely, so that jobs finish often enough to be measured.
+
+  For the largest extractions, the jobs can instead be run by worker
+  processes, each with its own address space, sink and allocator. Ranges
+  are written to part files as usual and joined once every worker is done,
+  and a job whose worker crashes is tried again on a new one
+*/
+class BatchExtraction {
+  friend class TableJob;
+  friend class BatchProcessTask;
+public:
+  /**
+    Default constructor
+
+    @param factory Creates each worker's sink. It must outlive this
+    extraction
+    @param jobs How many tables to extract at once. This is limited by the
+    factory's max_workers(), and 0 is taken as 1
+  */
+  BatchExtraction(SinkFactory& factory, const unsigned int jobs = 1) throw ();
+
+  /** Delete every sink, without finishing them */
+  ~BatchExtraction() throw ();
+
+  /**
+    Only extract tables which have been included by name. If no table is
+    ever included, every table is extracted
+
+    @param name The name of a table to extract
+  */
+  void include_table(const std::string& name) throw ();
+
+  /**
+    Never extract a table, even if it was included
+
+    @param name The name of a table to skip
+  */
+  void exclude_table(const std::string& name) throw ();
+
+  /**
+    Check whether a table will be extracted
+
+    @param name The name of the table
+
+    @return Whether a table of that name is selected
+  */
+  bool is_selected(const std::string& name) const throw ();
+
+  /**
+    Limit how many rows are extracted from each table
+
+    @param rows The most rows to extract, or 0 for every row
+  */
+  void set_row_limit(const unsigned int rows) throw ();
+
+  /**
+    Set the fewest rows a table may be split into a range of. Tables with
+    fewer than twice this many rows are never split
+
+    @param rows The fewest rows in each range
+  */
+  void set_min_range_rows(const unsigned int rows) throw ();
+
+  /** The default fewest rows in each range */
+  static const unsigned int default_min_range_rows;
+
+  /**
+    Tune the number of workers while extracting, rather than always running
+    as many as were asked for. The jobs given to the constructor become the
+    most workers, and a sink is created for each of them
+
+    @param min_workers The fewest workers, which is also how many start.
+    If this is no less than the most workers, nothing is tuned
+    @param log Where to log each change, or NULL
+  */
+  void set_adaptive(const unsigned int min_workers, std::ostream* log = NULL)
+    throw ();
+
+  /**
+    Run jobs in worker processes rather than threads, with a sink each. The
+    tuning of set_adaptive() doesn't apply to them
+
+    @param processes How many workers to run at once, limited by the
+    factory's max_workers(), or 0 to use threads
+    @param attempts How many times to try a job whose worker crashes
+  */
+  void set_processes(const unsigned int processes,
+    const unsigned int attempts = ProcessPool::default_max_attempts)
+    throw ();
+
+  /**
+    Get how many worker processes died and were replaced
+
+    @return How many workers were replaced, over every extract()
+  */
+  unsigned int get_worker_restarts() const throw ();
+
+  /**
+    Extract every selected table of a database. Tables which fail are
+    recorded rather than thrown
+
+    @param db The database to extract from
+  */
+  void extract(const Database& db);
+
+  /**
+    Record an error which didn't belong to a single table, such as a schema
+    which couldn't be read
+
+    @param message The error's message
+  */
+  void record_error(const std::string& message) throw ();
+
+  /**
+    Finish every sink, after the last database has been extracted. Errors
+    are recorded rather than thrown, as are included tables which were never
+    found
+  */
+  void finish() throw ();
+
+  /**
+    Get how every table went, in the order the tables were found
+
+    @return Each extracted table's outcome
+  */
+  const std::vector<TableOutcome>& get_outcomes() const throw ();
+
+  /**
+    Get the errors which didn't belong to a single table
+
+    @return Each error's message
+  */
+  const std::vector<std::string>& get_errors() const throw ();
+
+  /**
+    Get how many tables failed, plus any errors which didn't belong to a
+    single table
+
+    @return How many things went wrong
+  */
+  unsigned int failure_count() const throw ();
+
+  /**
+    Describe the extraction as a single line of JSON, such as
+    {"succeeded":2,"failed":0,"seconds":1.5,"tables":[...],"errors":[]}
+
+    @param seconds How long the whole extraction took
+
+    @return The summary, without a trailing newline
+  */
+  std::string summary(const double seconds) const throw ();
+
+protected:
+  /**
+    Take an idle sink, for a table about to be extracted
+
+    @return A sink no other worker is using
+  */
+  DataSink* lease_sink() throw ();
+
+  /**
+    Return a sink taken by lease_sink()
+
+    @param sink The sink, which the worker has finished with
+  */
+  void return_sink(DataSink* sink) throw ();
+
+  /**
+    Run jobs in worker processes, then finish every table
+
+    @param jobs The jobs, in the order to start them
+    @param runs The tables the jobs belong to
+  */
+  void run_processes(const std::vector<TableJob*>& jobs,
+    const std::vector<TableRun*>& runs);
+
+  /**
+    Record that one part of a table is done
+
+    @param run The table
+    @param error Why the part failed, or empty if it succeeded
+    @param seconds How long the part took
+
+    @return Whether this was the table's last part to finish
+  */
+  bool finish_part(TableRun& run, const std::string& error,
+    const double seconds) throw ();
+
+  /** Creates the sinks */
+  SinkFactory& factory;
+
+  /** How many tables are extracted at once */
+  const unsigned int workers;
+
+  /** Every sink, created by the first call to extract() */
+  std::vector<DataSink*> sinks;
+
+  /** Sinks which aren't being used */
+  std::vector<DataSink*> idle_sinks;
+
+  /** Protects idle_sinks, and the parts of tables split into ranges */
+  Mutex sinks_mutex;
+
+  /** Runs tables when there is more than one worker, or NULL */
+  ThreadPool* pool;
+
+  /** The fewest workers, if they're tuned, or else the most workers */
+  unsigned int min_workers;
+
+  /** Where tuning decisions are logged, or NULL */
+  std::ostream* adaptive_log;
+
+  /** Tunes the pool, if there's a range of workers, or NULL */
+  ConcurrencyController* controller;
+
+  /** How many worker processes run jobs, or 0 if threads do */
+  unsigned int processes;
+
+  /** How many times a job is tried in worker processes */
+  unsigned int max_attempts;
+
+  /** How many worker processes were replaced */
+  unsigned int worker_restarts;
+
+  /** Whether the factory's sinks can write ranges, or -1 if not yet asked */
+  int can_split_sinks;
+
+  /** Tables to extract. If empty, every table is */
+  std::set<std::string> included;
+
+  /** Included tables which have been seen in a database */
+  std::set<std::string> found;
+
+  /** Tables to skip */
+  std::set<std::string> excluded;
+
+  /** The most rows to extract from each table, or 0 */
+  unsigned int row_limit;
+
+  /** The fewest rows in each range of a split table */
+  unsigned int min_range_rows;
+
+  /** How every extracted table went */
+  std::vector<TableOutcome> outcomes;
+
+  /** Errors which didn't belong to a single table */
+  std::vector<std::string> errors;
+
+private:
+  // The sinks, pool and controller can't be shared between copies
+  BatchExtraction(const BatchExtraction&);
+  BatchExtraction& operator=(const BatchExtraction&);
+};
+
+} // namespace
+
+#endif // DRILLER_BATCH_EXTRACTION_H
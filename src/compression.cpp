@@ -0,0 +1,131 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * compression.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include "compression.h"
+
+#if ENABLE_ZLIB
+  #include <zlib.h>
+#endif
+
+#if ENABLE_ZSTD
+  #include <zstd.h>
+#endif
+
+namespace Driller {
+
+#if ENABLE_ZLIB
+/** Compress a block as a single gzip member */
+static bool compress_gzip(const char* data, const unsigned int length,
+  std::string& output) throw () {
+
+  z_stream stream;
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+
+  // Adding 16 to the window bits makes zlib write a gzip header and trailer
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+    Z_DEFAULT_STRATEGY) != Z_OK){
+
+    return false;
+  }
+
+  // Older versions of zlib don't count the gzip wrapper in deflateBound
+  output.resize(deflateBound(&stream, length) + 18);
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  stream.avail_in = length;
+  stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+  stream.avail_out = static_cast<uInt>(output.size());
+
+  const int result = deflate(&stream, Z_FINISH);
+  output.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  return (result == Z_STREAM_END);
+}
+#endif
+
+#if ENABLE_ZSTD
+/** Compress a block as a single zstd frame */
+static bool compress_zstd(const char* data, const unsigned int length,
+  std::string& output) throw () {
+
+  output.resize(ZSTD_compressBound(length));
+
+  const size_t written = ZSTD_compress(&output[0], output.size(), data,
+    length, 3);
+
+  if (ZSTD_isError(written)){
+    return false;
+  }
+
+  output.resize(written);
+  return true;
+}
+#endif
+
+bool compression_available(const Compression compression) throw () {
+  switch (compression){
+    case COMPRESSION_NONE:
+      return true;
+
+    case COMPRESSION_GZIP:
+      return ENABLE_ZLIB;
+
+    case COMPRESSION_ZSTD:
+      return ENABLE_ZSTD;
+
+    default:
+      return false;
+  }
+}
+
+bool compress_block(
+  const Compression compression,
+  const char* data,
+  const unsigned int length,
+  std::string& output) throw () {
+
+  switch (compression){
+    case COMPRESSION_NONE:
+      output.assign(data, length);
+      return true;
+
+#if ENABLE_ZLIB
+    case COMPRESSION_GZIP:
+      return compress_gzip(data, length, output);
+#endif
+
+#if ENABLE_ZSTD
+    case COMPRESSION_ZSTD:
+      return compress_zstd(data, length, output);
+#endif
+
+    default:
+      return false;
+  }
+}
+
+} // namespace
@@ -0,0 +1,87 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * compression.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_COMPRESSION_H
+#define DRILLER_COMPRESSION_H
+
+#include <string>
+
+namespace Driller {
+
+/**
+  Available compression formats
+*/
+typedef enum {
+  COMPRESSION_NONE = 0, /**< Plain, uncompressed output */
+  COMPRESSION_GZIP,     /**< gzip (RFC 1952), via zlib */
+  COMPRESSION_ZSTD,     /**< Zstandard, via libzstd */
+
+  COMPRESSION_NUM_TYPES /**< How many formats there are, not a real format */
+} Compression;
+
+/**
+  Mapping from Compression to the name used on the command line
+*/
+const std::string compression_strings[COMPRESSION_NUM_TYPES] = {
+  "none",
+  "gzip",
+  "zstd"
+};
+
+/**
+  Mapping from Compression to the file name extension used for that format
+*/
+const std::string compression_extensions[COMPRESSION_NUM_TYPES] = {
+  "",
+  ".gz",
+  ".zst"
+};
+
+/**
+  Get whether a compression format was enabled when Driller was built
+
+  @param compression The format to check
+
+  @return Whether data can be compressed in that format
+*/
+bool compression_available(const Compression compression) throw ();
+
+/**
+  Compress a block of data into a complete, self-contained stream. For gzip
+  this is a single gzip member, and for zstd a single frame. Concatenating the
+  output of several calls gives a valid file in that format
+
+  @param compression The format to compress into
+  @param data The data to compress
+  @param length How many bytes of data there are
+  @param output Receives the compressed data, replacing its contents
+
+  @return Whether the data was compressed. This fails if the format is not
+  available, or the compression library reports an error
+*/
+bool compress_block(
+  const Compression compression,
+  const char* data,
+  const unsigned int length,
+  std::string& output) throw ();
+
+} // namespace
+
+#endif // DRILLER_COMPRESSION_H
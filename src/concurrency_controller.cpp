@@ -0,0 +1,213 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * concurrency_controller.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "concurrency_controller.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace Driller {
+
+// Long enough that a few jobs finish in each sample
+const double ConcurrencyController::default_interval = 2;
+
+const double ConcurrencyController::tolerance = 0.05;
+
+const double ConcurrencyController::work_shift = 0.25;
+
+const unsigned int ConcurrencyController::settle_samples = 3;
+
+ConcurrencyController::ConcurrencyController(
+  const std::string& _name,
+  const unsigned int _min_limit,
+  const unsigned int _max_limit) throw ():
+
+  name(_name),
+  min_limit(std::max(1u, _min_limit)),
+  max_limit(std::max(min_limit, _max_limit)),
+  limit(min_limit),
+  direction(1),
+  baseline(-1),
+  moved(false),
+  holding(0),
+  interval(default_interval),
+  log(NULL),
+  sample_work(0),
+  sample_jobs(0){}
+
+void ConcurrencyController::set_interval(const double seconds) throw (){
+  interval = seconds;
+}
+
+void ConcurrencyController::set_log(std::ostream* _log) throw (){
+  log = _log;
+}
+
+unsigned int ConcurrencyController::get_limit() const throw (){
+  return limit;
+}
+
+unsigned int ConcurrencyController::sample(const double work,
+  const double seconds, const unsigned int queued) throw (){
+
+  if (seconds <= 0){
+    return limit;
+  }
+
+  const double throughput = work / seconds;
+  const unsigned int previous = limit;
+
+  // With nothing waiting, more threads would have nothing to do, and the
+  // sample says little about the limit
+  if (!queued){
+    baseline = -1;
+    moved = false;
+    return limit;
+  }
+
+  if (baseline < 0){
+    baseline = throughput;
+    moved = move(direction);
+    log_decision(previous, throughput, queued, "probing");
+    return limit;
+  }
+
+  const double change = (throughput - baseline) / std::max(baseline, 1e-9);
+
+  if (moved){
+    // Shrinking without losing throughput frees resources, so that counts
+    // as an improvement too
+    if (change > tolerance || (direction < 0 && change >= -tolerance)){
+      const char* reason = (change > tolerance) ? "improved" :
+        "no worse with fewer";
+      baseline = throughput;
+      moved = move(direction);
+      log_decision(previous, throughput, queued, reason);
+
+      // At a bound, hold there before probing back the other way
+      if (!moved){
+        direction = -direction;
+        holding = settle_samples;
+      }
+    }
+
+    else {
+      // Undo the step, and hold at the better limit for a while. The
+      // baseline was measured there, so it stands
+      direction = -direction;
+      move(direction);
+      moved = false;
+      holding = settle_samples;
+      log_decision(previous, throughput, queued,
+        change < -tolerance ? "worse, stepping back" :
+        "no better, stepping back");
+    }
+
+    return limit;
+  }
+
+  // Holding. A large change means the work itself changed, such as moving
+  // from small tables to large ones, so it's worth probing again at once
+  if (holding && change <= work_shift && change >= -work_shift){
+    --holding;
+    return limit;
+  }
+
+  holding = 0;
+  baseline = throughput;
+  moved = move(direction);
+  if (!moved){
+    // Blocked by a bound, so probe the other way
+    direction = -direction;
+    moved = move(direction);
+  }
+
+  log_decision(previous, throughput, queued, "probing");
+  return limit;
+}
+
+void ConcurrencyController::wait(ThreadPool& pool, Job* job) throw (){
+  pool.set_active_limit(limit);
+
+  // Callers may wait often and briefly, so every wait ends with a sample
+  bool finished = false;
+  while (!finished){
+    finished = pool.wait(job, interval);
+    sample_pool(pool);
+  }
+}
+
+void ConcurrencyController::wait_all(ThreadPool& pool) throw (){
+  pool.set_active_limit(limit);
+
+  bool finished = false;
+  while (!finished){
+    finished = pool.wait_all(interval);
+    sample_pool(pool);
+  }
+}
+
+void ConcurrencyController::sample_pool(ThreadPool& pool) throw (){
+  unsigned int jobs;
+  sample_work += pool.take_completed_work(&jobs);
+  sample_jobs += jobs;
+
+  // Work is only counted once a job finishes, so the sample keeps growing
+  // until a couple of jobs per thread have, or it would mostly measure
+  // which jobs happened to finish in it
+  const double seconds = timer.elapsed();
+  if (sample_jobs < 2 * limit || seconds < interval){
+    return;
+  }
+
+  pool.set_active_limit(sample(sample_work, seconds, pool.queued_count()));
+  sample_work = 0;
+  sample_jobs = 0;
+  timer.restart();
+}
+
+bool ConcurrencyController::move(const int step) throw (){
+  if (step > 0 && limit < max_limit){
+    ++limit;
+    return true;
+  }
+
+  if (step < 0 && limit > min_limit){
+    --limit;
+    return true;
+  }
+
+  return false;
+}
+
+void ConcurrencyController::log_decision(const unsigned int previous,
+  const double throughput, const unsigned int queued, const char* reason)
+  throw (){
+
+  if (!log || limit == previous){
+    return;
+  }
+
+  char line[256];
+  sprintf(line, "%s: %u -> %u at %.4g work/s with %u queued (%s)\n",
+    name.c_str(), previous, limit, throughput, queued, reason);
+  *log << line << std::flush;
+}
+
+} // namespace
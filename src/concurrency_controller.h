@@ -0,0 +1,181 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * concurrency_controller.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_CONCURRENCY_CONTROLLER_H
+#define DRILLER_CONCURRENCY_CONTROLLER_H
+
+#include <ostream>
+#include <string>
+#include "threads.h"
+#include "timer.h"
+
+namespace Driller {
+
+/**
+  Tunes how many of a ThreadPool's threads run at once, by hill climbing on
+  the pool's throughput. Every interval the work finished is sampled: if
+  the last step raised throughput the controller keeps going the same way,
+  and if it didn't the step is undone and the limit is left to settle
+  before probing again. Whether a run is bound by the disk, the processor
+  or the server it loads, the limit finds the point past which more threads
+  stop helping, within the bounds it was given
+*/
+class ConcurrencyController {
+public:
+  /**
+    Default constructor
+
+    @param name What the pool's threads are, such as "Jobs", for the log
+    @param min_limit The fewest threads to run at once, and the first limit
+    @param max_limit The most threads to run at once. The pool must have at
+    least this many
+  */
+  ConcurrencyController(
+    const std::string& name,
+    const unsigned int min_limit,
+    const unsigned int max_limit) throw ();
+
+  /**
+    Set how often throughput is sampled. A sample is also stretched until
+    two jobs have finished for each thread which may run
+
+    @param seconds The shortest time between samples
+  */
+  void set_interval(const double seconds) throw ();
+
+  /**
+    Set where decisions are logged, one line each
+
+    @param log The stream to log to, or NULL to log nothing
+  */
+  void set_log(std::ostream* log) throw ();
+
+  /**
+    Get how many threads may currently run at once
+
+    @return The current limit
+  */
+  unsigned int get_limit() const throw ();
+
+  /**
+    Take a sample and decide the next limit
+
+    @param work How much work finished since the last sample
+    @param seconds How long the sample took
+    @param queued How many jobs were waiting to start
+
+    @return The new limit
+  */
+  unsigned int sample(const double work, const double seconds,
+    const unsigned int queued) throw ();
+
+  /**
+    Wait for a job to finish, tuning the pool while waiting
+
+    @param pool The pool running the job
+    @param job The job to wait for
+  */
+  void wait(ThreadPool& pool, Job* job) throw ();
+
+  /**
+    Wait for every job of a pool to finish, tuning the pool while waiting
+
+    @param pool The pool to wait for
+  */
+  void wait_all(ThreadPool& pool) throw ();
+
+  /** Default seconds between samples */
+  static const double default_interval;
+
+  /** How much throughput must change by to count, as a fraction */
+  static const double tolerance;
+
+  /**
+    How much throughput must change by while the limit is held, as a
+    fraction, to be taken as the work itself changing
+  */
+  static const double work_shift;
+
+  /** How many samples the limit is held for after a step is undone */
+  static const unsigned int settle_samples;
+
+protected:
+  /**
+    Add a pool's finished work to the current sample, and once the sample
+    is long enough, apply the limit it decides
+
+    @param pool The pool to sample
+  */
+  void sample_pool(ThreadPool& pool) throw ();
+
+  /**
+    Move the limit one step, if the bounds allow it
+
+    @param step 1 to grow, -1 to shrink
+
+    @return Whether the limit changed
+  */
+  bool move(const int step) throw ();
+
+  /**
+    Log a decision, if it changed the limit
+
+    @param previous The limit before the decision
+    @param throughput The work per second sampled
+    @param queued How many jobs were waiting
+    @param reason Why the decision was made
+  */
+  void log_decision(const unsigned int previous, const double throughput,
+    const unsigned int queued, const char* reason) throw ();
+
+  const std::string name;
+  const unsigned int min_limit, max_limit;
+
+  /** How many threads may run at once */
+  unsigned int limit;
+
+  /** Which way the next step goes, 1 or -1 */
+  int direction;
+
+  /** Throughput before the last step, or below 0 if there is none */
+  double baseline;
+
+  /** Whether the last sample moved the limit */
+  bool moved;
+
+  /** How many more samples to hold the limit for */
+  unsigned int holding;
+
+  double interval;
+  std::ostream* log;
+
+  /** The work finished so far in the current sample */
+  double sample_work;
+
+  /** How many jobs have finished so far in the current sample */
+  unsigned int sample_jobs;
+
+  /** Times the current sample */
+  Timer timer;
+};
+
+} // namespace
+
+#endif // DRILLER_CONCURRENCY_CONTROLLER_H
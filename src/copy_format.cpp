@@ -0,0 +1,322 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * copy_format.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "copy_format.h"
+#include "sql_format.h"
+#include <cstring>
+
+namespace Driller {
+
+const char copy_binary_header[] = "PGCOPY\n\377\r\n\0\0\0\0\0\0\0\0\0";
+const unsigned int copy_binary_header_size = 19;
+
+const char copy_binary_trailer[] = "\377\377";
+const unsigned int copy_binary_trailer_size = 2;
+
+/** Days from 1970-01-01, where Unix days start, to 2000-01-01 */
+const int32 postgres_epoch_days = 10957;
+
+/** NUMERIC's sign for negative values */
+const uint16 numeric_negative = 0x4000;
+
+/** Write a 16-bit value in network byte order, as binary COPY expects */
+inline void put_uint16(const uint16 value, char* out) throw () {
+  out[0] = static_cast<char>(value >> 8);
+  out[1] = static_cast<char>(value);
+}
+
+/** Write a 32-bit value in network byte order */
+inline void put_uint32(const uint32 value, char* out) throw () {
+  out[0] = static_cast<char>(value >> 24);
+  out[1] = static_cast<char>(value >> 16);
+  out[2] = static_cast<char>(value >> 8);
+  out[3] = static_cast<char>(value);
+}
+
+/**
+  Write a field holding a fixed-size value
+
+  @param value The value, which is sign extended to the field's size
+  @param size The field's size: 2, 4 or 8 bytes
+  @param out Receives the field's length and value
+
+  @return The length of the field
+*/
+unsigned int write_integer_field(const int64 value, const unsigned int size,
+  char* out) throw () {
+
+  put_uint32(size, out);
+
+  if (size == 2){
+    put_uint16(static_cast<uint16>(value), out + 4);
+  }
+
+  else if (size == 4){
+    put_uint32(static_cast<uint32>(value), out + 4);
+  }
+
+  else {
+    put_uint32(static_cast<uint32>(static_cast<uint64>(value) >> 32), out + 4);
+    put_uint32(static_cast<uint32>(value), out + 8);
+  }
+
+  return 4 + size;
+}
+
+/**
+  Write a field holding text or bytes
+
+  @param bytes The value
+  @param length The length of the value
+  @param out Receives the field's length and value
+
+  @return The length of the field
+*/
+unsigned int write_bytes_field(const void* bytes, const unsigned int length,
+  char* out) throw () {
+
+  put_uint32(length, out);
+  memcpy(out + 4, bytes, length);
+  return 4 + length;
+}
+
+unsigned int write_copy_row_start(const unsigned int columns, char* out)
+  throw (){
+
+  put_uint16(static_cast<uint16>(columns), out);
+  return 2;
+}
+
+unsigned int encode_numeric(const int32 cents, char* out) throw (){
+  const uint32 magnitude = cents < 0 ?
+    0u - static_cast<uint32>(cents) : static_cast<uint32>(cents);
+  uint32 whole = magnitude / 100;
+  const uint32 fraction = magnitude % 100;
+
+  // NUMERIC stores base 10000 digits, most significant first. The cents are
+  // the first digit after the point, so 0.05 is 0500
+  uint16 digits[4];
+  unsigned int count = 0;
+  uint16 whole_digits[3];
+  unsigned int whole_count = 0;
+  while (whole){
+    whole_digits[whole_count++] = static_cast<uint16>(whole % 10000);
+    whole /= 10000;
+  }
+
+  while (whole_count){
+    digits[count++] = whole_digits[--whole_count];
+  }
+  const int16 weight = static_cast<int16>(count) - 1;
+
+  if (fraction){
+    digits[count++] = static_cast<uint16>(fraction * 100);
+  }
+
+  // Trailing zero digits are left out, as PostgreSQL itself does
+  while (count && digits[count - 1] == 0){
+    count--;
+  }
+
+  put_uint16(static_cast<uint16>(count), out);
+  put_uint16(static_cast<uint16>(count ? weight : 0), out + 2);
+  put_uint16(cents < 0 ? numeric_negative : 0, out + 4);
+  put_uint16(2, out + 6);
+
+  for (unsigned int ii = 0; ii < count; ii++){
+    put_uint16(digits[ii], out + 8 + (2 * ii));
+  }
+
+  return 8 + (2 * count);
+}
+
+int32 copy_date(const uint32 date) throw (){
+  return Column::date_to_unix_days(date) - postgres_epoch_days;
+}
+
+unsigned int max_copy_value_size(const Column& column, const uint8* row)
+  throw (){
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return 5;
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+      return 6;
+
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_DATE:
+      return 8;
+
+    case COLUMN_UINT32:
+      return 12;
+
+    case COLUMN_CURRENCY:
+      return 4 + 14;
+
+    case COLUMN_PHONE:
+      return 4 + 12;
+
+    case COLUMN_ENUM:
+      return 4 + static_cast<unsigned int>(column.enumeration.get_value(
+        Column::get_uint8(column.get_field(row))).size());
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING:
+    case COLUMN_BLOB: {
+      const uint8* bytes;
+      return 4 + column.get_bytes(row, bytes);
+    }
+
+    default:
+      return 4 + 7;
+  }
+}
+
+unsigned int write_copy_value(const Column& column, const uint8* row,
+  char* out) throw (){
+
+  const uint8* field = column.get_field(row);
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      put_uint32(1, out);
+      out[4] = field[0] ? 1 : 0;
+      return 5;
+
+    // PostgreSQL has no single byte integers, nor unsigned ones, so each is
+    // widened to the smallest type which holds every value
+    case COLUMN_INT8:
+      return write_integer_field(Column::get_int8(field), 2, out);
+
+    case COLUMN_UINT8:
+      return write_integer_field(Column::get_uint8(field), 2, out);
+
+    case COLUMN_INT16:
+      return write_integer_field(Column::get_int16(field), 2, out);
+
+    case COLUMN_UINT16:
+      return write_integer_field(Column::get_uint16(field), 4, out);
+
+    case COLUMN_INT32:
+      return write_integer_field(Column::get_int32(field), 4, out);
+
+    case COLUMN_UINT32:
+      return write_integer_field(Column::get_uint32(field), 8, out);
+
+    case COLUMN_DATE:
+      return write_integer_field(copy_date(Column::get_uint32(field)), 4,
+        out);
+
+    case COLUMN_CURRENCY: {
+      const unsigned int length = encode_numeric(Column::get_int32(field),
+        out + 4);
+      put_uint32(length, out);
+      return 4 + length;
+    }
+
+    case COLUMN_PHONE: {
+      const unsigned int length = format_phone(field, out + 4);
+      put_uint32(length, out);
+      return 4 + length;
+    }
+
+    case COLUMN_ENUM: {
+      const std::string value = column.enumeration.get_value(
+        Column::get_uint8(field));
+      return write_bytes_field(value.data(),
+        static_cast<unsigned int>(value.size()), out);
+    }
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING: {
+      const uint8* bytes;
+      unsigned int length = column.get_bytes(row, bytes);
+      const void* nul = memchr(bytes, 0, length);
+      if (nul){
+        length = static_cast<unsigned int>(
+          static_cast<const uint8*>(nul) - bytes);
+      }
+      return write_bytes_field(bytes, length, out);
+    }
+
+    case COLUMN_BLOB: {
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(row, bytes);
+      return write_bytes_field(bytes, length, out);
+    }
+
+    default:
+      return write_bytes_field("unknown", 7, out);
+  }
+}
+
+unsigned int write_copy_text(const ColumnType type, const char* text,
+  const unsigned int length, char* out) throw (){
+
+  char* start = out;
+
+  // extract_data() writes blobs as hex pairs separated by spaces, and bytea
+  // reads them as hex pairs after \x, whose backslash COPY needs escaped
+  if (type == COLUMN_BLOB){
+    memcpy(out, "\\\\x", 3);
+    out += 3;
+    for (unsigned int ii = 0; ii < length; ii++){
+      if (text[ii] != ' '){
+        *out++ = text[ii];
+      }
+    }
+    return static_cast<unsigned int>(out - start);
+  }
+
+  for (unsigned int ii = 0; ii < length; ii++){
+    switch (text[ii]){
+      case '\\':
+        *out++ = '\\';
+        *out++ = '\\';
+        break;
+
+      case '\t':
+        *out++ = '\\';
+        *out++ = 't';
+        break;
+
+      case '\n':
+        *out++ = '\\';
+        *out++ = 'n';
+        break;
+
+      case '\r':
+        *out++ = '\\';
+        *out++ = 'r';
+        break;
+
+      default:
+        *out++ = text[ii];
+    }
+  }
+
+  return static_cast<unsigned int>(out - start);
+}
+
+} // namespace
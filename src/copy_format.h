@@ -0,0 +1,118 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * copy_format.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_COPY_FORMAT_H
+#define DRILLER_COPY_FORMAT_H
+
+#include "database/column.h"
+
+namespace Driller {
+
+/** The signature, flags and header extension which start a binary COPY */
+extern const char copy_binary_header[];
+
+/** The length of copy_binary_header */
+extern const unsigned int copy_binary_header_size;
+
+/** The field count which ends a binary COPY */
+extern const char copy_binary_trailer[];
+
+/** The length of copy_binary_trailer */
+extern const unsigned int copy_binary_trailer_size;
+
+/**
+  Write the field count which starts each row of a binary COPY
+
+  @param columns How many columns each row has
+  @param out Receives the count. It must hold at least 2 bytes
+
+  @return The length of the count
+*/
+unsigned int write_copy_row_start(const unsigned int columns, char* out)
+  throw ();
+
+/**
+  Encode an amount of currency in PostgreSQL's binary NUMERIC format, with
+  two decimal places
+
+  @param cents The amount, in cents
+  @param out Receives the value, without its length. It must hold at least
+  14 bytes
+
+  @return The length of the value
+*/
+unsigned int encode_numeric(const int32 cents, char* out) throw ();
+
+/**
+  Convert a stored date to PostgreSQL's binary DATE value
+
+  @param date The date, as stored in a date column
+
+  @return The number of days since 2000-01-01
+*/
+int32 copy_date(const uint32 date) throw ();
+
+/**
+  Get the most space a raw value can take in a binary COPY, including its
+  length
+
+  @param column The value's column
+  @param row The start of the row containing the value
+
+  @return The most bytes write_copy_value() will write
+*/
+unsigned int max_copy_value_size(const Column& column, const uint8* row)
+  throw ();
+
+/**
+  Write a raw value as a binary COPY field, in the format of the column's
+  type as given by PostgreSQLSink. Integers, dates and currency are written
+  as binary numbers. Text is written as is, up to any NULL character, since
+  PostgreSQL text can't contain one
+
+  @param column The value's column
+  @param row The start of the row containing the value
+  @param out Receives the field's length, then its value. It must hold at
+  least max_copy_value_size() bytes
+
+  @return The length of the field
+*/
+unsigned int write_copy_value(const Column& column, const uint8* row,
+  char* out) throw ();
+
+/**
+  Write a value extracted as text, as by Column::extract_data(), as a field
+  of a text COPY. Backslashes and control characters are escaped, and blobs
+  are converted from their hex dump to bytea's hex format
+
+  @param type The value's column type
+  @param text The value
+  @param length The length of text
+  @param out Receives the field. It must hold at least 2 * length + 3
+  characters
+
+  @return The length of the field
+*/
+unsigned int write_copy_text(const ColumnType type, const char* text,
+  const unsigned int length, char* out) throw ();
+
+} // namespace
+
+#endif // DRILLER_COPY_FORMAT_H
@@ -19,6 +19,7 @@
 */
 
 #include "data_sink.h"
+#include "errors.h"
 
 namespace Driller {
 
@@ -34,4 +35,27 @@ void DataSink::output_database(const Database& db) {
   }
 }
 
+bool DataSink::can_output_ranges() const {
+  return false;
+}
+
+void DataSink::output_range(const Table&, const unsigned int,
+  const unsigned int, const unsigned int){
+
+  throw Errors::GenericError("This output can't be split into ranges of rows");
+}
+
+void DataSink::join_ranges(const Table&, const unsigned int){}
+
+void DataSink::discard_ranges(const Table&, const unsigned int){}
+
+Table DataSink::table_from_row(const Table& table,
+  const unsigned int first_row){
+
+  Table range = table;
+  range.set_data_offset(table.get_data_offset() +
+    (first_row * table.get_row_length()));
+  return range;
+}
+
 } // namespace
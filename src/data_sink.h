@@ -49,11 +49,72 @@ public:
     const unsigned int row_limit = 0) = 0;
 
   /**
-    Output an entire database to this sink
+    Output an entire database to this sink. By default, each table is passed
+    to output_table() in turn
 
     @param database The database to extract from
   */
-  void output_database(const Database& db);
+  virtual void output_database(const Database& db);
+
+  /**
+    Get whether this sink can write a table as several ranges of rows, with
+    output_range(), so that one large table can be split between workers. By
+    default it can't
+
+    @return Whether output_range() is supported
+  */
+  virtual bool can_output_ranges() const;
+
+  /**
+    Extract a range of a table's rows as one part of the table's output.
+    Parts may be written in any order, and by different sinks of the same
+    kind, then are joined by join_ranges() once every one has been written.
+    Only tables with fixed length rows can be split. By default this throws
+    a GenericError
+
+    @param table The table to extract
+    @param first_row The first row of the range
+    @param row_count How many rows the range holds, or 0 for every row from
+    first_row on
+    @param part The part's number, counting from 0 in row order
+  */
+  virtual void output_range(
+    const Table& table,
+    const unsigned int first_row,
+    const unsigned int row_count,
+    const unsigned int part);
+
+  /**
+    Join every part of a table written by output_range(), in row order, into
+    the table's usual output. By default this does nothing
+
+    @param table The table
+    @param parts How many parts the table was split into
+  */
+  virtual void join_ranges(const Table& table, const unsigned int parts);
+
+  /**
+    Remove the parts of a table written by output_range(), after one of them
+    failed. Parts which were never written are ignored. By default this does
+    nothing
+
+    @param table The table
+    @param parts How many parts the table was split into
+  */
+  virtual void discard_ranges(const Table& table, const unsigned int parts);
+
+protected:
+  /**
+    Get a copy of a table which starts at one of its rows, so that a range
+    can be read with an ordinary row limit
+
+    @param table A table with fixed length rows
+    @param first_row The row the copy should start at
+
+    @return The copy
+  */
+  static Table table_from_row(const Table& table,
+    const unsigned int first_row);
 };
 
 } // namespace
@@ -0,0 +1,562 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * arrow_export.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <vector>
+#include "arrow_export.h"
+#include "../string_scan.h"
+
+#ifdef WIN32
+  #include <malloc.h>
+#endif
+
+namespace Driller {
+
+/**
+  Get how long Latin-1 text will be once converted to UTF-8
+
+  @param text The text
+  @param length The length of text
+
+  @return The length of the converted text
+*/
+static unsigned int utf8_length(const char* text, const unsigned int length)
+  throw () {
+
+  // Every byte from 0x80 up becomes two
+  const char* end = text + length;
+  unsigned int converted = length;
+  for (const char* high = find_non_ascii(text, end); high != end;
+    high = find_non_ascii(high + 1, end)){
+
+    ++converted;
+  }
+
+  return converted;
+}
+
+/** Arrow recommends aligning and padding every buffer to 64 bytes */
+static const unsigned int buffer_alignment = 64;
+
+/**
+  Allocate a zeroed buffer, aligned and padded for Arrow
+
+  @param size How many bytes are needed
+
+  @return The buffer, which must be freed with free_buffer()
+*/
+static uint8* allocate_buffer(const unsigned long size) throw () {
+  // Always allocate something, so that buffers are never NULL
+  const unsigned long padded = ((size + buffer_alignment - 1) /
+    buffer_alignment) * buffer_alignment + buffer_alignment;
+
+  void* buffer = NULL;
+
+#ifdef WIN32
+  buffer = _aligned_malloc(padded, buffer_alignment);
+#else
+  if (posix_memalign(&buffer, buffer_alignment, padded) != 0){
+    buffer = NULL;
+  }
+#endif
+
+  if (buffer){
+    memset(buffer, 0, padded);
+  }
+  return static_cast<uint8*>(buffer);
+}
+
+/** Free a buffer from allocate_buffer() */
+static void free_buffer(void* buffer) throw () {
+#ifdef WIN32
+  _aligned_free(buffer);
+#else
+  free(buffer);
+#endif
+}
+
+/////////////
+// Schemas //
+/////////////
+
+/** What an exported schema owns */
+class SchemaData {
+public:
+  std::string format;
+  std::string name;
+  std::vector<ArrowSchema*> children;
+};
+
+extern "C" {
+
+static void release_schema(ArrowSchema* schema){
+  SchemaData* data = static_cast<SchemaData*>(schema->private_data);
+
+  for (unsigned int ii = 0; ii < data->children.size(); ii++){
+    ArrowSchema* child = data->children[ii];
+    if (child->release){
+      child->release(child);
+    }
+    delete child;
+  }
+
+  if (schema->dictionary){
+    if (schema->dictionary->release){
+      schema->dictionary->release(schema->dictionary);
+    }
+    delete schema->dictionary;
+  }
+
+  delete data;
+  schema->release = NULL;
+}
+
+} // extern "C"
+
+/**
+  Fill in a schema
+
+  @param schema The schema to fill in
+  @param format The Arrow format string
+  @param name The field name
+*/
+static void init_schema(ArrowSchema* schema, const std::string& format,
+  const std::string& name) throw () {
+
+  SchemaData* data = new SchemaData;
+  data->format = format;
+  data->name = name;
+
+  schema->format = data->format.c_str();
+  schema->name = data->name.c_str();
+  schema->metadata = NULL;
+  schema->flags = 0;
+  schema->n_children = 0;
+  schema->children = NULL;
+  schema->dictionary = NULL;
+  schema->release = release_schema;
+  schema->private_data = data;
+}
+
+const char* arrow_format(const Column& column) throw () {
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return "b";
+
+    case COLUMN_INT8:
+      return "c";
+
+    case COLUMN_UINT8:
+      return "C";
+
+    case COLUMN_INT16:
+      return "s";
+
+    case COLUMN_UINT16:
+      return "S";
+
+    case COLUMN_INT32:
+      return "i";
+
+    case COLUMN_UINT32:
+      return "I";
+
+    case COLUMN_DATE:
+      return "tdD";
+
+    case COLUMN_CURRENCY:
+      return "d:10,2";
+
+    case COLUMN_ENUM:
+      return "C";
+
+    case COLUMN_BLOB:
+      return "z";
+
+    default:
+      return "u";
+  }
+}
+
+void export_arrow_schema(const Table& table, ArrowSchema* schema) throw () {
+  init_schema(schema, "+s", "");
+  SchemaData* data = static_cast<SchemaData*>(schema->private_data);
+
+  const unsigned int column_count = table.column_count();
+  for (unsigned int col = 0; col < column_count; col++){
+    const Column& column = table.column_at(col);
+
+    ArrowSchema* child = new ArrowSchema;
+    init_schema(child, arrow_format(column), column.get_name());
+
+    if (column.get_type() == COLUMN_ENUM){
+      child->dictionary = new ArrowSchema;
+      init_schema(child->dictionary, "u", "");
+    }
+
+    data->children.push_back(child);
+  }
+
+  schema->n_children = column_count;
+  schema->children = column_count? &data->children[0] : NULL;
+}
+
+////////////
+// Arrays //
+////////////
+
+/** What an exported array owns */
+class ArrayData {
+public:
+  /** Pointers handed out through ArrowArray::buffers */
+  const void* buffers[3];
+
+  /** Buffers to free on release */
+  std::vector<uint8*> owned;
+
+  std::vector<ArrowArray*> children;
+};
+
+extern "C" {
+
+static void release_array(ArrowArray* array){
+  ArrayData* data = static_cast<ArrayData*>(array->private_data);
+
+  for (unsigned int ii = 0; ii < data->children.size(); ii++){
+    ArrowArray* child = data->children[ii];
+    if (child->release){
+      child->release(child);
+    }
+    delete child;
+  }
+
+  if (array->dictionary){
+    if (array->dictionary->release){
+      array->dictionary->release(array->dictionary);
+    }
+    delete array->dictionary;
+  }
+
+  for (unsigned int ii = 0; ii < data->owned.size(); ii++){
+    free_buffer(data->owned[ii]);
+  }
+
+  delete data;
+  array->release = NULL;
+}
+
+} // extern "C"
+
+/**
+  Fill in an array with no nulls
+
+  @param array The array to fill in
+  @param length How many values the array holds
+  @param buffer_count How many buffers the array's type has
+
+  @return The array's private data, so buffers can be added to it
+*/
+static ArrayData* init_array(ArrowArray* array, const unsigned int length,
+  const unsigned int buffer_count) throw () {
+
+  ArrayData* data = new ArrayData;
+  data->buffers[0] = NULL;
+  data->buffers[1] = NULL;
+  data->buffers[2] = NULL;
+
+  array->length = length;
+  array->null_count = 0;
+  array->offset = 0;
+  array->n_buffers = buffer_count;
+  array->n_children = 0;
+  array->buffers = data->buffers;
+  array->children = NULL;
+  array->dictionary = NULL;
+  array->release = release_array;
+  array->private_data = data;
+
+  return data;
+}
+
+/**
+  Add an owned buffer to an array
+
+  @param data The array's private data
+  @param index Which of the array's buffers this is
+  @param size How many bytes the buffer needs
+
+  @return The new buffer
+*/
+static uint8* add_buffer(ArrayData* data, const unsigned int index,
+  const unsigned long size) throw () {
+
+  uint8* buffer = allocate_buffer(size);
+  data->owned.push_back(buffer);
+  data->buffers[index] = buffer;
+  return buffer;
+}
+
+/**
+  Export a list of strings as a utf8 or binary array
+
+  @param array The array to fill in
+  @param values The values to export
+*/
+static void export_strings(ArrowArray* array,
+  const std::vector<std::string>& values) throw () {
+
+  const unsigned int count = static_cast<unsigned int>(values.size());
+  ArrayData* data = init_array(array, count, 3);
+
+  unsigned long total = 0;
+  for (unsigned int ii = 0; ii < count; ii++){
+    total += values[ii].size();
+  }
+
+  int32* offsets = reinterpret_cast<int32*>(
+    add_buffer(data, 1, (count + 1) * sizeof(int32)));
+  uint8* bytes = add_buffer(data, 2, total);
+
+  int32 offset = 0;
+  for (unsigned int ii = 0; ii < count; ii++){
+    offsets[ii] = offset;
+    memcpy(bytes + offset, values[ii].data(), values[ii].size());
+    offset += static_cast<int32>(values[ii].size());
+  }
+  offsets[count] = offset;
+}
+
+/**
+  Export one column of a batch of rows
+
+  @param array The array to fill in
+  @param column The column to export
+  @param rows The rows to export from
+  @param first_row The first row to export
+  @param row_count How many rows to export
+*/
+static void export_column(ArrowArray* array, const Column& column,
+  const RowData& rows, const unsigned int first_row,
+  const unsigned int row_count) throw () {
+
+  const unsigned int end_row = first_row + row_count;
+
+  switch (column.get_type()){
+    case COLUMN_BOOL: {
+      ArrayData* data = init_array(array, row_count, 2);
+      uint8* bits = add_buffer(data, 1, (row_count + 7) / 8);
+
+      for (unsigned int row = first_row; row < end_row; row++){
+        if (column.get_field(rows[row])[0]){
+          const unsigned int bit = row - first_row;
+          bits[bit / 8] |= static_cast<uint8>(1 << (bit % 8));
+        }
+      }
+      break;
+    }
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_ENUM: {
+      ArrayData* data = init_array(array, row_count, 2);
+      uint8* values = add_buffer(data, 1, row_count);
+
+      unsigned int max_id = 0;
+      for (unsigned int row = first_row; row < end_row; row++){
+        values[row - first_row] = column.get_field(rows[row])[0];
+        if (values[row - first_row] > max_id){
+          max_id = values[row - first_row];
+        }
+      }
+
+      // Enumeration IDs index straight into a dictionary of every ID up to
+      // the largest, so they can be stored without being remapped
+      if (column.get_type() == COLUMN_ENUM){
+        const std::list<EnumCase> cases = column.enumeration.get_case_list();
+        std::list<EnumCase>::const_iterator iter;
+        for (iter = cases.begin(); iter != cases.end(); ++iter){
+          if (iter->id > max_id){
+            max_id = iter->id;
+          }
+        }
+
+        std::vector<std::string> dictionary(max_id + 1);
+        for (iter = cases.begin(); iter != cases.end(); ++iter){
+          dictionary[iter->id] = iter->value;
+        }
+
+        array->dictionary = new ArrowArray;
+        export_strings(array->dictionary, dictionary);
+      }
+      break;
+    }
+
+    case COLUMN_INT16:
+    case COLUMN_UINT16: {
+      ArrayData* data = init_array(array, row_count, 2);
+      uint16* values = reinterpret_cast<uint16*>(
+        add_buffer(data, 1, row_count * sizeof(uint16)));
+
+      for (unsigned int row = first_row; row < end_row; row++){
+        values[row - first_row] = Column::get_uint16(column.get_field(rows[row]));
+      }
+      break;
+    }
+
+    case COLUMN_INT32:
+    case COLUMN_UINT32: {
+      ArrayData* data = init_array(array, row_count, 2);
+      uint32* values = reinterpret_cast<uint32*>(
+        add_buffer(data, 1, row_count * sizeof(uint32)));
+
+      for (unsigned int row = first_row; row < end_row; row++){
+        values[row - first_row] = Column::get_uint32(column.get_field(rows[row]));
+      }
+      break;
+    }
+
+    case COLUMN_DATE: {
+      ArrayData* data = init_array(array, row_count, 2);
+      int32* values = reinterpret_cast<int32*>(
+        add_buffer(data, 1, row_count * sizeof(int32)));
+
+      for (unsigned int row = first_row; row < end_row; row++){
+        values[row - first_row] = Column::date_to_unix_days(
+          Column::get_uint32(column.get_field(rows[row])));
+      }
+      break;
+    }
+
+    // Decimal128 values are two's complement, least significant word first
+    case COLUMN_CURRENCY: {
+      ArrayData* data = init_array(array, row_count, 2);
+      int64* values = reinterpret_cast<int64*>(
+        add_buffer(data, 1, row_count * 2 * sizeof(int64)));
+
+      for (unsigned int row = first_row; row < end_row; row++){
+        const int64 cents = Column::get_int32(column.get_field(rows[row]));
+        values[(row - first_row) * 2] = cents;
+        values[(row - first_row) * 2 + 1] = (cents < 0)? -1 : 0;
+      }
+      break;
+    }
+
+    // Text is stored as Latin-1, but Arrow's utf8 must be UTF-8. Blobs are
+    // binary, and copied as they are
+    case COLUMN_BLOB:
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING: {
+      // Find the total size first, so the bytes can be copied just once
+      ArrayData* data = init_array(array, row_count, 3);
+      const bool text = (column.get_type() != COLUMN_BLOB);
+      unsigned long total = 0;
+      const uint8* bytes;
+
+      for (unsigned int row = first_row; row < end_row; row++){
+        const unsigned int length = column.get_bytes(rows[row], bytes);
+        total += text?
+          utf8_length(reinterpret_cast<const char*>(bytes), length) : length;
+      }
+
+      int32* offsets = reinterpret_cast<int32*>(
+        add_buffer(data, 1, (row_count + 1) * sizeof(int32)));
+      uint8* values = add_buffer(data, 2, total);
+
+      int32 offset = 0;
+      for (unsigned int row = first_row; row < end_row; row++){
+        const unsigned int length = column.get_bytes(rows[row], bytes);
+        offsets[row - first_row] = offset;
+
+        if (text){
+          offset += latin1_to_utf8(reinterpret_cast<const char*>(bytes),
+            length, reinterpret_cast<char*>(values + offset));
+        }
+
+        else {
+          memcpy(values + offset, bytes, length);
+          offset += length;
+        }
+      }
+      offsets[row_count] = offset;
+      break;
+    }
+
+    // Anything else is exported as its text representation
+    default: {
+      std::vector<std::string> values;
+      values.reserve(row_count);
+
+      unsigned int format_buffer_size = 30;
+      char* format_buffer = new char[format_buffer_size];
+
+      std::string value;
+      for (unsigned int row = first_row; row < end_row; row++){
+        const char* text = column.extract_data(rows[row], format_buffer,
+          format_buffer_size);
+        latin1_to_utf8(text, static_cast<unsigned int>(strlen(text)), value);
+        values.push_back(value);
+      }
+
+      delete [] format_buffer;
+      export_strings(array, values);
+    }
+  }
+}
+
+void export_arrow_array(const RowData& rows, ArrowArray* array,
+  const unsigned int first_row, const unsigned int row_count) throw () {
+
+  unsigned int count = 0;
+  if (first_row < rows.row_count()){
+    count = rows.row_count() - first_row;
+  }
+
+  if (row_count && row_count < count){
+    count = row_count;
+  }
+
+  // The struct array itself only has a validity buffer, which is left out
+  ArrayData* data = init_array(array, count, 1);
+
+  const unsigned int column_count = rows.table.column_count();
+  for (unsigned int col = 0; col < column_count; col++){
+    ArrowArray* child = new ArrowArray;
+    export_column(child, rows.table.column_at(col), rows, first_row, count);
+    data->children.push_back(child);
+  }
+
+  array->n_children = column_count;
+  array->children = column_count? &data->children[0] : NULL;
+}
+
+void export_arrow_table(const Table& table, ArrowSchema* schema,
+  ArrowArray* array, const unsigned int row_limit)
+  throw (Errors::FileReadError) {
+
+  const RowData* rows = table.load_rows(row_limit);
+  export_arrow_array(*rows, array);
+  delete rows;
+
+  export_arrow_schema(table, schema);
+}
+
+} // namespace
@@ -0,0 +1,144 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * arrow_export.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_DATABASE_ARROW_EXPORT_H
+#define DRILLER_DATABASE_ARROW_EXPORT_H
+
+#include "table.h"
+#include "row_data.h"
+
+// The Arrow C Data Interface structures, as given by the Arrow specification
+// but with int64_t spelled int64 for older compilers. The guard lets hosts
+// which already define them (such as Arrow itself) include this header too
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  Driller::int64 flags;
+  Driller::int64 n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  Driller::int64 length;
+  Driller::int64 null_count;
+  Driller::int64 offset;
+  Driller::int64 n_buffers;
+  Driller::int64 n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+} // extern "C"
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace Driller {
+
+/**
+  Get the Arrow format string used for a column's values. Enumerations are
+  dictionary encoded, so this is the format of their indices
+
+  @param column The column to describe
+
+  @return An Arrow C Data Interface format string
+*/
+const char* arrow_format(const Column& column) throw ();
+
+/**
+  Describe a table as an Arrow struct type, with one child per column. This
+  is the schema of every array exported from the table
+
+  Columns are mapped to Arrow types as follows:
+
+  - Integers become the integer type of the same width and signedness
+  - Booleans become boolean
+  - Dates become date32
+  - Currency becomes decimal128(10, 2)
+  - Enumerations become uint8 indices into a utf8 dictionary of cases
+  - Blobs become binary
+  - Everything else becomes utf8, converted from the Latin-1 text in the
+    data files
+
+  @param table The table to describe
+  @param schema Receives the schema. The caller must release it
+*/
+void export_arrow_schema(const Table& table, ArrowSchema* schema) throw ();
+
+/**
+  Export a batch of rows as an Arrow struct array, with one child array per
+  column. Values are decoded once into buffers aligned and padded to 64
+  bytes, which are then owned by the array; consumers can use them in place
+  without parsing or copying them again. The rows may be deleted once this
+  returns
+
+  @param rows The rows to export from
+  @param array Receives the array. The caller must release it
+  @param first_row The first row to export
+  @param row_count How many rows to export. If this is 0, or runs past the
+  end of rows, every row from first_row on is exported
+*/
+void export_arrow_array(
+  const RowData& rows,
+  ArrowArray* array,
+  const unsigned int first_row = 0,
+  const unsigned int row_count = 0) throw ();
+
+/**
+  Export an entire table, as both a schema and a single array
+
+  @param table The table to export
+  @param schema Receives the schema. The caller must release it
+  @param array Receives the array. The caller must release it
+  @param row_limit If this is greater than 0, limit the number of rows
+  exported from the table
+*/
+void export_arrow_table(
+  const Table& table,
+  ArrowSchema* schema,
+  ArrowArray* array,
+  const unsigned int row_limit = 0) throw (Errors::FileReadError);
+
+} // namespace
+
+#endif // DRILLER_DATABASE_ARROW_EXPORT_H
@@ -279,31 +279,9 @@ const char* extract_phone(const ColumnExtractionInfo& info) {
 
 /* COLUMN_DATE */
 const char* extract_date(const ColumnExtractionInfo& info) {
-  // Number of days since 1700-02-28
-  uint32 date_delta = Column::get_uint32(info.data);
-
-  // 1700-02-28, in Julian days
-  uint32 julian_start_date = 2342031;
-
-  uint32 julian_date = julian_start_date + date_delta;
-
   uint32 year;
   uint8 month, day;
-
-  // Convert the julian date to YYYY-MM-DD format
-  // This algorithm is from the glib library
-  uint32 A, B, C, D, E, M;
-
-  A = julian_date + 32045;
-  B = (4 * (A + 36524)) / 146097 - 1;
-  C = A - (146097 * B) / 4;
-  D = (4 * (C + 365)) / 1461 - 1;
-  E = C - ((1461*D) / 4);
-  M = (5 * (E - 1) + 2)/153;
-
-  month = static_cast<uint8>(M + 3 - (12*(M/10)));
-  day = static_cast<uint8>(E - (153*M + 2)/5);
-  year = 100 * B + D - 4800 + (M / 10);
+  Column::date_to_ymd(Column::get_uint32(info.data), year, month, day);
 
   // Convert the values into a string
   sprintf(info.buffer, "%u-%u-%u", year, month, day);
@@ -505,6 +483,76 @@ bool Column::needs_length() const throw () {
   return (type == COLUMN_BLOB || type == COLUMN_STRING);
 }
 
+int32 Column::date_to_unix_days(const uint32 date) throw () {
+  // 1700-02-28 and 1970-01-01, in Julian days
+  const int32 julian_start_date = 2342031;
+  const int32 julian_unix_epoch = 2440588;
+
+  return static_cast<int32>(date) + julian_start_date - julian_unix_epoch;
+}
+
+void Column::date_to_ymd(const uint32 date, uint32& year, uint8& month,
+  uint8& day) throw () {
+
+  // Number of days since 1700-02-28
+  uint32 date_delta = date;
+
+  // 1700-02-28, in Julian days
+  uint32 julian_start_date = 2342031;
+
+  uint32 julian_date = julian_start_date + date_delta;
+
+  // Convert the julian date to YYYY-MM-DD format
+  // This algorithm is from the glib library
+  uint32 A, B, C, D, E, M;
+
+  A = julian_date + 32045;
+  B = (4 * (A + 36524)) / 146097 - 1;
+  C = A - (146097 * B) / 4;
+  D = (4 * (C + 365)) / 1461 - 1;
+  E = C - ((1461*D) / 4);
+  M = (5 * (E - 1) + 2)/153;
+
+  month = static_cast<uint8>(M + 3 - (12*(M/10)));
+  day = static_cast<uint8>(E - (153*M + 2)/5);
+  year = 100 * B + D - 4800 + (M / 10);
+}
+
+const uint8* Column::get_field(const uint8* row) const throw () {
+  return row + offset;
+}
+
+unsigned int Column::get_bytes(const uint8* row, const uint8*& bytes) const
+  throw () {
+
+  bytes = row + offset;
+
+  switch (type){
+    case COLUMN_STRING:
+      for (unsigned int ii = 0; ii < length; ii++){
+        if (bytes[ii] == 0){
+          return ii;
+        }
+      }
+      return length;
+
+    case COLUMN_VARSTRING: {
+      // The string runs from this column's offset to the end of the row,
+      // whose length is stored 2 bytes into the row. Table::load_rows()
+      // rejects rows which end before the string starts, or past the end of
+      // the file
+      const uint32 row_length = get_uint32(row + 2);
+      return (row_length > offset)? row_length - offset : 0;
+    }
+
+    case COLUMN_BLOB:
+      return length;
+
+    default:
+      return 0;
+  }
+}
+
 const char* Column::extract_data(const uint8* data,
                                  char*& buffer,
                                  unsigned int& buffer_size) const throw () {
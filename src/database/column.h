@@ -160,14 +160,57 @@ public:
     return file[0] + file[1]*256u;
   }
 
-  static int32 get_int32(const uint8* file) throw () {
-    return file[0] + file[1]*256 + file[2]*65536 + file[3]*16777216;
-  }
-
   static uint32 get_uint32(const uint8* file) throw () {
     return file[0] + file[1]*256u + file[2]*65536u + file[3]*16777216u;
   }
 
+  // Assembled unsigned, since a high byte above 127 overflows a signed int
+  static int32 get_int32(const uint8* file) throw () {
+    return static_cast<int32>(get_uint32(file));
+  }
+
+  /**
+    Convert a date, as stored in a date column, to the number of days since
+    1970-01-01
+
+    @param date The stored date, which counts days since 1700-02-28
+
+    @return The number of days since the Unix epoch
+  */
+  static int32 date_to_unix_days(const uint32 date) throw ();
+
+  /**
+    Convert a date, as stored in a date column, to a calendar date
+
+    @param date The stored date, which counts days since 1700-02-28
+    @param year Receives the year
+    @param month Receives the month, from 1 to 12
+    @param day Receives the day of the month, from 1 to 31
+  */
+  static void date_to_ymd(const uint32 date, uint32& year, uint8& month,
+    uint8& day) throw ();
+
+  /**
+    Find this column's value within a row
+
+    @param row The start of the row containing this column
+
+    @return A pointer to the first byte of this column's value
+  */
+  const uint8* get_field(const uint8* row) const throw ();
+
+  /**
+    Find the raw bytes of a string, varstring or blob column. Strings stop at
+    their NULL terminator, if they have one
+
+    @param row The start of the row containing this column
+    @param bytes Receives a pointer to the first byte of the value
+
+    @return How many bytes long the value is
+  */
+  unsigned int get_bytes(const uint8* row, const uint8*& bytes) const
+    throw ();
+
   /**
     Extract data from this column
 
@@ -18,14 +18,29 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include <errno.h>
 #include <sstream>
 #include <algorithm>
 
 #include <libxml/xmlwriter.h>
 
 #include "database.h"
+#include "snapshot.h"
 #include "misc.h"
 
+#ifdef __APPLE__
+  #ifndef __unix
+    #define __unix
+  #endif
+#endif
+
+// For listing snapshot directories
+#ifdef __unix
+  #include <dirent.h>
+#elif WIN32
+  #include <windows.h>
+#endif
+
 /** Perform one-time libXML initialization */
 void init_libxml() throw () {
   static bool initialized = false;
@@ -99,6 +114,16 @@ Database Database::from_buffer(const char* buffer)
   return db;
 }
 
+Database Database::from_snapshot(const std::string& directory) throw (
+  Errors::DuplicateEnumID,
+  Errors::FileParseError,
+  Errors::FileReadError) {
+
+  Database db;
+  db.load_snapshot(directory);
+  return db;
+}
+
 Database::~Database() throw () {
   clear();
 }
@@ -192,6 +217,77 @@ void Database::load_from_buffer(const char* buffer) throw (
   }
 }
 
+void Database::load_snapshot(const std::string& directory) throw (
+  Errors::DuplicateEnumID,
+  Errors::FileParseError,
+  Errors::FileReadError) {
+
+  const std::string& extension = Snapshot::extension;
+  std::vector<std::string> file_names;
+
+  // Find every snapshot in the directory
+#ifdef __unix
+  DIR* dir = opendir(directory.c_str());
+
+  if (!dir){
+    throw Errors::FileReadError(directory, errno);
+  }
+
+  for (dirent* entry = readdir(dir); entry; entry = readdir(dir)){
+    file_names.push_back(entry->d_name);
+  }
+
+  closedir(dir);
+
+#elif WIN32
+  WIN32_FIND_DATA found;
+  HANDLE search = FindFirstFile((directory + "/*" + extension).c_str(),
+    &found);
+
+  if (search == INVALID_HANDLE_VALUE){
+    throw Errors::FileReadError(directory, errno);
+  }
+
+  do {
+    file_names.push_back(found.cFileName);
+  } while (FindNextFile(search, &found));
+
+  FindClose(search);
+#endif
+
+  // Tables are listed in file name order, since the directory order isn't
+  // meaningful
+  std::sort(file_names.begin(), file_names.end());
+
+  clear();
+
+  // Name the database after the directory
+  std::string dir_name = directory;
+  while (dir_name.size() > 1 && (dir_name[dir_name.size() - 1] == '/' ||
+    dir_name[dir_name.size() - 1] == '\\')){
+
+    dir_name.erase(dir_name.size() - 1);
+  }
+  set_name(dir_name.substr(dir_name.find_last_of("/\\") + 1));
+
+  for (unsigned int ii = 0; ii < file_names.size(); ii++){
+    const std::string& file_name = file_names[ii];
+
+    if (file_name.size() <= extension.size() ||
+      file_name.compare(file_name.size() - extension.size(), extension.size(),
+        extension) != 0){
+
+      continue;
+    }
+
+    const std::string full_file_name = directory + "/" + file_name;
+    Snapshot snapshot(full_file_name);
+    Table table = snapshot.get_table();
+    table.set_snapshot_file(full_file_name);
+    add_table(table);
+  }
+}
+
 unsigned int Database::table_count() const throw () {
   return static_cast<unsigned int>(tables.size());
 }
@@ -30,6 +30,7 @@
 #include <string>
 #include "../errors.h"
 #include "table.h"
+#include "row_data.h"
 
 namespace Driller {
 
@@ -68,6 +69,21 @@ public:
   static Database from_buffer(const char* buffer)
     throw (Errors::DuplicateEnumID, Errors::FileParseError);
 
+  /**
+    Open a directory of snapshots, as written by a SnapshotSink. Each table
+    is defined by its snapshot, and reads its data from it instead of the
+    data path
+
+    @param directory The directory containing the snapshots
+
+    @return The Database holding every snapshot in the directory
+  */
+  static Database from_snapshot(const std::string& directory)
+    throw (
+      Errors::DuplicateEnumID,
+      Errors::FileParseError,
+      Errors::FileReadError);
+
   /**
     Default constructor, calls clear()
   */
@@ -83,6 +99,16 @@ public:
     Errors::FileParseError,
     Errors::FileReadError);
 
+  /**
+    Load every table in a directory of snapshots
+
+    @param directory The directory containing the snapshots
+  */
+  void load_snapshot(const std::string& directory) throw (
+    Errors::DuplicateEnumID,
+    Errors::FileParseError,
+    Errors::FileReadError);
+
   /**
     Load a database from a properly formatted XML buffer
 
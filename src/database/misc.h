@@ -103,6 +103,8 @@ namespace Driller {
   typedef unsigned short int uint16;
   typedef long int int32;
   typedef unsigned long int uint32;
+  typedef __int64 int64;
+  typedef unsigned __int64 uint64;
 #else
   typedef int8_t int8;
   typedef uint8_t uint8;
@@ -110,6 +112,8 @@ namespace Driller {
   typedef uint16_t uint16;
   typedef int32_t int32;
   typedef uint32_t uint32;
+  typedef int64_t int64;
+  typedef uint64_t uint64;
 #endif
 
 /**
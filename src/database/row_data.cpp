@@ -0,0 +1,55 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * row_data.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "row_data.h"
+
+namespace Driller {
+
+RowData::RowData(
+  const Table& _table,
+  Table::ExtractionState* _state,
+  const uint8** _rows,
+  const unsigned int _row_count) throw ():
+
+  table(_table),
+  state(_state),
+  rows(_rows),
+  rows_count(_row_count){}
+
+RowData::~RowData() throw () {
+  delete [] rows;
+  table.unload_data(state);
+}
+
+const uint8* RowData::operator[](const unsigned int row) const throw () {
+  return rows[row];
+}
+
+unsigned int RowData::row_count() const throw () {
+  return rows_count;
+}
+
+void RowData::sort(const Column& column, const uint64 memory_budget)
+  throw (Errors::FileWriteError, Errors::FileReadError) {
+
+  sort_rows(rows, rows_count, column, memory_budget);
+}
+
+} // namespace
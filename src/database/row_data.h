@@ -0,0 +1,104 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * row_data.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_DATABASE_ROW_DATA_H
+#define DRILLER_DATABASE_ROW_DATA_H
+
+#include "table.h"
+#include "row_sort.h"
+
+namespace Driller {
+
+/**
+  The raw, undecoded rows of a table. Each row is a pointer into the table's
+  loaded data file, which can be read with the Column accessors. This lets
+  typed outputs read values directly, without formatting them as text first
+
+  RowData is created by Table::load_rows(), and keeps the data file loaded
+  until it is deleted
+*/
+class RowData {
+  friend class Table;
+public:
+  /** Unload the table's data */
+  ~RowData() throw ();
+
+  /**
+    Get the start of a row
+
+    @param row The index of the row
+
+    @return A pointer to the first byte of the row
+  */
+  const uint8* operator[](const unsigned int row) const throw ();
+
+  /**
+    Get how many rows were loaded
+
+    @return How many rows were loaded
+  */
+  unsigned int row_count() const throw ();
+
+  /**
+    Reorder the rows by one column's value. See sort_rows()
+
+    @param column The column to sort by
+    @param memory_budget The most memory an in-memory sort may use, in bytes
+  */
+  void sort(const Column& column,
+    const uint64 memory_budget = default_sort_memory)
+    throw (Errors::FileWriteError, Errors::FileReadError);
+
+  /** The table these rows were loaded from */
+  const Table& table;
+
+protected:
+  /**
+    Create a new set of rows. Only Table does this
+
+    @param table The table the rows belong to
+    @param state The loaded data file, which will be unloaded on deletion
+    @param rows Pointers to the start of each row, which will be deleted
+    @param row_count How many rows there are
+  */
+  RowData(
+    const Table& table,
+    Table::ExtractionState* state,
+    const uint8** rows,
+    const unsigned int row_count) throw ();
+
+  /** The loaded data file */
+  Table::ExtractionState* state;
+
+  /** Pointers to the start of each row */
+  const uint8** rows;
+
+  /** How many rows there are */
+  const unsigned int rows_count;
+
+private:
+  // Rows cannot be copied, since they own the loaded file
+  RowData(const RowData&);
+  RowData& operator=(const RowData&);
+};
+
+} // namespace
+
+#endif // DRILLER_DATABASE_ROW_DATA_H
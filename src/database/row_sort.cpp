@@ -0,0 +1,348 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * row_sort.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "row_sort.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace Driller {
+
+const uint64 default_sort_memory = 256 * 1024 * 1024;
+
+/** Used in error messages about the temporary files holding sorted runs */
+const char* const run_file_name = "temporary sort file";
+
+/** The fewest entries in each sorted run, however small the budget */
+const unsigned int min_run_entries = 4096;
+
+/** A row and the key it's sorted by */
+struct SortEntry {
+  uint32 key;
+  const uint8* row;
+};
+
+/**
+  Sort entries by key, a byte at a time starting with the lowest. Each pass
+  keeps the order of the previous one, so the sort is stable. Bytes which are
+  the same in every key, such as the high bytes of small IDs, are skipped
+
+  @param entries The entries to sort
+  @param scratch Space for as many entries
+  @param count How many entries there are
+
+  @return Either entries or scratch, whichever holds the sorted entries
+*/
+SortEntry* radix_sort(SortEntry* entries, SortEntry* scratch,
+  const unsigned int count) throw () {
+
+  unsigned int counts[4][256];
+  memset(counts, 0, sizeof(counts));
+
+  for (unsigned int ii = 0; ii < count; ii++){
+    const uint32 key = entries[ii].key;
+    counts[0][key & 0xFF]++;
+    counts[1][(key >> 8) & 0xFF]++;
+    counts[2][(key >> 16) & 0xFF]++;
+    counts[3][key >> 24]++;
+  }
+
+  for (unsigned int digit = 0; digit < 4 && count; digit++){
+    const unsigned int shift = digit * 8;
+    if (counts[digit][(entries[0].key >> shift) & 0xFF] == count){
+      continue;
+    }
+
+    unsigned int offsets[256];
+    unsigned int offset = 0;
+    for (unsigned int value = 0; value < 256; value++){
+      offsets[value] = offset;
+      offset += counts[digit][value];
+    }
+
+    for (unsigned int ii = 0; ii < count; ii++){
+      scratch[offsets[(entries[ii].key >> shift) & 0xFF]++] = entries[ii];
+    }
+
+    std::swap(entries, scratch);
+  }
+
+  return entries;
+}
+
+/**
+  Fill entries with the keys of a range of rows
+
+  @param rows The rows
+  @param count How many rows to read
+  @param column The column to sort by
+  @param entries Receives an entry for each row
+*/
+void read_keys(const uint8** rows, const unsigned int count,
+  const Column& column, SortEntry* entries) throw () {
+
+  for (unsigned int ii = 0; ii < count; ii++){
+    entries[ii].key = integer_sort_key(column, rows[ii]);
+    entries[ii].row = rows[ii];
+  }
+}
+
+/**
+  Radix sort rows in runs which fit the memory budget, write each run to a
+  temporary file, then merge the runs
+
+  @param rows The rows, which are reordered
+  @param count How many rows there are
+  @param column The column to sort by
+  @param run_entries How many entries each run holds
+*/
+void external_sort(const uint8** rows, const unsigned int count,
+  const Column& column, const unsigned int run_entries)
+  throw (Errors::FileWriteError, Errors::FileReadError) {
+
+  std::vector<FILE*> runs;
+
+  try {
+    {
+      std::vector<SortEntry> entries(run_entries), scratch(run_entries);
+
+      for (unsigned int first = 0; first < count; first += run_entries){
+        const unsigned int run_count = std::min(run_entries, count - first);
+        read_keys(rows + first, run_count, column, &entries[0]);
+        const SortEntry* sorted = radix_sort(&entries[0], &scratch[0],
+          run_count);
+
+        FILE* file = tmpfile();
+        if (!file){
+          throw Errors::FileWriteError(run_file_name, errno);
+        }
+        runs.push_back(file);
+
+        if (fwrite(sorted, sizeof(SortEntry), run_count, file) != run_count){
+          throw Errors::FileWriteError(run_file_name, errno);
+        }
+        rewind(file);
+      }
+    }
+
+    // Each run gets an equal share of the memory the runs were sorted in
+    const unsigned int run_count = static_cast<unsigned int>(runs.size());
+    const unsigned int chunk = std::max(1u, (2 * run_entries) / run_count);
+    std::vector<std::vector<SortEntry> > buffers(run_count);
+    std::vector<unsigned int> positions(run_count, 0);
+
+    // The next key of each run. Equal keys come from the earliest run
+    // first, which keeps the merge stable
+    typedef std::pair<uint32, unsigned int> HeapEntry;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+      std::greater<HeapEntry> > heap;
+
+    for (unsigned int run = 0; run < run_count; run++){
+      buffers[run].resize(chunk);
+      buffers[run].resize(fread(&buffers[run][0], sizeof(SortEntry), chunk,
+        runs[run]));
+      if (buffers[run].empty()){
+        throw Errors::FileReadError(run_file_name, errno);
+      }
+      heap.push(HeapEntry(buffers[run][0].key, run));
+    }
+
+    unsigned int out = 0;
+    while (!heap.empty()){
+      const unsigned int run = heap.top().second;
+      heap.pop();
+
+      std::vector<SortEntry>& buffer = buffers[run];
+      rows[out++] = buffer[positions[run]++].row;
+
+      if (positions[run] == buffer.size()){
+        buffer.resize(chunk);
+        buffer.resize(fread(&buffer[0], sizeof(SortEntry), chunk, runs[run]));
+        positions[run] = 0;
+
+        if (buffer.empty()){
+          if (ferror(runs[run])){
+            throw Errors::FileReadError(run_file_name, errno);
+          }
+          continue;
+        }
+      }
+
+      heap.push(HeapEntry(buffer[positions[run]].key, run));
+    }
+  }
+
+  catch (...){
+    for (unsigned int ii = 0; ii < runs.size(); ii++){
+      fclose(runs[ii]);
+    }
+    throw;
+  }
+
+  for (unsigned int ii = 0; ii < runs.size(); ii++){
+    fclose(runs[ii]);
+  }
+}
+
+/**
+  Find the bytes a text, blob or phone value is compared by
+
+  @param column The value's column
+  @param row The start of the row containing the value
+  @param bytes Receives a pointer to the first byte
+
+  @return How many bytes there are
+*/
+unsigned int sort_bytes(const Column& column, const uint8* row,
+  const uint8*& bytes) throw () {
+
+  if (column.get_type() == COLUMN_PHONE){
+    bytes = column.get_field(row);
+    return 10;
+  }
+
+  return column.get_bytes(row, bytes);
+}
+
+/**
+  Orders rows by a text, blob or phone column's bytes
+*/
+class ByteOrder {
+public:
+  ByteOrder(const Column& _column) throw (): column(_column){}
+
+  bool operator()(const uint8* a, const uint8* b) const throw () {
+    const uint8* a_bytes;
+    const uint8* b_bytes;
+    const unsigned int a_length = sort_bytes(column, a, a_bytes);
+    const unsigned int b_length = sort_bytes(column, b, b_bytes);
+
+    const int order = memcmp(a_bytes, b_bytes, std::min(a_length, b_length));
+    return order < 0 || (order == 0 && a_length < b_length);
+  }
+
+  const Column& column;
+};
+
+bool has_integer_sort_key(const ColumnType type) throw (){
+  switch (type){
+    case COLUMN_BOOL:
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+    case COLUMN_DATE:
+    case COLUMN_CURRENCY:
+    case COLUMN_ENUM:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+uint32 integer_sort_key(const Column& column, const uint8* row) throw (){
+  const uint8* field = column.get_field(row);
+
+  // Flipping the sign bit orders signed values as unsigned keys
+  switch (column.get_type()){
+    case COLUMN_INT8:
+      return static_cast<uint32>(Column::get_int8(field)) ^ 0x80000000u;
+
+    case COLUMN_INT16:
+      return static_cast<uint32>(Column::get_int16(field)) ^ 0x80000000u;
+
+    case COLUMN_INT32:
+    case COLUMN_CURRENCY:
+      return static_cast<uint32>(Column::get_int32(field)) ^ 0x80000000u;
+
+    case COLUMN_UINT16:
+      return Column::get_uint16(field);
+
+    case COLUMN_UINT32:
+    case COLUMN_DATE:
+      return Column::get_uint32(field);
+
+    default:
+      return field[0];
+  }
+}
+
+void sort_rows(const uint8** rows, const unsigned int count,
+  const Column& column, const uint64 memory_budget)
+  throw (Errors::FileWriteError, Errors::FileReadError){
+
+  if (count < 2){
+    return;
+  }
+
+  if (!has_integer_sort_key(column.get_type())){
+    const ByteOrder order(column);
+    for (unsigned int ii = 1; ii < count; ii++){
+      if (order(rows[ii], rows[ii - 1])){
+        std::stable_sort(rows, rows + count, order);
+        break;
+      }
+    }
+    return;
+  }
+
+  uint32 previous = integer_sort_key(column, rows[0]);
+  unsigned int ii = 1;
+  for (; ii < count; ii++){
+    const uint32 key = integer_sort_key(column, rows[ii]);
+    if (key < previous){
+      break;
+    }
+    previous = key;
+  }
+
+  if (ii == count){
+    return;
+  }
+
+  // Radix sorting needs room for two copies of the entries
+  const uint64 needed = 2 * static_cast<uint64>(count) * sizeof(SortEntry);
+  if (needed > memory_budget){
+    const unsigned int run_entries = static_cast<unsigned int>(std::max<uint64>(
+      min_run_entries, memory_budget / (2 * sizeof(SortEntry))));
+
+    if (run_entries < count){
+      external_sort(rows, count, column, run_entries);
+      return;
+    }
+  }
+
+  std::vector<SortEntry> entries(count), scratch(count);
+  read_keys(rows, count, column, &entries[0]);
+
+  const SortEntry* sorted = radix_sort(&entries[0], &scratch[0], count);
+  for (ii = 0; ii < count; ii++){
+    rows[ii] = sorted[ii].row;
+  }
+}
+
+} // namespace
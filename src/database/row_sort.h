@@ -0,0 +1,76 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * row_sort.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_DATABASE_ROW_SORT_H
+#define DRILLER_DATABASE_ROW_SORT_H
+
+#include "../file_errors.h"
+#include "column.h"
+
+namespace Driller {
+
+/** The default most memory sort_rows() uses, in bytes */
+extern const uint64 default_sort_memory;
+
+/**
+  Check whether a column's values can be sorted as 32-bit keys. This is true
+  of every type except text, blobs and phone numbers
+
+  @param type The column's type
+
+  @return Whether sort_rows() radix sorts the column
+*/
+bool has_integer_sort_key(const ColumnType type) throw ();
+
+/**
+  Get the 32-bit key of a value, which orders values of the same column the
+  same way as the values themselves. Only valid if has_integer_sort_key() is
+  true for the column's type
+
+  @param column The value's column
+  @param row The start of the row containing the value
+
+  @return The value's key
+*/
+uint32 integer_sort_key(const Column& column, const uint8* row) throw ();
+
+/**
+  Reorder rows by one column's raw value, in ascending order. Rows with equal
+  values keep their order. Text, blobs and phone numbers are compared byte by
+  byte, and enumerations by their stored IDs
+
+  Other types are radix sorted as 32-bit keys, each of which is kept with its
+  row pointer. If those take more than the memory budget, they are sorted in
+  runs which fit, written to temporary files and merged. Rows which are
+  already in order are left as they are after a single check
+
+  @param rows Pointers to the start of each row, which are reordered
+  @param count How many rows there are
+  @param column The column to sort by
+  @param memory_budget The most memory the keys of an in-memory sort may
+  take, in bytes
+*/
+void sort_rows(const uint8** rows, const unsigned int count,
+  const Column& column, const uint64 memory_budget = default_sort_memory)
+  throw (Errors::FileWriteError, Errors::FileReadError);
+
+} // namespace
+
+#endif // DRILLER_DATABASE_ROW_SORT_H
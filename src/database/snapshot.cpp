@@ -0,0 +1,1038 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * snapshot.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <errno.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include "snapshot.h"
+#include "database.h"
+
+#ifdef __APPLE__
+  #ifndef __unix
+    #define __unix
+  #endif
+#endif
+
+// For mmap
+#ifdef __unix
+  #include <sys/types.h>
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+
+// For Windows versions of mmap
+#elif WIN32
+  #include <windows.h>
+#endif
+
+/*
+  Snapshot file layout. All integers are little-endian, and every section
+  starts on an 8 byte boundary:
+
+  "DRLSNAP1"
+  Column sections: values, then index, then strings, as the encoding needs
+  Footer:
+    uint32 row count
+    uint32 column count
+    uint32 block size
+    uint32 definition length
+    The table definition, as database XML
+    For each column: uint32 encoding, width, dictionary count, and offsets
+    of the values, index and strings sections
+  Trailer:
+    uint32 footer offset
+    uint32 footer length
+    "DSNAPEND"
+*/
+
+namespace Driller {
+
+const std::string Snapshot::extension = ".dsnap";
+const unsigned int Snapshot::block_size = 128;
+
+/** Identifies the start of a snapshot file */
+static const char header_magic[] = "DRLSNAP1";
+
+/** Identifies the end of a snapshot file */
+static const char trailer_magic[] = "DSNAPEND";
+
+/** How long the trailer is */
+static const unsigned int trailer_length = 16;
+
+/** How many uint32 fields each column's footer entry has */
+static const unsigned int column_entry_fields = 6;
+
+/////////////////////
+// Reading helpers //
+/////////////////////
+
+/** Read an unsigned integer of 1, 2 or 4 bytes */
+static uint32 get_unsigned(const uint8* data, const unsigned int width)
+  throw () {
+
+  switch (width){
+    case 1:
+      return Column::get_uint8(data);
+
+    case 2:
+      return Column::get_uint16(data);
+
+    default:
+      return Column::get_uint32(data);
+  }
+}
+
+/** Read a signed 64-bit integer */
+static int64 get_int64(const uint8* data) throw () {
+  return static_cast<int64>(Column::get_uint32(data)) +
+    (static_cast<int64>(Column::get_int32(data + 4)) << 32);
+}
+
+/**
+  Get which encoding a column's values are stored with
+
+  @param column The column
+
+  @return The column's encoding
+*/
+static SnapshotEncoding encoding_for(const Column& column) throw () {
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return SNAPSHOT_BITMAP;
+
+    case COLUMN_ENUM:
+      return SNAPSHOT_UINT8;
+
+    case COLUMN_CURRENCY:
+    case COLUMN_DATE:
+      return SNAPSHOT_INT32;
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+      return SNAPSHOT_DELTA;
+
+    default:
+      return SNAPSHOT_DICTIONARY;
+  }
+}
+
+////////////////////
+// SnapshotColumn //
+////////////////////
+
+SnapshotColumn::SnapshotColumn() throw ():
+  encoding(SNAPSHOT_DICTIONARY),
+  width(1),
+  values(NULL),
+  index(NULL),
+  strings(NULL),
+  dictionary_count(0){}
+
+SnapshotEncoding SnapshotColumn::get_encoding() const throw () {
+  return encoding;
+}
+
+int64 SnapshotColumn::get_integer(const unsigned int row) const throw () {
+  switch (encoding){
+    case SNAPSHOT_BITMAP:
+      return (values[row / 8] >> (row % 8)) & 1;
+
+    case SNAPSHOT_UINT8:
+      return values[row];
+
+    case SNAPSHOT_INT32:
+      return Column::get_int32(values + (row * 4));
+
+    case SNAPSHOT_DELTA:
+      return get_int64(index + ((row / Snapshot::block_size) * 8)) +
+        get_unsigned(values + (row * width), width);
+
+    default:
+      return 0;
+  }
+}
+
+const char* SnapshotColumn::get_string(const unsigned int row) const
+  throw () {
+
+  return dictionary_entry(get_index(row));
+}
+
+unsigned int SnapshotColumn::get_index(const unsigned int row) const
+  throw () {
+
+  return get_unsigned(values + (row * width), width);
+}
+
+unsigned int SnapshotColumn::dictionary_size() const throw () {
+  return dictionary_count;
+}
+
+const char* SnapshotColumn::dictionary_entry(const unsigned int entry) const
+  throw () {
+
+  if (entry >= dictionary_count){
+    return "";
+  }
+
+  return reinterpret_cast<const char*>(strings) +
+    Column::get_uint32(index + (entry * 4));
+}
+
+//////////////
+// Snapshot //
+//////////////
+
+Snapshot::Snapshot(const std::string& _file_name)
+  throw (Errors::FileReadError, Errors::FileParseError):
+
+  file_name(_file_name),
+  data(NULL),
+  data_length(0),
+  rows(0){
+
+// On UNIX-based systems, mmap the file
+#ifdef __unix
+  int fd = open(file_name.c_str(), O_RDONLY, 0);
+
+  if (fd < 0){
+    throw Errors::FileReadError(file_name, errno);
+  }
+
+  data_length = lseek(fd, 0, SEEK_END);
+  if (data_length > 0){
+    data = static_cast<uint8*>(
+      mmap(0, data_length, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0));
+
+    if (data == MAP_FAILED){
+      data = NULL;
+    }
+  }
+
+  close(fd);
+
+// On Windows, use the equivalent Win32 API functions
+#elif WIN32
+  HANDLE file_handle = CreateFile(file_name.c_str(), GENERIC_READ,
+    FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_READONLY, NULL);
+
+  if (file_handle == INVALID_HANDLE_VALUE){
+    throw Errors::FileReadError(file_name, errno);
+  }
+
+  data_length = GetFileSize(file_handle, NULL);
+
+  HANDLE file_mapping = CreateFileMapping(file_handle, NULL, PAGE_READONLY,
+    0, 0, NULL);
+
+  if (file_mapping){
+    data = reinterpret_cast<uint8*>(MapViewOfFile(file_mapping,
+      FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(file_mapping);
+  }
+
+  CloseHandle(file_handle);
+
+// Anything else, just use plain fread
+#else
+  FILE* file = fopen(file_name.c_str(), "rb");
+
+  if (!file){
+    throw Errors::FileReadError(file_name, errno);
+  }
+
+  fseek(file, 0, SEEK_END);
+  data_length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  data = new uint8[data_length];
+  fread(data, 1, data_length, file);
+  fclose(file);
+#endif
+
+  if (!data){
+    throw Errors::FileReadError(file_name, errno);
+  }
+
+  // Check the header and trailer
+  if (data_length < 8 + trailer_length ||
+    memcmp(data, header_magic, 8) != 0 ||
+    memcmp(data + data_length - 8, trailer_magic, 8) != 0){
+
+    unmap();
+    throw Errors::FileParseError(file_name);
+  }
+
+  const uint8* trailer = data + data_length - trailer_length;
+  const uint32 footer_offset = Column::get_uint32(trailer);
+  const uint32 footer_length = Column::get_uint32(trailer + 4);
+
+  // Read the footer, checking that everything it points to is in the file
+  bool valid = (footer_length >= 16 && footer_offset >= 8 &&
+    footer_offset + footer_length == data_length - trailer_length);
+
+  if (valid){
+    const uint8* footer = data + footer_offset;
+    rows = Column::get_uint32(footer);
+    const uint32 column_count = Column::get_uint32(footer + 4);
+    const uint32 file_block_size = Column::get_uint32(footer + 8);
+    const uint32 definition_length = Column::get_uint32(footer + 12);
+
+    valid = (file_block_size == block_size &&
+      definition_length <= footer_length - 16 &&
+      column_count <= (footer_length - 16 - definition_length) /
+        (column_entry_fields * 4));
+
+    if (valid){
+      definition.assign(reinterpret_cast<const char*>(footer + 16),
+        definition_length);
+    }
+
+    const uint8* entry = footer + 16 + definition_length;
+    const uint32 blocks = (rows + block_size - 1) / block_size;
+
+    for (uint32 col = 0; valid && col < column_count; col++){
+      SnapshotColumn column;
+      const uint32 encoding = Column::get_uint32(entry);
+      const uint32 width = Column::get_uint32(entry + 4);
+      const uint32 count = Column::get_uint32(entry + 8);
+      const uint32 values_offset = Column::get_uint32(entry + 12);
+      const uint32 index_offset = Column::get_uint32(entry + 16);
+      const uint32 strings_offset = Column::get_uint32(entry + 20);
+      entry += column_entry_fields * 4;
+
+      // How large each section should be
+      uint64 values_size = 0;
+      uint64 index_size = 0;
+
+      switch (encoding){
+        case SNAPSHOT_BITMAP:
+          values_size = (rows + 7) / 8;
+          break;
+
+        case SNAPSHOT_UINT8:
+          values_size = rows;
+          break;
+
+        case SNAPSHOT_INT32:
+          values_size = static_cast<uint64>(rows) * 4;
+          break;
+
+        case SNAPSHOT_DELTA:
+          values_size = static_cast<uint64>(rows) * width;
+          index_size = static_cast<uint64>(blocks) * 8;
+          break;
+
+        case SNAPSHOT_DICTIONARY:
+          values_size = static_cast<uint64>(rows) * width;
+          index_size = (static_cast<uint64>(count) + 1) * 4;
+          break;
+
+        default:
+          valid = false;
+      }
+
+      if (encoding == SNAPSHOT_DELTA || encoding == SNAPSHOT_DICTIONARY){
+        valid = valid && (width == 1 || width == 2 || width == 4);
+      }
+
+      valid = valid &&
+        values_offset + values_size <= footer_offset &&
+        index_offset + index_size <= footer_offset;
+
+      // Each dictionary entry must end before the next starts
+      if (valid && encoding == SNAPSHOT_DICTIONARY){
+        const uint8* offsets = data + index_offset;
+        uint32 last = 0;
+        for (uint32 ii = 0; valid && ii <= count; ii++){
+          const uint32 offset = Column::get_uint32(offsets + (ii * 4));
+          valid = (offset >= last &&
+            strings_offset + static_cast<uint64>(offset) <= footer_offset &&
+            (ii == 0 || data[strings_offset + offset - 1] == 0));
+          last = offset;
+        }
+      }
+
+      if (valid){
+        column.encoding = static_cast<SnapshotEncoding>(encoding);
+        column.width = width;
+        column.values = data + values_offset;
+        column.index = data + index_offset;
+        column.strings = data + strings_offset;
+        column.dictionary_count = count;
+        columns.push_back(column);
+      }
+    }
+  }
+
+  if (!valid){
+    unmap();
+    throw Errors::FileParseError(file_name);
+  }
+}
+
+Snapshot::~Snapshot() throw () {
+  unmap();
+}
+
+void Snapshot::unmap() throw () {
+  if (!data){
+    return;
+  }
+
+// On UNIX-based systems, remove the memory mapping to the file
+#ifdef __unix
+  munmap(data, data_length);
+
+// ditto windows
+#elif WIN32
+  UnmapViewOfFile(data);
+
+// some other OS, delete the allocated buffer
+#else
+  delete[] data;
+#endif
+
+  data = NULL;
+}
+
+unsigned int Snapshot::row_count() const throw () {
+  return rows;
+}
+
+unsigned int Snapshot::column_count() const throw () {
+  return static_cast<unsigned int>(columns.size());
+}
+
+const SnapshotColumn& Snapshot::column_at(const unsigned int index) const
+  throw () {
+
+  return columns.at(index);
+}
+
+Table Snapshot::get_table() const
+  throw (Errors::DuplicateEnumID, Errors::FileParseError) {
+
+  Database db = Database::from_buffer(definition.c_str());
+
+  if (db.table_count() != 1 ||
+    db.table_at(0).column_count() != column_count()){
+
+    throw Errors::FileParseError(file_name);
+  }
+
+  return db.table_at(0);
+}
+
+const ResultSet* Snapshot::extract_data(const Table& table,
+  const unsigned int row_limit) const throw (Errors::FileParseError) {
+
+  const unsigned int column_count = table.column_count();
+  unsigned int row_count = rows;
+
+  if (row_limit && row_count > row_limit){
+    row_count = row_limit;
+  }
+
+  // The table must match the one the snapshot was taken from. Values which
+  // aren't stored as text are put back into a row of their original format,
+  // so that they're formatted by exactly the same code as the original data
+  unsigned int scratch_size = 0;
+  if (column_count != columns.size()){
+    throw Errors::FileParseError(file_name);
+  }
+
+  for (unsigned int col = 0; col < column_count; col++){
+    const Column& column = table.column_at(col);
+
+    if (encoding_for(column) != columns[col].encoding){
+      throw Errors::FileParseError(file_name);
+    }
+
+    if (columns[col].encoding != SNAPSHOT_DICTIONARY &&
+      column.get_offset() + 4 > scratch_size){
+
+      scratch_size = column.get_offset() + 4;
+    }
+  }
+
+  ResultSet* result = new ResultSet(table, row_count, column_count);
+  uint8* scratch = new uint8[scratch_size + 1];
+  memset(scratch, 0, scratch_size + 1);
+
+  unsigned int format_buffer_size = 30;
+  char* format_buffer = new char[format_buffer_size];
+
+  // Dates are stored as days since 1970, which must be converted back
+  const int32 date_bias = Column::date_to_unix_days(0);
+
+  for (unsigned int col = 0; col < column_count; col++){
+    const Column& column = table.column_at(col);
+    const SnapshotColumn& stored = columns[col];
+
+    if (stored.encoding == SNAPSHOT_DICTIONARY){
+      for (unsigned int row = 0; row < row_count; row++){
+        result->set_cell(row, col, stored.get_string(row));
+      }
+      continue;
+    }
+
+    uint8* field = scratch + column.get_offset();
+    for (unsigned int row = 0; row < row_count; row++){
+      int64 value = stored.get_integer(row);
+      if (column.get_type() == COLUMN_DATE){
+        value -= date_bias;
+      }
+
+      const uint32 bits = static_cast<uint32>(value);
+      field[0] = static_cast<uint8>(bits & 0xFF);
+      field[1] = static_cast<uint8>((bits >> 8) & 0xFF);
+      field[2] = static_cast<uint8>((bits >> 16) & 0xFF);
+      field[3] = static_cast<uint8>((bits >> 24) & 0xFF);
+
+      result->set_cell(row, col,
+        column.extract_data(scratch, format_buffer, format_buffer_size));
+    }
+  }
+
+  delete [] format_buffer;
+  delete [] scratch;
+
+  return result;
+}
+
+/**
+  Store an integer in a raw field, little-endian
+
+  @param field The field
+  @param value The value
+  @param width How many bytes the field has
+*/
+static void put_field(uint8* field, const int64 value,
+  const unsigned int width) throw () {
+
+  const uint64 bits = static_cast<uint64>(value);
+  for (unsigned int ii = 0; ii < width; ii++){
+    field[ii] = static_cast<uint8>((bits >> (8 * ii)) & 0xFF);
+  }
+}
+
+/**
+  Get how many bytes of a raw row a column's field takes, for columns whose
+  width is set by their type
+
+  @param column The column
+
+  @return The field's width
+*/
+static unsigned int field_width(const Column& column) throw () {
+  switch (column.get_type()){
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+      return 2;
+
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+    case COLUMN_DATE:
+    case COLUMN_CURRENCY:
+      return 4;
+
+    // Ten digits, of which the last three are NULL for 7 digit numbers
+    case COLUMN_PHONE:
+      return 10;
+
+    case COLUMN_BLOB:
+    case COLUMN_STRING:
+      return column.get_length();
+
+    case COLUMN_VARSTRING:
+    case COLUMN_UNKNOWN:
+      return 0;
+
+    default:
+      return 1;
+  }
+}
+
+/**
+  Put a value stored as text back into its raw field. This reverses
+  Column::extract_data() for strings, blobs and phone numbers
+
+  @param column The value's column
+  @param text The value
+  @param field The field to fill
+*/
+static void put_text_field(const Column& column, const char* text,
+  uint8* field) throw () {
+
+  switch (column.get_type()){
+    case COLUMN_STRING: {
+      const unsigned int length = static_cast<unsigned int>(strlen(text));
+      memcpy(field, text, std::min(length, column.get_length()));
+      break;
+    }
+
+    case COLUMN_VARSTRING:
+      memcpy(field, text, strlen(text));
+      break;
+
+    // Blobs are hex pairs, separated by spaces
+    case COLUMN_BLOB:
+      for (unsigned int ii = 0; ii < column.get_length() && text[0] &&
+        text[1]; ii++){
+
+        unsigned int byte = 0;
+        sscanf(text, "%2X", &byte);
+        field[ii] = static_cast<uint8>(byte);
+        text += text[2]? 3 : 2;
+      }
+      break;
+
+    // Phone numbers are digits separated by dashes
+    case COLUMN_PHONE:
+      for (unsigned int ii = 0; ii < 10 && *text; text++){
+        if (*text != '-'){
+          field[ii++] = static_cast<uint8>(*text);
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+uint8* Snapshot::rebuild_rows(const Table& table, const unsigned int row_limit,
+  unsigned int& length) const throw (Errors::FileParseError) {
+
+  const unsigned int column_count = table.column_count();
+  unsigned int row_count = rows;
+
+  if (row_limit && row_count > row_limit){
+    row_count = row_limit;
+  }
+
+  if (column_count != columns.size()){
+    throw Errors::FileParseError(file_name);
+  }
+
+  // Rows have a fixed length, unless a varstring runs to the end of each
+  // one. Then each row holds its length 2 bytes in, and is at least long
+  // enough for that and every other field
+  const bool variable = (table.get_row_length() == 0);
+  unsigned int fixed_length = variable? 6 : table.get_row_length();
+  int varstring = -1;
+
+  for (unsigned int col = 0; col < column_count; col++){
+    const Column& column = table.column_at(col);
+
+    if (encoding_for(column) != columns[col].encoding){
+      throw Errors::FileParseError(file_name);
+    }
+
+    if (column.get_type() == COLUMN_VARSTRING){
+      varstring = static_cast<int>(col);
+    }
+
+    else if (variable &&
+      column.get_offset() + field_width(column) > fixed_length){
+
+      fixed_length = column.get_offset() + field_width(column);
+    }
+  }
+
+  // Find where each row starts, so the rows can be filled in one buffer
+  std::vector<unsigned int> starts(row_count + 1, 0);
+  for (unsigned int row = 0; row < row_count; row++){
+    unsigned int row_length = fixed_length;
+
+    if (variable && varstring >= 0){
+      const unsigned int end = table.column_at(varstring).get_offset() +
+        static_cast<unsigned int>(strlen(columns[varstring].get_string(row)));
+      row_length = std::max(row_length, end);
+    }
+
+    starts[row + 1] = starts[row] + row_length;
+  }
+
+  length = starts[row_count];
+  uint8* data = new uint8[length + 1];
+  memset(data, 0, length + 1);
+
+  // Dates are stored as days since 1970, which must be converted back
+  const int32 date_bias = Column::date_to_unix_days(0);
+
+  for (unsigned int row = 0; row < row_count; row++){
+    uint8* raw = data + starts[row];
+
+    if (variable){
+      put_field(raw + 2, starts[row + 1] - starts[row], 4);
+    }
+
+    for (unsigned int col = 0; col < column_count; col++){
+      const Column& column = table.column_at(col);
+      const SnapshotColumn& stored = columns[col];
+      uint8* field = raw + column.get_offset();
+
+      if (stored.encoding == SNAPSHOT_DICTIONARY){
+        put_text_field(column, stored.get_string(row), field);
+        continue;
+      }
+
+      int64 value = stored.get_integer(row);
+      if (column.get_type() == COLUMN_DATE){
+        value -= date_bias;
+      }
+
+      put_field(field, value, field_width(column));
+    }
+  }
+
+  return data;
+}
+
+/////////////
+// Writing //
+/////////////
+
+/**
+  Writes a snapshot file's sections, keeping track of where each one starts
+*/
+class SnapshotWriter {
+public:
+  SnapshotWriter(const std::string& _file_name) throw (Errors::FileWriteError):
+    file_name(_file_name),
+    position(0){
+
+    file = fopen(file_name.c_str(), "wb");
+    if (!file){
+      throw Errors::FileWriteError(file_name, errno);
+    }
+  }
+
+  /** Close the file. If it wasn't finished, it is removed */
+  ~SnapshotWriter() throw () {
+    if (file){
+      fclose(file);
+      remove(file_name.c_str());
+    }
+  }
+
+  /**
+    Write a section, padded to start the next one on an 8 byte boundary
+
+    @param section The section's contents
+
+    @return Where the section starts
+  */
+  uint32 write_section(const std::string& section)
+    throw (Errors::FileWriteError) {
+
+    const uint32 start = position;
+    write(section);
+
+    static const char padding[8] = {0};
+    if (position % 8){
+      write(std::string(padding, 8 - (position % 8)));
+    }
+
+    return start;
+  }
+
+  /** Write raw data */
+  void write(const std::string& section) throw (Errors::FileWriteError) {
+    if (section.size() &&
+      fwrite(section.data(), section.size(), 1, file) != 1){
+
+      throw Errors::FileWriteError(file_name, errno);
+    }
+    position += static_cast<uint32>(section.size());
+  }
+
+  /** Finish writing the file */
+  void close() throw (Errors::FileWriteError) {
+    FILE* closing = file;
+    file = NULL;
+
+    if (fclose(closing) != 0){
+      remove(file_name.c_str());
+      throw Errors::FileWriteError(file_name, errno);
+    }
+  }
+
+  uint32 get_position() const throw () {
+    return position;
+  }
+
+protected:
+  const std::string file_name;
+  FILE* file;
+  uint32 position;
+};
+
+/** Append a little-endian integer of 1, 2, 4 or 8 bytes */
+static void put_unsigned(std::string& out, const uint64 value,
+  const unsigned int width) throw () {
+
+  for (unsigned int byte = 0; byte < width; byte++){
+    out += static_cast<char>((value >> (8 * byte)) & 0xFF);
+  }
+}
+
+/** Get how many bytes are needed to store values up to maximum */
+static unsigned int width_for(const uint64 maximum) throw () {
+  if (maximum <= 0xFF){
+    return 1;
+  }
+
+  else if (maximum <= 0xFFFF){
+    return 2;
+  }
+
+  return 4;
+}
+
+/** Read an integer column's value */
+static int64 read_integer(const Column& column, const uint8* row) throw () {
+  const uint8* field = column.get_field(row);
+
+  switch (column.get_type()){
+    case COLUMN_INT8:
+      return static_cast<int8>(Column::get_uint8(field));
+
+    case COLUMN_UINT8:
+      return Column::get_uint8(field);
+
+    case COLUMN_INT16:
+      return static_cast<int16>(Column::get_uint16(field));
+
+    case COLUMN_UINT16:
+      return Column::get_uint16(field);
+
+    case COLUMN_INT32:
+      return Column::get_int32(field);
+
+    default:
+      return Column::get_uint32(field);
+  }
+}
+
+void Snapshot::write(const std::string& file_name, const RowData& rows)
+  throw (Errors::FileWriteError) {
+
+  const Table& table = rows.table;
+  const unsigned int row_count = rows.row_count();
+  const unsigned int column_count = table.column_count();
+
+  // Store the table definition as a database holding just this table
+  std::string table_definition;
+  try {
+    Database db;
+    db.add_table(table);
+
+    std::ostringstream out;
+    out << db;
+    table_definition = out.str();
+  }
+
+  catch (const Errors::BaseError&){
+    throw Errors::FileWriteError(file_name, EINVAL);
+  }
+
+  SnapshotWriter writer(file_name);
+  writer.write(std::string(header_magic, 8));
+
+  std::string entries;
+  std::string values;
+  std::string index;
+  std::string strings;
+  unsigned int format_buffer_size = 30;
+  char* format_buffer = new char[format_buffer_size];
+
+  try {
+    for (unsigned int col = 0; col < column_count; col++){
+      const Column& column = table.column_at(col);
+      const SnapshotEncoding encoding = encoding_for(column);
+      unsigned int width = 0;
+      unsigned int count = 0;
+
+      values.clear();
+      index.clear();
+      strings.clear();
+
+      switch (encoding){
+        case SNAPSHOT_BITMAP:
+          values.assign((row_count + 7) / 8, '\0');
+          for (unsigned int row = 0; row < row_count; row++){
+            if (column.get_field(rows[row])[0]){
+              values[row / 8] = static_cast<char>(values[row / 8] |
+                (1 << (row % 8)));
+            }
+          }
+          break;
+
+        case SNAPSHOT_UINT8:
+          for (unsigned int row = 0; row < row_count; row++){
+            values += static_cast<char>(column.get_field(rows[row])[0]);
+          }
+          break;
+
+        case SNAPSHOT_INT32:
+          for (unsigned int row = 0; row < row_count; row++){
+            const uint8* field = column.get_field(rows[row]);
+            int32 value;
+
+            if (column.get_type() == COLUMN_DATE){
+              value = Column::date_to_unix_days(Column::get_uint32(field));
+            }
+
+            else {
+              value = Column::get_int32(field);
+            }
+
+            put_unsigned(values, static_cast<uint32>(value), 4);
+          }
+          break;
+
+        // Each block's base is its smallest value, so every delta is
+        // positive and as small as possible
+        case SNAPSHOT_DELTA: {
+          std::vector<int64> bases;
+          uint64 max_delta = 0;
+
+          for (unsigned int first = 0; first < row_count; first += block_size){
+            const unsigned int end = (first + block_size < row_count)?
+              first + block_size : row_count;
+
+            int64 base = read_integer(column, rows[first]);
+            int64 top = base;
+            for (unsigned int row = first + 1; row < end; row++){
+              const int64 value = read_integer(column, rows[row]);
+              if (value < base){
+                base = value;
+              }
+              if (value > top){
+                top = value;
+              }
+            }
+
+            bases.push_back(base);
+            if (static_cast<uint64>(top - base) > max_delta){
+              max_delta = static_cast<uint64>(top - base);
+            }
+          }
+
+          width = width_for(max_delta);
+          for (unsigned int row = 0; row < row_count; row++){
+            put_unsigned(values, static_cast<uint64>(
+              read_integer(column, rows[row]) - bases[row / block_size]),
+              width);
+          }
+
+          for (unsigned int ii = 0; ii < bases.size(); ii++){
+            put_unsigned(index, static_cast<uint64>(bases[ii]), 8);
+          }
+          break;
+        }
+
+        // Each distinct string is stored once, in order of first appearance
+        default: {
+          std::map<std::string, uint32> dictionary;
+          std::vector<uint32> indexes;
+          indexes.reserve(row_count);
+
+          for (unsigned int row = 0; row < row_count; row++){
+            const std::string value = column.extract_data(rows[row],
+              format_buffer, format_buffer_size);
+
+            std::map<std::string, uint32>::iterator found =
+              dictionary.find(value);
+
+            if (found == dictionary.end()){
+              const uint32 entry = static_cast<uint32>(dictionary.size());
+              dictionary.insert(std::make_pair(value, entry));
+
+              put_unsigned(index, strings.size(), 4);
+              strings += value;
+              strings += '\0';
+              indexes.push_back(entry);
+            }
+
+            else {
+              indexes.push_back(found->second);
+            }
+          }
+          put_unsigned(index, strings.size(), 4);
+
+          count = static_cast<unsigned int>(dictionary.size());
+          width = width_for(count? count - 1 : 0);
+          for (unsigned int row = 0; row < row_count; row++){
+            put_unsigned(values, indexes[row], width);
+          }
+        }
+      }
+
+      const uint32 values_offset = writer.write_section(values);
+      const uint32 index_offset = writer.write_section(index);
+      const uint32 strings_offset = writer.write_section(strings);
+
+      put_unsigned(entries, encoding, 4);
+      put_unsigned(entries, width, 4);
+      put_unsigned(entries, count, 4);
+      put_unsigned(entries, values_offset, 4);
+      put_unsigned(entries, index_offset, 4);
+      put_unsigned(entries, strings_offset, 4);
+    }
+  }
+
+  catch (...){
+    delete [] format_buffer;
+    throw;
+  }
+
+  delete [] format_buffer;
+
+  // The footer indexes every column, so it is written last
+  std::string footer;
+  put_unsigned(footer, row_count, 4);
+  put_unsigned(footer, column_count, 4);
+  put_unsigned(footer, block_size, 4);
+  put_unsigned(footer, table_definition.size(), 4);
+  footer += table_definition;
+  footer += entries;
+
+  std::string trailer;
+  put_unsigned(trailer, writer.get_position(), 4);
+  put_unsigned(trailer, footer.size(), 4);
+  trailer.append(trailer_magic, 8);
+
+  writer.write(footer);
+  writer.write(trailer);
+  writer.close();
+}
+
+} // namespace
@@ -0,0 +1,271 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * snapshot.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_DATABASE_SNAPSHOT_H
+#define DRILLER_DATABASE_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include "../file_errors.h"
+#include "table.h"
+#include "row_data.h"
+#include "result_set.h"
+
+namespace Driller {
+
+/** How a snapshot column's values are stored */
+enum SnapshotEncoding {
+  /** Booleans, one bit per row */
+  SNAPSHOT_BITMAP = 0,
+
+  /** Enumeration IDs, one byte per row */
+  SNAPSHOT_UINT8,
+
+  /** Currency in cents, or dates as days since 1970-01-01 */
+  SNAPSHOT_INT32,
+
+  /**
+    Integers, stored as a base value for every block of rows plus a fixed
+    width offset from the base for each row. Sorted or clustered IDs only
+    need one or two bytes per row
+  */
+  SNAPSHOT_DELTA,
+
+  /**
+    Text, stored as a dictionary of distinct NULL-terminated strings plus
+    the index of each row's string
+  */
+  SNAPSHOT_DICTIONARY,
+
+  /** How many encodings there are, not a real encoding */
+  SNAPSHOT_NUM_ENCODINGS
+};
+
+/**
+  One column of an open Snapshot. Values are read straight from the mapped
+  file; nothing is decoded until it is asked for
+*/
+class SnapshotColumn {
+  friend class Snapshot;
+public:
+  /** Create an empty column */
+  SnapshotColumn() throw ();
+
+  /**
+    Get how this column is stored
+
+    @return The column's encoding
+  */
+  SnapshotEncoding get_encoding() const throw ();
+
+  /**
+    Get a row's value, for every encoding except SNAPSHOT_DICTIONARY
+
+    @param row The row to read
+
+    @return The row's value
+  */
+  int64 get_integer(const unsigned int row) const throw ();
+
+  /**
+    Get a row's value, for SNAPSHOT_DICTIONARY columns
+
+    @param row The row to read
+
+    @return The row's NULL-terminated value, which stays valid as long as the
+    snapshot is open
+  */
+  const char* get_string(const unsigned int row) const throw ();
+
+  /**
+    Get the dictionary index of a row's value, for SNAPSHOT_DICTIONARY
+    columns. Rows with equal values have equal indexes
+
+    @param row The row to read
+
+    @return The row's index into the dictionary
+  */
+  unsigned int get_index(const unsigned int row) const throw ();
+
+  /**
+    Get how many distinct values a SNAPSHOT_DICTIONARY column has
+
+    @return The number of dictionary entries
+  */
+  unsigned int dictionary_size() const throw ();
+
+  /**
+    Get a dictionary entry
+
+    @param index The index of the entry
+
+    @return The entry's NULL-terminated value
+  */
+  const char* dictionary_entry(const unsigned int index) const throw ();
+
+protected:
+  /** How the column is stored */
+  SnapshotEncoding encoding;
+
+  /** How many bytes each delta or dictionary index takes */
+  unsigned int width;
+
+  /** Per-row values, deltas or dictionary indexes */
+  const uint8* values;
+
+  /** Block bases for SNAPSHOT_DELTA, entry offsets for SNAPSHOT_DICTIONARY */
+  const uint8* index;
+
+  /** The dictionary's strings */
+  const uint8* strings;
+
+  /** How many dictionary entries there are */
+  unsigned int dictionary_count;
+};
+
+/**
+  A table's extracted data, stored as typed, encoded columns in a file which
+  is memory mapped when opened. Each column's location and encoding is kept
+  in an index at the end of the file, along with the table's definition, so
+  a snapshot can be opened and queried without the original data file or
+  database XML
+
+  Snapshots are written with Snapshot::write(), and a directory of them can
+  be opened with Database::from_snapshot()
+*/
+class Snapshot {
+public:
+  /**
+    Open a snapshot file
+
+    @param file_name The file to open
+  */
+  Snapshot(const std::string& file_name)
+    throw (Errors::FileReadError, Errors::FileParseError);
+
+  /** Unmap the file */
+  ~Snapshot() throw ();
+
+  /**
+    Get how many rows the snapshot holds
+
+    @return The number of rows
+  */
+  unsigned int row_count() const throw ();
+
+  /**
+    Get how many columns the snapshot holds
+
+    @return The number of columns
+  */
+  unsigned int column_count() const throw ();
+
+  /**
+    Get a column
+
+    @param index The index of the column
+
+    @return The column at index
+  */
+  const SnapshotColumn& column_at(const unsigned int index) const throw ();
+
+  /**
+    Get the definition of the table the snapshot was taken from
+
+    @return The table, with the same columns as the snapshot
+  */
+  Table get_table() const
+    throw (Errors::DuplicateEnumID, Errors::FileParseError);
+
+  /**
+    Format the snapshot's data as text, exactly as Table::extract_data()
+    would for the original data
+
+    @param table The table the snapshot was taken from
+    @param row_limit If this is greater than 0, limit the number of rows
+    extracted
+
+    @return The extracted data. This should be deleted.
+  */
+  const ResultSet* extract_data(const Table& table,
+    const unsigned int row_limit = 0) const throw (Errors::FileParseError);
+
+  /**
+    Put the snapshot's values back into rows of the original data file's
+    format, so they can be read with the Column accessors just like rows
+    loaded from the data file. Bytes which no column covers are left as 0
+
+    @param table The table the snapshot was taken from
+    @param row_limit If this is greater than 0, limit the number of rows
+    rebuilt
+    @param length Receives the total length of the rows
+
+    @return The rows, one after another. This should be deleted with
+    delete []
+  */
+  uint8* rebuild_rows(const Table& table, const unsigned int row_limit,
+    unsigned int& length) const throw (Errors::FileParseError);
+
+  /**
+    Write a snapshot of some rows
+
+    @param file_name The file to write, which will be replaced
+    @param rows The rows to store. Their table's definition is stored too
+  */
+  static void write(const std::string& file_name, const RowData& rows)
+    throw (Errors::FileWriteError);
+
+  /** The file extension used for snapshots */
+  static const std::string extension;
+
+  /** How many rows share each base value in SNAPSHOT_DELTA columns */
+  static const unsigned int block_size;
+
+protected:
+  /** Unmap the file, if it is mapped */
+  void unmap() throw ();
+
+  /** The name of the open file, for error messages */
+  const std::string file_name;
+
+  /** The mapped file */
+  uint8* data;
+
+  /** The size of the mapped file */
+  unsigned int data_length;
+
+  /** How many rows there are */
+  unsigned int rows;
+
+  /** The columns' index entries */
+  std::vector<SnapshotColumn> columns;
+
+  /** The table definition, as database XML */
+  std::string definition;
+
+private:
+  // Snapshots cannot be copied, since they own the mapping
+  Snapshot(const Snapshot&);
+  Snapshot& operator=(const Snapshot&);
+};
+
+} // namespace
+
+#endif // DRILLER_DATABASE_SNAPSHOT_H
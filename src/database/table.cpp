@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <sstream>
 #include "database.h"
+#include "snapshot.h"
 #include "misc.h"
 
 #ifdef __APPLE__
@@ -147,6 +148,14 @@ unsigned int Table::get_row_length() const throw(){
   return row_length;
 }
 
+void Table::set_snapshot_file(const std::string& _file_name) throw(){
+  snapshot_file = _file_name;
+}
+
+std::string Table::get_snapshot_file() const throw(){
+  return snapshot_file;
+}
+
 Column& Table::column_at(const unsigned int index) throw (){
   return columns.at(index);
 }
@@ -170,21 +179,91 @@ std::vector<Column> Table::get_columns() const throw(){
 const ResultSet* Table::extract_data(const unsigned int row_limit) const
   throw (Errors::FileReadError){
 
-  ExtractionState* state = load_data();
+  if (!snapshot_file.empty()){
+    try {
+      Snapshot snapshot(snapshot_file);
+      return snapshot.extract_data(*this, row_limit);
+    }
+
+    catch (const Errors::FileParseError&){
+      throw Errors::FileReadError(snapshot_file, EINVAL);
+    }
+  }
 
-  // Holds pointers to the start of each row
-  const uint8** row_locations;
+  const RowData* rows = load_rows(row_limit);
 
-  // Column count
+  // Row and column counts
+  const unsigned int row_count = rows->row_count();
   const unsigned int column_count = static_cast<const unsigned int>(
     columns.size());
 
+  ResultSet* result = new ResultSet(*this, row_count, column_count);
+  unsigned int format_buffer_size = 30;
+  char* format_buffer = new char[format_buffer_size];
+
+  // Run through the data, extracting rows into a ResultSet
+  std::vector<Column>::const_iterator column_iter = columns.begin();
+  for (unsigned int col_idx = 0; col_idx < column_count; col_idx++){
+    const Column& column = *column_iter;
+
+    for (unsigned int row_idx = 0; row_idx < row_count; row_idx++){
+      result->set_cell(row_idx, col_idx,
+        column.extract_data((*rows)[row_idx], format_buffer, format_buffer_size)
+      );
+    }
+
+    ++column_iter;
+  }
+
+  delete [] format_buffer;
+  delete rows;
+
+  return result;
+}
+
+RowData* Table::load_rows(const unsigned int row_limit) const
+  throw (Errors::FileReadError){
+
+  // Snapshots are rebuilt into rows like the data file's, which start at
+  // the beginning of the buffer
+  ExtractionState* state;
+  uint32 first_offset = data_offset;
+
+  if (!snapshot_file.empty()){
+    state = new ExtractionState;
+    state->allocated = true;
+    first_offset = 0;
+
+    try {
+      Snapshot snapshot(snapshot_file);
+      state->data = snapshot.rebuild_rows(*this, row_limit,
+        state->data_length);
+    }
+
+    catch (const Errors::FileParseError&){
+      delete state;
+      throw Errors::FileReadError(snapshot_file, EINVAL);
+    }
+
+    catch (...){
+      delete state;
+      throw;
+    }
+  }
+
+  else {
+    state = load_data();
+  }
+
+  // Holds pointers to the start of each row
+  const uint8** row_locations;
+
   // Calculate how many rows will be needed
   unsigned int row_count = 0;
 
   // If there are no variable-width columns
   if (row_length > 0){
-    row_count = (state->data_length - data_offset) / row_length;
+    row_count = (state->data_length - first_offset) / row_length;
 
     // Clamp the row count, if needed
     if (row_limit)
@@ -196,7 +275,7 @@ const ResultSet* Table::extract_data(const unsigned int row_limit) const
 
     // Calculate the location of each row, and place it into the location array
     for (unsigned int row = 0; row < row_count; row++){
-      row_locations[row] = state->data + data_offset + (row_length * row);
+      row_locations[row] = state->data + first_offset + (row_length * row);
     }
   }
 
@@ -205,11 +284,35 @@ const ResultSet* Table::extract_data(const unsigned int row_limit) const
     // FIXME: Dentrix specific
     row_count = 0;
 
-    // First pass to determine the row count
-    uint32 current_offset = data_offset;
+    // Each row holds its own length 2 bytes in, and must be long enough to
+    // reach every variable-width column
+    uint32 min_row_length = 6;
+    for (unsigned int ii = 0; ii < columns.size(); ii++){
+      if (columns[ii].get_type() == COLUMN_VARSTRING &&
+        columns[ii].get_offset() > min_row_length){
+
+        min_row_length = columns[ii].get_offset();
+      }
+    }
+
+    // First pass to determine the row count, and check that every row lies
+    // within the file
+    uint32 current_offset = first_offset;
     while (current_offset < state->data_length){
+      const uint32 remaining = state->data_length - current_offset;
+      const uint32 length = (remaining < 6)? 0 :
+        Column::get_uint32(state->data + current_offset + 2);
+
+      if (length < min_row_length || length > remaining){
+        unload_data(state);
+        std::stringstream reason;
+        reason << "Corrupt varstring row at offset " << current_offset;
+        throw Errors::CorruptFileError(Database::get_data_path() + "/" +
+          file_name, reason.str());
+      }
+
       ++row_count;
-      current_offset += Column::get_uint32(state->data + current_offset + 2);
+      current_offset += length;
     }
 
     // Clamp the row count, if needed
@@ -221,7 +324,7 @@ const ResultSet* Table::extract_data(const unsigned int row_limit) const
     row_locations = new const uint8*[row_count];
 
     // Second pass, to insert row locations into the location array
-    current_offset = data_offset;
+    current_offset = first_offset;
     for (unsigned int row = 0; current_offset < state->data_length &&
       row < row_count; row++){
 
@@ -230,29 +333,7 @@ const ResultSet* Table::extract_data(const unsigned int row_limit) const
     }
   }
 
-  ResultSet* result = new ResultSet(*this, row_count, column_count);
-  unsigned int format_buffer_size = 30;
-  char* format_buffer = new char[format_buffer_size];
-
-  // Run through the data, extracting rows into a ResultSet
-  std::vector<Column>::const_iterator column_iter = columns.begin();
-  for (unsigned int col_idx = 0; col_idx < column_count; col_idx++){
-    const Column& column = *column_iter;
-
-    for (unsigned int row_idx = 0; row_idx < row_count; row_idx++){
-      result->set_cell(row_idx, col_idx,
-        column.extract_data(row_locations[row_idx], format_buffer, format_buffer_size)
-      );
-    }
-
-    ++column_iter;
-  }
-
-  delete [] format_buffer;
-  delete [] row_locations;
-
-  unload_data(state);
-  return result;
+  return new RowData(*this, state, row_locations, row_count);
 }
 
 Table::ExtractionState* Table::load_data() const throw (Errors::FileReadError){
@@ -318,6 +399,12 @@ Table::ExtractionState* Table::load_data() const throw (Errors::FileReadError){
 }
 
 void Table::unload_data(ExtractionState* state) const throw () {
+  if (state->allocated){
+    delete[] state->data;
+    delete state;
+    return;
+  }
+
 // On UNIX-based systems, remove the memory mapping to the file
 #ifdef __unix
   munmap(state->data, state->data_length);
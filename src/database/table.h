@@ -34,10 +34,13 @@
 
 namespace Driller {
 
+class RowData;
+
 /**
   Contains a single table in the database
 */
 class Table {
+  friend class RowData;
 public:
   /**
     Create a new table
@@ -139,6 +142,20 @@ public:
   */
   unsigned int get_row_length() const throw ();
 
+  /**
+    Read this table's data from a snapshot instead of its data file
+
+    @param file_name The snapshot's full path, or "" to use the data file
+  */
+  void set_snapshot_file(const std::string& file_name) throw ();
+
+  /**
+    Get the snapshot this table's data is read from
+
+    @return The snapshot's full path, or "" if the data file is used
+  */
+  std::string get_snapshot_file() const throw ();
+
   /**
     Find the column at the specified index, and return it
 
@@ -183,6 +200,19 @@ public:
   const ResultSet* extract_data(const unsigned int row_limit = 0) const
     throw(Errors::FileReadError);
 
+  /**
+    Load the table's rows without decoding them, for reading typed values
+    with the Column accessors. For tables read from a snapshot, the rows are
+    rebuilt in the data file's format from the snapshot's values
+
+    @param row_limit If this is greater than 0, limit the number of rows
+    loaded from the table
+
+    @return The loaded rows. This should be deleted.
+  */
+  RowData* load_rows(const unsigned int row_limit = 0) const
+    throw(Errors::FileReadError);
+
 protected:
   /**
     Columns in the table
@@ -211,15 +241,28 @@ protected:
   */
   unsigned int row_length;
 
+  /**
+    If not empty, the snapshot data is extracted from instead of file_name
+  */
+  std::string snapshot_file;
+
   /**
     Used for storing temporary data for data extraction
   */
   struct ExtractionState {
+    ExtractionState() throw ():
+      data_length(0),
+      data(NULL),
+      allocated(false){}
+
     /** The size of the loaded file */
     unsigned int data_length;
 
     /** The file's data */
     uint8* data;
+
+    /** Whether data was allocated with new [], rather than loaded */
+    bool allocated;
   };
 
   /**
@@ -0,0 +1,155 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * table_cost.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "table_cost.h"
+#include "database.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <utility>
+
+namespace Driller {
+
+/** The cost of each row regardless of its columns, such as its newline */
+static const double row_overhead = 8;
+
+/**
+  Estimate the cost of extracting one value of a column
+
+  @param column The column
+
+  @return The estimated cost
+*/
+static double column_cost(const Column& column) throw (){
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_ENUM:
+      return 2;
+
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+      return 4;
+
+    case COLUMN_CURRENCY:
+      return 6;
+
+    case COLUMN_DATE:
+      return 8;
+
+    case COLUMN_PHONE:
+      return 12;
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING:
+      return 2 + column.get_length();
+
+    case COLUMN_BLOB:
+      return 2 + (3 * column.get_length());
+
+    default:
+      return 4;
+  }
+}
+
+unsigned int estimate_row_count(const Table& table) throw (){
+  const std::string file_name = table.get_snapshot_file().empty() ?
+    Database::get_data_path() + "/" + table.get_file_name() :
+    table.get_snapshot_file();
+
+  struct stat info;
+  if (stat(file_name.c_str(), &info) != 0){
+    return 0;
+  }
+
+  // Snapshots and tables of varying row length are measured by the space
+  // their columns take
+  unsigned int row_length = table.get_row_length();
+  unsigned int data_offset = table.get_data_offset();
+  if (!table.get_snapshot_file().empty() || !row_length){
+    data_offset = 0;
+    row_length = 0;
+    for (unsigned int col = 0; col < table.column_count(); col++){
+      const Column& column = table.column_at(col);
+      row_length = std::max(row_length,
+        column.get_offset() + column.get_length());
+    }
+    row_length = std::max(row_length, 1u);
+  }
+
+  const unsigned long size = static_cast<unsigned long>(info.st_size);
+  if (size <= data_offset){
+    return 0;
+  }
+
+  return static_cast<unsigned int>((size - data_offset) / row_length);
+}
+
+double estimate_row_cost(const Table& table) throw (){
+  double cost = row_overhead;
+  for (unsigned int col = 0; col < table.column_count(); col++){
+    cost += column_cost(table.column_at(col));
+  }
+
+  return cost;
+}
+
+double estimate_table_cost(const Table& table, const unsigned int row_limit)
+  throw (){
+
+  unsigned int rows = estimate_row_count(table);
+  if (row_limit && rows > row_limit){
+    rows = row_limit;
+  }
+
+  // Even an empty table costs something to create
+  return (static_cast<double>(rows) + 1) * estimate_row_cost(table);
+}
+
+/** Orders (cost, index) pairs by falling cost, then rising index */
+static bool more_costly(const std::pair<double, unsigned int>& a,
+  const std::pair<double, unsigned int>& b) throw (){
+
+  return (a.first != b.first) ? a.first > b.first : a.second < b.second;
+}
+
+std::vector<unsigned int> schedule_by_cost(const std::vector<Table>& tables,
+  const unsigned int row_limit) throw (){
+
+  std::vector<std::pair<double, unsigned int> > costs;
+  for (unsigned int ii = 0; ii < tables.size(); ii++){
+    costs.push_back(std::make_pair(
+      estimate_table_cost(tables[ii], row_limit), ii));
+  }
+
+  std::sort(costs.begin(), costs.end(), more_costly);
+
+  std::vector<unsigned int> order;
+  for (unsigned int ii = 0; ii < costs.size(); ii++){
+    order.push_back(costs[ii].second);
+  }
+
+  return order;
+}
+
+} // namespace
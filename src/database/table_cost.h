@@ -0,0 +1,80 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * table_cost.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_DATABASE_TABLE_COST_H
+#define DRILLER_DATABASE_TABLE_COST_H
+
+#include <vector>
+#include "table.h"
+
+namespace Driller {
+
+/**
+  Estimate how many rows a table has from the size of its file, without
+  reading it. Tables with rows of varying length are estimated from the
+  space their columns take, so they may be well off
+
+  @param table The table
+
+  @return The estimated row count, or 0 if the file can't be found
+*/
+unsigned int estimate_row_count(const Table& table) throw ();
+
+/**
+  Estimate the relative cost of extracting a single row of a table, from its
+  columns' types and lengths. Text costs for each character, since it is
+  copied and escaped, and blobs cost more again for being written as hex
+
+  @param table The table
+
+  @return The estimated cost, in arbitrary units
+*/
+double estimate_row_cost(const Table& table) throw ();
+
+/**
+  Estimate the relative cost of extracting a whole table
+
+  @param table The table
+  @param row_limit If this is greater than 0, the most rows that will be
+  extracted
+
+  @return The estimated cost, in the units of estimate_row_cost()
+*/
+double estimate_table_cost(const Table& table,
+  const unsigned int row_limit = 0) throw ();
+
+/**
+  Order tables so that the most costly come first. Handing tables to workers
+  in this order, longest processing time first, keeps a large table from
+  being started last while every other worker sits idle
+
+  @param tables The tables
+  @param row_limit If this is greater than 0, the most rows that will be
+  extracted from each table
+
+  @return The index of each table, most costly first. Tables of equal cost
+  keep their order
+*/
+std::vector<unsigned int> schedule_by_cost(const std::vector<Table>& tables,
+  const unsigned int row_limit = 0) throw ();
+
+} // namespace
+
+#endif // DRILLER_DATABASE_TABLE_COST_H
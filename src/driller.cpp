@@ -20,9 +20,19 @@
 
 #include "driller.h"
 #include "binreloc.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include "batch_extraction.h"
 #include "file_sink.h"
+#include "json_lines_sink.h"
+#include "parquet_sink.h"
+#include "pipe_sink.h"
+#include "snapshot_sink.h"
+#include "sql_script_sink.h"
+#include "threads.h"
+#include "timer.h"
 #include "gui.h"
 #include <errno.h>
 
@@ -31,17 +41,74 @@
 #endif
 
 #if ENABLE_MYSQL
-#include "mysql_sink.h"
+#include "mysql_pool_sink.h"
+#endif
+
+#if ENABLE_POSTGRESQL
+#include "postgresql_sink.h"
+#endif
+
+#if ENABLE_SQLITE
+#include "sqlite_sink.h"
 #endif
 
 using namespace Driller;
 
-// Global settings for connecting to MySQL, if needed
+// Where to extract to: file, snapshot, parquet or json for a directory of
+// files, sql for a script to load into MySQL later, pipe for rows streamed
+// to standard output or a named pipe, or the database mysql, postgresql or
+// sqlite
+std::string sink_name = "mysql";
+
+// The directory files are written to, the file a script is written to, or
+// the pipe rows are streamed to
+std::string output_file;
+
+// How files and scripts are compressed
+Compression output_compression = COMPRESSION_NONE;
+
+// The most rows and roughly the most bytes in each shard of a table written
+// by the file sink, or 0 to write each table to a single file
+unsigned int shard_rows = 0,
+  shard_bytes = 0;
+
+// Whether a pipe carries several tables in frames, and whether its buffers
+// are spliced into it rather than copied
+bool pipe_framed = false,
+  pipe_splice = false;
+
+// Which tables to extract and which to skip, by name. If none are listed,
+// every table is extracted
+std::vector<std::string> included_tables, excluded_tables;
+
+// The most rows to extract from each table, or 0 for every row, and how
+// many tables to extract at once, or 0 if not given. If fewer jobs are
+// given than the most, the number is tuned between them while extracting
+unsigned int row_limit = 0,
+  jobs = 0,
+  min_jobs = 0;
+
+// How many worker processes to extract with, or 0 to use threads, and how
+// many times to try a job whose worker crashes
+unsigned int processes = 0,
+  process_attempts = ProcessPool::default_max_attempts;
+
+// Global settings for connecting to MySQL, if needed. PostgreSQL uses the
+// host, username, password, database, port and connections too, and SQLite
+// uses the database as the name of its file
 std::string mysql_host = "localhost",
   mysql_username,
   mysql_password,
-  mysql_database;
-unsigned int mysql_port;
+  mysql_database,
+  mysql_load_method = "prepared",
+  mysql_upsert_key;
+unsigned int mysql_port,
+  mysql_connections = 1,
+  mysql_min_connections = 1,
+  mysql_in_flight = 2;
+bool mysql_staging = false,
+  mysql_resumable = false,
+  mysql_presort = false;
 
 // Database schema files to extract
 std::vector<std::string> files;
@@ -156,6 +223,49 @@ void save_dentrix_path(){
   file.close();
 }
 
+/**
+  Split a comma separated list of names, as given to --table and --exclude
+
+  @param value The list
+  @param names Receives each name
+*/
+void split_names(const std::string& value, std::vector<std::string>& names){
+  std::string::size_type start = 0;
+  while (start <= value.size()){
+    std::string::size_type end = value.find(',', start);
+    if (end == std::string::npos){
+      end = value.size();
+    }
+
+    if (end > start){
+      names.push_back(value.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+}
+
+/**
+  Parse a count which may be a range, such as 4 or 2-8, as given to --jobs
+  and --connections
+
+  @param value The count or range
+  @param least Receives the smaller end, or the count
+  @param most Receives the larger end, or the count
+*/
+void parse_count_range(const std::string& value, unsigned int& least,
+  unsigned int& most){
+
+  char* end;
+  least = most = strtoul(value.c_str(), &end, 10);
+  if (*end == '-'){
+    most = strtoul(end + 1, &end, 10);
+  }
+
+  if (least > most){
+    std::swap(least, most);
+  }
+}
+
 void parse_option(std::string option){
   if (option.substr(0, 2) == "--"){
     option.erase(0, 2);
@@ -172,7 +282,82 @@ void parse_option(std::string option){
     key = option.substr(0, split_index);
     value = option.substr(split_index + 1);
 
-    if (key == "host"){
+    if (key == "sink"){
+      if (value == "file" || value == "snapshot" || value == "parquet" ||
+        value == "json" || value == "sql" || value == "pipe" ||
+        value == "mysql" || value == "postgresql" || value == "sqlite"){
+        sink_name = value;
+      }
+
+      else {
+        std::cerr << "WARNING: unknown sink '" << value << "'\n";
+      }
+    }
+
+    else if (key == "output"){
+      output_file = value;
+    }
+
+    else if (key == "compression"){
+      bool known = false;
+      for (unsigned int ii = 0; ii < COMPRESSION_NUM_TYPES; ii++){
+        if (value == compression_strings[ii]){
+          output_compression = static_cast<Compression>(ii);
+          known = true;
+        }
+      }
+
+      if (!known){
+        std::cerr << "WARNING: unknown compression '" << value << "'\n";
+      }
+    }
+
+    else if (key == "shard-rows"){
+      char* unused;
+      shard_rows = strtoul(value.c_str(), &unused, 10);
+    }
+
+    else if (key == "shard-bytes"){
+      char* unused;
+      shard_bytes = strtoul(value.c_str(), &unused, 10);
+    }
+
+    else if (key == "table"){
+      split_names(value, included_tables);
+    }
+
+    else if (key == "exclude"){
+      split_names(value, excluded_tables);
+    }
+
+    else if (key == "rows"){
+      char* unused;
+      row_limit = strtoul(value.c_str(), &unused, 10);
+    }
+
+    else if (key == "jobs"){
+      parse_count_range(value, min_jobs, jobs);
+    }
+
+    else if (key == "processes"){
+      char* unused;
+      processes = strtoul(value.c_str(), &unused, 10);
+    }
+
+    else if (key == "attempts"){
+      char* unused;
+      process_attempts = strtoul(value.c_str(), &unused, 10);
+    }
+
+    else if (key == "framed"){
+      pipe_framed = (value == "true");
+    }
+
+    else if (key == "splice"){
+      pipe_splice = (value == "true");
+    }
+
+    else if (key == "host"){
       mysql_host = value;
     }
 
@@ -193,6 +378,41 @@ void parse_option(std::string option){
       mysql_port = strtoul(value.c_str(), &unused, 10);
     }
 
+    else if (key == "connections"){
+      parse_count_range(value, mysql_min_connections, mysql_connections);
+    }
+
+    else if (key == "in-flight"){
+      char* unused;
+      mysql_in_flight = strtoul(value.c_str(), &unused, 10);
+    }
+
+    else if (key == "staging"){
+      mysql_staging = (value == "true");
+    }
+
+    else if (key == "resume"){
+      mysql_resumable = (value == "true");
+    }
+
+    else if (key == "upsert-key"){
+      mysql_upsert_key = value;
+    }
+
+    else if (key == "presort"){
+      mysql_presort = (value == "true");
+    }
+
+    else if (key == "load"){
+      if (value == "insert" || value == "prepared" || value == "infile"){
+        mysql_load_method = value;
+      }
+
+      else {
+        std::cerr << "WARNING: unknown load method '" << value << "'\n";
+      }
+    }
+
     else {
       std::cerr << "WARNING: unknown option '" << key << "'\n";
     }
@@ -204,28 +424,384 @@ void parse_option(std::string option){
   }
 }
 
-int run_text_version(int argc, char** argv){
-  // Parse commandline arguments
-  for (int i = 1; i < argc; i++){
-    parse_option(argv[i]);
+/**
+  Print the command line options to standard output
+*/
+void print_usage(){
+  std::cout <<
+    "Usage: driller [OPTION]... SCHEMA...\n"
+    "Extract the tables described by each SCHEMA file.\n"
+    "\n"
+    "  --sink=SINK          file, snapshot, parquet, json, sql, pipe, mysql,\n"
+    "                       postgresql or sqlite (default mysql)\n"
+    "  --output=PATH        the directory for file, snapshot, parquet and\n"
+    "                       json; the script for sql; the file or named pipe\n"
+    "                       for pipe, or - for standard output (the default)\n"
+    "  --compression=TYPE   none, gzip or zstd, for file, json, parquet and\n"
+    "                       sql\n"
+    "  --shard-rows=N       split each table written by file into shards of\n"
+    "                       at most N rows, listed in TABLE.manifest\n"
+    "  --shard-bytes=N      split them into shards of about N bytes\n"
+    "  --table=NAME[,...]   only extract these tables\n"
+    "  --exclude=NAME[,...] never extract these tables\n"
+    "  --rows=N             extract at most N rows from each table\n"
+    "  --jobs=N             extract N tables, or parts of large ones, at once\n"
+    "  --jobs=MIN-MAX       tune the number of jobs by throughput\n"
+    "  --processes=N        run jobs in N worker processes instead of threads\n"
+    "  --attempts=N         try a job N times if its worker process crashes\n"
+    "  --framed=true        frame each table, to stream several to a pipe\n"
+    "  --splice=true        splice buffers into a pipe instead of copying\n"
+    "  --host, --port, --username, --password, --database=VALUE\n"
+    "                       where mysql and postgresql connect to; sqlite\n"
+    "                       takes --database as its file\n"
+    "  --connections=N      MySQL connections for each job to split tables\n"
+    "                       over; PostgreSQL takes this as the default --jobs\n"
+    "  --connections=MIN-MAX\n"
+    "                       tune how many MySQL connections insert at once\n"
+    "  --load=METHOD        insert, prepared or infile, for MySQL\n"
+    "  --in-flight=N, --staging=true, --resume=true, --upsert-key=COLUMN,\n"
+    "  --presort=true       further MySQL loading options\n"
+    "\n"
+    "A summary is printed as a line of JSON once every table has been tried,\n"
+    "to standard error if rows are being streamed to standard output. The\n"
+    "exit status is 0 if every table was extracted, 1 if extraction couldn't\n"
+    "start, and 2 if any table or schema failed.\n";
+}
+
+#if ENABLE_MYSQL || ENABLE_POSTGRESQL || ENABLE_SQLITE
+/**
+  Print how long a sink spent loading rows and building indexes, to standard
+  error so standard output only holds the summary
+
+  @param label What to call the sink
+  @param connection The sink, such as a MySQLSink or SQLiteSink
+*/
+template <typename Sink>
+void report_load_times(const std::string& label, const Sink& connection){
+
+  const double seconds = connection.get_send_time();
+
+  std::cerr << label << ": " << connection.get_rows_sent() << " rows in "
+            << seconds << " s";
+  if (seconds > 0){
+    std::cerr << " (" << static_cast<unsigned int>(
+      connection.get_rows_sent() / seconds) << " rows/s)";
   }
+  std::cerr << ", indexes built in " << connection.get_index_time()
+            << " s\n";
+}
+#endif
+
+#if ENABLE_MYSQL
+/**
+  Get the load method chosen with --mysql-load-method
+
+  @return How rows are sent to the server
+*/
+MySQLLoadMethod get_mysql_load_method(){
+  if (mysql_load_method == "insert"){
+    return MYSQL_LOAD_INSERT;
+  }
+
+  else if (mysql_load_method == "infile"){
+    return MYSQL_LOAD_INFILE;
+  }
+
+  return MYSQL_LOAD_PREPARED;
+}
+
+/**
+  Apply the MySQL loading options to a sink
+
+  @param sink A MySQLSink or MySQLPoolSink
+
+  @return The sink
+*/
+template <typename Sink>
+Sink* configure_mysql(Sink* sink){
+  sink->set_batches_in_flight(mysql_in_flight);
+  sink->set_staging(mysql_staging);
+  sink->set_resumable(mysql_resumable);
+  sink->set_upsert_key(mysql_upsert_key);
+  sink->set_presort(mysql_presort);
+  return sink;
+}
+#endif
+
+/**
+  Creates the sink chosen on the command line, once for each job
+*/
+class CommandLineSinks : public SinkFactory {
+public:
+  CommandLineSinks() throw ():
+    workers(1),
+    finished(0){}
+
+  DataSink* create_sink(const unsigned int _workers){
+    workers = _workers;
+
+    // Each job's sink compresses with its share of the processors
+    const unsigned int threads = std::max(1u,
+      ThreadPool::processor_count() / workers);
+
+    if (sink_name == "file"){
+      FileSink* sink = new FileSink(output_file);
+      sink->set_compression(output_compression);
+      sink->set_threads(threads);
+      sink->set_shard_rows(shard_rows);
+      sink->set_shard_bytes(shard_bytes);
+      return sink;
+    }
+
+    if (sink_name == "snapshot"){
+      return new SnapshotSink(output_file);
+    }
+
+    if (sink_name == "parquet"){
+      ParquetSink* sink = new ParquetSink(output_file);
+      sink->set_compression(output_compression);
+      return sink;
+    }
+
+    if (sink_name == "json"){
+      JsonLinesSink* sink = new JsonLinesSink(output_file);
+      sink->set_compression(output_compression);
+      sink->set_threads(threads);
+      return sink;
+    }
+
+    if (sink_name == "sql"){
+      SQLScriptSink* sink = new SQLScriptSink(output_file);
+      sink->set_compression(output_compression);
+      sink->set_threads(threads);
+      return sink;
+    }
+
+    if (sink_name == "pipe"){
+      PipeSink* sink = new PipeSink(output_file.empty() ? "-" : output_file);
+      sink->set_framed(pipe_framed);
+      sink->set_splice(pipe_splice);
+      return sink;
+    }
+
+    if (sink_name == "postgresql"){
+#if ENABLE_POSTGRESQL
+      return new PostgreSQLSink(mysql_host,
+        mysql_username,
+        mysql_password,
+        mysql_database,
+        mysql_port);
+#else
+      throw Errors::GenericError(
+        "Driller was built without PostgreSQL support");
+#endif
+    }
+
+    if (sink_name == "sqlite"){
+#if ENABLE_SQLITE
+      return new SQLiteSink(mysql_database);
+#else
+      throw Errors::GenericError("Driller was built without SQLite support");
+#endif
+    }
 
 #if ENABLE_MYSQL
-  if (files.size() > 0){
-    // Construct a MySQL data sink
-    MySQLSink sink(mysql_host,
+    // Load tables, and ranges of large tables, over several connections
+    if (mysql_connections > 1){
+      MySQLPoolSink* sink = configure_mysql(new MySQLPoolSink(mysql_host,
+        mysql_username,
+        mysql_password,
+        mysql_database,
+        mysql_port,
+        mysql_connections,
+        get_mysql_load_method()));
+      sink->set_adaptive(mysql_min_connections, &std::cerr);
+      return sink;
+    }
+
+    return configure_mysql(new MySQLSink(mysql_host,
       mysql_username,
       mysql_password,
       mysql_database,
-      mysql_port);
+      mysql_port,
+      get_mysql_load_method()));
+#else
+    throw Errors::GenericError("Driller was built without MySQL support");
+#endif
+  }
+
+  void finish_sink(DataSink* sink){
+    ++finished;
 
-    for (unsigned int i = 0; i < files.size(); i++){
-      sink.output_database(Database::from_file(files.at(i)));
+    if (SQLScriptSink* script = dynamic_cast<SQLScriptSink*>(sink)){
+      script->close();
+    }
+
+    if (PipeSink* pipe = dynamic_cast<PipeSink*>(sink)){
+      pipe->close();
+    }
+
+#if ENABLE_MYSQL
+    // Report how much each connection managed, to help size the pool
+    if (MySQLPoolSink* pool = dynamic_cast<MySQLPoolSink*>(sink)){
+      for (unsigned int i = 0; i < pool->connection_count(); i++){
+        std::stringstream label;
+        label << job_label() << "Connection " << (i + 1);
+        report_load_times(label.str(), pool->connection_at(i));
+      }
+    }
+
+    if (MySQLSink* mysql = dynamic_cast<MySQLSink*>(sink)){
+      report_load_times(job_label() + "MySQL", *mysql);
     }
-  }
 #endif
 
-  return 0;
+#if ENABLE_POSTGRESQL
+    if (PostgreSQLSink* postgresql = dynamic_cast<PostgreSQLSink*>(sink)){
+      report_load_times(job_label() + "PostgreSQL", *postgresql);
+    }
+#endif
+
+#if ENABLE_SQLITE
+    if (SQLiteSink* sqlite = dynamic_cast<SQLiteSink*>(sink)){
+      report_load_times(job_label() + "SQLite", *sqlite);
+    }
+#endif
+  }
+
+  unsigned int max_workers() const throw (){
+    // These sinks all write to a single file or stream
+    if (sink_name == "sql" || sink_name == "pipe" || sink_name == "sqlite"){
+      return 1;
+    }
+
+    return 0;
+  }
+
+protected:
+  /**
+    Get what to call the sink being finished, when there are several
+
+    @return The job's number and a space, or nothing for a single job
+  */
+  std::string job_label() const {
+    if (workers < 2){
+      return "";
+    }
+
+    std::stringstream label;
+    label << "Job " << finished << ", ";
+    return label.str();
+  }
+
+  /** How many jobs there are */
+  unsigned int workers;
+
+  /** How many sinks have been finished */
+  unsigned int finished;
+};
+
+int run_text_version(int argc, char** argv){
+  // Parse commandline arguments
+  for (int i = 1; i < argc; i++){
+    if (std::string(argv[i]) == "--help"){
+      print_usage();
+      return 0;
+    }
+
+    parse_option(argv[i]);
+  }
+
+  if (files.empty()){
+    std::cerr << "ERROR: no schema files were given; see --help\n";
+    return 1;
+  }
+
+  if (output_file.empty() && (sink_name == "file" ||
+    sink_name == "snapshot" || sink_name == "parquet" ||
+    sink_name == "json")){
+
+    std::cerr << "ERROR: --output must name the directory to write to\n";
+    return 1;
+  }
+
+  if (output_file.empty() && sink_name == "sql"){
+    std::cerr << "ERROR: --output must name the script to write\n";
+    return 1;
+  }
+
+  if (mysql_database.empty() && sink_name == "sqlite"){
+    std::cerr << "ERROR: --database must name the SQLite file\n";
+    return 1;
+  }
+
+  // PostgreSQL has always loaded each table on a connection of its own, so
+  // its connection count stands in for the job count
+  if (!jobs){
+    jobs = (sink_name == "postgresql") ? mysql_connections : 1;
+    min_jobs = (sink_name == "postgresql") ? mysql_min_connections : 1;
+  }
+
+  // Tuning decisions go with the other diagnostics, away from the summary
+  CommandLineSinks factory;
+  BatchExtraction batch(factory, jobs);
+  batch.set_adaptive(min_jobs, &std::cerr);
+  batch.set_processes(processes, process_attempts);
+  batch.set_row_limit(row_limit);
+
+  for (unsigned int i = 0; i < included_tables.size(); i++){
+    batch.include_table(included_tables[i]);
+  }
+
+  for (unsigned int i = 0; i < excluded_tables.size(); i++){
+    batch.exclude_table(excluded_tables[i]);
+  }
+
+  Timer timer;
+  unsigned int streamed_tables = 0;
+  for (unsigned int i = 0; i < files.size(); i++){
+    Database db;
+    try {
+      db = Database::from_file(files.at(i));
+    }
+
+    // A broken schema doesn't stop the others being extracted
+    catch (const Errors::BaseError& error){
+      batch.record_error(files.at(i) + ": " + error.error_message());
+      continue;
+    }
+
+    if (sink_name == "pipe" && !pipe_framed){
+      const unsigned int previous = streamed_tables;
+      for (unsigned int ii = 0; ii < db.table_count(); ii++){
+        if (batch.is_selected(db.table_at(ii).get_name())){
+          ++streamed_tables;
+        }
+      }
+
+      if (previous < 2 && streamed_tables > 1){
+        std::cerr << "WARNING: tables will be streamed back to back; use "
+                  << "--framed=true to tell them apart\n";
+      }
+    }
+
+    batch.extract(db);
+  }
+
+  batch.finish();
+
+  if (batch.get_worker_restarts()){
+    std::cerr << "WARNING: " << batch.get_worker_restarts()
+              << " worker process(es) died and were replaced\n";
+  }
+
+  // Rows may be streaming to standard output, which must get nothing else
+  const bool rows_on_stdout = (sink_name == "pipe" &&
+    (output_file.empty() || output_file == "-"));
+  (rows_on_stdout ? std::cerr : std::cout) <<
+    batch.summary(timer.elapsed()) << "\n";
+
+  return batch.failure_count() ? 2 : 0;
 }
 
 int main(int argc, char** argv){
@@ -234,9 +810,23 @@ int main(int argc, char** argv){
 
   Database::set_data_path(find_dentrix_path());
 
-  int return_code;
+  int return_code = 0;
   if (argc > 1) {
-    return_code = run_text_version(argc, argv);
+    // Errors which stop extraction from starting, such as a refused
+    // connection, are reported rather than left to abort
+    try {
+      return_code = run_text_version(argc, argv);
+    }
+
+    catch (const Errors::BaseError& error){
+      std::cerr << "ERROR: " << error.error_message() << "\n";
+      return_code = 1;
+    }
+
+    catch (const std::exception& error){
+      std::cerr << "ERROR: " << error.what() << "\n";
+      return_code = 1;
+    }
   }
   else {
 #if ENABLE_GUI
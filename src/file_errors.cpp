@@ -20,6 +20,7 @@
 
 #include "file_errors.h"
 #include <errno.h>
+#include <cstring>
 
 namespace Errors {
 
@@ -35,6 +36,10 @@ std::string FileError::error_message() const throw(){
   return message;
 }
 
+int FileError::get_error_code() const throw(){
+  return error_code;
+}
+
 FileReadError::FileReadError(const std::string& _file, const int _error_code)
   throw(): FileError(_file, _error_code){}
 
@@ -46,6 +51,14 @@ std::string FileReadError::error_message() const throw(){
   return message;
 }
 
+CorruptFileError::CorruptFileError(const std::string& _file,
+  const std::string& _reason) throw():
+  FileReadError(_file, 0), reason(_reason){}
+
+std::string CorruptFileError::error_message() const throw(){
+  return "Error reading " + file + ": " + reason;
+}
+
 FileWriteError::FileWriteError(const std::string& _file, const int _error_code)
   throw(): FileError(_file, _error_code){}
 
@@ -49,6 +49,14 @@ public:
   */
   virtual std::string error_message() const throw();
 
+  /**
+    Get the error code, so the error can be reported again for another file
+    or on another thread
+
+    @return The error code, or 0 if there isn't one
+  */
+  int get_error_code() const throw();
+
 protected:
   /**
     The file this error involves
@@ -85,6 +93,35 @@ public:
   virtual std::string error_message() const throw();
 };
 
+/**
+  Class for files which could be read, but hold data which makes no sense
+*/
+class CorruptFileError : public FileReadError {
+public:
+  /**
+    Default constructor
+
+    @param file The file holding the corrupt data
+    @param reason What is wrong with the data
+  */
+  CorruptFileError(const std::string& file, const std::string& reason)
+    throw();
+
+  /** Empty destructor */
+  virtual ~CorruptFileError() throw() {}
+
+  /**
+    Returns an error message stating the file is corrupt, and why
+
+    @return A message suitable for being shown to a user
+  */
+  virtual std::string error_message() const throw();
+
+protected:
+  /** What is wrong with the data */
+  const std::string reason;
+};
+
 /**
   Class for errors during file output
 */
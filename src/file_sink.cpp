@@ -19,38 +19,366 @@
 */
 
 #include "file_sink.h"
+#include "output_file.h"
+#include "threads.h"
 #include <errno.h>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
 
 namespace Driller {
 
+/**
+  Write a range of rows from a result set, tab-delimited
+
+  @param file The file to write to
+  @param result The extracted data
+  @param first_row The first row to write
+  @param row_count How many rows to write
+*/
+static void write_rows(OutputFile& file, const ResultSet* result,
+  const unsigned int first_row, const unsigned int row_count)
+  throw (Errors::FileWriteError) {
+
+  std::string line;
+  for (unsigned int row = first_row; row < first_row + row_count; row++){
+    const char** data = (*result)[row];
+    line.clear();
+    for (unsigned int col = 0; col < result->column_count(); col++){
+      line += data[col];
+      line += '\t';
+    }
+    line += '\n';
+    file.write(line);
+  }
+}
+
+/**
+  Writes a single shard of a table
+*/
+class ShardJob : public Job {
+public:
+  ShardJob(
+    const std::string& _file_name,
+    const Compression _compression,
+    const ResultSet* _result,
+    const unsigned int _first_row,
+    const unsigned int _row_count) throw ():
+
+    file_name(_file_name),
+    compression(_compression),
+    result(_result),
+    first_row(_first_row),
+    row_count(_row_count),
+    bytes(0),
+    checksum(0),
+    error_code(0){}
+
+  virtual ~ShardJob() throw () {}
+
+  void run() {
+    // Each shard is already one unit of parallel work, so compress it on
+    // this thread
+    try {
+      OutputFile file(file_name, compression);
+      write_rows(file, result, first_row, row_count);
+      file.close();
+
+      bytes = file.bytes_written();
+      checksum = file.checksum();
+    }
+
+    // The pool only keeps the message, so keep the reason for the error
+    catch (Errors::FileWriteError& e){
+      error_code = e.get_error_code();
+      throw;
+    }
+  }
+
+  const std::string file_name;
+  const Compression compression;
+  const ResultSet* result;
+  const unsigned int first_row;
+  const unsigned int row_count;
+
+  /** Size of the finished shard */
+  unsigned long bytes;
+
+  /** CRC-32 of the finished shard */
+  unsigned long checksum;
+
+  /** The errno of a failed write, or 0 */
+  int error_code;
+};
+
+/**
+  Get the name of one shard of a table
+
+  @param base_name The table's file name, without an extension
+  @param shard The shard's number
+  @param compression How the shard is compressed
+
+  @return The shard's file name, such as "People.0001.txt.gz"
+*/
+static std::string shard_file_name(const std::string& base_name,
+  const unsigned int shard, const Compression compression) throw () {
+
+  char suffix[32];
+  sprintf(suffix, ".%04u.txt", shard);
+  return base_name + suffix + compression_extensions[compression];
+}
+
 FileSink::FileSink(const std::string& _directory) throw ():
-  directory(_directory){}
+  directory(_directory),
+  compression(COMPRESSION_NONE),
+  pool(NULL),
+  shard_rows(0),
+  shard_bytes(0){}
 
-FileSink::~FileSink() throw () {}
+FileSink::~FileSink() throw () {
+  delete pool;
+}
 
 void FileSink::output_table(const Table& table, const unsigned int row_limit)
   throw (Errors::FileReadError, Errors::FileWriteError) {
 
-  std::string real_name = directory + "/" + table.get_name() + ".txt";
+  const ResultSet* result = table.extract_data(row_limit);
 
-  std::ofstream file(real_name.c_str());
+  try {
+    if (shard_rows || shard_bytes){
+      output_shards(table, result);
+    }
 
-  if (!file.is_open()){
-    throw Errors::FileWriteError(real_name, errno);
+    else {
+      OutputFile file(table_file_name(table), compression, pool);
+      write_rows(file, result, 0, result->row_count());
+      file.close();
+    }
   }
 
-  const ResultSet* result = table.extract_data(row_limit);
-  for (unsigned int row = 0; row < result->row_count(); row++){
-    const char** data = (*result)[row];
-    for (unsigned int col = 0; col < result->column_count(); col++){
-      file << data[col] << "\t";
-    }
-    file << "\n";
+  catch (...){
+    delete result;
+    throw;
+  }
+
+  delete result;
+}
+
+bool FileSink::can_output_ranges() const {
+  return !shard_rows && !shard_bytes;
+}
+
+void FileSink::output_range(const Table& table, const unsigned int first_row,
+  const unsigned int row_count, const unsigned int part)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  const ResultSet* result = table_from_row(table, first_row).extract_data(
+    row_count);
+
+  try {
+    OutputFile file(part_file_name(table_file_name(table), part),
+      compression, pool);
+    write_rows(file, result, 0, result->row_count());
+    file.close();
+  }
+
+  catch (...){
+    delete result;
+    throw;
   }
-  file.close();
 
   delete result;
 }
 
+void FileSink::join_ranges(const Table& table, const unsigned int parts)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  join_files(table_file_name(table), part_file_names(table, parts));
+
+  // Parts past the last one are left over from an interrupted extraction
+  for (unsigned int part = parts; ; part++){
+    if (remove(part_file_name(table_file_name(table), part).c_str()) != 0){
+      break;
+    }
+  }
+}
+
+void FileSink::discard_ranges(const Table& table, const unsigned int parts)
+  throw () {
+
+  remove_files(part_file_names(table, parts));
+}
+
+std::string FileSink::table_file_name(const Table& table) const throw () {
+  return directory + "/" + table.get_name() + ".txt" +
+    compression_extensions[compression];
+}
+
+std::vector<std::string> FileSink::part_file_names(const Table& table,
+  const unsigned int parts) const throw () {
+
+  std::vector<std::string> names;
+  for (unsigned int ii = 0; ii < parts; ii++){
+    names.push_back(part_file_name(table_file_name(table), ii));
+  }
+  return names;
+}
+
+void FileSink::output_shards(const Table& table, const ResultSet* result)
+  throw (Errors::FileWriteError) {
+
+  const std::string base_name = directory + "/" + table.get_name();
+  std::vector<ShardJob*> jobs;
+
+  // Split the rows into shards. Measuring a row is cheap next to formatting
+  // it, so sizes are found up front to let every shard start at once. An
+  // empty table has no shards, just a manifest which lists none
+  unsigned int first_row = 0;
+  while (first_row < result->row_count()){
+    unsigned int row = first_row;
+    unsigned long bytes = 0;
+
+    while (row < result->row_count()){
+      if (shard_rows && row - first_row >= shard_rows){
+        break;
+      }
+
+      if (shard_bytes && row > first_row && bytes >= shard_bytes){
+        break;
+      }
+
+      const char** data = (*result)[row];
+      for (unsigned int col = 0; col < result->column_count(); col++){
+        bytes += strlen(data[col]) + 1;
+      }
+      bytes += 1;
+      ++row;
+    }
+
+    jobs.push_back(new ShardJob(
+      shard_file_name(base_name, static_cast<unsigned int>(jobs.size()),
+        compression),
+      compression, result, first_row, row - first_row));
+
+    first_row = row;
+  }
+
+  // Write every shard, in parallel if possible
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    if (pool){
+      pool->add_job(jobs[ii]);
+    }
+
+    else {
+      try {
+        jobs[ii]->run();
+      }
+
+      catch (...){
+        for (unsigned int jj = 0; jj < jobs.size(); jj++){
+          delete jobs[jj];
+        }
+        throw;
+      }
+    }
+  }
+
+  if (pool){
+    for (unsigned int ii = 0; ii < jobs.size(); ii++){
+      pool->wait(jobs[ii]);
+    }
+
+    for (unsigned int ii = 0; ii < jobs.size(); ii++){
+      if (jobs[ii]->failed()){
+        const std::string failed_name = jobs[ii]->file_name;
+        const int error_code = jobs[ii]->error_code?
+          jobs[ii]->error_code : EIO;
+
+        for (unsigned int jj = 0; jj < jobs.size(); jj++){
+          delete jobs[jj];
+        }
+        throw Errors::FileWriteError(failed_name, error_code);
+      }
+    }
+  }
+
+  // Remove shards left over from an earlier extraction which had more of
+  // them, in any format, so they can't be mistaken for part of this one
+  for (unsigned int shard = static_cast<unsigned int>(jobs.size()); ;
+    shard++){
+
+    bool found = false;
+    for (unsigned int ii = 0; ii < COMPRESSION_NUM_TYPES; ii++){
+      const std::string stale = shard_file_name(base_name, shard,
+        static_cast<Compression>(ii));
+      if (remove(stale.c_str()) == 0){
+        found = true;
+      }
+    }
+
+    if (!found){
+      break;
+    }
+  }
+
+  // Write the manifest last, so that its presence means every shard is done
+  std::string manifest = "# file\tfirst_row\trow_count\tbytes\tcrc32\n";
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    const ShardJob* job = jobs[ii];
+
+    // Shards are listed relative to the manifest
+    const std::string shard_name = job->file_name.substr(
+      directory.size() + 1);
+
+    char line[64];
+    sprintf(line, "\t%u\t%u\t%lu\t%08lx\n", job->first_row, job->row_count,
+      job->bytes, job->checksum);
+
+    manifest += shard_name + line;
+    delete job;
+  }
+
+  OutputFile manifest_file(base_name + ".manifest");
+  manifest_file.write(manifest);
+  manifest_file.close();
+}
+
+void FileSink::set_compression(const Compression _compression) throw () {
+  compression = _compression;
+}
+
+Compression FileSink::get_compression() const throw () {
+  return compression;
+}
+
+void FileSink::set_threads(const unsigned int threads)
+  throw (Errors::GenericError) {
+
+  delete pool;
+  pool = NULL;
+
+  if (threads > 1){
+    pool = new ThreadPool(threads);
+  }
+}
+
+unsigned int FileSink::get_threads() const throw () {
+  return pool? pool->thread_count() : 1;
+}
+
+void FileSink::set_shard_rows(const unsigned int rows) throw () {
+  shard_rows = rows;
+}
+
+unsigned int FileSink::get_shard_rows() const throw () {
+  return shard_rows;
+}
+
+void FileSink::set_shard_bytes(const unsigned int bytes) throw () {
+  shard_bytes = bytes;
+}
+
+unsigned int FileSink::get_shard_bytes() const throw () {
+  return shard_bytes;
+}
+
 } // namespace
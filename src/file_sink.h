@@ -23,9 +23,12 @@
 
 #include "data_sink.h"
 #include "errors.h"
+#include "compression.h"
 
 namespace Driller {
 
+class ThreadPool;
+
 /**
   A FileSink will extract data from a Database into a tab-delimited file
 */
@@ -45,8 +48,157 @@ public:
   void output_table(const Table& table, const unsigned int row_limit = 0)
     throw (Errors::FileReadError, Errors::FileWriteError);
 
+  /**
+    Check whether tables can be split into ranges, which they can unless
+    they are being sharded
+
+    @return Whether output_range() is supported
+  */
+  bool can_output_ranges() const;
+
+  /**
+    Write a range of a table's rows to a part of its file
+
+    @param table The table to extract
+    @param first_row The first row of the range
+    @param row_count How many rows the range holds, or 0 for the rest
+    @param part The part's number
+  */
+  void output_range(const Table& table, const unsigned int first_row,
+    const unsigned int row_count, const unsigned int part)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Join a table's parts into its file
+
+    @param table The table
+    @param parts How many parts were written
+  */
+  void join_ranges(const Table& table, const unsigned int parts)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Remove a table's parts
+
+    @param table The table
+    @param parts How many parts were written
+  */
+  void discard_ranges(const Table& table, const unsigned int parts) throw ();
+
+  /**
+    Set how output files should be compressed. Compressed files get the
+    format's usual extension added, such as "table.txt.gz"
+
+    @param compression The compression format
+  */
+  void set_compression(const Compression compression) throw ();
+
+  /**
+    Get how output files are compressed
+
+    @return The compression format
+  */
+  Compression get_compression() const throw ();
+
+  /**
+    Set how many threads are used to write output. With more than one
+    thread, shards are written in parallel, or if the table is not sharded,
+    blocks of its file are compressed in parallel
+
+    @param threads How many threads to use
+  */
+  void set_threads(const unsigned int threads) throw (Errors::GenericError);
+
+  /**
+    Get how many threads are used to write output
+
+    @return How many threads are used
+  */
+  unsigned int get_threads() const throw ();
+
+  /**
+    Split each table into shards of at most this many rows. Shards are
+    named "table.0000.txt", "table.0001.txt", and so on, and are listed in
+    "table.manifest" along with their row ranges and checksums. An empty
+    table has no shards. Shards left from an earlier extraction with more of
+    them are removed
+
+    @param rows How many rows each shard may hold, or 0 to not shard by rows
+  */
+  void set_shard_rows(const unsigned int rows) throw ();
+
+  /**
+    Get the maximum number of rows in each shard
+
+    @return How many rows each shard may hold, or 0 if not sharding by rows
+  */
+  unsigned int get_shard_rows() const throw ();
+
+  /**
+    Split each table into shards of roughly this many bytes, before
+    compression. A shard is only split between rows, so it may be slightly
+    larger. If both this and the shard row count are set, a shard is ended by
+    whichever limit it reaches first
+
+    @param bytes The target shard size, or 0 to not shard by size
+  */
+  void set_shard_bytes(const unsigned int bytes) throw ();
+
+  /**
+    Get the target size of each shard
+
+    @return The target shard size, or 0 if not sharding by size
+  */
+  unsigned int get_shard_bytes() const throw ();
+
 protected:
+  /**
+    Get the name of a table's file
+
+    @param table The table
+
+    @return The file's name, including its directory
+  */
+  std::string table_file_name(const Table& table) const throw ();
+
+  /**
+    Get the names of the parts a table's file is written in
+
+    @param table The table
+    @param parts How many parts there are
+
+    @return Each part's name, in order
+  */
+  std::vector<std::string> part_file_names(const Table& table,
+    const unsigned int parts) const throw ();
+
+  /**
+    Write a table as a set of shards, plus a manifest describing them
+
+    @param table The table being written
+    @param result The table's extracted data
+  */
+  void output_shards(const Table& table, const ResultSet* result)
+    throw (Errors::FileWriteError);
+
   const std::string directory;
+
+  /** How output files are compressed */
+  Compression compression;
+
+  /** Runs compression and shard jobs, or NULL to do everything on one thread */
+  ThreadPool* pool;
+
+  /** Maximum rows per shard, or 0 */
+  unsigned int shard_rows;
+
+  /** Target bytes per shard, or 0 */
+  unsigned int shard_bytes;
+
+private:
+  // The thread pool can't be shared between copies
+  FileSink(const FileSink&);
+  FileSink& operator=(const FileSink&);
 };
 
 } // namespace
@@ -0,0 +1,280 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * json_format.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "json_format.h"
+#include "sql_format.h"
+#include "string_scan.h"
+#include <cstdio>
+#include <cstring>
+
+namespace Driller {
+
+/** Hex digits, for blobs and escaped control characters */
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/**
+  Write text as a quoted JSON string
+
+  @param text The text
+  @param length The length of text
+  @param out Receives the string. It must hold at least 6 * length + 2
+  characters
+
+  @return The length of the string
+*/
+static unsigned int write_json_string(const char* text,
+  const unsigned int length, char* out) throw (){
+
+  out[0] = '"';
+  const unsigned int escaped = escape_json_string(text, length, out + 1);
+  out[escaped + 1] = '"';
+  return escaped + 2;
+}
+
+/**
+  Write text cut at its first NULL character as a quoted JSON string
+
+  @param bytes The text
+  @param length The most characters the text can have
+  @param out Receives the string
+
+  @return The length of the string
+*/
+static unsigned int write_json_field_text(const uint8* bytes,
+  unsigned int length, char* out) throw (){
+
+  const void* nul = memchr(bytes, 0, length);
+  if (nul){
+    length = static_cast<unsigned int>(static_cast<const uint8*>(nul) - bytes);
+  }
+  return write_json_string(reinterpret_cast<const char*>(bytes), length, out);
+}
+
+unsigned int escape_json_string(const char* string, const unsigned int length,
+  char* out) throw (){
+
+  const char* end = string + length;
+  char* start = out;
+
+  while (string != end){
+    const char* special = find_json_special(string, end);
+    memcpy(out, string, special - string);
+    out += special - string;
+
+    if (special == end){
+      break;
+    }
+
+    const unsigned char byte = static_cast<unsigned char>(*special);
+    if (byte >= 0x80){
+      out[0] = static_cast<char>(0xC0 | (byte >> 6));
+      out[1] = static_cast<char>(0x80 | (byte & 0x3F));
+      out += 2;
+    }
+
+    else {
+      out[0] = '\\';
+      switch (byte){
+        case '"': out[1] = '"'; out += 2; break;
+        case '\\': out[1] = '\\'; out += 2; break;
+        case '\n': out[1] = 'n'; out += 2; break;
+        case '\r': out[1] = 'r'; out += 2; break;
+        case '\t': out[1] = 't'; out += 2; break;
+        default:
+          memcpy(out + 1, "u00", 3);
+          out[4] = hex_digits[byte >> 4];
+          out[5] = hex_digits[byte & 0xF];
+          out += 6;
+      }
+    }
+
+    string = special + 1;
+  }
+
+  return static_cast<unsigned int>(out - start);
+}
+
+unsigned int max_json_value_size(const Column& column, const uint8* row)
+  throw (){
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return 5;
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+      return 11;
+
+    // format_currency() also writes a NULL terminator
+    case COLUMN_CURRENCY:
+      return 13;
+
+    case COLUMN_DATE:
+      return 12;
+
+    case COLUMN_PHONE:
+      return (6 * 12) + 2;
+
+    case COLUMN_ENUM: {
+      const std::string value = column.enumeration.get_value(
+        Column::get_uint8(column.get_field(row)));
+      return (6 * static_cast<unsigned int>(value.size())) + 2;
+    }
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING:
+    case COLUMN_BLOB: {
+      const uint8* bytes;
+      return (6 * column.get_bytes(row, bytes)) + 2;
+    }
+
+    default:
+      return 9;
+  }
+}
+
+unsigned int write_json_value(const Column& column, const uint8* row,
+  char* out) throw (){
+
+  const uint8* field = column.get_field(row);
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      if (field[0]){
+        memcpy(out, "true", 4);
+        return 4;
+      }
+      memcpy(out, "false", 5);
+      return 5;
+
+    // Numbers are written as they are in SQL
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+    case COLUMN_CURRENCY:
+      return write_sql_value(column, row, out);
+
+    case COLUMN_DATE:
+      out[0] = '"';
+      format_date(Column::get_uint32(field), out + 1);
+      out[11] = '"';
+      return 12;
+
+    case COLUMN_PHONE: {
+      char phone[12];
+      return write_json_string(phone, format_phone(field, phone), out);
+    }
+
+    case COLUMN_ENUM: {
+      const std::string value = column.enumeration.get_value(
+        Column::get_uint8(field));
+      return write_json_string(value.data(),
+        static_cast<unsigned int>(value.size()), out);
+    }
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING: {
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(row, bytes);
+      return write_json_field_text(bytes, length, out);
+    }
+
+    case COLUMN_BLOB: {
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(row, bytes);
+      out[0] = '"';
+      for (unsigned int ii = 0; ii < length; ii++){
+        out[1 + (2 * ii)] = hex_digits[bytes[ii] >> 4];
+        out[2 + (2 * ii)] = hex_digits[bytes[ii] & 0xF];
+      }
+      out[1 + (2 * length)] = '"';
+      return (2 * length) + 2;
+    }
+
+    default:
+      memcpy(out, "\"unknown\"", 9);
+      return 9;
+  }
+}
+
+unsigned int write_json_text(const ColumnType type, const char* text,
+  const unsigned int length, char* out) throw (){
+
+  switch (type){
+    // extract_data() writes booleans as words
+    case COLUMN_BOOL:
+      if (text[0] == 'T'){
+        memcpy(out, "true", 4);
+        return 4;
+      }
+      memcpy(out, "false", 5);
+      return 5;
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+    case COLUMN_CURRENCY:
+      memcpy(out, text, length);
+      return length;
+
+    // Dates are extracted without leading zeros, as in 1955-7-3
+    case COLUMN_DATE: {
+      unsigned int year, month, day;
+      if (sscanf(text, "%u-%u-%u", &year, &month, &day) != 3){
+        break;
+      }
+      char date[16];
+      const int date_length = snprintf(date, sizeof(date),
+        "%04u-%02u-%02u", year % 10000, month % 100, day % 100);
+      return write_json_string(date, static_cast<unsigned int>(date_length),
+        out);
+    }
+
+    // Blobs are extracted as hex pairs separated by spaces
+    case COLUMN_BLOB: {
+      char* start = out;
+      *out++ = '"';
+      for (unsigned int ii = 0; ii < length; ii++){
+        if (text[ii] != ' '){
+          *out++ = text[ii];
+        }
+      }
+      *out++ = '"';
+      return static_cast<unsigned int>(out - start);
+    }
+
+    default:
+      break;
+  }
+
+  return write_json_string(text, length, out);
+}
+
+} // namespace
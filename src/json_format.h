@@ -0,0 +1,86 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * json_format.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_JSON_FORMAT_H
+#define DRILLER_JSON_FORMAT_H
+
+#include "database/column.h"
+
+namespace Driller {
+
+/**
+  Escape Latin-1 text for a JSON string, converting it to UTF-8. Spans with
+  nothing to escape are copied in bulk
+
+  @param string The text to escape
+  @param length The length of string
+  @param out Receives the escaped text, without quotes. It must hold at
+  least 6 * length characters
+
+  @return The length of the escaped text
+*/
+unsigned int escape_json_string(const char* string, const unsigned int length,
+  char* out) throw ();
+
+/**
+  Get the most space a raw value can take as a JSON value
+
+  @param column The value's column
+  @param row The start of the row containing the value
+
+  @return The most characters write_json_value() will write
+*/
+unsigned int max_json_value_size(const Column& column, const uint8* row)
+  throw ();
+
+/**
+  Write a raw value as a JSON value. Integers and currency are written as
+  numbers, and booleans as true or false. Dates are written as YYYY-MM-DD
+  strings, text is cut at its first NULL character, and blobs are written as
+  hex strings
+
+  @param column The value's column
+  @param row The start of the row containing the value
+  @param out Receives the value. It must hold at least max_json_value_size()
+  characters
+
+  @return The length of the value
+*/
+unsigned int write_json_value(const Column& column, const uint8* row,
+  char* out) throw ();
+
+/**
+  Write a value extracted as text, as by Column::extract_data(), as a JSON
+  value in the same form as write_json_value() does
+
+  @param type The value's column type
+  @param text The value
+  @param length The length of text
+  @param out Receives the value. It must hold at least 6 * length + 2
+  characters
+
+  @return The length of the value
+*/
+unsigned int write_json_text(const ColumnType type, const char* text,
+  const unsigned int length, char* out) throw ();
+
+} // namespace
+
+#endif // DRILLER_JSON_FORMAT_H
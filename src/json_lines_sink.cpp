@@ -0,0 +1,226 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * json_lines_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "json_lines_sink.h"
+#include "json_format.h"
+#include "output_file.h"
+#include "threads.h"
+#include "database/result_set.h"
+#include "database/row_data.h"
+#include <cstring>
+#include <vector>
+
+namespace Driller {
+
+/**
+  Get the text written before each value of a row: the opening brace or a
+  comma, then the column's quoted name and a colon. These are the same for
+  every row, so they're built once per table
+
+  @param table The table
+
+  @return Each column's prefix
+*/
+static std::vector<std::string> key_prefixes(const Table& table) throw (){
+  std::vector<std::string> prefixes;
+
+  for (unsigned int col = 0; col < table.column_count(); col++){
+    const std::string name = table.column_at(col).get_name();
+    std::vector<char> key((6 * name.size()) + 2);
+    key.resize(write_json_text(COLUMN_STRING, name.data(),
+      static_cast<unsigned int>(name.size()), &key[0]));
+
+    prefixes.push_back((col ? "," : "{") + std::string(key.begin(),
+      key.end()) + ":");
+  }
+
+  return prefixes;
+}
+
+JsonLinesSink::JsonLinesSink(const std::string& _directory) throw ():
+  directory(_directory),
+  compression(COMPRESSION_NONE),
+  pool(NULL){}
+
+JsonLinesSink::~JsonLinesSink() throw () {
+  delete pool;
+}
+
+void JsonLinesSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  write_table(table, row_limit, table_file_name(table));
+}
+
+bool JsonLinesSink::can_output_ranges() const {
+  return true;
+}
+
+void JsonLinesSink::output_range(const Table& table,
+  const unsigned int first_row, const unsigned int row_count,
+  const unsigned int part)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  write_table(table_from_row(table, first_row), row_count,
+    part_file_name(table_file_name(table), part));
+}
+
+void JsonLinesSink::join_ranges(const Table& table, const unsigned int parts)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  join_files(table_file_name(table), part_file_names(table, parts));
+}
+
+void JsonLinesSink::discard_ranges(const Table& table,
+  const unsigned int parts) throw () {
+
+  remove_files(part_file_names(table, parts));
+}
+
+std::string JsonLinesSink::table_file_name(const Table& table) const
+  throw () {
+
+  return directory + "/" + table.get_name() + ".jsonl" +
+    compression_extensions[compression];
+}
+
+std::vector<std::string> JsonLinesSink::part_file_names(const Table& table,
+  const unsigned int parts) const throw () {
+
+  std::vector<std::string> names;
+  for (unsigned int ii = 0; ii < parts; ii++){
+    names.push_back(part_file_name(table_file_name(table), ii));
+  }
+  return names;
+}
+
+void JsonLinesSink::write_table(const Table& table,
+  const unsigned int row_limit, const std::string& file_name)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  // Snapshots can only be read as text
+  const ResultSet* result = NULL;
+  RowData* rows = NULL;
+  if (!table.get_snapshot_file().empty()){
+    result = table.extract_data(row_limit);
+  }
+  else {
+    rows = table.load_rows(row_limit);
+  }
+
+  try {
+    OutputFile file(file_name, compression, pool);
+
+    const std::vector<std::string> prefixes = key_prefixes(table);
+    const std::vector<Column> column_list = table.get_columns();
+    const unsigned int columns = static_cast<unsigned int>(column_list.size());
+    const unsigned int row_count = rows ? rows->row_count() :
+      result->row_count();
+
+    unsigned int prefix_size = 2;
+    for (unsigned int col = 0; col < columns; col++){
+      prefix_size += static_cast<unsigned int>(prefixes[col].size());
+    }
+
+    std::vector<unsigned int> lengths(columns);
+    std::vector<char> line(4096);
+
+    for (unsigned int row = 0; row < row_count; row++){
+      const uint8* raw = rows ? (*rows)[row] : NULL;
+      const char** cells = result ? (*result)[row] : NULL;
+
+      // The most this row can take, if every character must be escaped
+      unsigned int row_size = prefix_size;
+      for (unsigned int col = 0; col < columns; col++){
+        if (raw){
+          row_size += max_json_value_size(column_list[col], raw);
+        }
+        else {
+          lengths[col] = static_cast<unsigned int>(strlen(cells[col]));
+          row_size += (6 * lengths[col]) + 2;
+        }
+      }
+
+      if (row_size > line.size()){
+        line.resize(row_size);
+      }
+
+      // A table without columns still has an object per row
+      unsigned int length = 0;
+      if (!columns){
+        line[length++] = '{';
+      }
+
+      for (unsigned int col = 0; col < columns; col++){
+        memcpy(&line[length], prefixes[col].data(), prefixes[col].size());
+        length += static_cast<unsigned int>(prefixes[col].size());
+
+        if (raw){
+          length += write_json_value(column_list[col], raw, &line[length]);
+        }
+        else {
+          length += write_json_text(column_list[col].get_type(), cells[col],
+            lengths[col], &line[length]);
+        }
+      }
+
+      line[length++] = '}';
+      line[length++] = '\n';
+      file.write(&line[0], length);
+    }
+
+    file.close();
+  }
+
+  catch (...){
+    delete rows;
+    delete result;
+    throw;
+  }
+
+  delete rows;
+  delete result;
+}
+
+void JsonLinesSink::set_compression(const Compression _compression) throw () {
+  compression = _compression;
+}
+
+Compression JsonLinesSink::get_compression() const throw () {
+  return compression;
+}
+
+void JsonLinesSink::set_threads(const unsigned int threads)
+  throw (Errors::GenericError) {
+
+  delete pool;
+  pool = NULL;
+
+  if (threads > 1){
+    pool = new ThreadPool(threads);
+  }
+}
+
+unsigned int JsonLinesSink::get_threads() const throw () {
+  return pool? pool->thread_count() : 1;
+}
+
+} // namespace
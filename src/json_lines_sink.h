@@ -0,0 +1,167 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * json_lines_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_JSON_LINES_SINK_H
+#define DRILLER_JSON_LINES_SINK_H
+
+#include "data_sink.h"
+#include "errors.h"
+#include "compression.h"
+
+namespace Driller {
+
+class ThreadPool;
+
+/**
+  A JsonLinesSink extracts each table into a JSON Lines file, with one
+  object per row keyed by column name. Values keep their types: integers
+  and currency are numbers, booleans are true or false, and dates are
+  YYYY-MM-DD strings. Text is converted from Latin-1 to UTF-8
+*/
+class JsonLinesSink : public DataSink {
+public:
+  /**
+    Default constructor
+
+    @param directory The directory extracted files should be stored in. This
+    must exist, or no data will be output
+  */
+  JsonLinesSink(const std::string& directory) throw ();
+
+  /** Default destructor */
+  virtual ~JsonLinesSink() throw ();
+
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Tables can always be split into ranges
+
+    @return true
+  */
+  bool can_output_ranges() const;
+
+  /**
+    Write a range of a table's rows to a part of its file
+
+    @param table The table to extract
+    @param first_row The first row of the range
+    @param row_count How many rows the range holds, or 0 for the rest
+    @param part The part's number
+  */
+  void output_range(const Table& table, const unsigned int first_row,
+    const unsigned int row_count, const unsigned int part)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Join a table's parts into its file
+
+    @param table The table
+    @param parts How many parts were written
+  */
+  void join_ranges(const Table& table, const unsigned int parts)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Remove a table's parts
+
+    @param table The table
+    @param parts How many parts were written
+  */
+  void discard_ranges(const Table& table, const unsigned int parts) throw ();
+
+  /**
+    Set how output files should be compressed. Compressed files get the
+    format's usual extension added, such as "table.jsonl.gz"
+
+    @param compression The compression format
+  */
+  void set_compression(const Compression compression) throw ();
+
+  /**
+    Get how output files are compressed
+
+    @return The compression format
+  */
+  Compression get_compression() const throw ();
+
+  /**
+    Set how many threads are used to compress output
+
+    @param threads How many threads to use
+  */
+  void set_threads(const unsigned int threads) throw (Errors::GenericError);
+
+  /**
+    Get how many threads are used to compress output
+
+    @return How many threads are used
+  */
+  unsigned int get_threads() const throw ();
+
+protected:
+  /**
+    Write a table's rows to a file
+
+    @param table The table to extract
+    @param row_limit If this is greater than 0, limit the number of rows
+    @param file_name The file to write
+  */
+  void write_table(const Table& table, const unsigned int row_limit,
+    const std::string& file_name)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Get the name of a table's file
+
+    @param table The table
+
+    @return The file's name, including its directory
+  */
+  std::string table_file_name(const Table& table) const throw ();
+
+  /**
+    Get the names of the parts a table's file is written in
+
+    @param table The table
+    @param parts How many parts there are
+
+    @return Each part's name, in order
+  */
+  std::vector<std::string> part_file_names(const Table& table,
+    const unsigned int parts) const throw ();
+
+  const std::string directory;
+
+  /** How output files are compressed */
+  Compression compression;
+
+  /** Compresses blocks of output, or NULL to do everything on one thread */
+  ThreadPool* pool;
+
+private:
+  // The thread pool can't be shared between copies
+  JsonLinesSink(const JsonLinesSink&);
+  JsonLinesSink& operator=(const JsonLinesSink&);
+};
+
+} // namespace
+
+#endif // DRILLER_JSON_LINES_SINK_H
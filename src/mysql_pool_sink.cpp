@@ -0,0 +1,434 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * mysql_pool_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysql_pool_sink.h"
+#include "database/table_cost.h"
+#include <sstream>
+
+#ifdef WIN32
+  #include <windows.h>
+#endif
+#define NO_CLIENT_LONG_LONG
+#include <mysql.h>
+
+namespace Driller {
+
+/** Default number of rows in each concurrently inserted range */
+const unsigned int default_range_rows = 100000;
+
+/**
+  A table whose ranges are queued for loading. The last range to finish
+  frees the loaded rows, and builds the table's indexes if every range
+  succeeded
+*/
+class MySQLTableLoad {
+public:
+  MySQLTableLoad(
+    const Table& _table,
+    const MySQLTableData* _data,
+    const unsigned int ranges) throw ():
+
+    table(_table),
+    data(_data),
+    remaining(ranges),
+    failed(false){}
+
+  ~MySQLTableLoad() throw () {
+    delete data;
+  }
+
+  /**
+    Record that a range has finished
+
+    @param succeeded Whether the range was inserted
+
+    @return Whether every range of the table has now finished, and all of
+    them succeeded. The caller must then finish the table, and call
+    release_data()
+  */
+  bool range_finished(const bool succeeded) throw () {
+    MutexLocker locker(mutex);
+    failed = failed || !succeeded;
+    if (--remaining > 0){
+      return false;
+    }
+
+    if (failed){
+      delete data;
+      data = NULL;
+    }
+    return !failed;
+  }
+
+  /**
+    Delete the loaded rows, once the table has been finished
+  */
+  void release_data() throw () {
+    delete data;
+    data = NULL;
+  }
+
+  const Table table;
+  const MySQLTableData* data;
+
+protected:
+  /** How many ranges have not finished */
+  unsigned int remaining;
+
+  /** Whether any range has failed. A staging table is then never swapped in */
+  bool failed;
+
+  /** Protects remaining and data */
+  Mutex mutex;
+};
+
+/**
+  Holds a connection from the pool for as long as it's in scope
+*/
+class ConnectionLease {
+public:
+  ConnectionLease(MySQLPoolSink& _pool) throw ():
+    pool(_pool), connection(_pool.acquire()){}
+
+  ~ConnectionLease() throw () {
+    pool.release(connection);
+  }
+
+  MySQLPoolSink& pool;
+  MySQLSink* const connection;
+};
+
+/**
+  Inserts one range of a table's rows, on whichever connection is idle
+*/
+class MySQLRangeJob : public Job {
+public:
+  MySQLRangeJob(
+    MySQLPoolSink& _pool,
+    MySQLTableLoad& _load,
+    const unsigned int _first_row,
+    const unsigned int _row_count) throw ():
+
+    pool(_pool),
+    load(_load),
+    first_row(_first_row),
+    row_count(_row_count){
+
+    // A tuned pool's throughput is measured in rows
+    work = row_count;
+  }
+
+  void run() {
+    ConnectionLease lease(pool);
+
+    try {
+      lease.connection->insert_rows(*load.data, first_row, row_count);
+    }
+
+    catch (const Errors::MySQLError&){
+      load.range_finished(false);
+      throw;
+    }
+
+    if (load.range_finished(true)){
+      try {
+        lease.connection->end_table(*load.data, false);
+      }
+
+      catch (const Errors::MySQLError&){
+        load.release_data();
+        throw;
+      }
+
+      load.release_data();
+    }
+  }
+
+  MySQLPoolSink& pool;
+  MySQLTableLoad& load;
+  const unsigned int first_row;
+  const unsigned int row_count;
+};
+
+MySQLPoolSink::MySQLPoolSink(
+  const std::string& host,
+  const std::string& username,
+  const std::string& password,
+  const std::string& database,
+  const unsigned int port,
+  const unsigned int connection_count,
+  const MySQLLoadMethod load_method)
+  throw (Errors::MySQLError, Errors::GenericError):
+
+  pool(NULL),
+  controller(NULL),
+  finished_jobs(0),
+  range_rows(default_range_rows){
+
+  // The client library must be set up before several threads use it
+  mysql_library_init(0, NULL, NULL);
+
+  try {
+    for (unsigned int ii = 0; ii < std::max(connection_count, 1u); ii++){
+      connections.push_back(new MySQLSink(host, username, password, database,
+        port, load_method));
+    }
+
+    pool = new ThreadPool(static_cast<unsigned int>(connections.size()));
+  }
+
+  catch (...){
+    for (unsigned int ii = 0; ii < connections.size(); ii++){
+      delete connections[ii];
+    }
+    throw;
+  }
+
+  idle = connections;
+}
+
+MySQLPoolSink::~MySQLPoolSink() throw (){
+  try {
+    finish();
+  }
+
+  catch (const Errors::GenericError&){
+    // Errors were already reported by output_table() or output_database()
+  }
+
+  delete controller;
+  delete pool;
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    delete connections[ii];
+  }
+}
+
+void MySQLPoolSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError, Errors::MySQLError,
+    Errors::GenericError){
+
+  queue_table(table, row_limit);
+  finish();
+}
+
+void MySQLPoolSink::output_database(const Database& db){
+  // The most costly tables start first, so none is left for last
+  std::vector<Table> tables = db.get_tables();
+  const std::vector<unsigned int> order = schedule_by_cost(tables);
+  for (unsigned int ii = 0; ii < order.size(); ii++){
+    queue_table(tables[order[ii]], 0);
+  }
+
+  finish();
+}
+
+void MySQLPoolSink::queue_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError, Errors::MySQLError){
+
+  // Limit how many tables are held in memory, waiting for queued ranges
+  // before loading another table
+  while (jobs.size() - finished_jobs > 2 * connections.size()){
+    if (controller){
+      controller->wait(*pool, jobs[finished_jobs++]);
+    }
+
+    else {
+      pool->wait(jobs[finished_jobs++]);
+    }
+  }
+
+  const MySQLTableData* data = connections[0]->load_table_data(table,
+    row_limit);
+  const unsigned int rows = data->row_count();
+  const unsigned int ranges = std::max(1u,
+    (rows + range_rows - 1) / range_rows);
+
+  // Tables are never locked, so every connection can insert into them
+  std::set<unsigned int> committed;
+  try {
+    ConnectionLease lease(*this);
+    committed = lease.connection->begin_table(table, false, rows, range_rows);
+
+    // An interrupted load may have already sent every range
+    if (committed.size() == ranges){
+      lease.connection->end_table(*data, false);
+      delete data;
+      return;
+    }
+  }
+
+  catch (const Errors::MySQLError&){
+    delete data;
+    throw;
+  }
+
+  MySQLTableLoad* load = new MySQLTableLoad(table, data,
+    ranges - static_cast<unsigned int>(committed.size()));
+  loads.push_back(load);
+
+  for (unsigned int ii = 0; ii < ranges; ii++){
+    const unsigned int first = ii * range_rows;
+    if (committed.count(first)){
+      continue;
+    }
+
+    MySQLRangeJob* job = new MySQLRangeJob(*this, *load, first,
+      std::min(range_rows, rows - first));
+
+    jobs.push_back(job);
+    pool->add_job(job);
+  }
+}
+
+void MySQLPoolSink::finish() throw (Errors::GenericError){
+  if (controller){
+    controller->wait_all(*pool);
+  }
+
+  else {
+    pool->wait_all();
+  }
+
+  unsigned int failed = 0;
+  std::string first_error;
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    if (jobs[ii]->failed() && failed++ == 0){
+      first_error = jobs[ii]->get_error();
+    }
+    delete jobs[ii];
+  }
+
+  for (unsigned int ii = 0; ii < loads.size(); ii++){
+    delete loads[ii];
+  }
+
+  jobs.clear();
+  loads.clear();
+  finished_jobs = 0;
+
+  if (failed){
+    std::stringstream ss;
+    ss << failed << " range(s) could not be loaded. The first error was: "
+       << first_error;
+    throw Errors::GenericError(ss.str());
+  }
+}
+
+MySQLSink* MySQLPoolSink::acquire() throw (){
+  MutexLocker locker(idle_mutex);
+  while (idle.empty()){
+    idle_condition.wait(idle_mutex);
+  }
+
+  MySQLSink* connection = idle.back();
+  idle.pop_back();
+
+  MySQLSink::init_thread();
+  return connection;
+}
+
+void MySQLPoolSink::release(MySQLSink* connection) throw (){
+  MutexLocker locker(idle_mutex);
+  idle.push_back(connection);
+  idle_condition.signal();
+}
+
+void MySQLPoolSink::set_load_method(const MySQLLoadMethod method)
+  throw (Errors::GenericError){
+
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    connections[ii]->set_load_method(method);
+  }
+}
+
+MySQLLoadMethod MySQLPoolSink::get_load_method() const throw (){
+  return connections[0]->get_load_method();
+}
+
+void MySQLPoolSink::set_batches_in_flight(const unsigned int batches)
+  throw (){
+
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    connections[ii]->set_batches_in_flight(batches);
+  }
+}
+
+void MySQLPoolSink::set_staging(const bool staging) throw (){
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    connections[ii]->set_staging(staging);
+  }
+}
+
+void MySQLPoolSink::set_resumable(const bool resumable) throw (){
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    connections[ii]->set_resumable(resumable);
+  }
+}
+
+void MySQLPoolSink::set_upsert_key(const std::string& column) throw (){
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    connections[ii]->set_upsert_key(column);
+  }
+}
+
+void MySQLPoolSink::set_presort(const bool presort) throw (){
+  for (unsigned int ii = 0; ii < connections.size(); ii++){
+    connections[ii]->set_presort(presort);
+  }
+}
+
+void MySQLPoolSink::set_adaptive(const unsigned int min_connections,
+  std::ostream* log) throw (){
+
+  delete controller;
+  controller = NULL;
+
+  if (min_connections < connections.size()){
+    controller = new ConcurrencyController("Connections", min_connections,
+      static_cast<unsigned int>(connections.size()));
+    controller->set_log(log);
+  }
+
+  else {
+    pool->set_active_limit(static_cast<unsigned int>(connections.size()));
+  }
+}
+
+void MySQLPoolSink::set_range_rows(const unsigned int rows) throw (){
+  range_rows = std::max(rows, 1u);
+}
+
+unsigned int MySQLPoolSink::get_range_rows() const throw (){
+  return range_rows;
+}
+
+unsigned int MySQLPoolSink::connection_count() const throw (){
+  return static_cast<unsigned int>(connections.size());
+}
+
+const MySQLSink& MySQLPoolSink::connection_at(const unsigned int index) const
+  throw (){
+
+  return *connections.at(index);
+}
+
+} // namespace
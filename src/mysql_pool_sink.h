@@ -0,0 +1,253 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * mysql_pool_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_MYSQL_POOL_SINK_H
+#define DRILLER_MYSQL_POOL_SINK_H
+
+#include <deque>
+#include "concurrency_controller.h"
+#include "mysql_sink.h"
+#include "threads.h"
+
+namespace Driller {
+
+class MySQLRangeJob;
+class MySQLTableLoad;
+
+/**
+  A MySQLPoolSink extracts data into a MySQL database over several
+  connections at once. Different tables are loaded on different connections,
+  and large tables are split into ranges of rows which are inserted
+  concurrently. How many connections insert at once can be tuned to the
+  server while loading
+*/
+class MySQLPoolSink : public DataSink {
+public:
+  /**
+    Open a pool of connections
+
+    @param host The host to connect to
+    @param username The user to connect as
+    @param password The password of the user to connect as
+    @param database The database to extract to
+    @param port The port the remote server accepts connections on
+    @param connections How many connections to open. If this is 0, one
+    connection is opened
+    @param load_method How rows are sent to the server. Only
+    MYSQL_LOAD_INFILE lets the connections accept LOAD DATA LOCAL INFILE
+  */
+  MySQLPoolSink(
+    const std::string& host,
+    const std::string& username,
+    const std::string& password,
+    const std::string& database,
+    const unsigned int port,
+    const unsigned int connections,
+    const MySQLLoadMethod load_method = MYSQL_LOAD_PREPARED)
+    throw (Errors::MySQLError, Errors::GenericError);
+
+  /** Wait for any running loads, then close every connection */
+  virtual ~MySQLPoolSink() throw ();
+
+  /**
+    Load one table, splitting it over every connection
+
+    @param table The table to extract
+  */
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::FileWriteError, Errors::MySQLError,
+      Errors::GenericError);
+
+  /**
+    Load every table of a database, with different tables loading on
+    different connections at the same time
+
+    @param db The database to extract from
+  */
+  void output_database(const Database& db);
+
+  /**
+    Set how rows are sent to the server, for every connection.
+    MYSQL_LOAD_INFILE can only be chosen if the pool was created with it
+
+    @param method The new load method
+  */
+  void set_load_method(const MySQLLoadMethod method)
+    throw (Errors::GenericError);
+
+  /**
+    Get how rows are sent to the server
+
+    @return The current load method
+  */
+  MySQLLoadMethod get_load_method() const throw ();
+
+  /**
+    Set how many text INSERTs each connection may have in flight
+
+    @param batches How many INSERTs may be in flight
+  */
+  void set_batches_in_flight(const unsigned int batches) throw ();
+
+  /**
+    Set whether tables are loaded into staging tables and then swapped in,
+    for every connection. See MySQLSink::set_staging()
+
+    @param staging Whether tables are loaded into staging tables
+  */
+  void set_staging(const bool staging) throw ();
+
+  /**
+    Set whether an interrupted load can be resumed, for every connection.
+    Each range of rows is committed with its checkpoint. See
+    MySQLSink::set_resumable()
+
+    @param resumable Whether loads can be resumed
+  */
+  void set_resumable(const bool resumable) throw ();
+
+  /**
+    Set the column rows are merged by, for every connection. See
+    MySQLSink::set_upsert_key()
+
+    @param column The name of the key column, or an empty string
+  */
+  void set_upsert_key(const std::string& column) throw ();
+
+  /**
+    Set whether rows are sorted before they are sent, for every connection.
+    See MySQLSink::set_presort()
+
+    @param presort Whether rows are sorted before they are sent
+  */
+  void set_presort(const bool presort) throw ();
+
+  /**
+    Set how many rows each concurrently inserted range holds. Tables with
+    fewer rows are loaded on a single connection
+
+    @param rows How many rows each range holds
+  */
+  void set_range_rows(const unsigned int rows) throw ();
+
+  /**
+    Tune how many connections insert at once while loading, by the rows per
+    second they manage, rather than always using every connection
+
+    @param min_connections The fewest connections to insert on, which is
+    also how many start. If this is no less than the connection count,
+    nothing is tuned
+    @param log Where to log each change, or NULL
+  */
+  void set_adaptive(const unsigned int min_connections,
+    std::ostream* log = NULL) throw ();
+
+  /**
+    Get how many rows each concurrently inserted range holds
+
+    @return How many rows each range holds
+  */
+  unsigned int get_range_rows() const throw ();
+
+  /**
+    Get how many connections are open
+
+    @return How many connections are open
+  */
+  unsigned int connection_count() const throw ();
+
+  /**
+    Get one of the connections, for reading its throughput
+
+    @param index The index of the connection
+
+    @return The connection at index
+  */
+  const MySQLSink& connection_at(const unsigned int index) const throw ();
+
+  /**
+    Take an idle connection, waiting until one is available. Each connection
+    is only used by one thread at a time
+
+    @return The connection, which must be passed to release()
+  */
+  MySQLSink* acquire() throw ();
+
+  /**
+    Return a connection taken with acquire()
+
+    @param connection The connection
+  */
+  void release(MySQLSink* connection) throw ();
+
+protected:
+  /**
+    Create a table and queue its rows to be loaded
+
+    @param table The table to load
+    @param row_limit If this is greater than 0, limit the number of rows
+  */
+  void queue_table(const Table& table, const unsigned int row_limit)
+    throw (Errors::FileReadError, Errors::FileWriteError, Errors::MySQLError);
+
+  /**
+    Wait for every queued range, then throw if any failed
+  */
+  void finish() throw (Errors::GenericError);
+
+  /** Every open connection */
+  std::vector<MySQLSink*> connections;
+
+  /** Connections not being used by any thread */
+  std::vector<MySQLSink*> idle;
+
+  /** Protects idle */
+  Mutex idle_mutex;
+
+  /** Signalled when a connection is released */
+  Condition idle_condition;
+
+  /** Runs the range jobs, with one thread per connection */
+  ThreadPool* pool;
+
+  /** Tunes how many of the pool's threads run, or NULL */
+  ConcurrencyController* controller;
+
+  /** Jobs which have been queued, oldest first */
+  std::deque<MySQLRangeJob*> jobs;
+
+  /** How many of the oldest jobs are known to have finished */
+  unsigned int finished_jobs;
+
+  /** Tables with queued jobs */
+  std::vector<MySQLTableLoad*> loads;
+
+  /** Rows per concurrently inserted range */
+  unsigned int range_rows;
+
+private:
+  // The connections can't be shared between copies
+  MySQLPoolSink(const MySQLPoolSink&);
+  MySQLPoolSink& operator=(const MySQLPoolSink&);
+};
+
+} // namespace
+
+#endif // DRILLER_MYSQL_POOL_SINK_H
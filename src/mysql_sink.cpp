@@ -19,6 +19,9 @@
 */
 
 #include "mysql_sink.h"
+#include "sql_format.h"
+#include "threads.h"
+#include "timer.h"
 #include <sstream>
 
 #ifdef WIN32
@@ -26,13 +29,24 @@
 #endif
 #define NO_CLIENT_LONG_LONG
 #include <mysql.h>
+#include <mysqld_error.h>
 #include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
 
 namespace Errors {
 
 MySQLError::MySQLError(MYSQL* connection) throw():
   message(mysql_error(connection)){}
 
+MySQLError::MySQLError(MYSQL_STMT* statement) throw():
+  message(mysql_stmt_error(statement)){}
+
+MySQLError::MySQLError(const std::string& _message) throw():
+  message(_message){}
+
 MySQLError::~MySQLError() throw(){}
 
 std::string MySQLError::error_message() const throw(){
@@ -47,59 +61,1075 @@ namespace Driller {
 // Misc utility functions //
 ////////////////////////////
 
+/** The largest text INSERT sent, even if the server would accept more */
+const unsigned int max_batch_bytes = 16 * 1024 * 1024;
+
+/** The smallest text INSERT sent, unless a table has less data */
+const unsigned int min_batch_bytes = 64 * 1024;
+
 /**
-  Use this function to get a buffer large enough to hold @string
+  Text INSERTs are sized so that the round trip latency is at most this
+  fraction of the time each one takes
+*/
+const double latency_share = 0.1;
+
+/** Appended to a table's name to name its staging table */
+const std::string staging_suffix = "__staging";
+
+/** Appended to a table's name while it is being replaced by its staging table */
+const std::string replaced_suffix = "__old";
+
+/** Records the ranges of rows committed by resumable loads */
+const std::string checkpoint_table = "driller_checkpoints";
+
+/** Rows committed at a time by a resumable load through output_table() */
+const unsigned int checkpoint_rows = 100000;
+
+/** Holds the source's keys while absent rows are deleted from a table */
+const std::string upsert_keys_table = "driller_upsert_keys";
+
+/** The name given to the unique index rows are merged by */
+const std::string upsert_index = "driller_upsert";
+
+/** How many absent rows each DELETE removes when merging */
+const unsigned int delete_batch_rows = 1000;
+
+/** Default number of text INSERTs sent ahead of the extraction thread */
+const unsigned int default_batches_in_flight = 2;
+
+/** Rows sent per execution of a prepared INSERT */
+const unsigned int prepared_batch_rows = 5000;
+
+/** The most placeholders MySQL allows in one prepared statement */
+const unsigned int max_placeholders = 65535;
 
-  @param string The string that must be held by the buffer
+/** Size of each formatted value of a column bound as text */
+const unsigned int bound_text_size = 16;
 
-  @return A pointer to the string. Do not free or delete this. This pointer
-  will be overwritten every time this function is called
+/** Set on each thread once init_thread() has set it up */
+pthread_key_t thread_key;
+
+/** Guards creating thread_key */
+pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+/**
+  Called as each thread set up by init_thread() exits
+
+  @param value The thread's value of thread_key
+*/
+void end_thread(void*){
+  mysql_thread_end();
+}
+
+/** Create thread_key, once */
+void create_thread_key(){
+  pthread_key_create(&thread_key, end_thread);
+}
+
+/**
+  One column's values for a batch of rows, decoded into the form they are
+  bound to a prepared statement in
 */
-char* get_escaped_string_buffer(const std::string& string) throw(){
-  static char* buffer = NULL;
-  static unsigned int buffer_len = 0;
+class BoundColumn {
+public:
+  /**
+    Choose how a column will be bound
+
+    @param column The column to bind
+    @param rows How many rows each batch holds
+  */
+  BoundColumn(const Column& column, const unsigned int rows) throw ():
+    column(&column), is_unsigned(false), lengths(rows), pointers(rows) {
+
+    switch (column.get_type()){
+      case COLUMN_BOOL:
+      case COLUMN_UINT8:
+      case COLUMN_UINT16:
+      case COLUMN_UINT32:
+        is_unsigned = true;
+        // Fall through
+
+      case COLUMN_INT8:
+      case COLUMN_INT16:
+      case COLUMN_INT32:
+        type = MYSQL_TYPE_LONG;
+        integers.resize(rows);
+      break;
+
+      case COLUMN_ENUM: {
+        // ENUM columns accept the 1-based position of a case in their
+        // definition, which lists cases in ID order. Unknown IDs become
+        // position 0, the empty string
+        type = MYSQL_TYPE_LONG;
+        is_unsigned = true;
+        integers.resize(rows);
+        positions.resize(256, 0);
+
+        std::list<EnumCase> case_list = column.enumeration.get_case_list();
+        std::list<EnumCase>::const_iterator iter;
+        uint32 position = 1;
+        for (iter = case_list.begin(); iter != case_list.end(); iter++){
+          positions[iter->id] = position++;
+        }
+      break;
+      }
+
+      case COLUMN_DATE:
+        type = MYSQL_TYPE_DATE;
+        dates.resize(rows);
+        memset(&dates[0], 0, rows * sizeof(MYSQL_TIME));
+        for (unsigned int ii = 0; ii < rows; ii++){
+          dates[ii].time_type = MYSQL_TIMESTAMP_DATE;
+        }
+      break;
+
+      case COLUMN_CURRENCY:
+        // Sent as exact decimal text, so no precision is lost to floats
+        type = MYSQL_TYPE_NEWDECIMAL;
+        text.resize(rows * bound_text_size);
+      break;
+
+      case COLUMN_STRING:
+      case COLUMN_VARSTRING:
+        type = MYSQL_TYPE_STRING;
+      break;
+
+      case COLUMN_BLOB:
+        type = MYSQL_TYPE_BLOB;
+      break;
+
+      default:
+        // Phone numbers and unknown columns use their text form
+        type = MYSQL_TYPE_STRING;
+        text.resize(rows * bound_text_size);
+      break;
+    }
+  }
+
+  /**
+    Decode one row's value
+
+    @param index The row's position within the batch
+    @param row The start of the row
+    @param buffer Scratch space for Column::extract_data()
+    @param buffer_size The size of buffer
+  */
+  void set(const unsigned int index, const uint8* row, char*& buffer,
+    unsigned int& buffer_size) throw () {
+
+    const uint8* field = column->get_field(row);
+
+    switch (column->get_type()){
+      case COLUMN_BOOL:
+        integers[index] = field[0] ? 1 : 0;
+      break;
+
+      case COLUMN_INT8:
+        integers[index] = static_cast<int8>(Column::get_uint8(field));
+      break;
+
+      case COLUMN_UINT8:
+        integers[index] = Column::get_uint8(field);
+      break;
+
+      case COLUMN_INT16:
+        integers[index] = static_cast<int16>(Column::get_uint16(field));
+      break;
+
+      case COLUMN_UINT16:
+        integers[index] = Column::get_uint16(field);
+      break;
+
+      case COLUMN_INT32:
+      case COLUMN_UINT32:
+        integers[index] = static_cast<int32>(Column::get_uint32(field));
+      break;
+
+      case COLUMN_ENUM:
+        integers[index] = positions[Column::get_uint8(field)];
+      break;
+
+      case COLUMN_DATE: {
+        uint32 year;
+        uint8 month, day;
+        Column::date_to_ymd(Column::get_uint32(field), year, month, day);
+        dates[index].year = year;
+        dates[index].month = month;
+        dates[index].day = day;
+      break;
+      }
+
+      case COLUMN_CURRENCY: {
+        char* value = &text[index * bound_text_size];
+        lengths[index] = format_currency(Column::get_int32(field), value);
+        pointers[index] = value;
+      break;
+      }
+
+      // Blobs are bound as their bytes, the same as the X'' literals text
+      // INSERTs of snapshot-backed tables write
+      case COLUMN_STRING:
+      case COLUMN_VARSTRING:
+      case COLUMN_BLOB: {
+        const uint8* bytes;
+        lengths[index] = column->get_bytes(row, bytes);
+        pointers[index] = reinterpret_cast<const char*>(bytes);
+      break;
+      }
+
+      default: {
+        const char* value = column->extract_data(row, buffer, buffer_size);
+        const unsigned int length = std::min(
+          static_cast<unsigned int>(strlen(value)), bound_text_size);
+
+        memcpy(&text[index * bound_text_size], value, length);
+        lengths[index] = length;
+        pointers[index] = &text[index * bound_text_size];
+      break;
+      }
+    }
+  }
+
+  /**
+    Bind a single row's value
+
+    @param bind The parameter to bind to
+    @param index The row's position within the batch
+  */
+  void bind_row(MYSQL_BIND& bind, const unsigned int index) throw () {
+    memset(&bind, 0, sizeof(MYSQL_BIND));
+    bind.buffer_type = type;
+    bind.is_unsigned = is_unsigned;
+
+    if (!integers.empty()){
+      bind.buffer = &integers[index];
+    }
+
+    else if (!dates.empty()){
+      bind.buffer = &dates[index];
+    }
+
+    else {
+      bind.buffer = const_cast<char*>(pointers[index]);
+      bind.buffer_length = lengths[index];
+      bind.length = &lengths[index];
+    }
+  }
+
+  /**
+    Bind every row's value at once, for array binding. Fixed-size values are
+    bound as an array of values, and variable-size values as an array of
+    pointers
+
+    @param bind The parameter to bind to
+  */
+  void bind_array(MYSQL_BIND& bind) throw () {
+    memset(&bind, 0, sizeof(MYSQL_BIND));
+    bind.buffer_type = type;
+    bind.is_unsigned = is_unsigned;
+
+    if (!integers.empty()){
+      bind.buffer = &integers[0];
+    }
+
+    else if (!dates.empty()){
+      bind.buffer = &dates[0];
+    }
+
+    else {
+      bind.buffer = &pointers[0];
+      bind.length = &lengths[0];
+    }
+  }
 
-  unsigned int string_len = static_cast<unsigned int>(string.size());
-  if ((2 * string_len) + 1 > buffer_len){
-    buffer_len = (2 * string_len) + 1;
+protected:
+  /** The column being bound */
+  const Column* column;
+
+  /** The type the values are sent as */
+  enum_field_types type;
+
+  /** Whether integer values are unsigned */
+  bool is_unsigned;
+
+  /** Integer values, for MYSQL_TYPE_LONG */
+  std::vector<int32> integers;
+
+  /** Date values, for MYSQL_TYPE_DATE */
+  std::vector<MYSQL_TIME> dates;
+
+  /** Fixed-size slots for values formatted as text */
+  std::vector<char> text;
+
+  /** The length of each variable-size value */
+  std::vector<unsigned long> lengths;
+
+  /** The start of each variable-size value */
+  std::vector<const char*> pointers;
+
+  /** For enumerations, the position of each case ID in the definition */
+  std::vector<uint32> positions;
+};
+
+/**
+  Feeds a table's rows to LOAD DATA LOCAL INFILE, formatting each row only
+  when the client library asks for more data. Rows are written in LOAD
+  DATA's default format: tab-separated fields, newline-terminated lines, and
+  backslash escapes
+*/
+class InfileStream {
+public:
+  /**
+    Create a stream over some rows
+
+    @param rows The rows to send from
+    @param first The first row to send
+    @param count How many rows to send
+  */
+  InfileStream(const RowData& rows, const unsigned int first,
+    const unsigned int count) throw ():
+    rows(rows), columns(rows.table.get_columns()), next_row(first),
+    end_row(first + count), pending_offset(0),
+    buffer(new char[bound_text_size]), buffer_size(bound_text_size) {}
+
+  /** Free the formatting buffer */
+  ~InfileStream() throw () {
     delete [] buffer;
-    buffer = new char[buffer_len];
   }
 
-  return buffer;
+  /** Client library callback, called when the server asks for the file */
+  static int init(void** state, const char*, void* user_data) {
+    *state = user_data;
+    return 0;
+  }
+
+  /** Client library callback, called to fill the next packet */
+  static int read(void* state, char* out, unsigned int out_size) {
+    return static_cast<InfileStream*>(state)->fill(out, out_size);
+  }
+
+  /** Client library callback, called when the load is finished */
+  static void end(void*) {}
+
+  /** Client library callback, called to describe a failure */
+  static int error(void*, char* message, unsigned int message_size) {
+    snprintf(message, message_size, "Unable to stream rows");
+    return 2000;
+  }
+
+  /** Client library callback which refuses a request for a file */
+  static int refuse_init(void**, const char*, void*) {
+    return 1;
+  }
+
+  /** Never called, since refuse_init() fails */
+  static int refuse_read(void*, char*, unsigned int) {
+    return -1;
+  }
+
+  /** Client library callback, describing why a request was refused */
+  static int refuse_error(void*, char* message, unsigned int message_size) {
+    snprintf(message, message_size,
+      "LOAD DATA LOCAL INFILE was not requested by this client");
+    return 2000;
+  }
+
+protected:
+  /**
+    Copy as many formatted rows as will fit into a buffer
+
+    @param out The buffer to fill
+    @param out_size The size of out
+
+    @return How many bytes were written, or 0 when every row has been sent
+  */
+  int fill(char* out, const unsigned int out_size) throw () {
+    unsigned int written = 0;
+
+    while (written < out_size){
+      if (pending_offset == pending.size()){
+        if (next_row == end_row){
+          break;
+        }
+        format_row(rows[next_row++]);
+      }
+
+      const unsigned int count = std::min(out_size - written,
+        static_cast<unsigned int>(pending.size() - pending_offset));
+      memcpy(out + written, pending.data() + pending_offset, count);
+      pending_offset += count;
+      written += count;
+    }
+
+    return static_cast<int>(written);
+  }
+
+  /**
+    Format one row as a line of the file
+
+    @param row The start of the row
+  */
+  void format_row(const uint8* row) throw () {
+    pending.clear();
+    pending_offset = 0;
+
+    char value[bound_text_size];
+    for (unsigned int col = 0; col < columns.size(); col++){
+      const Column& column = columns[col];
+      const uint8* field = column.get_field(row);
+
+      if (col){
+        pending += '\t';
+      }
+
+      switch (column.get_type()){
+        case COLUMN_BOOL:
+          pending += field[0] ? '1' : '0';
+        break;
+
+        case COLUMN_DATE: {
+          uint32 year;
+          uint8 month, day;
+          Column::date_to_ymd(Column::get_uint32(field), year, month, day);
+          pending.append(value, sprintf(value, "%04u-%02u-%02u", year, month,
+            day));
+        break;
+        }
+
+        case COLUMN_CURRENCY:
+          pending.append(value,
+            format_currency(Column::get_int32(field), value));
+        break;
+
+        case COLUMN_STRING:
+        case COLUMN_VARSTRING:
+        case COLUMN_BLOB: {
+          const uint8* bytes;
+          const unsigned int length = column.get_bytes(row, bytes);
+          append_escaped(reinterpret_cast<const char*>(bytes), length);
+        break;
+        }
+
+        default: {
+          const char* text = column.extract_data(row, buffer, buffer_size);
+          append_escaped(text, static_cast<unsigned int>(strlen(text)));
+        break;
+        }
+      }
+    }
+
+    pending += '\n';
+  }
+
+  /**
+    Append a value, escaping the characters LOAD DATA treats specially
+
+    @param text The value
+    @param length The length of text
+  */
+  void append_escaped(const char* text, const unsigned int length) throw () {
+    for (unsigned int ii = 0; ii < length; ii++){
+      switch (text[ii]){
+        case '\0': pending += "\\0"; break;
+        case '\t': pending += "\\t"; break;
+        case '\n': pending += "\\n"; break;
+        case '\\': pending += "\\\\"; break;
+        default: pending += text[ii];
+      }
+    }
+  }
+
+  /** The rows being sent */
+  const RowData& rows;
+
+  /** The rows' columns */
+  const std::vector<Column> columns;
+
+  /** The next row to format */
+  unsigned int next_row;
+
+  /** The row after the last one to send */
+  const unsigned int end_row;
+
+  /** The formatted row being sent */
+  std::string pending;
+
+  /** How much of the pending row has been sent */
+  unsigned int pending_offset;
+
+  /** Scratch space for Column::extract_data() */
+  char* buffer;
+
+  /** The size of buffer */
+  unsigned int buffer_size;
+};
+
+/**
+  Sends one text INSERT on a connection's sender thread
+*/
+class SendJob : public Job {
+public:
+  SendJob(
+    MYSQL* _connection,
+    const char* _query,
+    const unsigned int _length) throw ():
+
+    connection(_connection),
+    query(_query),
+    length(_length),
+    elapsed(0.0){}
+
+  void run() {
+    MySQLSink::init_thread();
+
+    Timer timer;
+    if (mysql_real_query(connection, query, length)){
+      throw Errors::MySQLError(connection);
+    }
+    elapsed = timer.elapsed();
+  }
+
+  MYSQL* connection;
+  const char* query;
+  const unsigned int length;
+
+  /** How long the query took, in seconds */
+  double elapsed;
+};
+
+////////////////////
+// MySQLTableData //
+////////////////////
+
+MySQLTableData::MySQLTableData(const ResultSet* result, const RowData* rows)
+  throw (): result(result), rows(rows){}
+
+MySQLTableData::~MySQLTableData() throw (){
+  delete result;
+  delete rows;
 }
 
+unsigned int MySQLTableData::row_count() const throw (){
+  return result ? result->row_count() : rows->row_count();
+}
+
+///////////////
+// MySQLSink //
+///////////////
+
 MySQLSink::MySQLSink(
   const std::string& host,
   const std::string& username,
   const std::string& password,
   const std::string& database,
-  const unsigned int port) throw (Errors::MySQLError){
+  const unsigned int port,
+  const MySQLLoadMethod _load_method) throw (Errors::MySQLError):
+  load_method(_load_method), local_infile(_load_method == MYSQL_LOAD_INFILE),
+  staging(false), resumable(false),
+  presort(false),
+  sort_memory(default_sort_memory), sender(NULL),
+  batches_in_flight(default_batches_in_flight),
+  batch_bytes(min_batch_bytes), escape_buffer(NULL),
+  escape_buffer_size(0), rows_sent(0), send_time(0.0), index_time(0.0){
 
   connection = mysql_init(NULL);
   mysql_options(connection, MYSQL_READ_DEFAULT_GROUP, "driller");
 
+  // Only MYSQL_LOAD_INFILE needs this, and even then the rows always come
+  // from this program through InfileStream, never from a file named by the
+  // server
+  if (local_infile){
+    unsigned int enable = 1;
+    mysql_options(connection, MYSQL_OPT_LOCAL_INFILE, &enable);
+  }
+
   // FIXME: port port in an argument
   if(!mysql_real_connect(connection, host.c_str(), username.c_str(),
     password.c_str(), database.c_str(), port, NULL, 0)){
 
     throw Errors::MySQLError(connection);
   }
+
+  // The library's own handler would read whatever file the server names
+  refuse_infile();
+
+  // Find the largest query the server accepts, timing the round trip
+  Timer timer;
+  send_query("SELECT @@max_allowed_packet, @@sql_mode");
+  MYSQL_RES* result = mysql_store_result(connection);
+  round_trip = timer.elapsed();
+
+  max_packet_size = 1024 * 1024;
+  bool backslash_escapes = true;
+  if (result){
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row && row[0]){
+      max_packet_size = strtoul(row[0], NULL, 10);
+    }
+    if (row && row[1]){
+      backslash_escapes = !strstr(row[1], "NO_BACKSLASH_ESCAPES");
+    }
+    mysql_free_result(result);
+  }
+
+  // In these character sets, a multibyte character's second byte can look
+  // like a backslash or quote, so only the client library can escape them
+  const std::string charset = mysql_character_set_name(connection);
+  byte_escaping = backslash_escapes && charset != "big5" &&
+    charset != "cp932" && charset != "gb18030" && charset != "gbk" &&
+    charset != "sjis";
+
+  // Leave room for the packet header and the statement's own overhead.
+  // Prefer batches of at least min_batch_bytes, but never past what the
+  // server accepts
+  const unsigned long packet_limit = max_packet_size > 1024 ?
+    max_packet_size - 1024 : max_packet_size;
+  max_query_size = std::max(static_cast<unsigned int>(
+    std::min<unsigned long>(max_batch_bytes, packet_limit)), min_batch_bytes);
+  max_query_size = static_cast<unsigned int>(std::min<unsigned long>(
+    max_query_size, packet_limit));
+  batch_bytes = std::min(batch_bytes, max_query_size);
 }
 
 MySQLSink::~MySQLSink() throw(){
+  delete sender;
+  for (unsigned int ii = 0; ii < query_buffers.size(); ii++){
+    delete [] query_buffers[ii];
+  }
+  delete [] escape_buffer;
+  mysql_close(connection);
 }
 
 void MySQLSink::output_table(const Table& table, const unsigned int row_limit)
-  throw (Errors::FileReadError, Errors::MySQLError) {
+  throw (Errors::FileReadError, Errors::FileWriteError, Errors::MySQLError) {
+
+  const MySQLTableData* data = load_table_data(table, row_limit);
+  const unsigned int rows = data->row_count();
+
+  try {
+    // A resumable load commits the rows a range at a time
+    const unsigned int range_rows = resumable ? checkpoint_rows :
+      std::max(rows, 1u);
+    const std::set<unsigned int> committed = begin_table(table, true, rows,
+      range_rows);
+
+    for (unsigned int first = 0; first < rows; first += range_rows){
+      if (!committed.count(first)){
+        insert_rows(*data, first, std::min(range_rows, rows - first));
+      }
+    }
+  }
+
+  catch (const Errors::MySQLError&){
+    delete data;
+    throw;
+  }
+
+  try {
+    end_table(*data, true);
+  }
+
+  catch (const Errors::MySQLError&){
+    delete data;
+    throw;
+  }
+
+  delete data;
+}
+
+std::set<unsigned int> MySQLSink::begin_table(const Table& table,
+  const bool lock, const unsigned int row_count,
+  const unsigned int range_rows) throw (Errors::MySQLError){
+
+  std::set<unsigned int> committed;
+  if (resumable){
+    committed = find_checkpoints(table, row_count, range_rows);
+  }
+
+  if (committed.empty()){
+    if (merges(table)){
+      prepare_merge(table);
+    }
+    else {
+      create_table(table);
+    }
+  }
+
+  // Lock the table. Nothing else reads a staging table, so it's never locked,
+  // and starting a transaction would unlock it
+  if (lock && (!staging || merges(table)) && !resumable){
+    send_query("LOCK TABLES " + load_table_name(table) + " WRITE");
+  }
+
+  return committed;
+}
+
+void MySQLSink::end_table(const MySQLTableData& data, const bool lock)
+  throw (Errors::MySQLError){
+
+  const Table& table = data.result ? data.result->table : data.rows->table;
+
+  if (lock && (!staging || merges(table)) && !resumable){
+    send_query("UNLOCK TABLES");
+  }
+
+  // A merged table already has its indexes
+  if (merges(table)){
+    delete_absent_rows(data);
+  }
+  else {
+    add_indexes(table);
+  }
+
+  // The checkpoints are only needed until the table is complete
+  const std::string table_name = load_table_name(table);
+  if (resumable){
+    send_query("DELETE FROM " + checkpoint_table + " WHERE table_name = '" +
+      table_name + "'");
+  }
+
+  if (staging && !merges(table)){
+    swap_table(table);
+  }
+}
+
+std::set<unsigned int> MySQLSink::find_checkpoints(const Table& table,
+  const unsigned int row_count, const unsigned int range_rows)
+  throw (Errors::MySQLError){
+
+  // ROWS is a reserved word since MySQL 8.0.2, so the range's size is
+  // range_rows
+  const std::string create = "CREATE TABLE IF NOT EXISTS " +
+    checkpoint_table + " ("
+    "table_name VARCHAR(255) NOT NULL, "
+    "row_count INT UNSIGNED NOT NULL, "
+    "first_row INT UNSIGNED NOT NULL, "
+    "range_rows INT UNSIGNED NOT NULL, "
+    "PRIMARY KEY (table_name, first_row)) ENGINE=InnoDB";
+  send_query(create);
+
+  const std::string table_name = load_table_name(table);
+  const std::string select = "SELECT row_count, first_row, range_rows FROM " +
+    checkpoint_table + " WHERE table_name = '" + table_name + "'";
+
+  // A table left by an older version names the column rows. Checkpoints
+  // only save work, so it's replaced and every table starts again
+  if (mysql_real_query(connection, select.c_str(),
+    static_cast<unsigned long>(select.size()))){
+
+    if (mysql_errno(connection) != ER_BAD_FIELD_ERROR){
+      throw Errors::MySQLError(connection);
+    }
+
+    send_query("DROP TABLE " + checkpoint_table);
+    send_query(create);
+    send_query(select);
+  }
+
+  std::set<unsigned int> committed;
+  bool valid = true;
+
+  MYSQL_RES* result = mysql_store_result(connection);
+  if (result){
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))){
+      const unsigned long checkpoint_row_count = strtoul(row[0], NULL, 10);
+      const unsigned long first = strtoul(row[1], NULL, 10);
+      const unsigned long rows = strtoul(row[2], NULL, 10);
+
+      // Only ranges of the same rows, split the same way, can be skipped
+      valid = valid && checkpoint_row_count == row_count &&
+        first % range_rows == 0 && first < row_count &&
+        rows == std::min<unsigned long>(range_rows, row_count - first);
+      committed.insert(static_cast<unsigned int>(first));
+    }
+    mysql_free_result(result);
+  }
+
+  // The table itself must still be there, too
+  if (!committed.empty() && valid){
+    valid = !mysql_query(connection, ("SELECT 1 FROM " + table_name +
+      " LIMIT 0").c_str());
+    MYSQL_RES* unused = mysql_store_result(connection);
+    if (unused){
+      mysql_free_result(unused);
+    }
+  }
+
+  // Start again from an empty table
+  if (!valid || committed.empty()){
+    committed.clear();
+    send_query("DELETE FROM " + checkpoint_table + " WHERE table_name = '" +
+      table_name + "'");
+  }
+
+  return committed;
+}
+
+const MySQLTableData* MySQLSink::load_table_data(const Table& table,
+  const unsigned int row_limit) const
+  throw (Errors::FileReadError, Errors::FileWriteError){
+
+  // Snapshots can only be read as text
+  if (!table.get_snapshot_file().empty()){
+    return new MySQLTableData(table.extract_data(row_limit), NULL);
+  }
+
+  RowData* rows = table.load_rows(row_limit);
+
+  // Send the rows in the order of the first indexed column, so the table's
+  // pages and the index built after the load are both filled in key order
+  const std::vector<Column> columns = table.get_columns();
+  for (unsigned int ii = 0; presort && ii < columns.size(); ii++){
+    if (columns[ii].get_indexed() && can_index_sql(columns[ii])){
+      try {
+        rows->sort(columns[ii], sort_memory);
+      }
+
+      catch (...){
+        delete rows;
+        throw;
+      }
+      break;
+    }
+  }
+
+  return new MySQLTableData(NULL, rows);
+}
+
+void MySQLSink::insert_rows(const MySQLTableData& data,
+  const unsigned int first, const unsigned int count)
+  throw (Errors::MySQLError){
+
+  Timer timer;
+
+  // The range is committed together with its checkpoint, so after a failure
+  // either both are there or neither is
+  if (resumable){
+    send_query("START TRANSACTION");
+  }
+
+  try {
+    if (data.result || load_method == MYSQL_LOAD_INSERT){
+      insert_text(data, first, count);
+    }
+
+    else if (load_method == MYSQL_LOAD_INFILE){
+      load_infile(*data.rows, first, count);
+    }
+
+    else {
+      insert_prepared(*data.rows, first, count);
+    }
+
+    if (resumable){
+      const Table& table = data.result ? data.result->table :
+        data.rows->table;
+
+      std::stringstream ss;
+      ss << "INSERT INTO " << checkpoint_table <<
+         " (table_name, row_count, first_row, range_rows) VALUES ('"
+         << load_table_name(table) << "', " << data.row_count() << ", "
+         << first << ", " << count << ")";
+      send_query(ss.str());
+      send_query("COMMIT");
+    }
+  }
+
+  catch (const Errors::MySQLError&){
+    // The connection may well be gone, so this can fail too
+    if (resumable){
+      mysql_query(connection, "ROLLBACK");
+    }
+    throw;
+  }
+
+  rows_sent += count;
+  send_time += timer.elapsed();
+}
+
+unsigned int MySQLSink::get_rows_sent() const throw (){
+  return rows_sent;
+}
+
+double MySQLSink::get_send_time() const throw (){
+  return send_time;
+}
+
+double MySQLSink::get_index_time() const throw (){
+  return index_time;
+}
+
+void MySQLSink::set_load_method(const MySQLLoadMethod method)
+  throw (Errors::GenericError){
+
+  if (method == MYSQL_LOAD_INFILE && !local_infile){
+    throw Errors::GenericError("LOAD DATA LOCAL INFILE must be chosen when "
+      "the MySQL connection is opened");
+  }
+
+  load_method = method;
+}
+
+MySQLLoadMethod MySQLSink::get_load_method() const throw (){
+  return load_method;
+}
+
+void MySQLSink::create_table(const Table& table) throw(Errors::MySQLError){
 
   // Delete the old table, if it exists
-  std::string table_name = make_safe_name(table.get_name());
+  std::string table_name = load_table_name(table);
   send_query("DROP TABLE IF EXISTS " + table_name);
 
   // Create the table
+  send_query("CREATE TABLE " + table_name + " (" + column_definitions(table) +
+    ")");
+}
+
+void MySQLSink::prepare_merge(const Table& table) throw(Errors::MySQLError){
+  const std::string table_name = load_table_name(table);
+  std::string buffer = column_definitions(table);
+
+  // Only a table created here is empty, so it's cheap to declare its
+  // indexes up front
+  std::vector<Column> column_list = table.get_columns();
+  std::vector<Column>::iterator column;
+  for (column = column_list.begin();
+    column != column_list.end();
+    column++){
+
+    // The key gets a unique index of its own
+    if (column->get_indexed() && can_index_sql(*column) &&
+      column->get_name() != upsert_key){
+
+      buffer += ", INDEX(`" + std::string(make_safe_name(column->get_name())) +
+        "`)";
+    }
+  }
+
+  send_query("CREATE TABLE IF NOT EXISTS " + table_name + " (" + buffer +
+    ")");
+
+  // ON DUPLICATE KEY UPDATE needs a unique index on the key. A table from an
+  // earlier merge already has one
+  const std::string key_name = make_safe_name(upsert_key);
+  if (mysql_query(connection, ("ALTER TABLE " + table_name + " ADD UNIQUE " +
+    upsert_index + " (`" + key_name + "`)").c_str()) &&
+    mysql_errno(connection) != ER_DUP_KEYNAME){
+
+    throw Errors::MySQLError(connection);
+  }
+}
+
+void MySQLSink::delete_absent_rows(const MySQLTableData& data)
+  throw(Errors::MySQLError){
+
+  const Table& table = data.result ? data.result->table : data.rows->table;
+  const std::vector<Column> column_list = table.get_columns();
+  const unsigned int key = static_cast<unsigned int>(upsert_column(table));
+  const Column& column = column_list[key];
+
+  const std::string table_name = load_table_name(table);
+  const std::string key_name = std::string("`") +
+    make_safe_name(column.get_name()) + "`";
+
+  // Temporary tables are private to the connection, and can be used while
+  // other tables are locked
+  send_query("DROP TEMPORARY TABLE IF EXISTS " + upsert_keys_table);
+  send_query("CREATE TEMPORARY TABLE " + upsert_keys_table + " (" +
+    key_name + " " + sql_type_from_column(column) + ", PRIMARY KEY (" +
+    key_name + "))");
+
+  // Send every key of the source, as many to a query as fit
+  const std::string prefix = "INSERT IGNORE INTO " + upsert_keys_table +
+    " VALUES ";
+  std::string query = prefix;
+  const bool library_escaped = !byte_escaping &&
+    sql_literal_kind(column.get_type()) == SQL_LITERAL_ESCAPED;
+  std::vector<char> value(bound_text_size);
+  char* format = new char[bound_text_size];
+  unsigned int format_size = bound_text_size;
+
+  try {
+    for (unsigned int row = 0; row < data.row_count(); row++){
+      const uint8* raw = data.result ? NULL : (*data.rows)[row];
+      const char* text = data.result ? (*data.result)[row][key] : NULL;
+      if (library_escaped && raw){
+        text = column.extract_data(raw, format, format_size);
+      }
+
+      const unsigned int text_length = text ?
+        static_cast<unsigned int>(strlen(text)) : 0;
+      const unsigned int size = text ? (2 * text_length) + 3 :
+        max_sql_value_size(column, raw);
+      if (value.size() < size){
+        value.resize(size);
+      }
+
+      unsigned int length;
+      if (library_escaped){
+        value[0] = '\'';
+        length = 1 + mysql_real_escape_string(connection, &value[1], text,
+          text_length);
+        value[length++] = '\'';
+      }
+
+      else if (text){
+        length = write_sql_text(column.get_type(), text, text_length,
+          &value[0]);
+      }
+
+      else {
+        length = write_sql_value(column, raw, &value[0]);
+      }
+
+      if (query.size() > prefix.size() &&
+        query.size() + length + 3 > batch_bytes){
+
+        send_query(query);
+        query = prefix;
+      }
+
+      if (query.size() > prefix.size()){
+        query += ',';
+      }
+      query += '(';
+      query.append(&value[0], length);
+      query += ')';
+    }
+  }
+
+  catch (const Errors::MySQLError&){
+    delete [] format;
+    throw;
+  }
+
+  delete [] format;
+
+  if (query.size() > prefix.size()){
+    send_query(query);
+  }
+
+  // Delete a batch at a time, so no single statement holds locks on, or
+  // sends replicas, a large share of the table
+  std::stringstream ss;
+  ss << "DELETE target FROM " << table_name << " AS target JOIN "
+     << "(SELECT live." << key_name << " FROM " << table_name << " AS live "
+     << "LEFT JOIN " << upsert_keys_table << " AS source ON source."
+     << key_name << " = live." << key_name << " WHERE source." << key_name
+     << " IS NULL LIMIT " << delete_batch_rows << ") AS absent ON absent."
+     << key_name << " = target." << key_name;
+  const std::string delete_query = ss.str();
+
+  do {
+    send_query(delete_query);
+  } while (mysql_affected_rows(connection) >= delete_batch_rows);
+
+  send_query("DROP TEMPORARY TABLE " + upsert_keys_table);
+}
+
+std::string MySQLSink::column_definitions(const Table& table) throw(){
   std::string buffer;
-  buffer = "CREATE TABLE " + table_name + " (";
 
   std::vector<Column> column_list = table.get_columns();
   std::vector<Column>::iterator column;
@@ -111,200 +1141,573 @@ void MySQLSink::output_table(const Table& table, const unsigned int row_limit)
     std::string name = make_safe_name(column->get_name());
 
     buffer += "`" + name + "` " + type + ", ";
+  }
+
+  buffer.erase(buffer.size() - 2, 2);
+  return buffer;
+}
 
-    if (column->get_indexed()){
-      if (!(column->get_type() == COLUMN_BLOB ||
-        column->get_type() == COLUMN_VARSTRING ||
-        (column->get_type() == COLUMN_STRING && column->get_length() > 255))){
+int MySQLSink::upsert_column(const Table& table) const throw(){
+  if (upsert_key.empty()){
+    return -1;
+  }
 
-          buffer += " INDEX(`" + name + "`), ";
-      }
+  const std::vector<Column> column_list = table.get_columns();
+  for (unsigned int col = 0; col < column_list.size(); col++){
+    if (column_list[col].get_name() == upsert_key){
+      return can_index_sql(column_list[col]) ? static_cast<int>(col) : -1;
     }
   }
 
-  buffer.erase(buffer.size() - 2, 2);
-  buffer += ")";
+  return -1;
+}
 
-  send_query(buffer);
+bool MySQLSink::merges(const Table& table) const throw(){
+  return upsert_column(table) >= 0;
+}
 
-  // Lock the table, and disable keys
-  send_query("LOCK TABLES " + table_name + " WRITE");
-  send_query("ALTER TABLE " + table_name + " DISABLE KEYS");
+std::string MySQLSink::insert_suffix(const Table& table) throw(){
+  if (!merges(table)){
+    return "";
+  }
 
-  buffer = "INSERT INTO " + table_name + " VALUES ";
+  // Rows whose values are all unchanged aren't written at all
+  std::string buffer;
+  const std::vector<Column> column_list = table.get_columns();
+  for (unsigned int col = 0; col < column_list.size(); col++){
+    if (column_list[col].get_name() == upsert_key){
+      continue;
+    }
 
-  const ResultSet* result = table.extract_data(row_limit);
+    const std::string name = make_safe_name(column_list[col].get_name());
+    buffer += buffer.empty() ? " ON DUPLICATE KEY UPDATE " : ", ";
+    buffer += "`" + name + "` = VALUES(`" + name + "`)";
+  }
 
-  try {
+  // A key with no other columns has nothing to update
+  if (buffer.empty()){
+    const std::string name = make_safe_name(upsert_key);
+    buffer = " ON DUPLICATE KEY UPDATE `" + name + "` = `" + name + "`";
+  }
+
+  return buffer;
+}
+
+void MySQLSink::add_indexes(const Table& table) throw(Errors::MySQLError){
+  std::string buffer;
+
+  std::vector<Column> column_list = table.get_columns();
+  std::vector<Column>::iterator column;
+  for (column = column_list.begin();
+    column != column_list.end();
+    column++){
+
+    if (!column->get_indexed() || !can_index_sql(*column)){
+      continue;
+    }
+
+    buffer += buffer.empty() ? " " : ", ";
+    buffer += "ADD INDEX(`" + std::string(make_safe_name(column->get_name())) +
+      "`)";
+  }
+
+  if (buffer.empty()){
+    return;
+  }
+
+  // Every index is built in one pass over the rows
+  Timer timer;
+  send_query("ALTER TABLE " + load_table_name(table) + buffer);
+  index_time += timer.elapsed();
+}
 
-    unsigned int i = 0;
-    for (unsigned int row = 0; row < result->row_count(); row++){
-      const char** data = (*result)[row];
-      buffer += "(";
-      for (unsigned int col = 0; col < result->column_count(); col++){
-        buffer += '"';
-        buffer += make_safe_string(data[col]);
-        buffer += "\",";
+void MySQLSink::swap_table(const Table& table) throw(Errors::MySQLError){
+  const std::string table_name = make_safe_name(table.get_name());
+  const std::string staging_name = table_name + staging_suffix;
+  const std::string replaced_name = table_name + replaced_suffix;
+
+  // Left over if an earlier swap failed part way through
+  send_query("DROP TABLE IF EXISTS " + replaced_name);
+
+  // RENAME TABLE can't replace a table, so the live table is renamed out of
+  // the way in the same statement. Readers see either the old table or the
+  // new one, and never wait for more than the rename. An empty table is
+  // created first if there is no live table yet, since each rename must
+  // succeed for any of them to
+  send_query("CREATE TABLE IF NOT EXISTS " + table_name + " LIKE " +
+    staging_name);
+  send_query("RENAME TABLE " + table_name + " TO " + replaced_name + ", " +
+    staging_name + " TO " + table_name);
+  send_query("DROP TABLE " + replaced_name);
+}
+
+std::string MySQLSink::load_table_name(const Table& table) throw(){
+  std::string name = make_safe_name(table.get_name());
+  if (staging && !merges(table)){
+    name += staging_suffix;
+  }
+  return name;
+}
+
+void MySQLSink::insert_text(const MySQLTableData& data,
+  const unsigned int first, const unsigned int count)
+  throw (Errors::MySQLError){
+
+  const Table& table = data.result ? data.result->table : data.rows->table;
+  const std::string prefix = "INSERT INTO " +
+    load_table_name(table) + " VALUES ";
+  const unsigned int prefix_length =
+    static_cast<unsigned int>(prefix.size());
+  const std::string suffix = insert_suffix(table);
+  const unsigned int suffix_length =
+    static_cast<unsigned int>(suffix.size());
+
+  const std::vector<Column> column_list = table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+  std::vector<unsigned long> lengths(columns);
+
+  // Numbers and dates never need escaping, so only text columns are escaped
+  // by the client library, and then only when the character set needs it
+  std::vector<bool> library_escaped(columns);
+  for (unsigned int col = 0; col < columns; col++){
+    library_escaped[col] = !byte_escaping &&
+      sql_literal_kind(column_list[col].get_type()) == SQL_LITERAL_ESCAPED;
+  }
+
+  // Raw rows are formatted one at a time, as the query is built, so the
+  // formatting overlaps with earlier queries being sent. Each column has its
+  // own format buffer, so a whole row's values stay valid together
+  std::vector<const char*> values(columns);
+  std::vector<char*> formats(columns);
+  std::vector<unsigned int> format_sizes(columns, bound_text_size);
+  for (unsigned int col = 0; col < columns; col++){
+    formats[col] = new char[bound_text_size];
+  }
+
+  // Each in-flight query needs its own buffer, plus one being built. The job
+  // sending each buffer's query is kept until it has finished
+  std::vector<SendJob*> jobs(batches_in_flight + 1, NULL);
+  while (query_buffers.size() < jobs.size()){
+    query_buffers.push_back(new char[max_query_size]);
+    query_buffer_sizes.push_back(max_query_size);
+  }
+
+  if (batches_in_flight > 0 && !sender){
+    sender = new ThreadPool(1);
+  }
+
+  unsigned int slot = 0;
+  unsigned int length = 0;
+
+  try {
+    for (unsigned int row = first; row < first + count; row++){
+      const uint8* raw = data.result ? NULL : (*data.rows)[row];
+      const char** cells = data.result ? (*data.result)[row] : NULL;
+
+      // The most this row can take, if every character must be escaped
+      unsigned int row_size = 3;
+      for (unsigned int col = 0; col < columns; col++){
+        if (raw && !library_escaped[col]){
+          row_size += max_sql_value_size(column_list[col], raw) + 1;
+          continue;
+        }
+
+        values[col] = cells ? cells[col] : column_list[col].extract_data(
+          raw, formats[col], format_sizes[col]);
+        lengths[col] = static_cast<unsigned long>(strlen(values[col]));
+        row_size += (2 * lengths[col]) + 3;
       }
 
+      if (length && length + row_size + suffix_length > batch_bytes){
+        memcpy(query_buffers[slot] + length, suffix.data(), suffix_length);
+        send_batch(jobs, slot, length + suffix_length);
+        length = 0;
+      }
 
-      /* MySQL limits the size of queries. To be safe, make a new query every
-         5000 rows */
-      // FIXME: should do some sort of auto-detection
-      if (i == 5000){
-        buffer.replace(buffer.size() - 1, 1, ")");
-        send_query(buffer);
+      // Only a single row larger than the buffer gets here with a too-small
+      // buffer. The server will reject it if it's over max_allowed_packet
+      char*& buffer = query_buffers[slot];
+      if (prefix_length + row_size + suffix_length >
+        query_buffer_sizes[slot]){
 
-        i = 0;
-        buffer = "INSERT INTO " + table_name + " VALUES ";
+        delete [] buffer;
+        query_buffer_sizes[slot] = prefix_length + row_size + suffix_length;
+        buffer = new char[query_buffer_sizes[slot]];
       }
 
+      if (length){
+        buffer[length++] = ',';
+      }
       else {
-        buffer.replace(buffer.size() - 1, 2, "),");
-        ++i;
+        memcpy(buffer, prefix.data(), prefix_length);
+        length = prefix_length;
+      }
+
+      // Write each value straight into the query
+      buffer[length++] = '(';
+      for (unsigned int col = 0; col < columns; col++){
+        if (col){
+          buffer[length++] = ',';
+        }
+
+        // Escaping only reads the connection's character set, so this is
+        // safe while a query is in flight
+        if (library_escaped[col]){
+          buffer[length++] = '\'';
+          length += mysql_real_escape_string(connection, buffer + length,
+            values[col], lengths[col]);
+          buffer[length++] = '\'';
+        }
+
+        else if (raw){
+          length += write_sql_value(column_list[col], raw, buffer + length);
+        }
+
+        else {
+          length += write_sql_text(column_list[col].get_type(), values[col],
+            lengths[col], buffer + length);
+        }
       }
+      buffer[length++] = ')';
     }
 
+    if (length){
+      memcpy(query_buffers[slot] + length, suffix.data(), suffix_length);
+      send_batch(jobs, slot, length + suffix_length);
+    }
 
-    // Send the query
-    buffer.erase(buffer.size() - 1, 1);
-    send_query(buffer);
+    // Wait for the queries still in flight, oldest first
+    for (unsigned int ii = 0; ii < jobs.size(); ii++){
+      finish_batch(jobs[(slot + ii) % jobs.size()]);
+    }
   }
 
   catch (const Errors::MySQLError&){
-    delete result;
+    if (sender){
+      sender->wait_all();
+    }
+    for (unsigned int ii = 0; ii < jobs.size(); ii++){
+      delete jobs[ii];
+    }
+    for (unsigned int col = 0; col < columns; col++){
+      delete [] formats[col];
+    }
     throw;
   }
 
-  delete result;
-
-  // Un-lock the table, and re-enable keys
-  send_query("UNLOCK TABLES");
-  send_query("ALTER TABLE " + table_name + " ENABLE KEYS");
+  for (unsigned int col = 0; col < columns; col++){
+    delete [] formats[col];
+  }
 }
 
-const char* MySQLSink::make_safe_string(const std::string& string) const
-  throw(){
+void MySQLSink::send_batch(std::vector<SendJob*>& jobs, unsigned int& slot,
+  const unsigned int length) throw (Errors::MySQLError){
 
-  char* buffer = get_escaped_string_buffer(string);
-  mysql_real_escape_string(connection, buffer, string.c_str(),
-    static_cast<unsigned long>(string.size()));
-  return buffer;
+  if (!sender){
+    Timer timer;
+    if (mysql_real_query(connection, query_buffers[slot], length)){
+      throw Errors::MySQLError(connection);
+    }
+    update_batch_size(length, timer.elapsed());
+    return;
+  }
+
+  // Hand the query to the sender thread, and move on to the next buffer.
+  // If that buffer's query is still in flight, this waits for it
+  jobs[slot] = new SendJob(connection, query_buffers[slot], length);
+  sender->add_job(jobs[slot]);
+
+  slot = (slot + 1) % jobs.size();
+  finish_batch(jobs[slot]);
 }
 
-const char* MySQLSink::make_safe_name(std::string name) const throw(){
-  // Replace spaces with underscores
-  std::replace(name.begin(), name.end(), ' ', '_');
+void MySQLSink::finish_batch(SendJob*& job) throw (Errors::MySQLError){
+  if (!job){
+    return;
+  }
 
-  return make_safe_string(name);
+  sender->wait(job);
+  SendJob* finished = job;
+  job = NULL;
+
+  if (finished->failed()){
+    const std::string error = finished->get_error();
+    delete finished;
+    throw Errors::MySQLError(error);
+  }
+
+  update_batch_size(finished->length, finished->elapsed);
+  delete finished;
 }
 
-void MySQLSink::send_query(const std::string& query) const
-  throw(Errors::MySQLError){
+void MySQLSink::update_batch_size(const unsigned int length,
+  const double elapsed) throw (){
 
-  if (mysql_real_query(connection, query.c_str(),
-    static_cast<unsigned long>(query.size()))){
+  // Each query costs one round trip plus its transfer and execution time.
+  // Estimate the rate the rest runs at, and size the next batch so the
+  // round trip is only a small share of the total
+  if (elapsed > round_trip){
+    const double bytes_per_second = length / (elapsed - round_trip);
+    const double wanted = bytes_per_second * round_trip *
+      ((1.0 - latency_share) / latency_share);
 
-    throw Errors::MySQLError(connection);
+    batch_bytes = static_cast<unsigned int>(std::min<double>(
+      std::max<double>(wanted, min_batch_bytes), max_query_size));
+  }
+
+  // Finished within one measured round trip, so the batch is far too small
+  else {
+    round_trip = elapsed;
+    batch_bytes = std::min(max_query_size, length * 2);
   }
 }
 
-std::string MySQLSink::sql_type_from_column(const Column& col) const throw(){
-  std::string buffer;
+void MySQLSink::set_batches_in_flight(const unsigned int batches) throw (){
+  batches_in_flight = batches;
+
+  if (batches == 0){
+    delete sender;
+    sender = NULL;
+  }
+}
+
+unsigned int MySQLSink::get_batches_in_flight() const throw (){
+  return batches_in_flight;
+}
+
+void MySQLSink::set_staging(const bool _staging) throw (){
+  staging = _staging;
+}
+
+bool MySQLSink::get_staging() const throw (){
+  return staging;
+}
+
+void MySQLSink::set_resumable(const bool _resumable) throw (){
+  resumable = _resumable;
+}
+
+bool MySQLSink::get_resumable() const throw (){
+  return resumable;
+}
+
+void MySQLSink::set_upsert_key(const std::string& column) throw (){
+  upsert_key = column;
+}
+
+const std::string& MySQLSink::get_upsert_key() const throw (){
+  return upsert_key;
+}
+
+void MySQLSink::set_presort(const bool _presort) throw (){
+  presort = _presort;
+}
+
+bool MySQLSink::get_presort() const throw (){
+  return presort;
+}
+
+void MySQLSink::set_sort_memory(const uint64 bytes) throw (){
+  sort_memory = bytes;
+}
+
+void MySQLSink::insert_prepared(const RowData& rows, const unsigned int first,
+  const unsigned int count) throw (Errors::MySQLError){
+
+  const Table& table = rows.table;
+  const std::vector<Column> column_list = table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+  if (columns == 0){
+    return;
+  }
+
+  const bool use_array = supports_array_binding();
+
+  // Without array binding, each statement has placeholders for several rows
+  const unsigned int batch_rows = use_array ? prepared_batch_rows :
+    std::max(1u, std::min(prepared_batch_rows, max_placeholders / columns));
+
+  std::vector<BoundColumn> bound;
+  for (unsigned int col = 0; col < columns; col++){
+    bound.push_back(BoundColumn(column_list[col], batch_rows));
+  }
+
+  std::string row_placeholders = "(";
+  for (unsigned int col = 0; col < columns; col++){
+    row_placeholders += col ? ",?" : "?";
+  }
+  row_placeholders += ")";
+
+  const std::string insert = "INSERT INTO " +
+    load_table_name(table) + " VALUES ";
 
-  switch(col.get_type()){
-    case COLUMN_UNKNOWN:
-    case COLUMN_NUM_TYPES:
-      // Contents of an unknown column is always "unknown"
-      buffer = "CHAR(7)";
-    break;
-
-    case COLUMN_BOOL:
-      buffer = "TINYINT(1) UNSIGNED";
-    break;
-
-    // Integer types
-    case COLUMN_INT8:
-      buffer = "TINYINT";
-    break;
-
-    case COLUMN_UINT8:
-      buffer = "TINYINT UNSIGNED";
-    break;
-
-    case COLUMN_INT16:
-      buffer = "SMALLINT";
-    break;
-
-    case COLUMN_UINT16:
-      buffer = "SMALLINT UNSIGNED";
-    break;
-
-    case COLUMN_INT32:
-      buffer = "INT";
-    break;
-
-    case COLUMN_UINT32:
-      buffer = "INT UNSIGNED";
-    break;
-
-    // String types
-    case COLUMN_BLOB:
-      buffer = "BLOB";
-    break;
-
-    case COLUMN_STRING:
-      if (col.get_length() < 256){
-        std::stringstream ss;
-        ss << "VARCHAR(" << col.get_length() << ")";
-        buffer = ss.str();
+  MYSQL_STMT* statement = NULL;
+  unsigned int statement_rows = 0;
+  std::vector<MYSQL_BIND> binds(use_array ? columns : columns * batch_rows);
+
+  char* buffer = new char[bound_text_size];
+  unsigned int buffer_size = bound_text_size;
+
+  try {
+    for (unsigned int start = first; start < first + count;
+      start += batch_rows){
+
+      const unsigned int batch = std::min(batch_rows, first + count - start);
+
+      for (unsigned int col = 0; col < columns; col++){
+        for (unsigned int row = 0; row < batch; row++){
+          bound[col].set(row, rows[start + row], buffer, buffer_size);
+        }
+      }
+
+      // Prepare a statement the first time, and again for the final, shorter
+      // batch when each row needs its own placeholders
+      if (!statement || (!use_array && batch != statement_rows)){
+        if (statement){
+          mysql_stmt_close(statement);
+        }
+
+        std::string query = insert + row_placeholders;
+        for (unsigned int row = 1; row < (use_array ? 1 : batch); row++){
+          query += "," + row_placeholders;
+        }
+        query += insert_suffix(table);
+
+        statement = mysql_stmt_init(connection);
+        if (!statement){
+          throw Errors::MySQLError(connection);
+        }
+        if (mysql_stmt_prepare(statement, query.c_str(),
+          static_cast<unsigned long>(query.size()))){
+
+          throw Errors::MySQLError(statement);
+        }
+        statement_rows = batch;
       }
-      
+
+      if (use_array){
+#if defined(MARIADB_PACKAGE_VERSION_ID) && MARIADB_PACKAGE_VERSION_ID >= 30000
+        unsigned int array_size = batch;
+        for (unsigned int col = 0; col < columns; col++){
+          bound[col].bind_array(binds[col]);
+        }
+        if (mysql_stmt_attr_set(statement, STMT_ATTR_ARRAY_SIZE, &array_size)){
+          throw Errors::MySQLError(statement);
+        }
+#endif
+      }
+
       else {
-        buffer = "TEXT";
+        for (unsigned int row = 0; row < batch; row++){
+          for (unsigned int col = 0; col < columns; col++){
+            bound[col].bind_row(binds[(row * columns) + col], row);
+          }
+        }
       }
-    break;
 
-    case COLUMN_VARSTRING:
-      buffer = "TEXT";
-    break;
+      // Strings are bound in place, so their addresses change every batch
+      if (mysql_stmt_bind_param(statement, &binds[0]) ||
+        mysql_stmt_execute(statement)){
 
+        throw Errors::MySQLError(statement);
+      }
+    }
+  }
 
-    // Special types
-    case COLUMN_PHONE:
-      buffer = "VARCHAR(12)";
-    break;
+  catch (const Errors::MySQLError&){
+    if (statement){
+      mysql_stmt_close(statement);
+    }
+    delete [] buffer;
+    throw;
+  }
 
-    case COLUMN_DATE:
-      buffer = "DATE";
-    break;
+  if (statement){
+    mysql_stmt_close(statement);
+  }
+  delete [] buffer;
+}
 
-    case COLUMN_CURRENCY:
-      buffer = "DECIMAL(10,2)";
-    break;
+void MySQLSink::load_infile(const RowData& rows, const unsigned int first,
+  const unsigned int count) throw (Errors::MySQLError){
 
-    case COLUMN_ENUM: {
-      std::stringstream ss;
-      ss << "ENUM (";
+  const std::string table_name = load_table_name(rows.table);
+  // LOAD DATA can only merge rows by replacing them
+  const std::string query = "LOAD DATA LOCAL INFILE '" + table_name +
+    (merges(rows.table) ? "' REPLACE" : "'") + " INTO TABLE " + table_name;
 
-      std::list<EnumCase> case_list = col.enumeration.get_case_list();
-      std::list<EnumCase>::iterator iter;
-      for (iter = case_list.begin();
-        iter != case_list.end();
-        iter++){
+  InfileStream stream(rows, first, count);
 
-        ss << "'" << make_safe_string((*iter).value) << "', ";
-      }
+  mysql_set_local_infile_handler(connection, InfileStream::init,
+    InfileStream::read, InfileStream::end, InfileStream::error, &stream);
 
-      buffer = ss.str();
-      buffer.erase(buffer.size() - 2, 2);
+  try {
+    send_query(query);
+  }
 
-      buffer += ")";
-    break;
-    }
+  catch (const Errors::MySQLError&){
+    refuse_infile();
+    throw;
   }
 
-  return buffer;
+  refuse_infile();
+}
+
+void MySQLSink::init_thread() throw (){
+  pthread_once(&thread_key_once, create_thread_key);
+  if (!pthread_getspecific(thread_key)){
+    mysql_thread_init();
+    pthread_setspecific(thread_key, &thread_key);
+  }
+}
+
+void MySQLSink::refuse_infile() throw (){
+  mysql_set_local_infile_handler(connection, InfileStream::refuse_init,
+    InfileStream::refuse_read, InfileStream::end, InfileStream::refuse_error,
+    NULL);
+}
+
+bool MySQLSink::supports_array_binding() const throw(){
+#if defined(MARIADB_PACKAGE_VERSION_ID) && MARIADB_PACKAGE_VERSION_ID >= 30000
+  // Array binding needs MariaDB Connector/C 3.0 and MariaDB 10.2.6
+  const char* server = mysql_get_server_info(connection);
+  return server && strstr(server, "MariaDB") &&
+    mysql_get_server_version(connection) >= 100206;
+#else
+  return false;
+#endif
+}
+
+const char* MySQLSink::make_safe_string(const std::string& string) throw(){
+  // Each connection has its own buffer, so connections can be used from
+  // different threads
+  const unsigned int string_len = static_cast<unsigned int>(string.size());
+  if ((2 * string_len) + 1 > escape_buffer_size){
+    escape_buffer_size = (2 * string_len) + 1;
+    delete [] escape_buffer;
+    escape_buffer = new char[escape_buffer_size];
+  }
+
+  mysql_real_escape_string(connection, escape_buffer, string.c_str(),
+    static_cast<unsigned long>(string_len));
+  return escape_buffer;
+}
+
+const char* MySQLSink::make_safe_name(std::string name) throw(){
+  // Replace spaces with underscores
+  std::replace(name.begin(), name.end(), ' ', '_');
+
+  return make_safe_string(name);
+}
+
+void MySQLSink::send_query(const std::string& query) const
+  throw(Errors::MySQLError){
+
+  if (mysql_real_query(connection, query.c_str(),
+    static_cast<unsigned long>(query.size()))){
+
+    throw Errors::MySQLError(connection);
+  }
 }
 
 } // namespace
@@ -23,8 +23,11 @@
 
 #include "data_sink.h"
 #include "errors.h"
+#include <set>
+#include <vector>
 
 struct st_mysql;
+struct st_mysql_stmt;
 
 namespace Errors {
 
@@ -37,6 +40,21 @@ public:
   */
   MySQLError(st_mysql* connection) throw();
 
+  /**
+    Create an error from a failed prepared statement
+
+    @param statement The MySQL statement that caused this error
+  */
+  MySQLError(st_mysql_stmt* statement) throw();
+
+  /**
+    Create an error from a message already taken from the connection, such
+    as one reported by another thread
+
+    @param message The MySQL error string
+  */
+  MySQLError(const std::string& message) throw();
+
   /** Default destructor */
   virtual ~MySQLError() throw();
 
@@ -55,6 +73,67 @@ protected:
 
 namespace Driller {
 
+class SendJob;
+class ThreadPool;
+
+/** How a MySQLSink sends rows to the server */
+enum MySQLLoadMethod {
+  /** Multi-row INSERT statements, with every value escaped and quoted */
+  MYSQL_LOAD_INSERT = 0,
+
+  /**
+    Server-side prepared INSERT statements, with values bound in their native
+    binary form. Integers, dates, currency and enumerations are sent without
+    being formatted as text, and strings are sent without being escaped
+  */
+  MYSQL_LOAD_PREPARED,
+
+  /**
+    LOAD DATA LOCAL INFILE, with rows formatted as the server reads them.
+    Nothing is written to disk; the rows are streamed from the table into the
+    connection. The server must allow local_infile, and the connection only
+    asks for it when it is opened with this method
+  */
+  MYSQL_LOAD_INFILE
+};
+
+/**
+  A table's rows, loaded for a MySQLSink to send: raw, or formatted as text
+  for tables that can only be read that way, such as snapshots. Either way,
+  ranges of the rows can be sent over several connections at once
+*/
+class MySQLTableData {
+public:
+  /**
+    Hold some loaded rows. Exactly one of the arguments should be non-NULL
+
+    @param result The rows as text, which will be deleted with this object
+    @param rows The raw rows, which will be deleted with this object
+  */
+  MySQLTableData(const ResultSet* result, const RowData* rows) throw ();
+
+  /** Delete the loaded rows */
+  ~MySQLTableData() throw ();
+
+  /**
+    Get how many rows were loaded
+
+    @return How many rows were loaded
+  */
+  unsigned int row_count() const throw ();
+
+  /** The rows as text, or NULL */
+  const ResultSet* const result;
+
+  /** The raw rows, or NULL */
+  const RowData* const rows;
+
+private:
+  // The loaded rows can't be shared between copies
+  MySQLTableData(const MySQLTableData&);
+  MySQLTableData& operator=(const MySQLTableData&);
+};
+
 /**
   A MySQLSink will extract data into a MySQL database
 */
@@ -69,13 +148,18 @@ public:
     @param password The password of the user to connect as
     @param database The database to extract to
     @param port The port the remote server accepts connections on
+    @param load_method How rows are sent to the server. LOAD DATA LOCAL
+    INFILE is only enabled on the connection for MYSQL_LOAD_INFILE, and even
+    then the server may only read the rows being loaded, never a file
   */
   MySQLSink(
     const std::string& host,
     const std::string& username,
     const std::string& password,
     const std::string& database,
-    const unsigned int port) throw (Errors::MySQLError);
+    const unsigned int port,
+    const MySQLLoadMethod load_method = MYSQL_LOAD_PREPARED)
+    throw (Errors::MySQLError);
 
   /** Default destructor */
   virtual ~MySQLSink() throw();
@@ -86,9 +170,395 @@ public:
     @param table The table to extract
   */
   void output_table(const Table& table, const unsigned int row_limit = 0)
-    throw (Errors::FileReadError, Errors::MySQLError);
+    throw (Errors::FileReadError, Errors::FileWriteError, Errors::MySQLError);
+
+  /**
+    Set how rows are sent to the server. MYSQL_LOAD_INFILE can only be
+    chosen if the sink was created with it
+
+    @param method The new load method
+  */
+  void set_load_method(const MySQLLoadMethod method)
+    throw (Errors::GenericError);
+
+  /**
+    Get how rows are sent to the server
+
+    @return The current load method
+  */
+  MySQLLoadMethod get_load_method() const throw ();
+
+  /**
+    Set up the client library for the calling thread, which must be done
+    before a thread other than the one that opened a connection uses it.
+    Only the first call on each thread does anything, and mysql_thread_end()
+    is called for it when the thread exits
+  */
+  static void init_thread() throw ();
+
+  /**
+    Set how many text INSERTs may be in flight at once. A dedicated thread
+    sends them, while the next one is built from the extracted rows, so the
+    extraction only waits when this many are already waiting on the network.
+    With 0, each INSERT is sent on the extracting thread. The default is 2
+
+    @param batches How many INSERTs may be in flight
+  */
+  void set_batches_in_flight(const unsigned int batches) throw ();
+
+  /**
+    Get how many text INSERTs may be in flight at once
+
+    @return How many INSERTs may be in flight
+  */
+  unsigned int get_batches_in_flight() const throw ();
+
+  /**
+    Set whether tables are replaced without downtime. Each table is then
+    loaded into an unlocked <name>__staging table, which is swapped in for the
+    live table with a single RENAME TABLE once it has all of its rows and
+    indexes. Until then, the live table can be read as usual. A failed load
+    leaves the live table as it was. The default is false, which drops and
+    recreates the live table and locks it while it loads
+
+    @param staging Whether tables are loaded into staging tables
+  */
+  void set_staging(const bool staging) throw ();
+
+  /**
+    Get whether tables are replaced without downtime
+
+    @return Whether tables are loaded into staging tables
+  */
+  bool get_staging() const throw ();
+
+  /**
+    Set whether an interrupted load can be resumed. Rows are then committed
+    a range at a time, each in a transaction with a record of the range in
+    the driller_checkpoints table. Loading the same table again skips the
+    ranges already recorded and sends the rest, as long as the table has the
+    same number of rows and is split into the same ranges. The records are
+    removed once the table is complete. Tables are never locked while
+    resumable. The default is false
+
+    @param resumable Whether loads can be resumed
+  */
+  void set_resumable(const bool resumable) throw ();
+
+  /**
+    Get whether an interrupted load can be resumed
+
+    @return Whether loads can be resumed
+  */
+  bool get_resumable() const throw ();
+
+  /**
+    Set a column to merge rows by, instead of replacing tables. A table with
+    this column is kept, and given a unique index on it if it hasn't one.
+    Each row is then inserted with ON DUPLICATE KEY UPDATE, so the server
+    only writes rows which are new or have changed. Afterwards, rows whose
+    key isn't in the source are deleted a batch at a time. The LOAD DATA
+    method replaces every row instead. Tables without the column, or whose
+    column can't be indexed, are replaced as usual, and merged tables are
+    never staged. The default is empty, which merges nothing
+
+    @param column The name of the key column, or an empty string
+  */
+  void set_upsert_key(const std::string& column) throw ();
+
+  /**
+    Get the column rows are merged by
+
+    @return The name of the key column, or an empty string
+  */
+  const std::string& get_upsert_key() const throw ();
+
+  /**
+    Set whether each table's rows are sorted by its first indexed column
+    before they are sent, so that they arrive in key order. Columns are
+    compared by their raw values, not their text. The default is false
+
+    @param presort Whether rows are sorted before they are sent
+  */
+  void set_presort(const bool presort) throw ();
+
+  /**
+    Get whether rows are sorted before they are sent
+
+    @return Whether rows are sorted before they are sent
+  */
+  bool get_presort() const throw ();
+
+  /**
+    Set the most memory sorting a table's rows may use. Larger tables are
+    sorted in runs on disk, and then merged
+
+    @param bytes The most memory a sort may use, in bytes
+  */
+  void set_sort_memory(const uint64 bytes) throw ();
+
+  /**
+    Replace a table, or its staging table, with an empty one matching its
+    definition. Its indexes are left out until end_table() is called. If
+    loads are resumable and an earlier load of the table was interrupted, the
+    table is kept instead, and the ranges it already has are returned
+
+    @param table The table to create
+    @param lock Whether to lock the table for writing. A locked table can
+    only be written to through this connection. Staging tables are never
+    locked
+    @param row_count How many rows will be loaded
+    @param range_rows How many rows insert_rows() will be sent at a time,
+    except for the last range
+
+    @return The first row of each range which needn't be sent again
+  */
+  std::set<unsigned int> begin_table(const Table& table, const bool lock,
+    const unsigned int row_count, const unsigned int range_rows)
+    throw (Errors::MySQLError);
+
+  /**
+    Build a table's indexes after its rows have been sent, and swap it in
+    if it's a staging table. A merged table instead has the rows which
+    aren't in the source deleted
+
+    @param data The rows which were loaded into the table passed to
+    begin_table()
+    @param lock Whether the table was locked by begin_table()
+  */
+  void end_table(const MySQLTableData& data, const bool lock)
+    throw (Errors::MySQLError);
+
+  /**
+    Load a table's rows in the form this sink's load method sends them in
+
+    @param table The table to load
+    @param row_limit If this is greater than 0, limit the number of rows
+
+    @return The loaded rows. This should be deleted.
+  */
+  const MySQLTableData* load_table_data(const Table& table,
+    const unsigned int row_limit = 0) const
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Send a range of loaded rows to their table, which must have been created
+    by begin_table() on this or another connection
+
+    @param data The loaded rows
+    @param first The first row to send
+    @param count How many rows to send
+  */
+  void insert_rows(const MySQLTableData& data, const unsigned int first,
+    const unsigned int count) throw (Errors::MySQLError);
+
+  /**
+    Get how many rows have been sent through this connection
+
+    @return How many rows have been sent
+  */
+  unsigned int get_rows_sent() const throw ();
+
+  /**
+    Get how long has been spent sending rows through this connection
+
+    @return The time spent in insert_rows(), in seconds
+  */
+  double get_send_time() const throw ();
+
+  /**
+    Get how long has been spent building indexes through this connection
+
+    @return The time spent adding indexes in end_table(), in seconds
+  */
+  double get_index_time() const throw ();
 
 protected:
+  /**
+    Replace the table rows are loaded into with an empty one matching its
+    definition
+
+    @param table The table to create
+  */
+  void create_table(const Table& table) throw(Errors::MySQLError);
+
+  /**
+    Create the table rows are merged into if it doesn't exist, and make
+    sure it has a unique index on the key column
+
+    @param table The table to merge rows into
+  */
+  void prepare_merge(const Table& table) throw(Errors::MySQLError);
+
+  /**
+    Delete the rows of a merged table whose keys aren't among the loaded
+    rows. The keys are sent to a temporary table, and the rows without a
+    match are deleted a batch at a time
+
+    @param data The rows merged into the table
+  */
+  void delete_absent_rows(const MySQLTableData& data)
+    throw(Errors::MySQLError);
+
+  /**
+    Get the column definitions of a table, as used by CREATE TABLE
+
+    @param table The table
+
+    @return Each column's name and type, separated by commas
+  */
+  std::string column_definitions(const Table& table) throw();
+
+  /**
+    Find the column a table's rows are merged by
+
+    @param table The table
+
+    @return The index of the key column, or -1 if the table isn't merged
+  */
+  int upsert_column(const Table& table) const throw();
+
+  /**
+    Check whether rows are merged into a table, rather than replacing it
+
+    @param table The table
+
+    @return Whether the table has the key column
+  */
+  bool merges(const Table& table) const throw();
+
+  /**
+    Get what ends each INSERT into a table, which updates existing rows
+    when rows are merged
+
+    @param table The table
+
+    @return The ON DUPLICATE KEY UPDATE clause, or an empty string
+  */
+  std::string insert_suffix(const Table& table) throw();
+
+  /**
+    Add the indexes of every column marked as indexed, with a single
+    ALTER TABLE. Building them once all rows are loaded is much faster than
+    updating them for every row
+
+    @param table The loaded table
+  */
+  void add_indexes(const Table& table) throw(Errors::MySQLError);
+
+  /**
+    Find the ranges of a table committed by an interrupted resumable load.
+    If any record doesn't match the ranges of this load, or the table is
+    gone, every record is removed and nothing is resumed
+
+    @param table The table being loaded
+    @param row_count How many rows will be loaded
+    @param range_rows How many rows are sent at a time
+
+    @return The first row of each committed range
+  */
+  std::set<unsigned int> find_checkpoints(const Table& table,
+    const unsigned int row_count, const unsigned int range_rows)
+    throw(Errors::MySQLError);
+
+  /**
+    Replace a live table with its fully loaded staging table
+
+    @param table The table to replace
+  */
+  void swap_table(const Table& table) throw(Errors::MySQLError);
+
+  /**
+    Get the name of the table rows are loaded into, which is either the
+    table's own name or its staging table's
+
+    @param table The table being loaded
+
+    @return The safe name to load rows into
+  */
+  std::string load_table_name(const Table& table) throw();
+
+  /**
+    Send a table's rows as multi-row text INSERT statements. Values are
+    written straight into a reusable query buffer, with only text quoted and
+    escaped, and each query is sized by bytes rather than rows: it never
+    exceeds the server's max_allowed_packet, and it grows or shrinks so that
+    the round trip latency stays a small part of the time each query takes. Finished queries are handed to the sender
+    thread, so the next one is built while they are on the wire
+
+    @param data The loaded rows
+    @param first The first row to send
+    @param count How many rows to send
+  */
+  void insert_text(const MySQLTableData& data, const unsigned int first,
+    const unsigned int count) throw (Errors::MySQLError);
+
+  /**
+    Send the INSERT statement built in a query buffer, either directly or by
+    queueing it for the sender thread, and move on to the next buffer
+
+    @param jobs The job sending each buffer's query, or NULL
+    @param slot The buffer the statement is in. Receives the next buffer to
+    build a statement in
+    @param length The length of the statement
+  */
+  void send_batch(std::vector<SendJob*>& jobs, unsigned int& slot,
+    const unsigned int length) throw (Errors::MySQLError);
+
+  /**
+    Wait for a queued INSERT to be sent, throwing if it failed
+
+    @param job The job sending the INSERT, or NULL. This is deleted and set
+    to NULL
+  */
+  void finish_batch(SendJob*& job) throw (Errors::MySQLError);
+
+  /**
+    Work out how large the next INSERT should be from how long one took
+
+    @param length The length of the INSERT
+    @param elapsed How long it took, in seconds
+  */
+  void update_batch_size(const unsigned int length, const double elapsed)
+    throw ();
+
+  /**
+    Send a table's rows through a prepared INSERT statement, with each value
+    bound in its binary form. When both the client library and the server
+    support array binding, each column is bound as an array and a whole batch
+    is sent in one execution. Otherwise, the statement has placeholders for
+    several rows at once
+
+    @param rows The raw rows
+    @param first The first row to send
+    @param count How many rows to send
+  */
+  void insert_prepared(const RowData& rows, const unsigned int first,
+    const unsigned int count) throw (Errors::MySQLError);
+
+  /**
+    Stream rows through LOAD DATA LOCAL INFILE
+
+    @param rows The raw rows
+    @param first The first row to send
+    @param count How many rows to send
+  */
+  void load_infile(const RowData& rows, const unsigned int first,
+    const unsigned int count) throw (Errors::MySQLError);
+
+  /**
+    Make the connection refuse every LOAD DATA LOCAL INFILE request. This is
+    how it's left whenever load_infile() isn't streaming rows
+  */
+  void refuse_infile() throw ();
+
+  /**
+    Check whether the server accepts array-bound prepared statements
+
+    @return Whether array binding can be used
+  */
+  bool supports_array_binding() const throw();
+
   /**
     Make a string safe to send to MySQL
 
@@ -97,7 +567,7 @@ protected:
     @return A pointer to the safe version of the string. Do not free or delete
     this. This pointer will be overwritten every time this function is called
   */
-  const char* make_safe_string(const std::string& string) const throw();
+  const char* make_safe_string(const std::string& string) throw();
 
   /**
     Make a string safe for being a name in MySQL
@@ -107,7 +577,7 @@ protected:
     @return A pointer to the safe version of the name. Do not free or delete
     this. This pointer will be overwritten every time this function is called
   */
-  const char* make_safe_name(std::string name) const throw();
+  const char* make_safe_name(std::string name) throw();
 
   /**
     Send a MySQL query, checking for errors and throwing an exception if needed
@@ -116,16 +586,78 @@ protected:
   */
   void send_query(const std::string& query) const throw(Errors::MySQLError);
 
-  /**
-    Get the SQL description for a column's type
+  st_mysql* connection;
+
+  /** How rows are sent to the server */
+  MySQLLoadMethod load_method;
 
-    @param col The column
+  /** Whether the connection was opened with LOAD DATA LOCAL INFILE */
+  bool local_infile;
 
-    @return The SQL type definition for the column
+  /** Whether tables are loaded into staging tables and then swapped in */
+  bool staging;
+
+  /** Whether ranges of rows are committed with checkpoints */
+  bool resumable;
+
+  /** The column rows are merged by, or an empty string */
+  std::string upsert_key;
+
+  /** Whether rows are sorted by their first indexed column before loading */
+  bool presort;
+
+  /** The most memory a sort may use, in bytes */
+  uint64 sort_memory;
+
+  /** The server's max_allowed_packet */
+  unsigned long max_packet_size;
+
+  /**
+    Whether text can be escaped a byte at a time by escape_sql_string(),
+    rather than by the client library
   */
-  std::string sql_type_from_column(const Column& col) const throw();
+  bool byte_escaping;
 
-  st_mysql* connection;
+  /** The shortest time a query has taken, in seconds */
+  double round_trip;
+
+  /** The largest text INSERT that will be built */
+  unsigned int max_query_size;
+
+  /** Reused for every text INSERT, one for each that may be in flight */
+  std::vector<char*> query_buffers;
+
+  /** The size of each query buffer */
+  std::vector<unsigned int> query_buffer_sizes;
+
+  /** The thread sending text INSERTs, or NULL */
+  ThreadPool* sender;
+
+  /** How many text INSERTs may be in flight at once */
+  unsigned int batches_in_flight;
+
+  /** How many bytes the next text INSERT should hold */
+  unsigned int batch_bytes;
+
+  /** Holds the result of make_safe_string() */
+  char* escape_buffer;
+
+  /** The size of escape_buffer */
+  unsigned int escape_buffer_size;
+
+  /** How many rows insert_rows() has sent */
+  unsigned int rows_sent;
+
+  /** How long insert_rows() has taken, in seconds */
+  double send_time;
+
+  /** How long add_indexes() has taken, in seconds */
+  double index_time;
+
+private:
+  // The connection can't be shared between copies
+  MySQLSink(const MySQLSink&);
+  MySQLSink& operator=(const MySQLSink&);
 };
 
 } // namespace
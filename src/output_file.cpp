@@ -0,0 +1,347 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * output_file.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "output_file.h"
+#include "threads.h"
+#include <errno.h>
+#include <cstdio>
+
+namespace Driller {
+
+/**
+  Compresses a single block of an OutputFile
+*/
+class CompressionJob : public Job {
+public:
+  CompressionJob(const Compression _compression) throw ():
+    compression(_compression),
+    compressed(false){}
+
+  virtual ~CompressionJob() throw () {}
+
+  void run() {
+    compressed = compress_block(compression, input.data(),
+      static_cast<unsigned int>(input.size()), output);
+
+    // Free the input now, rather than when the block is written
+    std::string().swap(input);
+  }
+
+  const Compression compression;
+
+  /** The uncompressed block */
+  std::string input;
+
+  /** The compressed block */
+  std::string output;
+
+  /** Whether compression succeeded */
+  bool compressed;
+};
+
+/** Lookup table for the CRC-32 polynomial used by gzip and zip */
+class CRC32Table {
+public:
+  CRC32Table() throw () {
+    for (unsigned long ii = 0; ii < 256; ii++){
+      unsigned long value = ii;
+      for (int bit = 0; bit < 8; bit++){
+        value = (value & 1)? (0xEDB88320UL ^ (value >> 1)) : (value >> 1);
+      }
+      values[ii] = value;
+    }
+  }
+
+  unsigned long values[256];
+};
+
+// Built during static initialization, so threads never race to fill it
+static const CRC32Table crc32_table;
+
+/**
+  Update a CRC-32 with some more data. The running value starts at
+  0xFFFFFFFF, and must be inverted to give the final checksum
+
+  @param crc The running CRC
+  @param data The data to add
+  @param length How many bytes of data there are
+
+  @return The updated running CRC
+*/
+static unsigned long update_crc32(unsigned long crc, const char* data,
+  const unsigned int length) throw () {
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  for (unsigned int ii = 0; ii < length; ii++){
+    crc = crc32_table.values[(crc ^ bytes[ii]) & 0xFF] ^ (crc >> 8);
+  }
+
+  return crc & 0xFFFFFFFFUL;
+}
+
+// 1 MiB blocks are large enough that splitting the stream costs very little
+// compression, and small enough to keep every thread busy on modest tables
+const unsigned int OutputFile::block_size = 1024 * 1024;
+
+OutputFile::OutputFile(
+  const std::string& _file_name,
+  const Compression _compression,
+  ThreadPool* _pool) throw (Errors::FileWriteError):
+
+  file_name(_file_name),
+  compression(_compression),
+  pool(_pool),
+  file(NULL),
+  written(0),
+  crc(0xFFFFFFFFUL){
+
+  if (!compression_available(compression)){
+    throw Errors::FileWriteError(file_name, ENOSYS);
+  }
+
+  file = fopen(file_name.c_str(), "wb");
+  if (!file){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+
+  buffer.reserve(block_size);
+}
+
+OutputFile::~OutputFile() throw () {
+  if (file){
+    discard_pending();
+    fclose(file);
+  }
+}
+
+void OutputFile::write(const char* data, const unsigned int length)
+  throw (Errors::FileWriteError) {
+
+  buffer.append(data, length);
+  if (buffer.size() >= block_size){
+    flush_block();
+  }
+}
+
+void OutputFile::write(const std::string& data)
+  throw (Errors::FileWriteError) {
+
+  write(data.data(), static_cast<unsigned int>(data.size()));
+}
+
+void OutputFile::close() throw (Errors::FileWriteError) {
+  if (!file){
+    return;
+  }
+
+  flush_block();
+  write_finished(true);
+
+  // A compressed file must hold at least one gzip member or zstd frame, so
+  // an empty file is still valid when nothing was written to it
+  if (written == 0 && compression != COMPRESSION_NONE){
+    if (!compress_block(compression, buffer.data(), 0, compressed)){
+      throw Errors::FileWriteError(file_name, EIO);
+    }
+
+    write_raw(compressed.data(), static_cast<unsigned int>(compressed.size()));
+  }
+
+  const int result = fclose(file);
+  file = NULL;
+
+  if (result != 0){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+void OutputFile::flush_block() throw (Errors::FileWriteError) {
+  if (buffer.empty()){
+    return;
+  }
+
+  // Uncompressed data goes straight to the file
+  if (compression == COMPRESSION_NONE){
+    write_raw(buffer.data(), static_cast<unsigned int>(buffer.size()));
+    buffer.clear();
+    return;
+  }
+
+  // Without a pool, compress on this thread
+  if (!pool){
+    if (!compress_block(compression, buffer.data(),
+      static_cast<unsigned int>(buffer.size()), compressed)){
+
+      throw Errors::FileWriteError(file_name, EIO);
+    }
+
+    write_raw(compressed.data(), static_cast<unsigned int>(compressed.size()));
+    buffer.clear();
+    return;
+  }
+
+  CompressionJob* job = new CompressionJob(compression);
+  job->input.swap(buffer);
+  buffer.reserve(block_size);
+
+  pending.push_back(job);
+  pool->add_job(job);
+
+  // Write whatever is already done, and stop the extraction from getting too
+  // far ahead of the compressors
+  write_finished(false);
+  while (pending.size() > 2 * pool->thread_count()){
+    pool->wait(pending.front());
+    write_finished(false);
+  }
+}
+
+void OutputFile::write_finished(const bool block)
+  throw (Errors::FileWriteError) {
+
+  while (!pending.empty()){
+    CompressionJob* job = pending.front();
+
+    if (block){
+      pool->wait(job);
+    }
+
+    else if (!pool->poll(job)){
+      break;
+    }
+
+    pending.pop_front();
+
+    if (job->failed() || !job->compressed){
+      delete job;
+      discard_pending();
+      throw Errors::FileWriteError(file_name, EIO);
+    }
+
+    try {
+      write_raw(job->output.data(),
+        static_cast<unsigned int>(job->output.size()));
+    }
+
+    catch (...){
+      delete job;
+      discard_pending();
+      throw;
+    }
+
+    delete job;
+  }
+}
+
+void OutputFile::write_raw(const char* data, const unsigned int length)
+  throw (Errors::FileWriteError) {
+
+  if (length > 0 && fwrite(data, 1, length, file) != length){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+
+  written += length;
+  crc = update_crc32(crc, data, length);
+}
+
+unsigned long OutputFile::bytes_written() const throw () {
+  return written;
+}
+
+unsigned long OutputFile::checksum() const throw () {
+  return crc ^ 0xFFFFFFFFUL;
+}
+
+void OutputFile::discard_pending() throw () {
+  while (!pending.empty()){
+    pool->wait(pending.front());
+    delete pending.front();
+    pending.pop_front();
+  }
+}
+
+std::string part_file_name(const std::string& file_name,
+  const unsigned int part) throw () {
+
+  char suffix[32];
+  sprintf(suffix, ".part%04u", part);
+  return file_name + suffix;
+}
+
+void join_files(const std::string& file_name,
+  const std::vector<std::string>& parts)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  if (parts.empty()){
+    return;
+  }
+
+  // Renaming won't replace an existing file everywhere
+  remove(file_name.c_str());
+  if (rename(parts[0].c_str(), file_name.c_str()) != 0){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+
+  FILE* file = fopen(file_name.c_str(), "ab");
+  if (!file){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+
+  std::vector<char> buffer(OutputFile::block_size);
+  for (unsigned int ii = 1; ii < parts.size(); ii++){
+    FILE* part = fopen(parts[ii].c_str(), "rb");
+    if (!part){
+      const int error = errno;
+      fclose(file);
+      throw Errors::FileReadError(parts[ii], error);
+    }
+
+    size_t length;
+    while ((length = fread(&buffer[0], 1, buffer.size(), part)) > 0){
+      if (fwrite(&buffer[0], 1, length, file) != length){
+        const int error = errno;
+        fclose(part);
+        fclose(file);
+        throw Errors::FileWriteError(file_name, error);
+      }
+    }
+
+    const bool read_failed = ferror(part) != 0;
+    fclose(part);
+    if (read_failed){
+      fclose(file);
+      throw Errors::FileReadError(parts[ii], EIO);
+    }
+
+    remove(parts[ii].c_str());
+  }
+
+  if (fclose(file) != 0){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+void remove_files(const std::vector<std::string>& files) throw () {
+  for (unsigned int ii = 0; ii < files.size(); ii++){
+    remove(files[ii].c_str());
+  }
+}
+
+} // namespace
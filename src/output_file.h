@@ -0,0 +1,192 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * output_file.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_OUTPUT_FILE_H
+#define DRILLER_OUTPUT_FILE_H
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#include "compression.h"
+#include "file_errors.h"
+
+namespace Driller {
+
+class ThreadPool;
+class CompressionJob;
+
+/**
+  A file being written to, optionally compressed. Data is collected into
+  blocks, and each block is compressed independently so that several blocks
+  can be compressed at once by a ThreadPool. Blocks are always written to the
+  file in the order they were filled
+*/
+class OutputFile {
+public:
+  /**
+    Open a file for writing, truncating it if it already exists
+
+    @param file_name The name of the file to write
+    @param compression How to compress the file's contents
+    @param pool If not NULL, blocks will be compressed by this pool's threads.
+    The pool must outlive this file
+  */
+  OutputFile(
+    const std::string& file_name,
+    const Compression compression = COMPRESSION_NONE,
+    ThreadPool* pool = NULL) throw (Errors::FileWriteError);
+
+  /** Close the file, if it hasn't been already. Errors are ignored */
+  ~OutputFile() throw ();
+
+  /**
+    Write some data to the file
+
+    @param data The data to write
+    @param length How many bytes of data there are
+  */
+  void write(const char* data, const unsigned int length)
+    throw (Errors::FileWriteError);
+
+  /**
+    Write a string to the file
+
+    @param data The string to write
+  */
+  void write(const std::string& data) throw (Errors::FileWriteError);
+
+  /**
+    Write any buffered data, wait for it to be compressed, and close the
+    file. Call this to find out whether the last writes succeeded
+  */
+  void close() throw (Errors::FileWriteError);
+
+  /**
+    Get how many bytes have been written to the file so far. After close(),
+    this is the size of the finished file
+
+    @return How many bytes have been written
+  */
+  unsigned long bytes_written() const throw ();
+
+  /**
+    Get the CRC-32 of everything written to the file so far, as it appears
+    on disk. After close(), this is the checksum of the finished file
+
+    @return The CRC-32 (as used by gzip and zip) of the written bytes
+  */
+  unsigned long checksum() const throw ();
+
+  /** How much uncompressed data is collected before compressing it */
+  static const unsigned int block_size;
+
+protected:
+  /** Compress the current block, or queue it to be compressed */
+  void flush_block() throw (Errors::FileWriteError);
+
+  /**
+    Write compressed blocks to the file, in order
+
+    @param block If true, wait for blocks which are still being compressed.
+    Otherwise stop at the first unfinished block
+  */
+  void write_finished(const bool block) throw (Errors::FileWriteError);
+
+  /**
+    Write raw bytes to the underlying file
+
+    @param data The bytes to write
+    @param length How many bytes to write
+  */
+  void write_raw(const char* data, const unsigned int length)
+    throw (Errors::FileWriteError);
+
+  /** Delete any queued jobs, after waiting for them to finish */
+  void discard_pending() throw ();
+
+  /** The name of the file, for error messages */
+  const std::string file_name;
+
+  /** How the file is compressed */
+  const Compression compression;
+
+  /** Used to compress blocks in parallel, or NULL */
+  ThreadPool* pool;
+
+  /** The file being written to, or NULL once closed */
+  FILE* file;
+
+  /** Data not yet compressed */
+  std::string buffer;
+
+  /** Compressed output, when blocks are compressed on this thread */
+  std::string compressed;
+
+  /** Blocks handed to the pool, in the order they must be written */
+  std::deque<CompressionJob*> pending;
+
+  /** How many bytes have been written to the file */
+  unsigned long written;
+
+  /** Running CRC-32 of the written bytes, before final inversion */
+  unsigned long crc;
+
+private:
+  // Output files cannot be copied
+  OutputFile(const OutputFile&);
+  OutputFile& operator=(const OutputFile&);
+};
+
+/**
+  Get the name one part of a file is written to, when the file is written
+  in several parts at once
+
+  @param file_name The name of the finished file
+  @param part The part's number
+
+  @return The part's file name, such as "table.txt.part0001"
+*/
+std::string part_file_name(const std::string& file_name,
+  const unsigned int part) throw ();
+
+/**
+  Join the parts of a file, in order. The first part is renamed to the
+  finished file, and every other part is appended to it and removed. Since
+  compressed blocks are complete streams, this works for compressed parts
+  too
+
+  @param file_name The name of the finished file
+  @param parts The name of each part
+*/
+void join_files(const std::string& file_name,
+  const std::vector<std::string>& parts)
+  throw (Errors::FileReadError, Errors::FileWriteError);
+
+/**
+  Remove files, ignoring any which don't exist
+
+  @param files The name of each file
+*/
+void remove_files(const std::vector<std::string>& files) throw ();
+
+} // namespace
+
+#endif // DRILLER_OUTPUT_FILE_H
@@ -0,0 +1,1030 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * parquet_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include "parquet_sink.h"
+#include "output_file.h"
+#include "string_scan.h"
+#include <errno.h>
+#include <map>
+#include <vector>
+#include <cstring>
+
+namespace Driller {
+
+//////////////////////////////////
+// Parquet format constants     //
+// (from parquet.thrift)        //
+//////////////////////////////////
+
+/** Physical types */
+enum ParquetType {
+  PARQUET_BOOLEAN = 0,
+  PARQUET_INT32 = 1,
+  PARQUET_INT64 = 2,
+  PARQUET_BYTE_ARRAY = 6
+};
+
+/** Legacy logical type annotations, still read by older tools */
+enum ParquetConvertedType {
+  PARQUET_CONVERTED_NONE = -1,
+  PARQUET_CONVERTED_UTF8 = 0,
+  PARQUET_CONVERTED_DECIMAL = 5,
+  PARQUET_CONVERTED_DATE = 6,
+  PARQUET_CONVERTED_UINT_8 = 11,
+  PARQUET_CONVERTED_UINT_16 = 12,
+  PARQUET_CONVERTED_UINT_32 = 13,
+  PARQUET_CONVERTED_INT_8 = 15,
+  PARQUET_CONVERTED_INT_16 = 16,
+  PARQUET_CONVERTED_INT_32 = 17
+};
+
+/** Value encodings */
+enum ParquetEncoding {
+  PARQUET_PLAIN = 0,
+  PARQUET_RLE = 3,
+  PARQUET_RLE_DICTIONARY = 8
+};
+
+/** Page types */
+enum ParquetPageType {
+  PARQUET_DATA_PAGE = 0,
+  PARQUET_DICTIONARY_PAGE = 2
+};
+
+/** Mapping from Compression to Parquet's compression codec IDs */
+static const int parquet_codecs[COMPRESSION_NUM_TYPES] = {
+  0, // UNCOMPRESSED
+  2, // GZIP
+  6  // ZSTD
+};
+
+/** Thrift compact protocol type IDs */
+enum ThriftType {
+  THRIFT_BOOL_TRUE = 1,
+  THRIFT_BOOL_FALSE = 2,
+  THRIFT_BYTE = 3,
+  THRIFT_I16 = 4,
+  THRIFT_I32 = 5,
+  THRIFT_I64 = 6,
+  THRIFT_BINARY = 8,
+  THRIFT_LIST = 9,
+  THRIFT_STRUCT = 12
+};
+
+/** Pages are ended once their encoded values reach this size */
+static const unsigned int page_size = 1024 * 1024;
+
+/** Dictionary encoding is abandoned if the dictionary grows past this size */
+static const unsigned int max_dictionary_size = 1024 * 1024;
+
+///////////////////////
+// Encoding helpers  //
+///////////////////////
+
+/** Append a little-endian 32-bit integer */
+static void put_int32(std::string& out, const uint32 value) throw () {
+  out += static_cast<char>(value & 0xFF);
+  out += static_cast<char>((value >> 8) & 0xFF);
+  out += static_cast<char>((value >> 16) & 0xFF);
+  out += static_cast<char>((value >> 24) & 0xFF);
+}
+
+/** Append a little-endian 64-bit integer */
+static void put_int64(std::string& out, const uint64 value) throw () {
+  put_int32(out, static_cast<uint32>(value & 0xFFFFFFFFu));
+  put_int32(out, static_cast<uint32>(value >> 32));
+}
+
+/** Append an unsigned LEB128 varint */
+static void put_varint(std::string& out, uint64 value) throw () {
+  while (value >= 0x80){
+    out += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+/**
+  Writes Thrift structures using the compact protocol, which is how every
+  Parquet header and the file footer are serialized
+*/
+class ThriftWriter {
+public:
+  ThriftWriter(std::string& _out) throw ():
+    out(_out){
+
+    last_field.push_back(0);
+  }
+
+  void field_i32(const int16 id, const int32 value) throw () {
+    field_header(id, THRIFT_I32);
+    put_zigzag(value);
+  }
+
+  void field_i64(const int16 id, const int64 value) throw () {
+    field_header(id, THRIFT_I64);
+    put_zigzag(value);
+  }
+
+  void field_byte(const int16 id, const int8 value) throw () {
+    field_header(id, THRIFT_BYTE);
+    out += static_cast<char>(value);
+  }
+
+  void field_bool(const int16 id, const bool value) throw () {
+    // Booleans are stored in the field header's type
+    field_header(id, value? THRIFT_BOOL_TRUE : THRIFT_BOOL_FALSE);
+  }
+
+  void field_binary(const int16 id, const std::string& value) throw () {
+    field_header(id, THRIFT_BINARY);
+    binary(value);
+  }
+
+  /** Start a struct-typed field. Finish it with end_struct() */
+  void field_struct(const int16 id) throw () {
+    field_header(id, THRIFT_STRUCT);
+    last_field.push_back(0);
+  }
+
+  /** Start a list-typed field. Write exactly size elements after this */
+  void field_list(const int16 id, const ThriftType element_type,
+    const unsigned int size) throw () {
+
+    field_header(id, THRIFT_LIST);
+    if (size < 15){
+      out += static_cast<char>((size << 4) | element_type);
+    }
+
+    else {
+      out += static_cast<char>(0xF0 | element_type);
+      put_varint(out, size);
+    }
+  }
+
+  /** Start a struct which is an element of a list */
+  void begin_struct() throw () {
+    last_field.push_back(0);
+  }
+
+  /** End any struct */
+  void end_struct() throw () {
+    out += '\0';
+    last_field.pop_back();
+  }
+
+  /** Write an i32 list element */
+  void i32(const int32 value) throw () {
+    put_zigzag(value);
+  }
+
+  /** Write a binary or string list element */
+  void binary(const std::string& value) throw () {
+    put_varint(out, value.size());
+    out += value;
+  }
+
+protected:
+  void field_header(const int16 id, const ThriftType type) throw () {
+    const int16 delta = id - last_field.back();
+    if (delta > 0 && delta <= 15){
+      out += static_cast<char>((delta << 4) | type);
+    }
+
+    else {
+      out += static_cast<char>(type);
+      put_zigzag(id);
+    }
+    last_field.back() = id;
+  }
+
+  void put_zigzag(const int64 value) throw () {
+    put_varint(out, (static_cast<uint64>(value) << 1) ^
+      static_cast<uint64>(value >> 63));
+  }
+
+  std::string& out;
+
+  /** The last field ID written in each open struct */
+  std::vector<int16> last_field;
+};
+
+/**
+  Bit-pack pending literal values, padding the last group of 8 with zeros
+
+  @param literals The values to pack, which will be cleared
+  @param bit_width How many bits each value needs
+  @param out The string to append the packed values to
+*/
+static void flush_literals(std::vector<uint32>& literals,
+  const unsigned int bit_width, std::string& out) throw () {
+
+  if (literals.empty()){
+    return;
+  }
+
+  while (literals.size() % 8){
+    literals.push_back(0);
+  }
+
+  put_varint(out, ((literals.size() / 8) << 1) | 1);
+
+  uint64 bits = 0;
+  unsigned int bit_count = 0;
+  for (unsigned int ii = 0; ii < literals.size(); ii++){
+    bits |= static_cast<uint64>(literals[ii]) << bit_count;
+    bit_count += bit_width;
+    while (bit_count >= 8){
+      out += static_cast<char>(bits & 0xFF);
+      bits >>= 8;
+      bit_count -= 8;
+    }
+  }
+
+  literals.clear();
+}
+
+/**
+  Encode values with Parquet's RLE / bit-packing hybrid encoding. Runs of
+  8 or more repeated values become RLE runs, and everything else is bit
+  packed in groups of 8
+
+  @param values The values to encode
+  @param first The first value to encode
+  @param count How many values to encode
+  @param bit_width How many bits each value needs
+  @param out The string to append the encoded values to
+*/
+static void encode_rle_hybrid(const std::vector<uint32>& values,
+  const unsigned int first, const unsigned int count,
+  const unsigned int bit_width, std::string& out) throw () {
+
+  std::vector<uint32> literals;
+  const unsigned int end = first + count;
+  const unsigned int value_bytes = (bit_width + 7) / 8;
+
+  unsigned int ii = first;
+  while (ii < end){
+    unsigned int run_end = ii + 1;
+    while (run_end < end && values[run_end] == values[ii]){
+      ++run_end;
+    }
+    unsigned int run = run_end - ii;
+
+    // Literal groups must be complete, so borrow from the run to fill them
+    const unsigned int padding = (8 - (literals.size() % 8)) % 8;
+
+    if (run >= padding + 8){
+      literals.insert(literals.end(), padding, values[ii]);
+      run -= padding;
+      flush_literals(literals, bit_width, out);
+
+      put_varint(out, run << 1);
+      for (unsigned int byte = 0; byte < value_bytes; byte++){
+        out += static_cast<char>((values[ii] >> (8 * byte)) & 0xFF);
+      }
+    }
+
+    else {
+      literals.insert(literals.end(), run, values[ii]);
+    }
+
+    ii = run_end;
+  }
+
+  flush_literals(literals, bit_width, out);
+}
+
+/////////////////////
+// Column writing  //
+/////////////////////
+
+/** How a column's values are read and stored */
+enum ValueKind {
+  KIND_BOOLEAN,  /**< A single byte, true if nonzero */
+  KIND_INT32,    /**< Integers and dates */
+  KIND_DECIMAL,  /**< Currency, stored as an INT64 count of cents */
+  KIND_BYTES,    /**< Raw bytes of strings and blobs */
+  KIND_TEXT,     /**< Anything else, using its text representation */
+  KIND_ENUM      /**< An enumeration's case values */
+};
+
+/** Get how a column's values should be read and stored */
+static ValueKind value_kind(const Column& column) throw () {
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return KIND_BOOLEAN;
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+    case COLUMN_DATE:
+      return KIND_INT32;
+
+    case COLUMN_CURRENCY:
+      return KIND_DECIMAL;
+
+    case COLUMN_BLOB:
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING:
+      return KIND_BYTES;
+
+    case COLUMN_ENUM:
+      return KIND_ENUM;
+
+    default:
+      return KIND_TEXT;
+  }
+}
+
+/** Read an integer or date column as an INT32 */
+static int32 read_int32(const Column& column, const uint8* row) throw () {
+  const uint8* field = column.get_field(row);
+
+  switch (column.get_type()){
+    case COLUMN_INT8:
+      return Column::get_int8(field);
+
+    case COLUMN_UINT8:
+      return Column::get_uint8(field);
+
+    case COLUMN_INT16:
+      return Column::get_int16(field);
+
+    case COLUMN_UINT16:
+      return Column::get_uint16(field);
+
+    case COLUMN_INT32:
+      return Column::get_int32(field);
+
+    // Stored as the same bits, and annotated as unsigned
+    case COLUMN_UINT32:
+      return static_cast<int32>(Column::get_uint32(field));
+
+    case COLUMN_DATE:
+      return Column::date_to_unix_days(Column::get_uint32(field));
+
+    default:
+      return 0;
+  }
+}
+
+/** Metadata gathered while writing one column chunk */
+class ChunkInfo {
+public:
+  ChunkInfo() throw ():
+    uncompressed_size(0),
+    compressed_size(0),
+    data_page_offset(0),
+    dictionary_page_offset(0),
+    dictionary(false){}
+
+  int64 uncompressed_size;
+  int64 compressed_size;
+  int64 data_page_offset;
+  int64 dictionary_page_offset;
+
+  /** Whether the chunk was dictionary encoded */
+  bool dictionary;
+};
+
+/**
+  Writes the pages of a single column chunk
+*/
+class ChunkWriter {
+public:
+  ChunkWriter(OutputFile& _file, int64& _position,
+    const Compression _compression, ChunkInfo& _info) throw ():
+
+    file(_file),
+    position(_position),
+    compression(_compression),
+    info(_info),
+    first_data_page(true){}
+
+  /**
+    Write a page
+
+    @param type Whether this is a data or dictionary page
+    @param body The encoded values
+    @param value_count How many values the page holds
+    @param encoding How the values are encoded
+  */
+  void write_page(const ParquetPageType type, const std::string& body,
+    const unsigned int value_count, const ParquetEncoding encoding)
+    throw (Errors::FileWriteError) {
+
+    const std::string* stored = &body;
+    if (compression != COMPRESSION_NONE){
+      if (!compress_block(compression, body.data(),
+        static_cast<unsigned int>(body.size()), compressed)){
+
+        throw Errors::FileWriteError("", EIO);
+      }
+      stored = &compressed;
+    }
+
+    std::string header;
+    ThriftWriter writer(header);
+    writer.field_i32(1, type);
+    writer.field_i32(2, static_cast<int32>(body.size()));
+    writer.field_i32(3, static_cast<int32>(stored->size()));
+
+    if (type == PARQUET_DICTIONARY_PAGE){
+      writer.field_struct(7);
+      writer.field_i32(1, value_count);
+      writer.field_i32(2, encoding);
+      writer.end_struct();
+
+      info.dictionary_page_offset = position;
+    }
+
+    else {
+      writer.field_struct(5);
+      writer.field_i32(1, value_count);
+      writer.field_i32(2, encoding);
+      writer.field_i32(3, PARQUET_RLE); // definition levels
+      writer.field_i32(4, PARQUET_RLE); // repetition levels
+      writer.end_struct();
+
+      if (first_data_page){
+        info.data_page_offset = position;
+        first_data_page = false;
+      }
+    }
+    writer.end_struct();
+
+    info.uncompressed_size += header.size() + body.size();
+    info.compressed_size += header.size() + stored->size();
+
+    file.write(header);
+    file.write(*stored);
+    position += header.size() + stored->size();
+  }
+
+protected:
+  OutputFile& file;
+
+  /** Where the next page will start in the file */
+  int64& position;
+
+  const Compression compression;
+  ChunkInfo& info;
+  bool first_data_page;
+
+  /** Reused buffer for compressed pages */
+  std::string compressed;
+};
+
+/**
+  Write one column of a row group
+
+  @param file The file to write to
+  @param position The current end of the file, which is advanced past the
+  written pages
+  @param compression How pages are compressed
+  @param column The column being written
+  @param rows The table's rows
+  @param first_row The first row in the row group
+  @param row_count How many rows are in the row group
+  @param info Receives metadata about the written chunk
+*/
+static void write_column_chunk(OutputFile& file, int64& position,
+  const Compression compression, const Column& column, const RowData& rows,
+  const unsigned int first_row, const unsigned int row_count, ChunkInfo& info)
+  throw (Errors::FileWriteError) {
+
+  ChunkWriter writer(file, position, compression, info);
+  const ValueKind kind = value_kind(column);
+  const unsigned int end_row = first_row + row_count;
+  std::string page;
+  unsigned int page_values = 0;
+
+  // Booleans are bit packed, eight to a byte
+  if (kind == KIND_BOOLEAN){
+    unsigned char bits = 0;
+    for (unsigned int row = first_row; row < end_row; row++){
+      if (column.get_field(rows[row])[0]){
+        bits |= static_cast<unsigned char>(1 << (page_values % 8));
+      }
+
+      if (++page_values % 8 == 0){
+        page += static_cast<char>(bits);
+        bits = 0;
+
+        if (page.size() >= page_size){
+          writer.write_page(PARQUET_DATA_PAGE, page, page_values,
+            PARQUET_PLAIN);
+          page.clear();
+          page_values = 0;
+        }
+      }
+    }
+
+    if (page_values % 8){
+      page += static_cast<char>(bits);
+    }
+
+    if (page_values){
+      writer.write_page(PARQUET_DATA_PAGE, page, page_values, PARQUET_PLAIN);
+    }
+    return;
+  }
+
+  // Fixed-width integers are stored plainly
+  if (kind == KIND_INT32 || kind == KIND_DECIMAL){
+    for (unsigned int row = first_row; row < end_row; row++){
+      if (kind == KIND_INT32){
+        put_int32(page, static_cast<uint32>(read_int32(column, rows[row])));
+      }
+
+      else {
+        put_int64(page, static_cast<uint64>(static_cast<int64>(
+          Column::get_int32(column.get_field(rows[row])))));
+      }
+
+      if (++page_values * ((kind == KIND_INT32)? 4 : 8) >= page_size){
+        writer.write_page(PARQUET_DATA_PAGE, page, page_values, PARQUET_PLAIN);
+        page.clear();
+        page_values = 0;
+      }
+    }
+
+    if (page_values){
+      writer.write_page(PARQUET_DATA_PAGE, page, page_values, PARQUET_PLAIN);
+    }
+    return;
+  }
+
+  // Everything else is a byte array. Try to build a dictionary of distinct
+  // values first, since most string columns repeat a lot
+  unsigned int format_buffer_size = 30;
+  char* format_buffer = new char[format_buffer_size];
+
+  std::vector<std::string> values;
+  std::vector<uint32> indices;
+  std::map<std::string, uint32> dictionary;
+  std::vector<int> enum_indices(256, -1);
+  unsigned int dictionary_size = 0;
+  bool use_dictionary = (column.get_type() != COLUMN_BLOB);
+
+  values.reserve(row_count);
+  for (unsigned int row = first_row; row < end_row; row++){
+    std::string value;
+    int cached = -1;
+
+    if (kind == KIND_ENUM){
+      const uint8 id = Column::get_uint8(column.get_field(rows[row]));
+      cached = use_dictionary? enum_indices[id] : -1;
+      if (cached < 0){
+        value = column.enumeration.get_value(id);
+      }
+    }
+
+    // Text is stored as Latin-1, but Parquet strings must be UTF-8. Blobs
+    // are kept as they are
+    else if (kind == KIND_BYTES){
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(rows[row], bytes);
+      if (column.get_type() == COLUMN_BLOB){
+        value.assign(reinterpret_cast<const char*>(bytes), length);
+      }
+
+      else {
+        latin1_to_utf8(reinterpret_cast<const char*>(bytes), length, value);
+      }
+    }
+
+    else {
+      const char* text = column.extract_data(rows[row], format_buffer,
+        format_buffer_size);
+      latin1_to_utf8(text, static_cast<unsigned int>(strlen(text)), value);
+    }
+
+    if (use_dictionary){
+      uint32 index;
+      if (cached >= 0){
+        index = static_cast<uint32>(cached);
+      }
+
+      else {
+        std::map<std::string, uint32>::iterator found = dictionary.find(value);
+        if (found != dictionary.end()){
+          index = found->second;
+        }
+
+        else {
+          index = static_cast<uint32>(dictionary.size());
+          dictionary.insert(std::make_pair(value, index));
+          values.push_back(value);
+          dictionary_size += static_cast<unsigned int>(value.size()) + 4;
+        }
+
+        if (kind == KIND_ENUM){
+          enum_indices[Column::get_uint8(column.get_field(rows[row]))] = index;
+        }
+      }
+      indices.push_back(index);
+
+      // Too many distinct values to be worth it; start over with plain
+      // encoding
+      if (dictionary_size > max_dictionary_size){
+        use_dictionary = false;
+        indices.clear();
+        dictionary.clear();
+        values.clear();
+        row = first_row - 1;
+      }
+    }
+
+    else {
+      values.push_back(value);
+    }
+  }
+
+  delete [] format_buffer;
+
+  if (use_dictionary){
+    info.dictionary = true;
+
+    for (unsigned int ii = 0; ii < values.size(); ii++){
+      put_int32(page, static_cast<uint32>(values[ii].size()));
+      page += values[ii];
+    }
+    writer.write_page(PARQUET_DICTIONARY_PAGE, page,
+      static_cast<unsigned int>(values.size()), PARQUET_PLAIN);
+
+    // Every index needs enough bits to hold the largest one
+    unsigned int bit_width = 1;
+    while (bit_width < 32 && (1u << bit_width) < values.size()){
+      ++bit_width;
+    }
+
+    // Each data page starts with the bit width, then the encoded indices
+    const unsigned int values_per_page = (page_size * 8) / bit_width;
+    for (unsigned int first = 0; first < indices.size();
+      first += values_per_page){
+
+      unsigned int count = static_cast<unsigned int>(indices.size()) - first;
+      if (count > values_per_page){
+        count = values_per_page;
+      }
+
+      page.clear();
+      page += static_cast<char>(bit_width);
+      encode_rle_hybrid(indices, first, count, bit_width, page);
+      writer.write_page(PARQUET_DATA_PAGE, page, count,
+        PARQUET_RLE_DICTIONARY);
+    }
+  }
+
+  else {
+    page.clear();
+    for (unsigned int ii = 0; ii < values.size(); ii++){
+      put_int32(page, static_cast<uint32>(values[ii].size()));
+      page += values[ii];
+      ++page_values;
+
+      if (page.size() >= page_size){
+        writer.write_page(PARQUET_DATA_PAGE, page, page_values, PARQUET_PLAIN);
+        page.clear();
+        page_values = 0;
+      }
+    }
+
+    if (page_values){
+      writer.write_page(PARQUET_DATA_PAGE, page, page_values, PARQUET_PLAIN);
+    }
+  }
+}
+
+/**
+  Write a column's schema element
+
+  @param writer The footer being written
+  @param column The column to describe
+*/
+static void write_schema_element(ThriftWriter& writer, const Column& column)
+  throw () {
+
+  ParquetType type = PARQUET_BYTE_ARRAY;
+  ParquetConvertedType converted = PARQUET_CONVERTED_NONE;
+  int bit_width = 0;
+  bool is_signed = true;
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      type = PARQUET_BOOLEAN;
+      break;
+
+    case COLUMN_INT8:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_INT_8;
+      bit_width = 8;
+      break;
+
+    case COLUMN_UINT8:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_UINT_8;
+      bit_width = 8;
+      is_signed = false;
+      break;
+
+    case COLUMN_INT16:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_INT_16;
+      bit_width = 16;
+      break;
+
+    case COLUMN_UINT16:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_UINT_16;
+      bit_width = 16;
+      is_signed = false;
+      break;
+
+    case COLUMN_INT32:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_INT_32;
+      bit_width = 32;
+      break;
+
+    case COLUMN_UINT32:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_UINT_32;
+      bit_width = 32;
+      is_signed = false;
+      break;
+
+    case COLUMN_DATE:
+      type = PARQUET_INT32;
+      converted = PARQUET_CONVERTED_DATE;
+      break;
+
+    case COLUMN_CURRENCY:
+      type = PARQUET_INT64;
+      converted = PARQUET_CONVERTED_DECIMAL;
+      break;
+
+    // Blobs are raw bytes, not text
+    case COLUMN_BLOB:
+      break;
+
+    default:
+      converted = PARQUET_CONVERTED_UTF8;
+  }
+
+  writer.begin_struct();
+  writer.field_i32(1, type);
+  writer.field_i32(3, 0); // REQUIRED
+  writer.field_binary(4, column.get_name());
+
+  if (converted != PARQUET_CONVERTED_NONE){
+    writer.field_i32(6, converted);
+  }
+
+  if (converted == PARQUET_CONVERTED_DECIMAL){
+    writer.field_i32(7, 2);  // scale
+    writer.field_i32(8, 10); // precision
+  }
+
+  // The newer logical type union, which mirrors the converted type
+  if (converted != PARQUET_CONVERTED_NONE){
+    writer.field_struct(10);
+
+    if (converted == PARQUET_CONVERTED_UTF8){
+      writer.field_struct(1); // STRING
+      writer.end_struct();
+    }
+
+    else if (converted == PARQUET_CONVERTED_DECIMAL){
+      writer.field_struct(5);
+      writer.field_i32(1, 2);
+      writer.field_i32(2, 10);
+      writer.end_struct();
+    }
+
+    else if (converted == PARQUET_CONVERTED_DATE){
+      writer.field_struct(6);
+      writer.end_struct();
+    }
+
+    else {
+      writer.field_struct(10); // INTEGER
+      writer.field_byte(1, static_cast<int8>(bit_width));
+      writer.field_bool(2, is_signed);
+      writer.end_struct();
+    }
+
+    writer.end_struct();
+  }
+
+  writer.end_struct();
+}
+
+/** Get a column's physical type, for the column chunk metadata */
+static ParquetType physical_type(const Column& column) throw () {
+  switch (value_kind(column)){
+    case KIND_BOOLEAN:
+      return PARQUET_BOOLEAN;
+
+    case KIND_INT32:
+      return PARQUET_INT32;
+
+    case KIND_DECIMAL:
+      return PARQUET_INT64;
+
+    default:
+      return PARQUET_BYTE_ARRAY;
+  }
+}
+
+/////////////////
+// ParquetSink //
+/////////////////
+
+const unsigned int ParquetSink::default_row_group_size = 1024 * 1024;
+
+ParquetSink::ParquetSink(const std::string& _directory) throw ():
+  directory(_directory),
+  row_group_size(default_row_group_size),
+  compression(COMPRESSION_NONE){}
+
+ParquetSink::~ParquetSink() throw () {}
+
+void ParquetSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  const std::string file_name = directory + "/" + table.get_name() +
+    ".parquet";
+
+  const std::vector<Column> columns = table.get_columns();
+  const RowData* rows = table.load_rows(row_limit);
+  const unsigned int row_count = rows->row_count();
+
+  std::string footer;
+  ThriftWriter writer(footer);
+
+  try {
+    // Blocks are buffered before reaching the file, so track page offsets
+    // here instead of asking it
+    OutputFile file(file_name);
+    file.write("PAR1", 4);
+    int64 position = 4;
+
+    // FileMetaData
+    writer.field_i32(1, 1); // version
+
+    // The schema is a root element, followed by one element per column
+    writer.field_list(2, THRIFT_STRUCT,
+      static_cast<unsigned int>(columns.size()) + 1);
+    writer.begin_struct();
+    writer.field_binary(4, "schema");
+    writer.field_i32(5, static_cast<int32>(columns.size()));
+    writer.end_struct();
+
+    for (unsigned int col = 0; col < columns.size(); col++){
+      write_schema_element(writer, columns[col]);
+    }
+
+    writer.field_i64(3, row_count);
+
+    const unsigned int group_count = (row_count + row_group_size - 1) /
+      row_group_size;
+    writer.field_list(4, THRIFT_STRUCT, group_count);
+
+    for (unsigned int group = 0; group < group_count; group++){
+      const unsigned int first_row = group * row_group_size;
+      unsigned int group_rows = row_count - first_row;
+      if (group_rows > row_group_size){
+        group_rows = row_group_size;
+      }
+
+      const int64 group_offset = position;
+      int64 group_uncompressed = 0;
+      int64 group_compressed = 0;
+
+      // RowGroup
+      writer.begin_struct();
+      writer.field_list(1, THRIFT_STRUCT,
+        static_cast<unsigned int>(columns.size()));
+
+      for (unsigned int col = 0; col < columns.size(); col++){
+        ChunkInfo info;
+        write_column_chunk(file, position, compression, columns[col], *rows, first_row,
+          group_rows, info);
+
+        group_uncompressed += info.uncompressed_size;
+        group_compressed += info.compressed_size;
+
+        // ColumnChunk
+        writer.begin_struct();
+        writer.field_i64(2, info.dictionary? info.dictionary_page_offset :
+          info.data_page_offset);
+
+        // ColumnMetaData
+        writer.field_struct(3);
+        writer.field_i32(1, physical_type(columns[col]));
+
+        if (info.dictionary){
+          writer.field_list(2, THRIFT_I32, 3);
+          writer.i32(PARQUET_PLAIN);
+          writer.i32(PARQUET_RLE);
+          writer.i32(PARQUET_RLE_DICTIONARY);
+        }
+
+        else {
+          writer.field_list(2, THRIFT_I32, 2);
+          writer.i32(PARQUET_PLAIN);
+          writer.i32(PARQUET_RLE);
+        }
+
+        writer.field_list(3, THRIFT_BINARY, 1);
+        writer.binary(columns[col].get_name());
+
+        writer.field_i32(4, parquet_codecs[compression]);
+        writer.field_i64(5, group_rows);
+        writer.field_i64(6, info.uncompressed_size);
+        writer.field_i64(7, info.compressed_size);
+        writer.field_i64(9, info.data_page_offset);
+
+        if (info.dictionary){
+          writer.field_i64(11, info.dictionary_page_offset);
+        }
+
+        writer.end_struct(); // ColumnMetaData
+        writer.end_struct(); // ColumnChunk
+      }
+
+      writer.field_i64(2, group_uncompressed);
+      writer.field_i64(3, group_rows);
+      writer.field_i64(5, group_offset);
+      writer.field_i64(6, group_compressed);
+      writer.end_struct(); // RowGroup
+    }
+
+    writer.field_binary(6, std::string("Driller version ") + VERSION);
+    writer.end_struct(); // FileMetaData
+
+    file.write(footer);
+
+    std::string trailer;
+    put_int32(trailer, static_cast<uint32>(footer.size()));
+    trailer += "PAR1";
+    file.write(trailer);
+
+    file.close();
+  }
+
+  catch (const Errors::FileWriteError&){
+    delete rows;
+
+    // Errors from compressing pages don't know which file they were for
+    throw Errors::FileWriteError(file_name, 0);
+  }
+
+  delete rows;
+}
+
+void ParquetSink::set_row_group_size(const unsigned int rows) throw () {
+  row_group_size = rows? rows : default_row_group_size;
+}
+
+unsigned int ParquetSink::get_row_group_size() const throw () {
+  return row_group_size;
+}
+
+void ParquetSink::set_compression(const Compression _compression) throw () {
+  compression = _compression;
+}
+
+Compression ParquetSink::get_compression() const throw () {
+  return compression;
+}
+
+} // namespace
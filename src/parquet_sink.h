@@ -0,0 +1,103 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * parquet_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_PARQUET_SINK_H
+#define DRILLER_PARQUET_SINK_H
+
+#include "data_sink.h"
+#include "errors.h"
+#include "compression.h"
+
+namespace Driller {
+
+/**
+  A ParquetSink will extract data into Apache Parquet files, one per table.
+  Values are written from the raw table data with their native types:
+
+  - Integers become INT32, annotated with their width and signedness
+  - Booleans become BOOLEAN
+  - Dates become INT32 DATE
+  - Currency becomes INT64 DECIMAL(10,2)
+  - Strings, phone numbers and enumerations become BYTE_ARRAY STRING,
+    dictionary encoded unless the dictionary grows too large
+  - Blobs become plain BYTE_ARRAY
+
+  The format is written directly, so no Parquet or Thrift library is needed
+*/
+class ParquetSink : public DataSink {
+public:
+  /**
+    Default constructor
+
+    @param directory The directory extracted files should be stored in. This
+    must exist, or no data will be output
+  */
+  ParquetSink(const std::string& directory) throw ();
+
+  /** Default destructor */
+  virtual ~ParquetSink() throw ();
+
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Set how many rows are stored in each row group
+
+    @param rows The row group size. If this is 0, the default is used
+  */
+  void set_row_group_size(const unsigned int rows) throw ();
+
+  /**
+    Get how many rows are stored in each row group
+
+    @return The row group size
+  */
+  unsigned int get_row_group_size() const throw ();
+
+  /**
+    Set how pages are compressed
+
+    @param compression The compression format
+  */
+  void set_compression(const Compression compression) throw ();
+
+  /**
+    Get how pages are compressed
+
+    @return The compression format
+  */
+  Compression get_compression() const throw ();
+
+  /** The default number of rows in each row group */
+  static const unsigned int default_row_group_size;
+
+protected:
+  const std::string directory;
+
+  /** How many rows are stored in each row group */
+  unsigned int row_group_size;
+
+  /** How pages are compressed */
+  Compression compression;
+};
+
+} // namespace
+
+#endif // DRILLER_PARQUET_SINK_H
@@ -0,0 +1,279 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * pipe_output.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include "pipe_output.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <cstring>
+
+#ifdef WIN32
+  #include <io.h>
+#else
+  #include <unistd.h>
+#endif
+
+#if HAVE_VMSPLICE
+  #include <sys/mman.h>
+  #include <sys/uio.h>
+#endif
+
+namespace Driller {
+
+// Large enough that a reader is woken rarely, and matching the most a pipe
+// can be made to hold without privileges on Linux
+const unsigned int PipeOutput::buffer_size = 1024 * 1024;
+
+PipeOutput::PipeOutput(const std::string& _file_name)
+  throw (Errors::FileWriteError):
+
+  file_name(_file_name == "-" ? "standard output" : _file_name),
+  fd(-1),
+  is_pipe(false),
+  splice_size(0),
+  current(0),
+  used(0),
+  written(0){
+
+  splice_buffers[0] = splice_buffers[1] = NULL;
+
+  if (_file_name == "-"){
+    fd = 1;
+  }
+
+  else {
+    fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0){
+      throw Errors::FileWriteError(file_name, errno);
+    }
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == 0){
+    is_pipe = S_ISFIFO(info.st_mode);
+  }
+
+#ifdef F_SETPIPE_SZ
+  // A larger pipe lets a whole buffer be written without waiting for the
+  // reader. If this fails, the default size still works
+  if (is_pipe){
+    fcntl(fd, F_SETPIPE_SZ, buffer_size);
+  }
+#endif
+
+  buffer.resize(buffer_size);
+}
+
+PipeOutput::~PipeOutput() throw () {
+  try {
+    close();
+  }
+
+  catch (...){}
+}
+
+void PipeOutput::write(const char* data, const unsigned int length)
+  throw (Errors::FileWriteError) {
+
+  // Writes at least as large as a buffer skip it, unless the buffer's pages
+  // are what get spliced
+  if (!splice_buffers[0] && used == 0 && length >= buffer_size){
+    write_raw(data, length);
+    return;
+  }
+
+  const unsigned int size = splice_buffers[0] ? splice_size : buffer_size;
+  unsigned int done = 0;
+  while (done < length){
+    char* fill = splice_buffers[0] ? splice_buffers[current] : &buffer[0];
+    const unsigned int count = std::min(size - used, length - done);
+
+    memcpy(fill + used, data + done, count);
+    used += count;
+    done += count;
+
+    if (used == size){
+      flush_buffer();
+    }
+  }
+}
+
+void PipeOutput::write(const std::string& data)
+  throw (Errors::FileWriteError) {
+
+  write(data.data(), static_cast<unsigned int>(data.size()));
+}
+
+void PipeOutput::close() throw (Errors::FileWriteError) {
+  if (fd < 0){
+    return;
+  }
+
+  try {
+    flush_buffer();
+  }
+
+  catch (...){
+    release_splice_buffers();
+    if (fd != 1){
+      ::close(fd);
+    }
+    fd = -1;
+    throw;
+  }
+
+  release_splice_buffers();
+
+  const int result = (fd != 1) ? ::close(fd) : 0;
+  fd = -1;
+
+  if (result != 0){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+bool PipeOutput::set_splice(const bool splice) throw () {
+  // The buffers can't change once something has been written to them
+  if (used || written){
+    return get_splice();
+  }
+
+  if (!splice){
+    release_splice_buffers();
+    return false;
+  }
+
+#if HAVE_VMSPLICE && defined(F_GETPIPE_SZ)
+  if (is_pipe && !splice_buffers[0]){
+    const int capacity = fcntl(fd, F_GETPIPE_SZ);
+    if (capacity <= 0){
+      return false;
+    }
+
+    // Both buffers come from one mapping, so each starts on a page and
+    // spans exactly as many pages as the pipe has slots
+    void* pages = mmap(NULL, 2 * static_cast<size_t>(capacity),
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED){
+      return false;
+    }
+
+    splice_size = static_cast<unsigned int>(capacity);
+    splice_buffers[0] = static_cast<char*>(pages);
+    splice_buffers[1] = splice_buffers[0] + splice_size;
+  }
+#endif
+
+  return get_splice();
+}
+
+bool PipeOutput::get_splice() const throw () {
+  return splice_buffers[0] != NULL;
+}
+
+unsigned long PipeOutput::bytes_written() const throw () {
+  return written;
+}
+
+void PipeOutput::flush_buffer() throw (Errors::FileWriteError) {
+  if (!used){
+    return;
+  }
+
+  if (splice_buffers[0]){
+    splice_raw(splice_buffers[current], used);
+    current = 1 - current;
+  }
+
+  else {
+    write_raw(&buffer[0], used);
+  }
+
+  used = 0;
+}
+
+void PipeOutput::write_raw(const char* data, const unsigned int length)
+  throw (Errors::FileWriteError) {
+
+  unsigned int done = 0;
+  while (done < length){
+    const long count = ::write(fd, data + done, length - done);
+    if (count < 0){
+      if (errno == EINTR){
+        continue;
+      }
+      throw Errors::FileWriteError(file_name, errno);
+    }
+    done += static_cast<unsigned int>(count);
+  }
+
+  written += length;
+}
+
+void PipeOutput::splice_raw(char* data, const unsigned int length)
+  throw (Errors::FileWriteError) {
+
+#if HAVE_VMSPLICE
+  // Once every page of this buffer is in the pipe, the pipe has no room
+  // left for the other buffer's pages, so the reader must be done with them
+  // and that buffer can be refilled
+  struct iovec pending;
+  pending.iov_base = data;
+  pending.iov_len = length;
+
+  while (pending.iov_len){
+    const long count = vmsplice(fd, &pending, 1, 0);
+    if (count < 0){
+      if (errno == EINTR){
+        continue;
+      }
+      throw Errors::FileWriteError(file_name, errno);
+    }
+    pending.iov_base = static_cast<char*>(pending.iov_base) + count;
+    pending.iov_len -= static_cast<size_t>(count);
+  }
+
+  written += length;
+#else
+  write_raw(data, length);
+#endif
+}
+
+void PipeOutput::release_splice_buffers() throw () {
+#if HAVE_VMSPLICE
+  // Unmapping leaves any pages the pipe still holds intact until they've
+  // been read, since nothing can write to them any more
+  if (splice_buffers[0]){
+    munmap(splice_buffers[0], 2 * static_cast<size_t>(splice_size));
+  }
+#endif
+
+  splice_buffers[0] = splice_buffers[1] = NULL;
+  splice_size = 0;
+  current = 0;
+}
+
+} // namespace
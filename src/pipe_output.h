@@ -0,0 +1,168 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * pipe_output.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_PIPE_OUTPUT_H
+#define DRILLER_PIPE_OUTPUT_H
+
+#include <string>
+#include <vector>
+#include "file_errors.h"
+
+namespace Driller {
+
+/**
+  A stream being written to, such as standard output or a named pipe. Data
+  is collected into large buffers, so that whatever reads the stream is
+  woken once per buffer rather than once per row. When the stream is a pipe,
+  buffers can optionally be spliced into it instead of copied
+*/
+class PipeOutput {
+public:
+  /**
+    Open a stream for writing. Opening a named pipe waits until something
+    opens it for reading. Anything else is created or truncated, like a file
+
+    @param file_name The file or named pipe to write, or "-" for standard
+    output
+  */
+  PipeOutput(const std::string& file_name) throw (Errors::FileWriteError);
+
+  /** Close the stream, if it hasn't been already. Errors are ignored */
+  ~PipeOutput() throw ();
+
+  /**
+    Write some data to the stream
+
+    @param data The data to write
+    @param length How many bytes of data there are
+  */
+  void write(const char* data, const unsigned int length)
+    throw (Errors::FileWriteError);
+
+  /**
+    Write a string to the stream
+
+    @param data The string to write
+  */
+  void write(const std::string& data) throw (Errors::FileWriteError);
+
+  /**
+    Write any buffered data and close the stream. Standard output is flushed
+    but left open
+  */
+  void close() throw (Errors::FileWriteError);
+
+  /**
+    Choose whether full buffers are given to the pipe with vmsplice(), which
+    lends the pipe the buffer's pages instead of copying them. A buffer is
+    only refilled once the pipe has been read past it, so this is safe for
+    readers which copy what they read, such as compressors and ssh. A reader
+    which splices the pipe onward, as some pipe viewers do, could still be
+    holding the pages, so this is off by default. This must be set before
+    anything is written
+
+    @param splice Whether to splice buffers into the pipe
+
+    @return Whether buffers will be spliced. This is false if the stream
+    isn't a pipe, or the system doesn't support vmsplice()
+  */
+  bool set_splice(const bool splice) throw ();
+
+  /**
+    Get whether buffers are spliced into the pipe
+
+    @return Whether buffers are spliced
+  */
+  bool get_splice() const throw ();
+
+  /**
+    Get how many bytes have been written to the stream so far
+
+    @return How many bytes have been written
+  */
+  unsigned long bytes_written() const throw ();
+
+  /** How much data is collected before it is written, when not splicing */
+  static const unsigned int buffer_size;
+
+protected:
+  /** Write or splice the current buffer, then start the next one */
+  void flush_buffer() throw (Errors::FileWriteError);
+
+  /**
+    Write bytes to the stream, retrying until all have been written
+
+    @param data The bytes to write
+    @param length How many bytes to write
+  */
+  void write_raw(const char* data, const unsigned int length)
+    throw (Errors::FileWriteError);
+
+  /**
+    Splice bytes into the pipe, retrying until all have been accepted
+
+    @param data The bytes to splice
+    @param length How many bytes to splice
+  */
+  void splice_raw(char* data, const unsigned int length)
+    throw (Errors::FileWriteError);
+
+  /** Free the spliced buffers' pages, which the pipe may still hold */
+  void release_splice_buffers() throw ();
+
+  /** The name of the stream, for error messages */
+  const std::string file_name;
+
+  /** The stream's file descriptor, or -1 once closed */
+  int fd;
+
+  /** Whether the stream is a pipe */
+  bool is_pipe;
+
+  /** Data not yet written, when not splicing */
+  std::vector<char> buffer;
+
+  /**
+    Two buffers, each the size of the pipe, used in turn when splicing.
+    These are NULL when not splicing
+  */
+  char* splice_buffers[2];
+
+  /** The size of each splice buffer, which is the capacity of the pipe */
+  unsigned int splice_size;
+
+  /** Which splice buffer is being filled */
+  unsigned int current;
+
+  /** How much of the current buffer has been filled */
+  unsigned int used;
+
+  /** How many bytes have been written to the stream */
+  unsigned long written;
+
+private:
+  // Streams cannot be copied
+  PipeOutput(const PipeOutput&);
+  PipeOutput& operator=(const PipeOutput&);
+};
+
+} // namespace
+
+#endif // DRILLER_PIPE_OUTPUT_H
@@ -0,0 +1,152 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * pipe_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "pipe_sink.h"
+#include "database/result_set.h"
+#include <cstdio>
+
+namespace Driller {
+
+// Small enough that a reader sees rows soon after they're formatted
+const unsigned int PipeSink::frame_size = 256 * 1024;
+
+PipeSink::PipeSink(const std::string& file_name)
+  throw (Errors::FileWriteError):
+
+  output(file_name),
+  framed(false),
+  tables(0),
+  closed(false){}
+
+PipeSink::~PipeSink() throw () {
+  try {
+    close();
+  }
+
+  catch (...){}
+}
+
+void PipeSink::output_table(const Table& table, const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  const ResultSet* result = table.extract_data(row_limit);
+
+  try {
+    if (framed){
+      std::string header;
+      if (!tables){
+        header = "driller-stream 1\n";
+      }
+
+      header += "table\t" + table.get_name() + "\ncolumns\t" +
+        table.get_name();
+      for (unsigned int col = 0; col < table.column_count(); col++){
+        header += '\t';
+        header += table.column_at(col).get_name();
+      }
+      header += '\n';
+      output.write(header);
+    }
+
+    // Unframed rows go straight to the stream, which buffers them. Framed
+    // rows are collected until a frame is full, since its length comes first
+    std::string rows;
+    for (unsigned int row = 0; row < result->row_count(); row++){
+      const char** data = (*result)[row];
+      for (unsigned int col = 0; col < result->column_count(); col++){
+        rows += data[col];
+        rows += '\t';
+      }
+      rows += '\n';
+
+      if (!framed){
+        output.write(rows);
+        rows.clear();
+      }
+
+      else if (rows.size() >= frame_size){
+        write_frame(rows);
+      }
+    }
+
+    if (framed){
+      write_frame(rows);
+
+      char footer[32];
+      sprintf(footer, "\t%u\n", result->row_count());
+      output.write("end\t" + table.get_name() + footer);
+    }
+  }
+
+  catch (...){
+    delete result;
+    throw;
+  }
+
+  ++tables;
+  delete result;
+}
+
+void PipeSink::close() throw (Errors::FileWriteError) {
+  if (closed){
+    return;
+  }
+  closed = true;
+
+  if (framed){
+    char footer[32];
+    sprintf(footer, "done\t%u\n", tables);
+
+    // An empty stream still says what it is
+    output.write(std::string(tables ? "" : "driller-stream 1\n") + footer);
+  }
+
+  output.close();
+}
+
+void PipeSink::set_framed(const bool _framed) throw () {
+  framed = _framed;
+}
+
+bool PipeSink::get_framed() const throw () {
+  return framed;
+}
+
+bool PipeSink::set_splice(const bool splice) throw () {
+  return output.set_splice(splice);
+}
+
+unsigned long PipeSink::bytes_written() const throw () {
+  return output.bytes_written();
+}
+
+void PipeSink::write_frame(std::string& rows) throw (Errors::FileWriteError) {
+  if (rows.empty()){
+    return;
+  }
+
+  char header[32];
+  sprintf(header, "rows\t%u\n", static_cast<unsigned int>(rows.size()));
+  output.write(header);
+  output.write(rows);
+  rows.clear();
+}
+
+} // namespace
@@ -0,0 +1,132 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * pipe_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_PIPE_SINK_H
+#define DRILLER_PIPE_SINK_H
+
+#include "data_sink.h"
+#include "errors.h"
+#include "pipe_output.h"
+
+namespace Driller {
+
+/**
+  A PipeSink streams tab-delimited rows, formatted as by FileSink, to
+  standard output or a named pipe, so they can be fed to another program
+  without being written to disk first.
+
+  By default tables are written one after another with nothing between
+  them, which suits extracting a single table. A framed stream can carry
+  several tables. It starts with the line "driller-stream 1", and every
+  later line is a keyword followed by tab-separated fields:
+
+  <pre>
+  table NAME              a table starts
+  columns NAME COLUMN...  the table's column names
+  rows LENGTH             followed by LENGTH bytes of whole rows
+  end NAME ROWS           the table is complete
+  done TABLES             the stream is complete
+  </pre>
+
+  Rows are only ever read by their length, so values containing newlines
+  can't be mistaken for a keyword
+*/
+class PipeSink : public DataSink {
+public:
+  /**
+    Default constructor
+
+    @param file_name The file or named pipe to write, or "-" for standard
+    output
+  */
+  PipeSink(const std::string& file_name = "-")
+    throw (Errors::FileWriteError);
+
+  /** Close the stream, if it hasn't been already. Errors are ignored */
+  virtual ~PipeSink() throw ();
+
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Finish the stream. A framed stream is ended with its "done" line. Call
+    this to find out whether the last writes succeeded
+  */
+  void close() throw (Errors::FileWriteError);
+
+  /**
+    Set whether tables are written as a framed stream. This must be set
+    before any table is written
+
+    @param framed Whether to frame tables
+  */
+  void set_framed(const bool framed) throw ();
+
+  /**
+    Get whether tables are written as a framed stream
+
+    @return Whether tables are framed
+  */
+  bool get_framed() const throw ();
+
+  /**
+    Set whether output is spliced into the pipe rather than copied. See
+    PipeOutput::set_splice() for when this is safe
+
+    @param splice Whether to splice output
+
+    @return Whether output will be spliced
+  */
+  bool set_splice(const bool splice) throw ();
+
+  /**
+    Get how many bytes have been written so far
+
+    @return How many bytes have been written
+  */
+  unsigned long bytes_written() const throw ();
+
+  /** How many bytes of rows each frame holds, at most a row more */
+  static const unsigned int frame_size;
+
+protected:
+  /**
+    Write a frame of rows, then empty them
+
+    @param rows Whole rows to write
+  */
+  void write_frame(std::string& rows) throw (Errors::FileWriteError);
+
+  /** Where the stream is written */
+  PipeOutput output;
+
+  /** Whether tables are framed */
+  bool framed;
+
+  /** How many tables have been written */
+  unsigned int tables;
+
+  /** Whether the stream has been finished */
+  bool closed;
+};
+
+} // namespace
+
+#endif // DRILLER_PIPE_SINK_H
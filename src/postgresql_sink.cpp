@@ -0,0 +1,498 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * postgresql_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "postgresql_sink.h"
+#include "copy_format.h"
+#include "timer.h"
+#include "database/result_set.h"
+#include "database/row_data.h"
+#include "database/table_cost.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <libpq-fe.h>
+
+namespace Errors {
+
+PostgreSQLError::PostgreSQLError(PGconn* connection) throw():
+  message(PQerrorMessage(connection)){}
+
+PostgreSQLError::PostgreSQLError(const std::string& _message) throw():
+  message(_message){}
+
+PostgreSQLError::~PostgreSQLError() throw(){}
+
+std::string PostgreSQLError::error_message() const throw(){
+  return message;
+}
+
+} // namespace
+
+namespace Driller {
+
+/** How much COPY data is gathered before it's handed to libpq */
+const unsigned int copy_buffer_size = 1024 * 1024;
+
+/**
+  Every byte is a valid LATIN1 character, so text from the data files can
+  never make a COPY fail on an invalid byte sequence
+*/
+const char* const client_encoding = "LATIN1";
+
+/** The first server version whose COPY takes the FREEZE option */
+const int copy_freeze_version = 90300;
+
+/**
+  Check whether PostgreSQL can index a column. Values of unbounded length
+  can be too large for a B-tree index entry
+
+  @param column The column
+
+  @return Whether the column can be indexed
+*/
+bool can_index_postgresql(const Column& column) throw (){
+  return column.get_type() != COLUMN_BLOB &&
+    column.get_type() != COLUMN_VARSTRING;
+}
+
+/**
+  Loads one table for PostgreSQLSink::output_database()
+*/
+class PostgreSQLTableJob : public Job {
+public:
+  PostgreSQLTableJob(PostgreSQLSink& _sink, const Table& _table) throw ():
+    sink(_sink), table(_table){}
+
+  void run() {
+    sink.load_table(table, 0);
+  }
+
+  PostgreSQLSink& sink;
+  const Table table;
+};
+
+////////////////////
+// PostgreSQLSink //
+////////////////////
+
+PostgreSQLSink::PostgreSQLSink(
+  const std::string& _host,
+  const std::string& _username,
+  const std::string& _password,
+  const std::string& _database,
+  const unsigned int _port,
+  const unsigned int connections)
+  throw (Errors::PostgreSQLError, Errors::GenericError):
+
+  host(_host), username(_username), password(_password),
+  database(_database), pool(NULL), rows_sent(0), send_time(0.0),
+  index_time(0.0){
+
+  if (_port){
+    std::stringstream ss;
+    ss << _port;
+    port = ss.str();
+  }
+
+  PQfinish(connect());
+
+  pool = new ThreadPool(std::max(connections, 1u));
+}
+
+PostgreSQLSink::~PostgreSQLSink() throw(){
+  delete pool;
+}
+
+void PostgreSQLSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::PostgreSQLError){
+
+  load_table(table, row_limit);
+}
+
+void PostgreSQLSink::output_database(const Database& db){
+  std::vector<Table> tables = db.get_tables();
+  std::vector<PostgreSQLTableJob*> jobs;
+
+  // The most costly tables start first, so none is left for last
+  const std::vector<unsigned int> order = schedule_by_cost(tables);
+  for (unsigned int ii = 0; ii < order.size(); ii++){
+    jobs.push_back(new PostgreSQLTableJob(*this, tables[order[ii]]));
+    pool->add_job(jobs.back());
+  }
+
+  pool->wait_all();
+
+  unsigned int failed = 0;
+  std::string first_error;
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    if (jobs[ii]->failed() && failed++ == 0){
+      first_error = jobs[ii]->get_error();
+    }
+    delete jobs[ii];
+  }
+
+  if (failed){
+    std::stringstream ss;
+    ss << failed << " table(s) could not be loaded. The first error was: "
+       << first_error;
+    throw Errors::GenericError(ss.str());
+  }
+}
+
+unsigned int PostgreSQLSink::get_rows_sent() const throw (){
+  MutexLocker locker(stats_mutex);
+  return rows_sent;
+}
+
+double PostgreSQLSink::get_send_time() const throw (){
+  MutexLocker locker(stats_mutex);
+  return send_time;
+}
+
+double PostgreSQLSink::get_index_time() const throw (){
+  MutexLocker locker(stats_mutex);
+  return index_time;
+}
+
+PGconn* PostgreSQLSink::connect() const throw (Errors::PostgreSQLError){
+  const char* keywords[] = {
+    "host", "port", "user", "password", "dbname", "client_encoding",
+    "fallback_application_name", NULL
+  };
+  const char* values[] = {
+    host.c_str(), port.c_str(), username.c_str(), password.c_str(),
+    database.c_str(), client_encoding, "driller", NULL
+  };
+
+  // Empty values are ignored, so libpq's defaults are used for them
+  PGconn* connection = PQconnectdbParams(keywords, values, 0);
+  if (!connection){
+    throw Errors::PostgreSQLError("Out of memory connecting to PostgreSQL");
+  }
+
+  if (PQstatus(connection) != CONNECTION_OK){
+    const Errors::PostgreSQLError error(connection);
+    PQfinish(connection);
+    throw error;
+  }
+
+  return connection;
+}
+
+void PostgreSQLSink::load_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::PostgreSQLError){
+
+  // Snapshots can only be read as text
+  const ResultSet* result = NULL;
+  RowData* rows = NULL;
+  if (!table.get_snapshot_file().empty()){
+    result = table.extract_data(row_limit);
+  }
+  else {
+    rows = table.load_rows(row_limit);
+  }
+
+  PGconn* connection = NULL;
+
+  try {
+    connection = connect();
+    const std::string table_name = quote_name(connection, table.get_name());
+
+    // Readers keep seeing the old table until the new one is committed. A
+    // table created in the same transaction can also be copied into with
+    // FREEZE, and without writing WAL when wal_level is minimal
+    send_query(connection, "BEGIN");
+    send_query(connection, "DROP TABLE IF EXISTS " + table_name);
+    send_query(connection, "CREATE TABLE " + table_name + " (" +
+      column_definitions(connection, table) + ")");
+
+    std::string copy = "COPY " + table_name + " FROM STDIN";
+    const bool freeze = PQserverVersion(connection) >= copy_freeze_version;
+    if (rows){
+      copy += freeze ? " WITH (FORMAT binary, FREEZE)" :
+        " WITH (FORMAT binary)";
+    }
+    else if (freeze){
+      copy += " WITH (FREEZE)";
+    }
+
+    Timer timer;
+
+    PGresult* started = PQexec(connection, copy.c_str());
+    if (PQresultStatus(started) != PGRES_COPY_IN){
+      const Errors::PostgreSQLError error(PQresultErrorMessage(started));
+      PQclear(started);
+      throw error;
+    }
+    PQclear(started);
+
+    if (rows){
+      copy_binary(connection, *rows);
+    }
+    else {
+      copy_text(connection, *result);
+    }
+
+    if (PQputCopyEnd(connection, NULL) != 1){
+      throw Errors::PostgreSQLError(connection);
+    }
+
+    // The COPY's own result says whether every row was accepted
+    PGresult* finished = PQgetResult(connection);
+    const bool copied = PQresultStatus(finished) == PGRES_COMMAND_OK;
+    const std::string message = PQresultErrorMessage(finished);
+    PQclear(finished);
+    while ((finished = PQgetResult(connection))){
+      PQclear(finished);
+    }
+    if (!copied){
+      throw Errors::PostgreSQLError(message);
+    }
+
+    const double copy_time = timer.elapsed();
+    timer.restart();
+
+    // Indexes are built once every row is in, which is much faster than
+    // updating them for every row
+    for (unsigned int col = 0; col < table.column_count(); col++){
+      const Column& column = table.column_at(col);
+      if (column.get_indexed() && can_index_postgresql(column)){
+        send_query(connection, "CREATE INDEX ON " + table_name + " (" +
+          quote_name(connection, column.get_name()) + ")");
+      }
+    }
+
+    const double indexes_time = timer.elapsed();
+
+    send_query(connection, "COMMIT");
+
+    MutexLocker locker(stats_mutex);
+    rows_sent += rows ? rows->row_count() : result->row_count();
+    send_time += copy_time;
+    index_time += indexes_time;
+  }
+
+  // Closing the connection rolls back whatever the transaction had done
+  catch (const Errors::PostgreSQLError&){
+    PQfinish(connection);
+    delete rows;
+    delete result;
+    throw;
+  }
+
+  PQfinish(connection);
+  delete rows;
+  delete result;
+}
+
+void PostgreSQLSink::copy_binary(PGconn* connection, const RowData& rows)
+  throw (Errors::PostgreSQLError){
+
+  const Table& table = rows.table;
+  const std::vector<Column> column_list = table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+
+  std::vector<char> buffer(copy_buffer_size);
+  unsigned int length = copy_binary_header_size;
+  memcpy(&buffer[0], copy_binary_header, copy_binary_header_size);
+
+  for (unsigned int row = 0; row < rows.row_count(); row++){
+    const uint8* raw = rows[row];
+
+    unsigned int row_size = 2;
+    for (unsigned int col = 0; col < columns; col++){
+      row_size += max_copy_value_size(column_list[col], raw);
+    }
+
+    if (length + row_size > buffer.size()){
+      send_copy_data(connection, &buffer[0], length);
+      length = 0;
+
+      // Only a single row larger than the buffer gets here
+      if (row_size > buffer.size()){
+        buffer.resize(row_size);
+      }
+    }
+
+    // Each value is encoded straight from the row into the buffer
+    char* out = &buffer[length];
+    out += write_copy_row_start(columns, out);
+    for (unsigned int col = 0; col < columns; col++){
+      out += write_copy_value(column_list[col], raw, out);
+    }
+    length = static_cast<unsigned int>(out - &buffer[0]);
+  }
+
+  if (length + copy_binary_trailer_size > buffer.size()){
+    send_copy_data(connection, &buffer[0], length);
+    length = 0;
+  }
+  memcpy(&buffer[length], copy_binary_trailer, copy_binary_trailer_size);
+  send_copy_data(connection, &buffer[0], length + copy_binary_trailer_size);
+}
+
+void PostgreSQLSink::copy_text(PGconn* connection, const ResultSet& result)
+  throw (Errors::PostgreSQLError){
+
+  const std::vector<Column> column_list = result.table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+
+  std::vector<char> buffer(copy_buffer_size);
+  std::vector<unsigned int> lengths(columns);
+  unsigned int length = 0;
+
+  for (unsigned int row = 0; row < result.row_count(); row++){
+    const char** cells = result[row];
+
+    // Every value ends with a tab or newline
+    unsigned int row_size = 0;
+    for (unsigned int col = 0; col < columns; col++){
+      lengths[col] = static_cast<unsigned int>(strlen(cells[col]));
+      row_size += (2 * lengths[col]) + 4;
+    }
+
+    if (length + row_size > buffer.size()){
+      send_copy_data(connection, &buffer[0], length);
+      length = 0;
+
+      if (row_size > buffer.size()){
+        buffer.resize(row_size);
+      }
+    }
+
+    for (unsigned int col = 0; col < columns; col++){
+      length += write_copy_text(column_list[col].get_type(), cells[col],
+        lengths[col], &buffer[length]);
+      buffer[length++] = col + 1 < columns ? '\t' : '\n';
+    }
+  }
+
+  if (length){
+    send_copy_data(connection, &buffer[0], length);
+  }
+}
+
+void PostgreSQLSink::send_copy_data(PGconn* connection, const char* data,
+  const unsigned int length) throw (Errors::PostgreSQLError){
+
+  if (PQputCopyData(connection, data, static_cast<int>(length)) != 1){
+    throw Errors::PostgreSQLError(connection);
+  }
+}
+
+std::string PostgreSQLSink::column_definitions(PGconn* connection,
+  const Table& table) throw (){
+
+  std::string buffer;
+  for (unsigned int col = 0; col < table.column_count(); col++){
+    const Column& column = table.column_at(col);
+    if (col){
+      buffer += ", ";
+    }
+    buffer += quote_name(connection, column.get_name()) + " " +
+      postgresql_type_from_column(column);
+  }
+  return buffer;
+}
+
+std::string PostgreSQLSink::quote_name(PGconn* connection, std::string name)
+  throw (){
+
+  std::replace(name.begin(), name.end(), ' ', '_');
+
+  char* quoted = PQescapeIdentifier(connection, name.data(), name.size());
+  if (!quoted){
+    return "\"" + name + "\"";
+  }
+
+  const std::string result = quoted;
+  PQfreemem(quoted);
+  return result;
+}
+
+void PostgreSQLSink::send_query(PGconn* connection, const std::string& query)
+  throw (Errors::PostgreSQLError){
+
+  PGresult* result = PQexec(connection, query.c_str());
+  if (PQresultStatus(result) != PGRES_COMMAND_OK){
+    const Errors::PostgreSQLError error(PQresultErrorMessage(result));
+    PQclear(result);
+    throw error;
+  }
+  PQclear(result);
+}
+
+std::string PostgreSQLSink::postgresql_type_from_column(const Column& col)
+  throw(){
+
+  // Types match the binary values written by write_copy_value()
+  switch (col.get_type()){
+    case COLUMN_BOOL:
+      return "BOOLEAN";
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+      return "SMALLINT";
+
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+      return "INTEGER";
+
+    case COLUMN_UINT32:
+      return "BIGINT";
+
+    case COLUMN_BLOB:
+      return "BYTEA";
+
+    case COLUMN_STRING: {
+      if (!col.get_length()){
+        return "TEXT";
+      }
+
+      std::stringstream ss;
+      ss << "VARCHAR(" << col.get_length() << ")";
+      return ss.str();
+    }
+
+    case COLUMN_VARSTRING:
+    case COLUMN_ENUM:
+      return "TEXT";
+
+    case COLUMN_PHONE:
+      return "VARCHAR(12)";
+
+    case COLUMN_DATE:
+      return "DATE";
+
+    case COLUMN_CURRENCY:
+      return "NUMERIC(10,2)";
+
+    default:
+      // Contents of an unknown column is always "unknown"
+      return "CHAR(7)";
+  }
+}
+
+} // namespace
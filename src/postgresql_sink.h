@@ -0,0 +1,252 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * postgresql_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_POSTGRESQL_SINK_H
+#define DRILLER_POSTGRESQL_SINK_H
+
+#include "data_sink.h"
+#include "errors.h"
+#include "file_errors.h"
+#include "threads.h"
+
+struct pg_conn;
+
+namespace Errors {
+
+class PostgreSQLError : public BaseError {
+public:
+  /**
+    Default constructor
+
+    @param connection The PostgreSQL connection that caused this error
+  */
+  PostgreSQLError(pg_conn* connection) throw();
+
+  /**
+    Create an error from a message already taken from the connection or a
+    query's result
+
+    @param message The PostgreSQL error string
+  */
+  PostgreSQLError(const std::string& message) throw();
+
+  /** Default destructor */
+  virtual ~PostgreSQLError() throw();
+
+  /**
+    Return the PostgreSQL error string
+
+    @return A message suitable for being shown to a user
+  */
+  virtual std::string error_message() const throw();
+
+protected:
+  const std::string message;
+};
+
+} // namespace
+
+namespace Driller {
+
+class PostgreSQLTableJob;
+
+/**
+  A PostgreSQLSink extracts data into a PostgreSQL database. Each table is
+  replaced inside a single transaction on a connection of its own, and its
+  rows are streamed with a binary COPY, so no value is ever formatted as
+  text and parsed again. Several tables can be loaded at once
+*/
+class PostgreSQLSink : public DataSink {
+  friend class PostgreSQLTableJob;
+public:
+  /**
+    Default constructor. A connection is opened and closed straight away, to
+    check that the server can be reached
+
+    @param host The host to connect to, or the directory of a Unix socket.
+    If this is empty, libpq's default is used
+    @param username The user to connect as
+    @param password The password of the user to connect as
+    @param database The database to extract to
+    @param port The port the server accepts connections on, or 0 for the
+    default
+    @param connections How many tables output_database() loads at once. If
+    this is 0, tables are loaded one at a time
+  */
+  PostgreSQLSink(
+    const std::string& host,
+    const std::string& username,
+    const std::string& password,
+    const std::string& database,
+    const unsigned int port,
+    const unsigned int connections = 1)
+    throw (Errors::PostgreSQLError, Errors::GenericError);
+
+  /** Default destructor */
+  virtual ~PostgreSQLSink() throw();
+
+  /**
+    Extract data from a table into a table of the same name, replacing it
+
+    @param table The table to extract
+    @param row_limit If this is greater than 0, limit the number of rows
+  */
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::PostgreSQLError);
+
+  /**
+    Extract every table of a database, as many at once as there are
+    connections. Every table is attempted even if some fail
+
+    @param db The database to extract
+  */
+  void output_database(const Database& db);
+
+  /**
+    Get how many rows have been copied to the server
+
+    @return How many rows have been copied
+  */
+  unsigned int get_rows_sent() const throw ();
+
+  /**
+    Get how long has been spent copying rows, summed over every connection
+
+    @return The time spent in COPY, in seconds
+  */
+  double get_send_time() const throw ();
+
+  /**
+    Get how long has been spent building indexes, summed over every
+    connection
+
+    @return The time spent creating indexes, in seconds
+  */
+  double get_index_time() const throw ();
+
+protected:
+  /**
+    Open a new connection with this sink's settings
+
+    @return The connection, which must be closed with PQfinish()
+  */
+  pg_conn* connect() const throw (Errors::PostgreSQLError);
+
+  /**
+    Replace a table and load its rows, on a connection of its own
+
+    @param table The table to load
+    @param row_limit If this is greater than 0, limit the number of rows
+  */
+  void load_table(const Table& table, const unsigned int row_limit)
+    throw (Errors::FileReadError, Errors::PostgreSQLError);
+
+  /**
+    Stream raw rows to a COPY in binary format
+
+    @param connection A connection whose COPY has started
+    @param rows The rows to copy
+  */
+  void copy_binary(pg_conn* connection, const RowData& rows)
+    throw (Errors::PostgreSQLError);
+
+  /**
+    Stream rows extracted as text to a COPY in text format. Snapshot tables
+    can only be read this way
+
+    @param connection A connection whose COPY has started
+    @param result The rows to copy
+  */
+  void copy_text(pg_conn* connection, const ResultSet& result)
+    throw (Errors::PostgreSQLError);
+
+  /**
+    Send part of a COPY's data
+
+    @param connection A connection whose COPY has started
+    @param data The data to send
+    @param length The length of data
+  */
+  void send_copy_data(pg_conn* connection, const char* data,
+    const unsigned int length) throw (Errors::PostgreSQLError);
+
+  /**
+    Get the column definitions of a table, as used by CREATE TABLE
+
+    @param connection The connection names are quoted for
+    @param table The table
+
+    @return Each column's quoted name and type, separated by commas
+  */
+  static std::string column_definitions(pg_conn* connection,
+    const Table& table) throw ();
+
+  /**
+    Quote a table or column name, with spaces replaced by underscores as the
+    MySQL sink does
+
+    @param connection The connection the name is quoted for
+    @param name The name to quote
+
+    @return The quoted name
+  */
+  static std::string quote_name(pg_conn* connection, std::string name)
+    throw ();
+
+  /**
+    Run a query which returns no rows
+
+    @param connection The connection to run it on
+    @param query The query
+  */
+  static void send_query(pg_conn* connection, const std::string& query)
+    throw (Errors::PostgreSQLError);
+
+  /**
+    Convert an internal column type to a PostgreSQL column type
+
+    @param col The column to convert
+
+    @return The name of a PostgreSQL type which fits every value of col
+  */
+  static std::string postgresql_type_from_column(const Column& col) throw();
+
+  /** Connection settings, as passed to PQconnectdbParams() */
+  std::string host, username, password, database, port;
+
+  /** Loads tables for output_database() */
+  ThreadPool* pool;
+
+  /** How many rows have been copied */
+  unsigned int rows_sent;
+
+  /** How long COPY has taken, in seconds */
+  double send_time;
+
+  /** How long creating indexes has taken, in seconds */
+  double index_time;
+
+  /** Protects the statistics, which every connection updates */
+  mutable Mutex stats_mutex;
+};
+
+} // namespace
+
+#endif // DRILLER_POSTGRESQL_SINK_H
@@ -0,0 +1,444 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * process_pool.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include "process_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  #include <errno.h>
+  #include <poll.h>
+  #include <signal.h>
+  #include <sys/socket.h>
+  #include <sys/types.h>
+  #include <sys/wait.h>
+  #include <unistd.h>
+
+  #ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+  #endif
+#endif
+
+namespace Driller {
+
+/////////////////
+// ProcessTask //
+/////////////////
+
+ProcessTask::ProcessTask() throw (){}
+
+ProcessTask::~ProcessTask() throw (){}
+
+void ProcessTask::start_worker(){}
+
+void ProcessTask::stop_worker(){}
+
+/////////////////
+// ProcessPool //
+/////////////////
+
+// Enough to get past a worker being killed from outside, without a unit
+// which always crashes its worker holding up the rest for long
+const unsigned int ProcessPool::default_max_attempts = 3;
+
+#if HAVE_FORK && HAVE_SOCKETPAIR
+/**
+  Send the whole of a line over a socket
+
+  @param socket The socket
+  @param line The line, which must end with a newline
+
+  @return Whether it was all sent. If the other end has gone, this fails
+  rather than raising SIGPIPE
+*/
+static bool send_line(const int socket, const std::string& line) throw (){
+  std::string::size_type sent = 0;
+  while (sent < line.size()){
+    const ssize_t length = send(socket, line.data() + sent,
+      line.size() - sent, MSG_NOSIGNAL);
+
+    if (length < 0 && errno == EINTR){
+      continue;
+    }
+
+    if (length <= 0){
+      return false;
+    }
+    sent += static_cast<std::string::size_type>(length);
+  }
+
+  return true;
+}
+#endif
+
+ProcessPool::ProcessPool(const unsigned int _processes,
+  const unsigned int _max_attempts) throw ():
+
+  processes(std::max(1u, _processes)),
+  max_attempts(std::max(1u, _max_attempts)){}
+
+ProcessPool::~ProcessPool() throw (){
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  // Closing a worker's socket tells it to stop
+  for (unsigned int ii = 0; ii < workers.size(); ii++){
+    close(workers[ii].socket);
+  }
+
+  for (unsigned int ii = 0; ii < workers.size(); ii++){
+    reap(workers[ii].pid);
+  }
+#endif
+}
+
+unsigned int ProcessPool::run(ProcessTask& task,
+  const std::vector<unsigned int>& units) throw (Errors::GenericError){
+
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  std::deque<unsigned int> pending(units.begin(), units.end());
+  std::vector<unsigned int> attempts;
+  unsigned int replaced = 0;
+
+  // A worker which dies before it's given a unit, such as one whose sink
+  // can't be created, is replaced a limited number of times
+  unsigned int idle_deaths = 0;
+  std::string idle_error;
+
+  // Buffered output would be written again by every worker
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(NULL);
+
+  while (workers.size() < std::min(processes,
+    static_cast<unsigned int>(pending.size())) && start_worker(task)){}
+
+  if (workers.empty() && !pending.empty()){
+    throw Errors::GenericError("Unable to start a worker process");
+  }
+
+  unsigned int busy = 0;
+  while (!pending.empty() || busy){
+    for (unsigned int ii = 0; ii < workers.size(); ii++){
+      if (workers[ii].unit < 0 && !pending.empty() &&
+        send_unit(workers[ii], pending)){
+
+        ++busy;
+      }
+    }
+
+    std::vector<pollfd> sockets(workers.size());
+    for (unsigned int ii = 0; ii < workers.size(); ii++){
+      sockets[ii].fd = workers[ii].socket;
+      sockets[ii].events = POLLIN;
+      sockets[ii].revents = 0;
+    }
+
+    if (!sockets.empty() &&
+      poll(&sockets[0], sockets.size(), -1) < 0 && errno != EINTR){
+
+      break;
+    }
+
+    // Walk backwards, so dead workers can be removed as they're found
+    for (unsigned int ii = static_cast<unsigned int>(sockets.size());
+      ii-- > 0;){
+
+      if (!sockets[ii].revents){
+        continue;
+      }
+
+      Worker& worker = workers[ii];
+      const int unit = worker.unit;
+      if (read_reply(worker, task)){
+        if (unit >= 0 && worker.unit < 0){
+          --busy;
+        }
+        continue;
+      }
+
+      close(worker.socket);
+      const std::string status = "Worker process " + reap(worker.pid);
+      const std::string error = worker.error.empty() ? status :
+        worker.error;
+      ++replaced;
+
+      if (worker.unit < 0){
+        ++idle_deaths;
+        idle_error = error;
+      }
+
+      else {
+        --busy;
+        const unsigned int failed = static_cast<unsigned int>(worker.unit);
+        if (attempts.size() <= failed){
+          attempts.resize(failed + 1, 0);
+        }
+
+        if (++attempts[failed] < max_attempts){
+          pending.push_front(failed);
+        }
+
+        else {
+          task.unit_failed(failed, error);
+        }
+      }
+
+      workers.erase(workers.begin() + ii);
+    }
+
+    // Replace dead workers while there's work for them
+    unsigned int idle = static_cast<unsigned int>(workers.size()) - busy;
+    while (idle < pending.size() && workers.size() < processes &&
+      idle_deaths <= processes * max_attempts && start_worker(task)){
+
+      ++idle;
+    }
+
+    if (workers.empty()){
+      // Nothing is left to run the rest
+      const std::string error = idle_error.empty() ?
+        "Unable to start a worker process" : idle_error;
+      for (unsigned int ii = 0; ii < pending.size(); ii++){
+        task.unit_failed(pending[ii], error);
+      }
+      pending.clear();
+    }
+  }
+
+  // Closing the sockets lets each worker finish up and exit
+  for (unsigned int ii = 0; ii < workers.size(); ii++){
+    close(workers[ii].socket);
+  }
+
+  for (unsigned int ii = 0; ii < workers.size(); ii++){
+    reap(workers[ii].pid);
+  }
+  workers.clear();
+
+  return replaced;
+#else
+  throw Errors::GenericError(
+    "Worker processes are not supported on this system");
+#endif
+}
+
+unsigned int ProcessPool::process_count() const throw (){
+  return processes;
+}
+
+bool ProcessPool::start_worker(ProcessTask& task) throw (){
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0){
+    return false;
+  }
+
+  const pid_t pid = fork();
+  if (pid < 0){
+    close(sockets[0]);
+    close(sockets[1]);
+    return false;
+  }
+
+  if (pid == 0){
+    // The other workers' sockets must only be open here, or they would
+    // never see their sockets close
+    close(sockets[0]);
+    for (unsigned int ii = 0; ii < workers.size(); ii++){
+      close(workers[ii].socket);
+    }
+
+    worker_main(task, sockets[1]);
+  }
+
+  close(sockets[1]);
+
+  Worker worker;
+  worker.pid = pid;
+  worker.socket = sockets[0];
+  worker.unit = -1;
+  workers.push_back(worker);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ProcessPool::worker_main(ProcessTask& task, const int socket) throw (){
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  // A worker which can't start says why before exiting
+  std::string error;
+  try {
+    task.start_worker();
+  }
+
+  catch (const Errors::BaseError& e){
+    error = e.error_message();
+  }
+
+  catch (const std::exception& e){
+    error = e.what();
+  }
+
+  catch (...){
+    error = "Unknown error";
+  }
+
+  if (!error.empty()){
+    send_line(socket, "!" + error + "\n");
+    _exit(1);
+  }
+
+  std::string received;
+  char buffer[256];
+  while (true){
+    const ssize_t length = read(socket, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR){
+      continue;
+    }
+
+    if (length <= 0){
+      break;
+    }
+
+    received.append(buffer, static_cast<std::string::size_type>(length));
+
+    std::string::size_type end;
+    while ((end = received.find('\n')) != std::string::npos){
+      const unsigned int unit = static_cast<unsigned int>(
+        strtoul(received.c_str(), NULL, 10));
+      received.erase(0, end + 1);
+
+      std::string result = task.run_unit(unit);
+      for (std::string::size_type ii = 0; ii < result.size(); ii++){
+        if (result[ii] == '\n'){
+          result[ii] = ' ';
+        }
+      }
+
+      if (!send_line(socket, "=" + result + "\n")){
+        _exit(1);
+      }
+    }
+  }
+
+  try {
+    task.stop_worker();
+  }
+
+  catch (...){
+    // Every unit has already reported how it went
+  }
+
+  // Destructors are skipped, since they belong to the coordinator's copy of
+  // everything, but output must still be written
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(NULL);
+  _exit(0);
+#endif
+}
+
+bool ProcessPool::send_unit(Worker& worker, std::deque<unsigned int>& pending)
+  throw (){
+
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  char line[32];
+  sprintf(line, "%u\n", pending.front());
+
+  // If the worker has gone, poll() will find its socket closed
+  if (!send_line(worker.socket, line)){
+    return false;
+  }
+
+  worker.unit = static_cast<int>(pending.front());
+  pending.pop_front();
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool ProcessPool::read_reply(Worker& worker, ProcessTask& task) throw (){
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  char buffer[4096];
+  const ssize_t length = read(worker.socket, buffer, sizeof(buffer));
+  if (length < 0 && errno == EINTR){
+    return true;
+  }
+
+  if (length <= 0){
+    return false;
+  }
+
+  worker.reply.append(buffer, static_cast<std::string::size_type>(length));
+
+  std::string::size_type end;
+  while ((end = worker.reply.find('\n')) != std::string::npos){
+    const std::string line = worker.reply.substr(0, end);
+    worker.reply.erase(0, end + 1);
+
+    // Results start with =, and why the worker couldn't start with !
+    if (line.empty() || line[0] != '=' || worker.unit < 0){
+      worker.error = line.empty() ? line : line.substr(1);
+      continue;
+    }
+
+    const unsigned int unit = static_cast<unsigned int>(worker.unit);
+    worker.unit = -1;
+    task.unit_finished(unit, line.substr(1));
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::string ProcessPool::reap(const int pid) throw (){
+#if HAVE_FORK && HAVE_SOCKETPAIR
+  char message[128];
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0){
+    if (errno != EINTR){
+      sprintf(message, "%d was lost", pid);
+      return message;
+    }
+  }
+
+  if (WIFSIGNALED(status)){
+    sprintf(message, "%d was killed by signal %d", pid, WTERMSIG(status));
+  }
+
+  else {
+    sprintf(message, "%d exited with status %d", pid, WEXITSTATUS(status));
+  }
+  return message;
+#else
+  return "";
+#endif
+}
+
+} // namespace
@@ -0,0 +1,218 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * process_pool.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_PROCESS_POOL_H
+#define DRILLER_PROCESS_POOL_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "errors.h"
+
+namespace Driller {
+
+/**
+  Numbered units of work for a ProcessPool. The pool forks its workers from
+  the process which owns the task, so each worker already has a copy of
+  whatever the units need, and only a unit's number is sent to it
+*/
+class ProcessTask {
+public:
+  /** Default constructor */
+  ProcessTask() throw ();
+
+  /** Default destructor */
+  virtual ~ProcessTask() throw ();
+
+  /**
+    Prepare a new worker process, before it runs any unit. This runs in the
+    worker
+  */
+  virtual void start_worker();
+
+  /**
+    Run a unit of work. This runs in a worker process, and must not throw
+
+    @param unit The number of the unit
+
+    @return The unit's result, which is passed to unit_finished(). Newlines
+    are replaced by spaces
+  */
+  virtual std::string run_unit(const unsigned int unit) throw () = 0;
+
+  /**
+    Clean up a worker process, once it has been told there are no more
+    units. This runs in the worker, just before it exits
+  */
+  virtual void stop_worker();
+
+  /**
+    Called in the coordinating process when a unit has finished
+
+    @param unit The number of the unit
+    @param result What run_unit() returned
+  */
+  virtual void unit_finished(const unsigned int unit,
+    const std::string& result) throw () = 0;
+
+  /**
+    Called in the coordinating process when a unit's worker died every time
+    the unit was tried
+
+    @param unit The number of the unit
+    @param error How the last worker died
+  */
+  virtual void unit_failed(const unsigned int unit, const std::string& error)
+    throw () = 0;
+};
+
+/**
+  Runs units of work in separate worker processes, each with its own address
+  space and allocator, connected to this one by a local socket. Units are
+  handed out in order to whichever worker is idle. A worker which dies in
+  the middle of a unit is replaced, and the unit is tried again on the new
+  worker, up to a limit.
+
+  Workers are forked, so the coordinating process should have no other
+  threads running while run() is
+*/
+class ProcessPool {
+public:
+  /**
+    Default constructor
+
+    @param processes How many workers to run at once. If this is 0, one
+    worker is run
+    @param max_attempts How many times a unit is tried before it fails. If
+    this is 0, each unit is tried once
+  */
+  ProcessPool(const unsigned int processes,
+    const unsigned int max_attempts = default_max_attempts) throw ();
+
+  /** Stop any workers still running */
+  ~ProcessPool() throw ();
+
+  /**
+    Run units of a task, and wait for every one to finish or fail. Workers
+    are started when this is called, and stopped before it returns
+
+    @param task The task, whose callbacks all run before this returns
+    @param units The numbers of the units to run, in the order to start them
+
+    @return How many workers died and had to be replaced
+  */
+  unsigned int run(ProcessTask& task, const std::vector<unsigned int>& units)
+    throw (Errors::GenericError);
+
+  /**
+    Get how many workers are run at once
+
+    @return How many workers are run at once
+  */
+  unsigned int process_count() const throw ();
+
+  /** The default number of times a unit is tried */
+  static const unsigned int default_max_attempts;
+
+protected:
+  /** A running worker, as seen from the coordinating process */
+  struct Worker {
+    /** The worker's process ID */
+    int pid;
+
+    /** The coordinator's end of the worker's socket */
+    int socket;
+
+    /** The unit the worker is running, or -1 if it's idle */
+    int unit;
+
+    /** Whatever part of the worker's reply has been read */
+    std::string reply;
+
+    /** Why the worker couldn't start, if it said */
+    std::string error;
+  };
+
+  /**
+    Fork a new worker
+
+    @param task The task the worker runs units of
+
+    @return Whether the worker was started
+  */
+  bool start_worker(ProcessTask& task) throw ();
+
+  /**
+    Run units in a new worker process until its socket is closed, then exit
+
+    @param task The task to run units of
+    @param socket The worker's end of its socket
+  */
+  static void worker_main(ProcessTask& task, const int socket) throw ();
+
+  /**
+    Give an idle worker the next unit
+
+    @param worker The worker
+    @param pending The units waiting to start
+
+    @return Whether the unit was sent
+  */
+  static bool send_unit(Worker& worker, std::deque<unsigned int>& pending)
+    throw ();
+
+  /**
+    Read whatever a worker has sent, and finish its unit if the whole reply
+    has arrived
+
+    @param worker The worker
+    @param task The worker's task
+
+    @return Whether the worker is still alive
+  */
+  static bool read_reply(Worker& worker, ProcessTask& task) throw ();
+
+  /**
+    Wait for a worker to exit, after its socket was closed
+
+    @param pid The worker's process ID
+
+    @return How the worker exited, for an error message
+  */
+  static std::string reap(const int pid) throw ();
+
+  /** How many workers run at once */
+  const unsigned int processes;
+
+  /** How many times each unit is tried */
+  const unsigned int max_attempts;
+
+  /** The running workers */
+  std::vector<Worker> workers;
+
+private:
+  // Workers can't be shared between copies
+  ProcessPool(const ProcessPool&);
+  ProcessPool& operator=(const ProcessPool&);
+};
+
+} // namespace
+
+#endif // DRILLER_PROCESS_POOL_H
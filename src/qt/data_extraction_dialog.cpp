@@ -31,9 +31,12 @@
 #include "data_extraction_dialog.h"
 #include "extracted_data_window.h"
 #include "../file_sink.h"
+#include "../json_lines_sink.h"
+#include "../snapshot_sink.h"
+#include "../threads.h"
 
 #if ENABLE_MYSQL
-#include "../mysql_sink.h"
+#include "../mysql_pool_sink.h"
 #endif
 
 namespace Driller {
@@ -46,6 +49,12 @@ enum OutputType {
   /** Output to several text files */
   OUTPUT_TEXT,
 
+  /** Output to snapshots, which can be reopened later */
+  OUTPUT_SNAPSHOT,
+
+  /** Output to several JSON Lines files */
+  OUTPUT_JSON_LINES,
+
 #if ENABLE_MYSQL
   /** Output to a MySQL database */
   OUTPUT_MYSQL,
@@ -57,7 +66,7 @@ enum OutputType {
 
 /** String for the output types */
 static const QString output_strings[OUTPUT_COUNT] = {
-  "Temporary window", "Text files",
+  "Temporary window", "Text files", "Snapshot", "JSON Lines files",
 #if ENABLE_MYSQL
   "MySQL database"
 #endif
@@ -126,9 +135,36 @@ DataExtractionDialog::DataExtractionDialog(QWidget* parent):
 
     text_output_path_browse = new QPushButton("Browse", text_options);
 
+    QLabel* compression_label = new QLabel("Compression:", text_options);
+    text_compression = new QComboBox(text_options);
+
+    // Only offer the formats this build can write
+    for (int ii = 0; ii < COMPRESSION_NUM_TYPES; ii++) {
+      if (compression_available(static_cast<Compression>(ii))) {
+        text_compression->addItem(compression_strings[ii].c_str(), ii);
+      }
+    }
+
+    // Large tables can be split into several files, listed in a manifest
+    QLabel* shard_rows_label = new QLabel("Rows per file:", text_options);
+    text_shard_rows = new QSpinBox(text_options);
+    text_shard_rows->setRange(0, 100000000);
+    text_shard_rows->setSpecialValueText("No limit");
+
+    QLabel* shard_size_label = new QLabel("MiB per file:", text_options);
+    text_shard_size = new QSpinBox(text_options);
+    text_shard_size->setRange(0, 4095);
+    text_shard_size->setSpecialValueText("No limit");
+
     hbox->addWidget(label);
     hbox->addWidget(text_output_path);
     hbox->addWidget(text_output_path_browse);
+    hbox->addWidget(compression_label);
+    hbox->addWidget(text_compression);
+    hbox->addWidget(shard_rows_label);
+    hbox->addWidget(text_shard_rows);
+    hbox->addWidget(shard_size_label);
+    hbox->addWidget(text_shard_size);
 
     // Connect signals
     QObject::connect(text_output_path_browse, SIGNAL(clicked(bool)),
@@ -156,6 +192,24 @@ DataExtractionDialog::DataExtractionDialog(QWidget* parent):
 
     mysql_database_name = new QLineEdit(mysql_options);
 
+    mysql_load_method = new QComboBox(mysql_options);
+    mysql_load_method->addItem("Prepared statements", MYSQL_LOAD_PREPARED);
+    mysql_load_method->addItem("INSERT queries", MYSQL_LOAD_INSERT);
+    mysql_load_method->addItem("LOAD DATA LOCAL INFILE", MYSQL_LOAD_INFILE);
+
+    mysql_connections = new QSpinBox(mysql_options);
+    mysql_connections->setMinimum(1);
+    mysql_connections->setMaximum(64);
+    mysql_connections->setValue(1);
+
+    mysql_staging = new QCheckBox("Replace tables without downtime",
+      mysql_options);
+
+    mysql_resumable = new QCheckBox("Resume interrupted loads",
+      mysql_options);
+
+    mysql_upsert_key = new QLineEdit(mysql_options);
+
     // Sensible defaults for some of the options
     mysql_host_name->setText("localhost");
     mysql_port->setMinimum(1);
@@ -173,7 +227,10 @@ DataExtractionDialog::DataExtractionDialog(QWidget* parent):
       *port_label = new QLabel("Port:", mysql_options),
       *user_name_label = new QLabel("User name:", mysql_options),
       *password_label = new QLabel("Password:", mysql_options),
-      *database_name_label = new QLabel("Database:", mysql_options);
+      *database_name_label = new QLabel("Database:", mysql_options),
+      *load_method_label = new QLabel("Send rows with:", mysql_options),
+      *connections_label = new QLabel("Connections:", mysql_options),
+      *upsert_key_label = new QLabel("Merge rows by column:", mysql_options);
 
     // Add widgets to the layout
     grid->addWidget(mysql_host_name, 0, 1);
@@ -181,12 +238,20 @@ DataExtractionDialog::DataExtractionDialog(QWidget* parent):
     grid->addWidget(mysql_user_name, 2, 1);
     grid->addWidget(mysql_password, 3, 1);
     grid->addWidget(mysql_database_name, 4, 1);
+    grid->addWidget(mysql_load_method, 5, 1);
+    grid->addWidget(mysql_connections, 6, 1);
+    grid->addWidget(mysql_staging, 7, 1);
+    grid->addWidget(mysql_resumable, 8, 1);
+    grid->addWidget(mysql_upsert_key, 9, 1);
 
     grid->addWidget(host_name_label, 0, 0);
     grid->addWidget(port_label, 1, 0);
     grid->addWidget(user_name_label, 2, 0);
     grid->addWidget(password_label, 3, 0);
     grid->addWidget(database_name_label, 4, 0);
+    grid->addWidget(load_method_label, 5, 0);
+    grid->addWidget(connections_label, 6, 0);
+    grid->addWidget(upsert_key_label, 9, 0);
 
 #endif
   }
@@ -229,20 +294,81 @@ void DataExtractionDialog::exec(const Database& db){
   DataSink* sink = 0;
 
   switch (output_type) {
-    case OUTPUT_TEXT:
-      sink = new FileSink(text_output_path->text().toUtf8().constData());
+    case OUTPUT_TEXT: {
+      FileSink* file_sink = new FileSink(
+        text_output_path->text().toUtf8().constData());
+
+      file_sink->set_compression(static_cast<Compression>(
+        text_compression->itemData(
+          text_compression->currentIndex()).toInt()));
+      file_sink->set_threads(ThreadPool::processor_count());
+      file_sink->set_shard_rows(text_shard_rows->value());
+      file_sink->set_shard_bytes(
+        static_cast<unsigned int>(text_shard_size->value()) * 1024 * 1024);
+
+      sink = file_sink;
+      break;
+    }
+
+    // Snapshots share the text output path
+    case OUTPUT_SNAPSHOT:
+      sink = new SnapshotSink(text_output_path->text().toUtf8().constData());
       break;
 
+    // So do JSON Lines files, and their compression
+    case OUTPUT_JSON_LINES: {
+      JsonLinesSink* json_sink = new JsonLinesSink(
+        text_output_path->text().toUtf8().constData());
+
+      json_sink->set_compression(static_cast<Compression>(
+        text_compression->itemData(
+          text_compression->currentIndex()).toInt()));
+      json_sink->set_threads(ThreadPool::processor_count());
+
+      sink = json_sink;
+      break;
+    }
+
 #if ENABLE_MYSQL
-    case OUTPUT_MYSQL:
-      sink = new MySQLSink(
-        mysql_host_name->text().toUtf8().constData(),
-        mysql_user_name->text().toUtf8().constData(),
-        mysql_password->text().toUtf8().constData(),
-        mysql_database_name->text().toUtf8().constData(),
-        mysql_port->value()
-      );
+    case OUTPUT_MYSQL: {
+      const MySQLLoadMethod method = static_cast<MySQLLoadMethod>(
+        mysql_load_method->itemData(
+          mysql_load_method->currentIndex()).toInt());
+
+      if (mysql_connections->value() > 1){
+        MySQLPoolSink* pool_sink = new MySQLPoolSink(
+          mysql_host_name->text().toUtf8().constData(),
+          mysql_user_name->text().toUtf8().constData(),
+          mysql_password->text().toUtf8().constData(),
+          mysql_database_name->text().toUtf8().constData(),
+          mysql_port->value(),
+          mysql_connections->value(),
+          method
+        );
+        pool_sink->set_staging(mysql_staging->isChecked());
+        pool_sink->set_resumable(mysql_resumable->isChecked());
+        pool_sink->set_upsert_key(
+          mysql_upsert_key->text().toUtf8().constData());
+        sink = pool_sink;
+      }
+
+      else {
+        MySQLSink* mysql_sink = new MySQLSink(
+          mysql_host_name->text().toUtf8().constData(),
+          mysql_user_name->text().toUtf8().constData(),
+          mysql_password->text().toUtf8().constData(),
+          mysql_database_name->text().toUtf8().constData(),
+          mysql_port->value(),
+          method
+        );
+        mysql_sink->set_staging(mysql_staging->isChecked());
+        mysql_sink->set_resumable(mysql_resumable->isChecked());
+        mysql_sink->set_upsert_key(
+          mysql_upsert_key->text().toUtf8().constData());
+        sink = mysql_sink;
+      }
       break;
+    }
 #endif
 
     default:
@@ -302,6 +428,8 @@ void DataExtractionDialog::on_output_selection_currentIndexChanged(
 
   switch (output_type) {
     case OUTPUT_TEXT:
+    case OUTPUT_SNAPSHOT:
+    case OUTPUT_JSON_LINES:
       text_options->show();
       mysql_options->hide();
       break;
@@ -65,6 +65,15 @@ protected:
   /** Button to browse for a data output directory */
   QPushButton* text_output_path_browse;
 
+  /** How the text files should be compressed */
+  QComboBox* text_compression;
+
+  /** The most rows in each shard of a text file, or 0 to not shard */
+  QSpinBox* text_shard_rows;
+
+  /** Roughly how many MiB are in each shard of a text file, or 0 */
+  QSpinBox* text_shard_size;
+
   // Widgets for MySQL extractions
 
   /** Used to show or hide all MySQL options at once */
@@ -85,6 +94,21 @@ protected:
   /** Database to store extracted data in */
   QLineEdit* mysql_database_name;
 
+  /** How rows are sent to the server */
+  QComboBox* mysql_load_method;
+
+  /** How many connections rows are loaded over */
+  QSpinBox* mysql_connections;
+
+  /** Whether tables are loaded into staging tables and then swapped in */
+  QCheckBox* mysql_staging;
+
+  /** Whether interrupted loads are resumed */
+  QCheckBox* mysql_resumable;
+
+  /** The column rows are merged by, if any */
+  QLineEdit* mysql_upsert_key;
+
 protected slots:
   void on_all_rows_stateChanged(const int state);
   void find_text_output_path();
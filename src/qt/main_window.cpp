@@ -254,6 +254,27 @@ void MainWindow::on_actionOpen_activated(){
   }
 }
 
+void MainWindow::on_actionOpen_Snapshot_activated(){
+  QString dir = QFileDialog::getExistingDirectory(this,
+    "Open a snapshot",                // Caption
+    current_directory.absolutePath(), // Directory
+    QFileDialog::ShowDirsOnly
+  );
+
+  if (dir.length() > 0) {
+    try {
+      // Snapshots aren't saved back to, so there's no file name
+      current_filename = "";
+      db = Database::from_snapshot(dir.toUtf8().constData());
+      refresh_all();
+    }
+
+    catch (const Errors::BaseError& error) {
+      show_error(error);
+    }
+  }
+}
+
 void MainWindow::on_actionSave_activated(){
   if (current_filename.isEmpty()){
     // Open a Save As dialog if no filename has been selected yet
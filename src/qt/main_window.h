@@ -83,6 +83,7 @@ protected slots:
   void on_actionQuit_activated();
 
   void on_actionOpen_activated();
+  void on_actionOpen_Snapshot_activated();
   void on_actionSave_activated();
   void on_actionSaveAs_activated();
   void on_actionExtract_Data_activated();
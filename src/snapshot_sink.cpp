@@ -0,0 +1,50 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * snapshot_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "snapshot_sink.h"
+#include "database/snapshot.h"
+
+namespace Driller {
+
+SnapshotSink::SnapshotSink(const std::string& _directory) throw ():
+  directory(_directory){}
+
+SnapshotSink::~SnapshotSink() throw () {}
+
+void SnapshotSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError) {
+
+  const RowData* rows = table.load_rows(row_limit);
+
+  try {
+    Snapshot::write(directory + "/" + table.get_name() + Snapshot::extension,
+      *rows);
+  }
+
+  catch (...){
+    delete rows;
+    throw;
+  }
+
+  delete rows;
+}
+
+} // namespace
@@ -0,0 +1,463 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * sql_format.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sql_format.h"
+#include "string_scan.h"
+#include <cctype>
+#include <cstring>
+#include <list>
+#include <sstream>
+#include <vector>
+
+namespace Driller {
+
+unsigned int format_phone(const uint8* field, char* buffer) throw () {
+  buffer[0] = field[0];
+  buffer[1] = field[1];
+  buffer[2] = field[2];
+  buffer[3] = '-';
+  buffer[4] = field[3];
+  buffer[5] = field[4];
+  buffer[6] = field[5];
+
+  // Only 7 digits (123-4567)
+  if (!field[7]){
+    buffer[7] = field[6];
+    return 8;
+  }
+
+  buffer[7] = '-';
+  buffer[8] = field[6];
+  buffer[9] = field[7];
+  buffer[10] = field[8];
+  buffer[11] = field[9];
+  return 12;
+}
+
+/**
+  Write a quoted, escaped string
+
+  @param string The string
+  @param length The length of string
+  @param out Receives the literal
+
+  @return The length of the literal
+*/
+unsigned int write_escaped(const char* string, const unsigned int length,
+  char* out) throw () {
+
+  out[0] = '\'';
+  const unsigned int written = escape_sql_string(string, length, out + 1);
+  out[written + 1] = '\'';
+  return written + 2;
+}
+
+SQLLiteralKind sql_literal_kind(const ColumnType type) throw (){
+  switch (type){
+    case COLUMN_BOOL:
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+    case COLUMN_CURRENCY:
+      return SQL_LITERAL_BARE;
+
+    case COLUMN_DATE:
+    case COLUMN_UNKNOWN:
+      return SQL_LITERAL_QUOTED;
+
+    // Escaping would depend on the connection's character set
+    case COLUMN_BLOB:
+      return SQL_LITERAL_HEX;
+
+    // Phone numbers are copied from the file as they are, so they could hold
+    // anything if it's corrupt
+    default:
+      return SQL_LITERAL_ESCAPED;
+  }
+}
+
+unsigned int format_unsigned(uint32 value, char* buffer) throw (){
+  char digits[10];
+  unsigned int count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + (value % 10));
+    value /= 10;
+  } while (value);
+
+  for (unsigned int ii = 0; ii < count; ii++){
+    buffer[ii] = digits[count - ii - 1];
+  }
+  return count;
+}
+
+unsigned int format_currency(const int32 cents, char* buffer) throw(){
+  const uint32 magnitude = cents < 0 ? 0u - static_cast<uint32>(cents)
+    : static_cast<uint32>(cents);
+
+  unsigned int length = 0;
+  if (cents < 0){
+    buffer[length++] = '-';
+  }
+
+  length += format_unsigned(magnitude / 100, buffer + length);
+  buffer[length++] = '.';
+  buffer[length++] = static_cast<char>('0' + (magnitude % 100) / 10);
+  buffer[length++] = static_cast<char>('0' + magnitude % 10);
+  buffer[length] = 0;
+  return length;
+}
+
+unsigned int format_date(const uint32 date, char* buffer) throw (){
+  uint32 year;
+  uint8 month, day;
+  Column::date_to_ymd(date, year, month, day);
+
+  buffer[0] = static_cast<char>('0' + (year / 1000) % 10);
+  buffer[1] = static_cast<char>('0' + (year / 100) % 10);
+  buffer[2] = static_cast<char>('0' + (year / 10) % 10);
+  buffer[3] = static_cast<char>('0' + year % 10);
+  buffer[4] = '-';
+  buffer[5] = static_cast<char>('0' + month / 10);
+  buffer[6] = static_cast<char>('0' + month % 10);
+  buffer[7] = '-';
+  buffer[8] = static_cast<char>('0' + day / 10);
+  buffer[9] = static_cast<char>('0' + day % 10);
+  return 10;
+}
+
+unsigned int escape_sql_string(const char* string, const unsigned int length,
+  char* out) throw (){
+
+  const char* end = string + length;
+  char* start = out;
+
+  while (string != end){
+    const char* special = find_sql_special(string, end);
+    memcpy(out, string, special - string);
+    out += special - string;
+
+    if (special == end){
+      break;
+    }
+
+    out[0] = '\\';
+    switch (*special){
+      case 0: out[1] = '0'; break;
+      case '\n': out[1] = 'n'; break;
+      case '\r': out[1] = 'r'; break;
+      case '\032': out[1] = 'Z'; break;
+      default: out[1] = *special;
+    }
+    out += 2;
+    string = special + 1;
+  }
+
+  return static_cast<unsigned int>(out - start);
+}
+
+unsigned int max_sql_value_size(const Column& column, const uint8* row)
+  throw (){
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return 1;
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+      return 11;
+
+    // format_currency() also writes a NULL terminator
+    case COLUMN_CURRENCY:
+      return 13;
+
+    case COLUMN_DATE:
+      return 12;
+
+    case COLUMN_PHONE:
+      return (2 * 12) + 2;
+
+    case COLUMN_ENUM: {
+      const std::string value = column.enumeration.get_value(
+        Column::get_uint8(column.get_field(row)));
+      return (2 * static_cast<unsigned int>(value.size())) + 2;
+    }
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING: {
+      const uint8* bytes;
+      return (2 * column.get_bytes(row, bytes)) + 2;
+    }
+
+    case COLUMN_BLOB: {
+      const uint8* bytes;
+      return (2 * column.get_bytes(row, bytes)) + 3;
+    }
+
+    default:
+      return 9;
+  }
+}
+
+unsigned int write_sql_value(const Column& column, const uint8* row,
+  char* out) throw (){
+
+  const uint8* field = column.get_field(row);
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      out[0] = field[0] ? '1' : '0';
+      return 1;
+
+    case COLUMN_UINT8:
+      return format_unsigned(Column::get_uint8(field), out);
+
+    case COLUMN_UINT16:
+      return format_unsigned(Column::get_uint16(field), out);
+
+    case COLUMN_UINT32:
+      return format_unsigned(Column::get_uint32(field), out);
+
+    case COLUMN_INT8:
+    case COLUMN_INT16:
+    case COLUMN_INT32: {
+      const int32 value = column.get_type() == COLUMN_INT8 ?
+        Column::get_int8(field) : column.get_type() == COLUMN_INT16 ?
+        Column::get_int16(field) : Column::get_int32(field);
+
+      if (value < 0){
+        out[0] = '-';
+        return 1 + format_unsigned(0u - static_cast<uint32>(value), out + 1);
+      }
+      return format_unsigned(static_cast<uint32>(value), out);
+    }
+
+    case COLUMN_CURRENCY:
+      return format_currency(Column::get_int32(field), out);
+
+    case COLUMN_DATE:
+      out[0] = '\'';
+      format_date(Column::get_uint32(field), out + 1);
+      out[11] = '\'';
+      return 12;
+
+    case COLUMN_PHONE: {
+      char phone[12];
+      return write_escaped(phone, format_phone(field, phone), out);
+    }
+
+    case COLUMN_ENUM: {
+      const std::string value = column.enumeration.get_value(
+        Column::get_uint8(field));
+      return write_escaped(value.data(),
+        static_cast<unsigned int>(value.size()), out);
+    }
+
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING: {
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(row, bytes);
+      return write_escaped(reinterpret_cast<const char*>(bytes), length, out);
+    }
+
+    case COLUMN_BLOB: {
+      static const char digits[] = "0123456789ABCDEF";
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(row, bytes);
+
+      out[0] = 'X';
+      out[1] = '\'';
+      for (unsigned int ii = 0; ii < length; ii++){
+        out[2 + (2 * ii)] = digits[bytes[ii] >> 4];
+        out[3 + (2 * ii)] = digits[bytes[ii] & 15];
+      }
+      out[2 + (2 * length)] = '\'';
+      return (2 * length) + 3;
+    }
+
+    default:
+      memcpy(out, "'unknown'", 9);
+      return 9;
+  }
+}
+
+unsigned int write_sql_text(const ColumnType type, const char* text,
+  const unsigned int length, char* out) throw (){
+
+  // extract_data() writes booleans as words
+  if (type == COLUMN_BOOL){
+    out[0] = text[0] == 'T' ? '1' : '0';
+    return 1;
+  }
+
+  switch (sql_literal_kind(type)){
+    case SQL_LITERAL_BARE:
+      memcpy(out, text, length);
+      return length;
+
+    case SQL_LITERAL_QUOTED:
+      out[0] = '\'';
+      memcpy(out + 1, text, length);
+      out[length + 1] = '\'';
+      return length + 2;
+
+    // Hex pairs separated by spaces. An empty blob is an empty string, which
+    // still fits in 2 characters
+    case SQL_LITERAL_HEX: {
+      if (!length){
+        memcpy(out, "''", 2);
+        return 2;
+      }
+
+      unsigned int written = 2;
+      for (unsigned int ii = 0; ii < length; ii++){
+        if (isxdigit(static_cast<unsigned char>(text[ii]))){
+          out[written++] = text[ii];
+        }
+      }
+
+      // A corrupt value could leave half a byte
+      written -= (written % 2);
+      out[0] = 'X';
+      out[1] = '\'';
+      out[written] = '\'';
+      return written + 1;
+    }
+
+    default:
+      return write_escaped(text, length, out);
+  }
+}
+
+bool can_index_sql(const Column& column) throw (){
+  return !(column.get_type() == COLUMN_BLOB ||
+    column.get_type() == COLUMN_VARSTRING ||
+    (column.get_type() == COLUMN_STRING && column.get_length() > 255));
+}
+
+std::string sql_type_from_column(const Column& col) throw (){
+  std::string buffer;
+
+  switch(col.get_type()){
+    case COLUMN_UNKNOWN:
+    case COLUMN_NUM_TYPES:
+      // Contents of an unknown column is always "unknown"
+      buffer = "CHAR(7)";
+    break;
+
+    case COLUMN_BOOL:
+      buffer = "TINYINT(1) UNSIGNED";
+    break;
+
+    // Integer types
+    case COLUMN_INT8:
+      buffer = "TINYINT";
+    break;
+
+    case COLUMN_UINT8:
+      buffer = "TINYINT UNSIGNED";
+    break;
+
+    case COLUMN_INT16:
+      buffer = "SMALLINT";
+    break;
+
+    case COLUMN_UINT16:
+      buffer = "SMALLINT UNSIGNED";
+    break;
+
+    case COLUMN_INT32:
+      buffer = "INT";
+    break;
+
+    case COLUMN_UINT32:
+      buffer = "INT UNSIGNED";
+    break;
+
+    // String types
+    case COLUMN_BLOB:
+      buffer = "BLOB";
+    break;
+
+    case COLUMN_STRING:
+      if (col.get_length() < 256){
+        std::stringstream ss;
+        ss << "VARCHAR(" << col.get_length() << ")";
+        buffer = ss.str();
+      }
+
+      else {
+        buffer = "TEXT";
+      }
+    break;
+
+    case COLUMN_VARSTRING:
+      buffer = "TEXT";
+    break;
+
+
+    // Special types
+    case COLUMN_PHONE:
+      buffer = "VARCHAR(12)";
+    break;
+
+    case COLUMN_DATE:
+      buffer = "DATE";
+    break;
+
+    case COLUMN_CURRENCY:
+      buffer = "DECIMAL(10,2)";
+    break;
+
+    case COLUMN_ENUM: {
+      std::stringstream ss;
+      ss << "ENUM (";
+
+      std::list<EnumCase> case_list = col.enumeration.get_case_list();
+      std::list<EnumCase>::iterator iter;
+      for (iter = case_list.begin();
+        iter != case_list.end();
+        iter++){
+
+        std::vector<char> escaped(2 * (*iter).value.size());
+        ss << "'" << std::string(escaped.begin(), escaped.begin() +
+          escape_sql_string((*iter).value.data(),
+            static_cast<unsigned int>((*iter).value.size()),
+            escaped.empty() ? NULL : &escaped[0])) << "', ";
+      }
+
+      buffer = ss.str();
+      buffer.erase(buffer.size() - 2, 2);
+
+      buffer += ")";
+    break;
+    }
+  }
+
+  return buffer;
+}
+
+} // namespace
@@ -0,0 +1,174 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * sql_format.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_SQL_FORMAT_H
+#define DRILLER_SQL_FORMAT_H
+
+#include "database/column.h"
+
+namespace Driller {
+
+/** How a column's values are written as SQL literals */
+enum SQLLiteralKind {
+  /** Numbers, which are written without quotes */
+  SQL_LITERAL_BARE = 0,
+
+  /** Quoted, but never containing a character that must be escaped */
+  SQL_LITERAL_QUOTED,
+
+  /** Quoted and escaped */
+  SQL_LITERAL_ESCAPED,
+
+  /** Bytes, written as a hexadecimal literal such as X'0AFF' */
+  SQL_LITERAL_HEX
+};
+
+/**
+  Get how values of a column type are written as SQL literals
+
+  @param type The column's type
+
+  @return How the column's values are written
+*/
+SQLLiteralKind sql_literal_kind(const ColumnType type) throw ();
+
+/**
+  Format an unsigned integer as decimal text
+
+  @param value The integer
+  @param buffer Receives the text, which is not NULL-terminated. It must hold
+  at least 10 characters
+
+  @return The length of the text
+*/
+unsigned int format_unsigned(uint32 value, char* buffer) throw ();
+
+/**
+  Format an amount of currency as exact decimal text
+
+  @param cents The amount, in cents
+  @param buffer Receives the NULL-terminated text. It must hold at least 13
+  characters
+
+  @return The length of the text
+*/
+unsigned int format_currency(const int32 cents, char* buffer) throw ();
+
+/**
+  Format a phone number as extract_data() does
+
+  @param field The stored phone number
+  @param buffer Receives the text. It must hold at least 12 characters
+
+  @return The length of the text
+*/
+unsigned int format_phone(const uint8* field, char* buffer) throw ();
+
+/**
+  Format a stored date as YYYY-MM-DD
+
+  @param date The date, as stored in a date column
+  @param buffer Receives the text, which is not NULL-terminated. It must hold
+  at least 10 characters
+
+  @return The length of the text
+*/
+unsigned int format_date(const uint32 date, char* buffer) throw ();
+
+/**
+  Escape a string for an SQL string literal, in the same way as
+  mysql_real_escape_string() does for single-byte and UTF-8 character sets.
+  Spans with nothing to escape are copied in bulk
+
+  @param string The string to escape
+  @param length The length of string
+  @param out Receives the escaped string, without quotes. It must hold at
+  least 2 * length characters
+
+  @return The length of the escaped string
+*/
+unsigned int escape_sql_string(const char* string, const unsigned int length,
+  char* out) throw ();
+
+/**
+  Get the most space a raw value can take as an SQL literal
+
+  @param column The value's column
+  @param row The start of the row containing the value
+
+  @return The most characters write_sql_value() will write
+*/
+unsigned int max_sql_value_size(const Column& column, const uint8* row)
+  throw ();
+
+/**
+  Write a raw value as an SQL literal. Integers, booleans and currency are
+  written as bare numbers, booleans as 1 or 0. Dates are quoted, and only
+  text is escaped. Blobs are written as hexadecimal literals of their bytes
+
+  @param column The value's column
+  @param row The start of the row containing the value
+  @param out Receives the literal. It must hold at least
+  max_sql_value_size() characters
+
+  @return The length of the literal
+*/
+unsigned int write_sql_value(const Column& column, const uint8* row,
+  char* out) throw ();
+
+/**
+  Write a value extracted as text, as by Column::extract_data(), as an SQL
+  literal in the same form as write_sql_value() does. Blobs, extracted as
+  hex pairs, become the same hexadecimal literal of their bytes
+
+  @param type The value's column type
+  @param text The value
+  @param length The length of text
+  @param out Receives the literal. It must hold at least 2 * length + 2
+  characters
+
+  @return The length of the literal
+*/
+unsigned int write_sql_text(const ColumnType type, const char* text,
+  const unsigned int length, char* out) throw ();
+
+/**
+  Get the MySQL type of a column, as used by CREATE TABLE. Every value
+  write_sql_value() writes for the column fits the type
+
+  @param col The column
+
+  @return The SQL type definition for the column
+*/
+std::string sql_type_from_column(const Column& col) throw ();
+
+/**
+  Check whether MySQL can index a column without a prefix length, which
+  TEXT and BLOB columns need
+
+  @param column The column
+
+  @return Whether the column can be indexed
+*/
+bool can_index_sql(const Column& column) throw ();
+
+} // namespace
+
+#endif // DRILLER_SQL_FORMAT_H
@@ -0,0 +1,498 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * sql_script_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sql_script_sink.h"
+#include "output_file.h"
+#include "sql_format.h"
+#include "threads.h"
+#include "database/result_set.h"
+#include "database/row_data.h"
+#include "database/table_cost.h"
+#include <errno.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace Driller {
+
+/** The largest INSERT written, unless set otherwise */
+const unsigned int default_packet_size = 1024 * 1024;
+
+/** The smallest INSERT size allowed, so each holds a few rows */
+const unsigned int min_packet_size = 4096;
+
+/** How much of a part is copied to the script at a time */
+const unsigned int append_buffer_size = 1024 * 1024;
+
+/**
+  Written before any table. Data files hold single-byte text, and values are
+  escaped with backslashes, which the SQL mode set here allows. Checks the
+  rows can't fail are turned off, and rows are committed once per table
+*/
+const char* const script_header =
+  "-- Driller SQL dump\n"
+  "\n"
+  "/*!40101 SET @OLD_CHARACTER_SET_CLIENT=@@CHARACTER_SET_CLIENT */;\n"
+  "/*!40101 SET NAMES latin1 */;\n"
+  "/*!40014 SET @OLD_UNIQUE_CHECKS=@@UNIQUE_CHECKS, UNIQUE_CHECKS=0 */;\n"
+  "/*!40014 SET @OLD_FOREIGN_KEY_CHECKS=@@FOREIGN_KEY_CHECKS,"
+  " FOREIGN_KEY_CHECKS=0 */;\n"
+  "/*!40101 SET @OLD_SQL_MODE=@@SQL_MODE,"
+  " SQL_MODE='NO_AUTO_VALUE_ON_ZERO' */;\n"
+  "SET @OLD_AUTOCOMMIT=@@AUTOCOMMIT, AUTOCOMMIT=0;\n";
+
+/** Written after every table, to restore the client's settings */
+const char* const script_footer =
+  "\n"
+  "SET AUTOCOMMIT=@OLD_AUTOCOMMIT;\n"
+  "/*!40101 SET SQL_MODE=@OLD_SQL_MODE */;\n"
+  "/*!40014 SET FOREIGN_KEY_CHECKS=@OLD_FOREIGN_KEY_CHECKS */;\n"
+  "/*!40014 SET UNIQUE_CHECKS=@OLD_UNIQUE_CHECKS */;\n"
+  "/*!40101 SET CHARACTER_SET_CLIENT=@OLD_CHARACTER_SET_CLIENT */;\n"
+  "\n"
+  "-- Dump completed\n";
+
+/**
+  Quote a table or column name, with spaces replaced by underscores as
+  MySQLSink does
+
+  @param name The name to quote
+
+  @return The quoted name
+*/
+static std::string quote_name(std::string name) throw (){
+  std::replace(name.begin(), name.end(), ' ', '_');
+
+  std::string quoted = "`";
+  for (unsigned int ii = 0; ii < name.size(); ii++){
+    if (name[ii] == '`'){
+      quoted += '`';
+    }
+    quoted += name[ii];
+  }
+  return quoted + "`";
+}
+
+/**
+  Write a table's rows as extended INSERTs
+
+  @param file The part to write to
+  @param table_name The table's quoted name
+  @param rows The raw rows, or NULL if result is used
+  @param result Rows extracted as text, or NULL if rows is used
+  @param packet_size The largest statement to write
+*/
+static void write_inserts(OutputFile& file, const std::string& table_name,
+  const RowData* rows, const ResultSet* result,
+  const unsigned int packet_size) throw (Errors::FileWriteError){
+
+  const Table& table = rows ? rows->table : result->table;
+  const unsigned int row_count = rows ? rows->row_count() :
+    result->row_count();
+
+  const std::string prefix = "INSERT INTO " + table_name + " VALUES ";
+  const unsigned int prefix_length =
+    static_cast<unsigned int>(prefix.size());
+
+  const std::vector<Column> column_list = table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+  std::vector<unsigned int> lengths(columns);
+
+  // Each statement is built here, then ended with ";\n"
+  std::vector<char> statement(std::max(packet_size, prefix_length) + 2);
+  unsigned int length = 0;
+
+  for (unsigned int row = 0; row < row_count; row++){
+    const uint8* raw = rows ? (*rows)[row] : NULL;
+    const char** cells = result ? (*result)[row] : NULL;
+
+    // The most this row can take, with its parentheses and commas
+    unsigned int row_size = 2;
+    for (unsigned int col = 0; col < columns; col++){
+      if (raw){
+        row_size += max_sql_value_size(column_list[col], raw) + 1;
+      }
+      else {
+        lengths[col] = static_cast<unsigned int>(strlen(cells[col]));
+        row_size += (2 * lengths[col]) + 3;
+      }
+    }
+
+    if (length && length + 1 + row_size > packet_size){
+      memcpy(&statement[length], ";\n", 2);
+      file.write(&statement[0], length + 2);
+      length = 0;
+    }
+
+    // Only a single row larger than a packet gets here without room
+    if (prefix_length + row_size + 2 > statement.size()){
+      statement.resize(prefix_length + row_size + 2);
+    }
+
+    if (length){
+      statement[length++] = ',';
+    }
+    else {
+      memcpy(&statement[0], prefix.data(), prefix_length);
+      length = prefix_length;
+    }
+
+    statement[length++] = '(';
+    for (unsigned int col = 0; col < columns; col++){
+      if (col){
+        statement[length++] = ',';
+      }
+
+      if (raw){
+        length += write_sql_value(column_list[col], raw, &statement[length]);
+      }
+      else {
+        length += write_sql_text(column_list[col].get_type(), cells[col],
+          lengths[col], &statement[length]);
+      }
+    }
+    statement[length++] = ')';
+  }
+
+  if (length){
+    memcpy(&statement[length], ";\n", 2);
+    file.write(&statement[0], length + 2);
+  }
+}
+
+/**
+  Writes one table's part for SQLScriptSink::output_database()
+*/
+class SQLScriptTableJob : public Job {
+public:
+  SQLScriptTableJob(const Table& _table, const unsigned int _packet_size,
+    const std::string& _part_name, const Compression _compression) throw ():
+
+    table(_table), packet_size(_packet_size), part_name(_part_name),
+    compression(_compression){}
+
+  virtual ~SQLScriptTableJob() throw () {}
+
+  void run() {
+    SQLScriptSink::write_table(table, 0, packet_size, part_name,
+      compression);
+  }
+
+  const Table table;
+  const unsigned int packet_size;
+  const std::string part_name;
+  const Compression compression;
+};
+
+///////////////////
+// SQLScriptSink //
+///////////////////
+
+SQLScriptSink::SQLScriptSink(const std::string& _file_name)
+  throw (Errors::FileWriteError):
+
+  file_name(_file_name), file(NULL), started(false), parts(0),
+  packet_size(default_packet_size), compression(COMPRESSION_NONE),
+  pool(NULL){
+
+  file = fopen(file_name.c_str(), "wb");
+  if (!file){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+SQLScriptSink::~SQLScriptSink() throw (){
+  try {
+    close();
+  }
+  catch (const Errors::FileWriteError&){}
+
+  if (file){
+    fclose(file);
+  }
+  delete pool;
+}
+
+void SQLScriptSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::FileWriteError){
+
+  start();
+
+  const std::string part_name = next_part_name();
+  try {
+    write_table(table, row_limit, packet_size, part_name, compression);
+  }
+  catch (...){
+    remove(part_name.c_str());
+    throw;
+  }
+
+  append_part(part_name);
+}
+
+void SQLScriptSink::output_database(const Database& db){
+  if (!pool){
+    DataSink::output_database(db);
+    return;
+  }
+
+  start();
+
+  std::vector<Table> tables = db.get_tables();
+  std::vector<SQLScriptTableJob*> jobs;
+
+  for (unsigned int ii = 0; ii < tables.size(); ii++){
+    jobs.push_back(new SQLScriptTableJob(tables[ii], packet_size,
+      next_part_name(), compression));
+  }
+
+  // The most costly tables start first, so none is left for last. Parts are
+  // still appended in the database's order
+  const std::vector<unsigned int> order = schedule_by_cost(tables);
+  for (unsigned int ii = 0; ii < order.size(); ii++){
+    pool->add_job(jobs[order[ii]]);
+  }
+
+  // Each part is appended as soon as it and every part before it are done,
+  // so the script keeps the database's table order
+  unsigned int failed = 0;
+  std::string first_error;
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    pool->wait(jobs[ii]);
+
+    if (jobs[ii]->failed()){
+      if (failed++ == 0){
+        first_error = jobs[ii]->get_error();
+      }
+      remove(jobs[ii]->part_name.c_str());
+      continue;
+    }
+
+    try {
+      append_part(jobs[ii]->part_name);
+    }
+    catch (const Errors::BaseError& error){
+      if (failed++ == 0){
+        first_error = error.error_message();
+      }
+    }
+  }
+
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    delete jobs[ii];
+  }
+
+  if (failed){
+    std::stringstream ss;
+    ss << failed << " table(s) could not be written. The first error was: "
+       << first_error;
+    throw Errors::GenericError(ss.str());
+  }
+}
+
+void SQLScriptSink::close() throw (Errors::FileWriteError){
+  if (!file){
+    return;
+  }
+
+  start();
+  write_text(script_footer);
+
+  FILE* closing = file;
+  file = NULL;
+  if (fclose(closing)){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+void SQLScriptSink::set_packet_size(const unsigned int bytes) throw (){
+  packet_size = bytes ? std::max(bytes, min_packet_size) :
+    default_packet_size;
+}
+
+unsigned int SQLScriptSink::get_packet_size() const throw (){
+  return packet_size;
+}
+
+void SQLScriptSink::set_compression(const Compression _compression) throw (){
+  compression = _compression;
+}
+
+Compression SQLScriptSink::get_compression() const throw (){
+  return compression;
+}
+
+void SQLScriptSink::set_threads(const unsigned int threads)
+  throw (Errors::GenericError){
+
+  delete pool;
+  pool = NULL;
+
+  if (threads > 1){
+    pool = new ThreadPool(threads);
+  }
+}
+
+unsigned int SQLScriptSink::get_threads() const throw (){
+  return pool ? pool->thread_count() : 1;
+}
+
+void SQLScriptSink::write_table(const Table& table,
+  const unsigned int row_limit, const unsigned int packet_size,
+  const std::string& part_name, const Compression compression)
+  throw (Errors::FileReadError, Errors::FileWriteError){
+
+  // CREATE TABLE needs at least one column, so such a table is only noted
+  if (!table.column_count()){
+    OutputFile file(part_name, compression);
+    file.write("\n--\n-- Table " + quote_name(table.get_name()) +
+      " has no columns, so it is skipped\n--\n");
+    file.close();
+    return;
+  }
+
+  // Snapshots can only be read as text
+  const ResultSet* result = NULL;
+  RowData* rows = NULL;
+  if (!table.get_snapshot_file().empty()){
+    result = table.extract_data(row_limit);
+  }
+  else {
+    rows = table.load_rows(row_limit);
+  }
+
+  try {
+    // Each part is its own unit of parallel work, so it's compressed on this
+    // thread
+    OutputFile file(part_name, compression);
+    const std::string table_name = quote_name(table.get_name());
+
+    std::string text = "\n--\n-- Table structure for table " + table_name +
+      "\n--\n\nDROP TABLE IF EXISTS " + table_name + ";\nCREATE TABLE " +
+      table_name + " (\n";
+    for (unsigned int col = 0; col < table.column_count(); col++){
+      const Column& column = table.column_at(col);
+      text += "  " + quote_name(column.get_name()) + " " +
+        sql_type_from_column(column) +
+        (col + 1 < table.column_count() ? ",\n" : "\n");
+    }
+    text += ");\n\n--\n-- Dumping data for table " + table_name +
+      "\n--\n\nLOCK TABLES " + table_name + " WRITE;\n";
+    file.write(text);
+
+    write_inserts(file, table_name, rows, result, packet_size);
+
+    text = "COMMIT;\nUNLOCK TABLES;\n";
+
+    // Every index is built in one pass, once the rows are in
+    std::string indexes;
+    for (unsigned int col = 0; col < table.column_count(); col++){
+      const Column& column = table.column_at(col);
+      if (column.get_indexed() && can_index_sql(column)){
+        indexes += indexes.empty() ? " " : ", ";
+        indexes += "ADD INDEX(" + quote_name(column.get_name()) + ")";
+      }
+    }
+    if (!indexes.empty()){
+      text += "ALTER TABLE " + table_name + indexes + ";\n";
+    }
+
+    file.write(text);
+    file.close();
+  }
+
+  catch (...){
+    delete rows;
+    delete result;
+    throw;
+  }
+
+  delete rows;
+  delete result;
+}
+
+void SQLScriptSink::start() throw (Errors::FileWriteError){
+  if (!started){
+    started = true;
+    write_text(script_header);
+  }
+}
+
+void SQLScriptSink::write_text(const std::string& text)
+  throw (Errors::FileWriteError){
+
+  std::string compressed;
+  const std::string* data = &text;
+  if (compression != COMPRESSION_NONE){
+    if (!compress_block(compression, text.data(),
+      static_cast<unsigned int>(text.size()), compressed)){
+
+      throw Errors::FileWriteError(file_name);
+    }
+    data = &compressed;
+  }
+
+  if (fwrite(data->data(), 1, data->size(), file) != data->size()){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+void SQLScriptSink::append_part(const std::string& part_name)
+  throw (Errors::FileReadError, Errors::FileWriteError){
+
+  FILE* part = fopen(part_name.c_str(), "rb");
+  if (!part){
+    throw Errors::FileReadError(part_name, errno);
+  }
+
+  std::vector<char> buffer(append_buffer_size);
+  size_t length;
+  while ((length = fread(&buffer[0], 1, buffer.size(), part)) > 0){
+    if (fwrite(&buffer[0], 1, length, file) != length){
+      const int error = errno;
+      fclose(part);
+      throw Errors::FileWriteError(file_name, error);
+    }
+  }
+
+  const bool read_failed = ferror(part) != 0;
+  fclose(part);
+  if (read_failed){
+    throw Errors::FileReadError(part_name);
+  }
+
+  remove(part_name.c_str());
+
+  // The script is complete up to here, even if this sink is never closed
+  if (fflush(file)){
+    throw Errors::FileWriteError(file_name, errno);
+  }
+}
+
+std::string SQLScriptSink::next_part_name() throw (){
+  std::stringstream ss;
+  ss << file_name << "." << parts++ << ".part";
+  return ss.str();
+}
+
+} // namespace
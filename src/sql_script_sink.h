@@ -0,0 +1,198 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * sql_script_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_SQL_SCRIPT_SINK_H
+#define DRILLER_SQL_SCRIPT_SINK_H
+
+#include <cstdio>
+#include "data_sink.h"
+#include "errors.h"
+#include "file_errors.h"
+#include "compression.h"
+
+namespace Driller {
+
+class ThreadPool;
+class SQLScriptTableJob;
+
+/**
+  A SQLScriptSink writes a script in the style of mysqldump, which recreates
+  each table and loads its rows when run through the mysql client. Rows are
+  written as extended INSERTs, each as large as the packet size allows. Keys
+  and checks are disabled and autocommit is off while rows are inserted, and
+  each table's indexes are added once its rows are in.
+
+  output_database() writes each table's statements into a part file of its
+  own, on as many threads as there are, and appends the parts to the script
+  in order. Every output_table() or output_database() call adds its tables to
+  the same script, which is finished by close()
+*/
+class SQLScriptSink : public DataSink {
+  friend class SQLScriptTableJob;
+public:
+  /**
+    Default constructor
+
+    @param file_name The script to write. It is replaced if it exists, and
+    parts are written next to it while tables are being extracted
+  */
+  SQLScriptSink(const std::string& file_name) throw (Errors::FileWriteError);
+
+  /** Finish the script, if it hasn't been already. Errors are ignored */
+  virtual ~SQLScriptSink() throw ();
+
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Write every table of a database, generating several tables' statements
+    at once if there is more than one thread. Every table is attempted even
+    if some fail
+
+    @param db The database to extract
+  */
+  void output_database(const Database& db);
+
+  /**
+    Write the end of the script, which restores the client's settings, and
+    close it. Nothing more can be written afterwards
+  */
+  void close() throw (Errors::FileWriteError);
+
+  /**
+    Set the largest INSERT statement written. It should be no larger than
+    the server's max_allowed_packet. A row too large to share a statement is
+    written in one of its own, whatever its size
+
+    @param bytes The target statement size, or 0 for the default of 1 MiB
+  */
+  void set_packet_size(const unsigned int bytes) throw ();
+
+  /**
+    Get the largest INSERT statement written
+
+    @return The target statement size, in bytes
+  */
+  unsigned int get_packet_size() const throw ();
+
+  /**
+    Set how the script should be compressed. Each part is compressed into a
+    self-contained gzip member or zstd frame, so appending them gives a
+    valid file. This must be set before any table is written
+
+    @param compression The compression format
+  */
+  void set_compression(const Compression compression) throw ();
+
+  /**
+    Get how the script is compressed
+
+    @return The compression format
+  */
+  Compression get_compression() const throw ();
+
+  /**
+    Set how many tables output_database() generates at once
+
+    @param threads How many threads to use
+  */
+  void set_threads(const unsigned int threads) throw (Errors::GenericError);
+
+  /**
+    Get how many tables output_database() generates at once
+
+    @return How many threads are used
+  */
+  unsigned int get_threads() const throw ();
+
+protected:
+  /**
+    Write one table's statements into a part: its definition, its rows and
+    its indexes
+
+    @param table The table to write
+    @param row_limit If this is greater than 0, limit the number of rows
+    @param packet_size The largest INSERT statement to write
+    @param part_name The part's file name
+    @param compression How to compress the part
+  */
+  static void write_table(const Table& table, const unsigned int row_limit,
+    const unsigned int packet_size, const std::string& part_name,
+    const Compression compression)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Write the start of the script, which sets up the client, if it hasn't
+    been written yet
+  */
+  void start() throw (Errors::FileWriteError);
+
+  /**
+    Compress some text, if needed, and write it to the script
+
+    @param text The text to write
+  */
+  void write_text(const std::string& text) throw (Errors::FileWriteError);
+
+  /**
+    Copy a finished part to the end of the script, then delete it
+
+    @param part_name The part's file name
+  */
+  void append_part(const std::string& part_name)
+    throw (Errors::FileReadError, Errors::FileWriteError);
+
+  /**
+    Get a file name for the next part
+
+    @return A name which no other part of this script uses
+  */
+  std::string next_part_name() throw ();
+
+  /** The script's file name */
+  const std::string file_name;
+
+  /** The script, or NULL once it's closed */
+  FILE* file;
+
+  /** Whether the start of the script has been written */
+  bool started;
+
+  /** How many parts have been named */
+  unsigned int parts;
+
+  /** The largest INSERT statement written */
+  unsigned int packet_size;
+
+  /** How the script is compressed */
+  Compression compression;
+
+  /** Generates tables for output_database(), or NULL to use this thread */
+  ThreadPool* pool;
+
+private:
+  // The file and thread pool can't be shared between copies
+  SQLScriptSink(const SQLScriptSink&);
+  SQLScriptSink& operator=(const SQLScriptSink&);
+};
+
+} // namespace
+
+#endif // DRILLER_SQL_SCRIPT_SINK_H
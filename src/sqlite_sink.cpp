@@ -0,0 +1,549 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * sqlite_sink.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sqlite_sink.h"
+#include "sql_format.h"
+#include "string_scan.h"
+#include "timer.h"
+#include "database/result_set.h"
+#include "database/row_data.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <sqlite3.h>
+
+namespace Errors {
+
+SQLiteError::SQLiteError(sqlite3* db) throw():
+  message(sqlite3_errmsg(db)){}
+
+SQLiteError::SQLiteError(const std::string& _message) throw():
+  message(_message){}
+
+SQLiteError::~SQLiteError() throw(){}
+
+std::string SQLiteError::error_message() const throw(){
+  return message;
+}
+
+} // namespace
+
+namespace Driller {
+
+/**
+  Settings for the whole load. Nothing is written to a rollback journal or
+  synced, the page cache is 64 MiB, and indexes are sorted in memory
+*/
+const char* const bulk_load_pragmas =
+  "PRAGMA journal_mode = OFF;"
+  "PRAGMA synchronous = OFF;"
+  "PRAGMA cache_size = -65536;"
+  "PRAGMA temp_store = MEMORY;";
+
+/** The most characters a date or phone number needs in scratch space */
+const unsigned int scratch_size = 12;
+
+/**
+  Bind text from the data files, which is Latin-1, to a statement parameter.
+  SQLite expects UTF-8, so any other characters are converted first
+
+  @param statement The statement
+  @param index The parameter's index, starting at 1
+  @param text The text, which must stay valid until the statement is run
+  @param length The length of text
+
+  @return SQLITE_OK, or an error code
+*/
+int bind_latin1(sqlite3_stmt* statement, const int index, const char* text,
+  const unsigned int length) throw (){
+
+  // Almost all text is ASCII, which is bound where it lies
+  if (find_non_ascii(text, text + length) == text + length){
+    return sqlite3_bind_text(statement, index, text,
+      static_cast<int>(length), SQLITE_STATIC);
+  }
+
+  std::string utf8;
+  latin1_to_utf8(text, length, utf8);
+  return sqlite3_bind_text(statement, index, utf8.data(),
+    static_cast<int>(utf8.size()), SQLITE_TRANSIENT);
+}
+
+/**
+  Read an amount extracted as text, such as -650.48, as a number of cents
+
+  @param text The amount
+  @param cents Receives the number of cents
+
+  @return Whether the text was an amount
+*/
+bool parse_cents(const char* text, sqlite3_int64& cents) throw (){
+  const bool negative = (*text == '-');
+  if (negative){
+    text++;
+  }
+
+  if (*text < '0' || *text > '9'){
+    return false;
+  }
+
+  cents = 0;
+  while (*text >= '0' && *text <= '9'){
+    cents = (cents * 10) + (*text++ - '0');
+  }
+
+  // Exactly two decimal places, ignoring any past them
+  const char* fraction = (*text == '.') ? text + 1 : "";
+  for (unsigned int ii = 0; ii < 2; ii++){
+    const bool digit = (*fraction >= '0' && *fraction <= '9');
+    cents = (cents * 10) + (digit ? *fraction++ - '0' : 0);
+  }
+
+  if (negative){
+    cents = -cents;
+  }
+
+  return true;
+}
+
+/**
+  Bind a raw value to a statement parameter
+
+  @param statement The statement
+  @param index The parameter's index, starting at 1
+  @param column The value's column
+  @param row The start of the row containing the value
+  @param scratch Space for a formatted date or phone number, which must stay
+  valid until the statement is run
+
+  @return SQLITE_OK, or an error code
+*/
+int bind_value(sqlite3_stmt* statement, const int index, const Column& column,
+  const uint8* row, char* scratch) throw (){
+
+  const uint8* field = column.get_field(row);
+
+  switch (column.get_type()){
+    case COLUMN_BOOL:
+      return sqlite3_bind_int(statement, index, field[0] ? 1 : 0);
+
+    case COLUMN_INT8:
+      return sqlite3_bind_int(statement, index, Column::get_int8(field));
+
+    case COLUMN_UINT8:
+      return sqlite3_bind_int(statement, index, Column::get_uint8(field));
+
+    case COLUMN_INT16:
+      return sqlite3_bind_int(statement, index, Column::get_int16(field));
+
+    case COLUMN_UINT16:
+      return sqlite3_bind_int(statement, index, Column::get_uint16(field));
+
+    case COLUMN_INT32:
+      return sqlite3_bind_int(statement, index, Column::get_int32(field));
+
+    case COLUMN_UINT32:
+      return sqlite3_bind_int64(statement, index, Column::get_uint32(field));
+
+    // SQLite has no date type, and ISO 8601 text is what its date
+    // functions read
+    case COLUMN_DATE:
+      return sqlite3_bind_text(statement, index, scratch,
+        format_date(Column::get_uint32(field), scratch), SQLITE_STATIC);
+
+    // A whole number of cents, which unlike a REAL is exact
+    case COLUMN_CURRENCY:
+      return sqlite3_bind_int64(statement, index, Column::get_int32(field));
+
+    case COLUMN_PHONE:
+      return sqlite3_bind_text(statement, index, scratch,
+        format_phone(field, scratch), SQLITE_STATIC);
+
+    case COLUMN_ENUM: {
+      const std::string value = column.enumeration.get_value(
+        Column::get_uint8(field));
+      return sqlite3_bind_text(statement, index, value.data(),
+        static_cast<int>(value.size()), SQLITE_TRANSIENT);
+    }
+
+    // Text and blobs are bound where they lie in the row, unless text needs
+    // converting
+    case COLUMN_STRING:
+    case COLUMN_VARSTRING: {
+      const uint8* bytes;
+      unsigned int length = column.get_bytes(row, bytes);
+      const void* nul = memchr(bytes, 0, length);
+      if (nul){
+        length = static_cast<unsigned int>(
+          static_cast<const uint8*>(nul) - bytes);
+      }
+      return bind_latin1(statement, index,
+        reinterpret_cast<const char*>(bytes), length);
+    }
+
+    case COLUMN_BLOB: {
+      const uint8* bytes;
+      const unsigned int length = column.get_bytes(row, bytes);
+      return sqlite3_bind_blob(statement, index, bytes,
+        static_cast<int>(length), SQLITE_STATIC);
+    }
+
+    default:
+      return sqlite3_bind_text(statement, index, "unknown", 7, SQLITE_STATIC);
+  }
+}
+
+/**
+  Bind a value extracted as text, as by Column::extract_data(), to a
+  statement parameter. Numbers are left as text, which the column's affinity
+  converts
+
+  @param statement The statement
+  @param index The parameter's index, starting at 1
+  @param type The value's column type
+  @param text The value
+  @param scratch Space for a converted date, which must stay valid until the
+  statement is run
+
+  @return SQLITE_OK, or an error code
+*/
+int bind_text(sqlite3_stmt* statement, const int index, const ColumnType type,
+  const char* text, char* scratch) throw (){
+
+  switch (type){
+    case COLUMN_BOOL:
+      return sqlite3_bind_int(statement, index, strcmp(text, "True") == 0);
+
+    case COLUMN_CURRENCY: {
+      sqlite3_int64 cents;
+      if (!parse_cents(text, cents)){
+        break;
+      }
+      return sqlite3_bind_int64(statement, index, cents);
+    }
+
+    // Enumeration values come from the schema, which is already UTF-8
+    case COLUMN_ENUM:
+      return sqlite3_bind_text(statement, index, text, -1, SQLITE_STATIC);
+
+    // Dates are extracted without leading zeros, as in 1955-7-3
+    case COLUMN_DATE: {
+      unsigned int year, month, day;
+      if (sscanf(text, "%u-%u-%u", &year, &month, &day) != 3){
+        break;
+      }
+      const int length = snprintf(scratch, scratch_size, "%04u-%02u-%02u",
+        year % 10000, month % 100, day % 100);
+      return sqlite3_bind_text(statement, index, scratch, length,
+        SQLITE_STATIC);
+    }
+
+    // Blobs are extracted as hex pairs separated by spaces
+    case COLUMN_BLOB: {
+      std::vector<uint8> bytes;
+      unsigned int byte;
+      int used;
+      while (sscanf(text, "%2x%n", &byte, &used) == 1){
+        bytes.push_back(static_cast<uint8>(byte));
+        text += used;
+      }
+      return sqlite3_bind_blob(statement, index,
+        bytes.empty() ? NULL : &bytes[0], static_cast<int>(bytes.size()),
+        SQLITE_TRANSIENT);
+    }
+
+    default:
+      break;
+  }
+
+  return bind_latin1(statement, index, text,
+    static_cast<unsigned int>(strlen(text)));
+}
+
+////////////////
+// SQLiteSink //
+////////////////
+
+SQLiteSink::SQLiteSink(const std::string& filename)
+  throw (Errors::SQLiteError):
+
+  db(NULL), rows_sent(0), send_time(0.0), index_time(0.0){
+
+  if (sqlite3_open_v2(filename.c_str(), &db,
+    SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK){
+
+    if (!db){
+      throw Errors::SQLiteError("Out of memory opening " + filename);
+    }
+
+    const Errors::SQLiteError error(db);
+    sqlite3_close(db);
+    throw error;
+  }
+
+  try {
+    execute(bulk_load_pragmas);
+  }
+  catch (const Errors::SQLiteError&){
+    sqlite3_close(db);
+    throw;
+  }
+}
+
+SQLiteSink::~SQLiteSink() throw(){
+  sqlite3_close(db);
+}
+
+void SQLiteSink::output_table(const Table& table,
+  const unsigned int row_limit)
+  throw (Errors::FileReadError, Errors::SQLiteError){
+
+  // CREATE TABLE needs at least one column, so such a table is skipped
+  if (!table.column_count()){
+    return;
+  }
+
+  // Snapshots can only be read as text
+  const ResultSet* result = NULL;
+  RowData* rows = NULL;
+  if (!table.get_snapshot_file().empty()){
+    result = table.extract_data(row_limit);
+  }
+  else {
+    rows = table.load_rows(row_limit);
+  }
+
+  sqlite3_stmt* statement = NULL;
+
+  try {
+    const std::string table_name = quote_name(table.get_name());
+
+    std::string definitions, parameters;
+    for (unsigned int col = 0; col < table.column_count(); col++){
+      const Column& column = table.column_at(col);
+      if (col){
+        definitions += ", ";
+        parameters += ", ";
+      }
+      definitions += quote_name(column.get_name()) + " " +
+        sqlite_type_from_column(column);
+      parameters += "?";
+    }
+
+    execute("BEGIN");
+    execute("DROP TABLE IF EXISTS " + table_name);
+    execute("CREATE TABLE " + table_name + " (" + definitions + ")");
+
+    // One statement is compiled, then run once per row
+    const std::string insert = "INSERT INTO " + table_name + " VALUES (" +
+      parameters + ")";
+    if (sqlite3_prepare_v2(db, insert.c_str(), -1, &statement, NULL) !=
+      SQLITE_OK){
+
+      throw Errors::SQLiteError(db);
+    }
+
+    Timer timer;
+
+    if (rows){
+      insert_rows(statement, *rows);
+    }
+    else {
+      insert_text(statement, *result);
+    }
+
+    sqlite3_finalize(statement);
+    statement = NULL;
+
+    const double insert_time = timer.elapsed();
+    timer.restart();
+
+    // Indexes are built once every row is in, which sorts each of them once
+    // instead of updating them for every row
+    for (unsigned int col = 0; col < table.column_count(); col++){
+      const Column& column = table.column_at(col);
+      if (column.get_indexed()){
+        execute("CREATE INDEX " +
+          quote_name(table.get_name() + "_" + column.get_name()) + " ON " +
+          table_name + " (" + quote_name(column.get_name()) + ")");
+      }
+    }
+
+    const double indexes_time = timer.elapsed();
+
+    execute("COMMIT");
+
+    rows_sent += rows ? rows->row_count() : result->row_count();
+    send_time += insert_time;
+    index_time += indexes_time;
+  }
+
+  catch (const Errors::SQLiteError&){
+    sqlite3_finalize(statement);
+    sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    delete rows;
+    delete result;
+    throw;
+  }
+
+  delete rows;
+  delete result;
+}
+
+unsigned int SQLiteSink::get_rows_sent() const throw (){
+  return rows_sent;
+}
+
+double SQLiteSink::get_send_time() const throw (){
+  return send_time;
+}
+
+double SQLiteSink::get_index_time() const throw (){
+  return index_time;
+}
+
+void SQLiteSink::insert_rows(sqlite3_stmt* statement, const RowData& rows)
+  throw (Errors::SQLiteError){
+
+  const std::vector<Column> column_list = rows.table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+  std::vector<char> scratch(columns * scratch_size);
+
+  for (unsigned int row = 0; row < rows.row_count(); row++){
+    const uint8* raw = rows[row];
+
+    for (unsigned int col = 0; col < columns; col++){
+      if (bind_value(statement, col + 1, column_list[col], raw,
+        &scratch[col * scratch_size]) != SQLITE_OK){
+
+        throw Errors::SQLiteError(db);
+      }
+    }
+
+    step(statement);
+  }
+}
+
+void SQLiteSink::insert_text(sqlite3_stmt* statement, const ResultSet& result)
+  throw (Errors::SQLiteError){
+
+  const std::vector<Column> column_list = result.table.get_columns();
+  const unsigned int columns = static_cast<unsigned int>(column_list.size());
+  std::vector<char> scratch(columns * scratch_size);
+
+  for (unsigned int row = 0; row < result.row_count(); row++){
+    const char** cells = result[row];
+
+    for (unsigned int col = 0; col < columns; col++){
+      if (bind_text(statement, col + 1, column_list[col].get_type(),
+        cells[col], &scratch[col * scratch_size]) != SQLITE_OK){
+
+        throw Errors::SQLiteError(db);
+      }
+    }
+
+    step(statement);
+  }
+}
+
+void SQLiteSink::step(sqlite3_stmt* statement) throw (Errors::SQLiteError){
+  if (sqlite3_step(statement) != SQLITE_DONE){
+    const Errors::SQLiteError error(db);
+    sqlite3_reset(statement);
+    throw error;
+  }
+
+  // Bindings are kept, and every one is replaced by the next row
+  sqlite3_reset(statement);
+}
+
+void SQLiteSink::execute(const std::string& sql) throw (Errors::SQLiteError){
+  char* message = NULL;
+  if (sqlite3_exec(db, sql.c_str(), NULL, NULL, &message) != SQLITE_OK){
+    const Errors::SQLiteError error(message ? message : sqlite3_errmsg(db));
+    sqlite3_free(message);
+    throw error;
+  }
+}
+
+std::string SQLiteSink::quote_name(std::string name) throw (){
+  std::replace(name.begin(), name.end(), ' ', '_');
+
+  std::string quoted = "\"";
+  for (unsigned int ii = 0; ii < name.size(); ii++){
+    if (name[ii] == '"'){
+      quoted += '"';
+    }
+    quoted += name[ii];
+  }
+  return quoted + "\"";
+}
+
+std::string SQLiteSink::sqlite_type_from_column(const Column& col) throw (){
+  switch (col.get_type()){
+    case COLUMN_BOOL:
+      return "BOOLEAN";
+
+    case COLUMN_INT8:
+    case COLUMN_UINT8:
+    case COLUMN_INT16:
+    case COLUMN_UINT16:
+    case COLUMN_INT32:
+    case COLUMN_UINT32:
+      return "INTEGER";
+
+    case COLUMN_BLOB:
+      return "BLOB";
+
+    case COLUMN_STRING: {
+      if (!col.get_length()){
+        return "TEXT";
+      }
+
+      std::stringstream ss;
+      ss << "VARCHAR(" << col.get_length() << ")";
+      return ss.str();
+    }
+
+    case COLUMN_VARSTRING:
+    case COLUMN_ENUM:
+      return "TEXT";
+
+    case COLUMN_PHONE:
+      return "VARCHAR(12)";
+
+    // Dates are bound as text, which isn't a number, so it's kept as is
+    case COLUMN_DATE:
+      return "DATE";
+
+    // Stored in cents. NUMERIC would keep amounts as REAL, which isn't exact
+    case COLUMN_CURRENCY:
+      return "INTEGER";
+
+    default:
+      // Contents of an unknown column is always "unknown"
+      return "CHAR(7)";
+  }
+}
+
+} // namespace
@@ -0,0 +1,200 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * sqlite_sink.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_SQLITE_SINK_H
+#define DRILLER_SQLITE_SINK_H
+
+#include "data_sink.h"
+#include "errors.h"
+#include "file_errors.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace Errors {
+
+class SQLiteError : public BaseError {
+public:
+  /**
+    Default constructor
+
+    @param db The SQLite database that caused this error
+  */
+  SQLiteError(sqlite3* db) throw();
+
+  /**
+    Create an error from a message that isn't held by a database handle
+
+    @param message The error string
+  */
+  SQLiteError(const std::string& message) throw();
+
+  /** Default destructor */
+  virtual ~SQLiteError() throw();
+
+  /**
+    Return the SQLite error string
+
+    @return A message suitable for being shown to a user
+  */
+  virtual std::string error_message() const throw();
+
+protected:
+  const std::string message;
+};
+
+} // namespace
+
+namespace Driller {
+
+/**
+  A SQLiteSink extracts data into a single SQLite database file, so no
+  server is needed. Each table is replaced inside one transaction, with its
+  rows inserted through a single prepared statement that is reset for every
+  row. Its indexes are built once every row is in.
+
+  Text is converted from the data files' Latin-1 to UTF-8. Currency is
+  stored as a whole number of cents in an INTEGER column, so amounts stay
+  exact; divide by 100 for dollars.
+
+  The rollback journal is turned off and nothing is synced while loading, so
+  if the program is interrupted the file may be left corrupt, and should be
+  extracted to again from scratch
+*/
+class SQLiteSink : public DataSink {
+public:
+  /**
+    Default constructor
+
+    @param filename The database file to extract to. It is created if it
+    doesn't exist
+  */
+  SQLiteSink(const std::string& filename) throw (Errors::SQLiteError);
+
+  /** Default destructor */
+  virtual ~SQLiteSink() throw();
+
+  /**
+    Extract data from a table into a table of the same name, replacing it.
+    A table with no columns can't be created, so it's skipped
+
+    @param table The table to extract
+    @param row_limit If this is greater than 0, limit the number of rows
+  */
+  void output_table(const Table& table, const unsigned int row_limit = 0)
+    throw (Errors::FileReadError, Errors::SQLiteError);
+
+  /**
+    Get how many rows have been inserted
+
+    @return How many rows have been inserted
+  */
+  unsigned int get_rows_sent() const throw ();
+
+  /**
+    Get how long has been spent inserting rows
+
+    @return The time spent inserting, in seconds
+  */
+  double get_send_time() const throw ();
+
+  /**
+    Get how long has been spent building indexes
+
+    @return The time spent creating indexes, in seconds
+  */
+  double get_index_time() const throw ();
+
+protected:
+  /**
+    Insert raw rows with the prepared statement
+
+    @param statement An INSERT with a parameter for every column
+    @param rows The rows to insert
+  */
+  void insert_rows(sqlite3_stmt* statement, const RowData& rows)
+    throw (Errors::SQLiteError);
+
+  /**
+    Insert rows extracted as text with the prepared statement. Snapshot
+    tables can only be read this way
+
+    @param statement An INSERT with a parameter for every column
+    @param result The rows to insert
+  */
+  void insert_text(sqlite3_stmt* statement, const ResultSet& result)
+    throw (Errors::SQLiteError);
+
+  /**
+    Run the prepared statement once, then reset it for the next row
+
+    @param statement The statement, with every parameter bound
+  */
+  void step(sqlite3_stmt* statement) throw (Errors::SQLiteError);
+
+  /**
+    Run SQL which returns no rows
+
+    @param sql The SQL
+  */
+  void execute(const std::string& sql) throw (Errors::SQLiteError);
+
+  /**
+    Quote a table or column name, with spaces replaced by underscores as the
+    other database sinks do
+
+    @param name The name to quote
+
+    @return The quoted name
+  */
+  static std::string quote_name(std::string name) throw ();
+
+  /**
+    Convert an internal column type to a SQLite column type. SQLite only uses
+    the type to choose a column's affinity, but the full type is kept so the
+    schema describes the data
+
+    @param col The column to convert
+
+    @return The SQLite column type
+  */
+  static std::string sqlite_type_from_column(const Column& col) throw ();
+
+  /** The database being extracted to */
+  sqlite3* db;
+
+  /** How many rows have been inserted */
+  unsigned int rows_sent;
+
+  /** How long inserting has taken, in seconds */
+  double send_time;
+
+  /** How long creating indexes has taken, in seconds */
+  double index_time;
+
+private:
+  // The database handle can't be shared between copies
+  SQLiteSink(const SQLiteSink&);
+  SQLiteSink& operator=(const SQLiteSink&);
+};
+
+} // namespace
+
+#endif // DRILLER_SQLITE_SINK_H
@@ -0,0 +1,286 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * string_scan.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_STRING_SCAN_H
+#define DRILLER_STRING_SCAN_H
+
+/*
+  Scans for the characters that must be escaped when text is written in
+  some other format. Almost all extracted text has none, so these check 16
+  bytes at a time where SSE2 is available, letting callers copy clean spans
+  in bulk
+*/
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DRILLER_SCAN_SSE2
+  #include <emmintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#endif
+
+#include <cstring>
+#include <string>
+
+namespace Driller {
+
+/**
+  Check whether a character must be escaped in an SQL string literal
+
+  @param c The character to check
+
+  @return Whether c is NULL, a newline, carriage return, backslash, quote,
+  double quote or Ctrl-Z
+*/
+inline bool is_sql_special(const char c) throw () {
+  switch (c){
+    case 0:
+    case '\n':
+    case '\r':
+    case '\\':
+    case '\'':
+    case '"':
+    case '\032':
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+/**
+  Check whether a character must be escaped in a JSON string. Extracted text
+  is Latin-1, so every byte from 0x80 up is converted to UTF-8
+
+  @param c The character to check
+
+  @return Whether c is a control character, a double quote, a backslash or
+  not ASCII
+*/
+inline bool is_json_special(const char c) throw () {
+  const unsigned char byte = static_cast<unsigned char>(c);
+  return byte < 0x20 || byte >= 0x80 || c == '"' || c == '\\';
+}
+
+#ifdef DRILLER_SCAN_SSE2
+/**
+  Find the lowest set bit of a non-zero mask
+
+  @param mask The mask
+
+  @return The index of its lowest set bit
+*/
+inline unsigned int lowest_set_bit(const unsigned int mask) throw () {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/**
+  Find the first character of a string that must be escaped in an SQL
+  string literal
+
+  @param begin The start of the string
+  @param end The end of the string
+
+  @return The first character for which is_sql_special() is true, or end
+*/
+inline const char* find_sql_special(const char* begin, const char* end)
+  throw () {
+
+#ifdef DRILLER_SCAN_SSE2
+  const __m128i nul = _mm_setzero_si128();
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i carriage_return = _mm_set1_epi8('\r');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i quote = _mm_set1_epi8('\'');
+  const __m128i double_quote = _mm_set1_epi8('"');
+  const __m128i ctrl_z = _mm_set1_epi8('\032');
+
+  for (; end - begin >= 16; begin += 16){
+    const __m128i chunk =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+
+    const __m128i found = _mm_or_si128(
+      _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, nul),
+          _mm_cmpeq_epi8(chunk, newline)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return),
+          _mm_cmpeq_epi8(chunk, backslash))),
+      _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+          _mm_cmpeq_epi8(chunk, double_quote)),
+        _mm_cmpeq_epi8(chunk, ctrl_z)));
+
+    const unsigned int mask = _mm_movemask_epi8(found);
+    if (mask){
+      return begin + lowest_set_bit(mask);
+    }
+  }
+#endif
+
+  for (; begin != end; begin++){
+    if (is_sql_special(*begin)){
+      return begin;
+    }
+  }
+
+  return end;
+}
+
+/**
+  Find the first character of a string that must be escaped in a JSON
+  string
+
+  @param begin The start of the string
+  @param end The end of the string
+
+  @return The first character for which is_json_special() is true, or end
+*/
+inline const char* find_json_special(const char* begin, const char* end)
+  throw () {
+
+#ifdef DRILLER_SCAN_SSE2
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i double_quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+
+  for (; end - begin >= 16; begin += 16){
+    const __m128i chunk =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+
+    // Compared as signed bytes, both control characters and bytes from 0x80
+    // up are less than a space
+    const __m128i found = _mm_or_si128(_mm_cmplt_epi8(chunk, space),
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, double_quote),
+        _mm_cmpeq_epi8(chunk, backslash)));
+
+    const unsigned int mask = _mm_movemask_epi8(found);
+    if (mask){
+      return begin + lowest_set_bit(mask);
+    }
+  }
+#endif
+
+  for (; begin != end; begin++){
+    if (is_json_special(*begin)){
+      return begin;
+    }
+  }
+
+  return end;
+}
+
+/**
+  Find the first character of a string which is not ASCII
+
+  @param begin The start of the string
+  @param end The end of the string
+
+  @return The first character from 0x80 up, or end
+*/
+inline const char* find_non_ascii(const char* begin, const char* end)
+  throw () {
+
+#ifdef DRILLER_SCAN_SSE2
+  // The top bit of each byte is exactly what movemask collects
+  for (; end - begin >= 16; begin += 16){
+    const unsigned int mask = _mm_movemask_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)));
+    if (mask){
+      return begin + lowest_set_bit(mask);
+    }
+  }
+#endif
+
+  for (; begin != end; begin++){
+    if (static_cast<unsigned char>(*begin) >= 0x80){
+      return begin;
+    }
+  }
+
+  return end;
+}
+
+/**
+  Convert Latin-1 text, as found in the data files, to UTF-8. Spans of ASCII
+  are copied in bulk
+
+  @param text The text to convert
+  @param length The length of text
+  @param out Receives the converted text. It must hold at least 2 * length
+  characters
+
+  @return The length of the converted text
+*/
+inline unsigned int latin1_to_utf8(const char* text, const unsigned int length,
+  char* out) throw () {
+
+  const char* end = text + length;
+  char* start = out;
+
+  while (text != end){
+    const char* high = find_non_ascii(text, end);
+    memcpy(out, text, high - text);
+    out += high - text;
+
+    if (high == end){
+      break;
+    }
+
+    const unsigned char byte = static_cast<unsigned char>(*high);
+    out[0] = static_cast<char>(0xC0 | (byte >> 6));
+    out[1] = static_cast<char>(0x80 | (byte & 0x3F));
+    out += 2;
+    text = high + 1;
+  }
+
+  return static_cast<unsigned int>(out - start);
+}
+
+/**
+  Convert Latin-1 text to UTF-8, as a string
+
+  @param text The text to convert
+  @param length The length of text
+  @param out Receives the converted text, replacing its contents
+*/
+inline void latin1_to_utf8(const char* text, const unsigned int length,
+  std::string& out) throw () {
+
+  // Almost all text is ASCII, which needs no conversion
+  if (find_non_ascii(text, text + length) == text + length){
+    out.assign(text, length);
+    return;
+  }
+
+  out.resize(2 * length);
+  out.resize(latin1_to_utf8(text, length, &out[0]));
+}
+
+} // namespace
+
+#endif // DRILLER_STRING_SCAN_H
@@ -0,0 +1,347 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * threads.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "threads.h"
+#include <algorithm>
+
+#ifdef __APPLE__
+  #ifndef __unix
+    #define __unix
+  #endif
+#endif
+
+#ifdef __unix
+  #include <unistd.h>
+  #include <sys/time.h>
+#elif WIN32
+  #include <windows.h>
+#endif
+
+namespace Driller {
+
+///////////
+// Mutex //
+///////////
+
+Mutex::Mutex() throw () {
+  pthread_mutex_init(&mutex, NULL);
+}
+
+Mutex::~Mutex() throw () {
+  pthread_mutex_destroy(&mutex);
+}
+
+void Mutex::lock() throw () {
+  pthread_mutex_lock(&mutex);
+}
+
+void Mutex::unlock() throw () {
+  pthread_mutex_unlock(&mutex);
+}
+
+MutexLocker::MutexLocker(Mutex& _mutex) throw ():
+  mutex(_mutex){
+
+  mutex.lock();
+}
+
+MutexLocker::~MutexLocker() throw () {
+  mutex.unlock();
+}
+
+///////////////
+// Condition //
+///////////////
+
+Condition::Condition() throw () {
+  pthread_cond_init(&condition, NULL);
+}
+
+Condition::~Condition() throw () {
+  pthread_cond_destroy(&condition);
+}
+
+void Condition::wait(Mutex& mutex) throw () {
+  pthread_cond_wait(&condition, &mutex.mutex);
+}
+
+bool Condition::wait_until(Mutex& mutex, const timespec& deadline) throw () {
+  return pthread_cond_timedwait(&condition, &mutex.mutex, &deadline) == 0;
+}
+
+timespec Condition::deadline_after(const double seconds) throw () {
+  // pthread_cond_timedwait() measures from the epoch, by the real time clock
+#ifdef __unix
+  timeval now;
+  gettimeofday(&now, NULL);
+  const double start = now.tv_sec + (now.tv_usec / 1000000.0);
+#elif WIN32
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  const double start = ((static_cast<double>(now.dwHighDateTime) * 4294967296.0
+    + now.dwLowDateTime) / 10000000.0) - 11644473600.0;
+#endif
+
+  const double end = start + ((seconds > 0)? seconds : 0);
+  timespec deadline;
+  deadline.tv_sec = static_cast<time_t>(end);
+  deadline.tv_nsec = static_cast<long>((end - deadline.tv_sec) * 1000000000.0);
+  if (deadline.tv_nsec >= 1000000000){
+    deadline.tv_nsec = 999999999;
+  }
+  return deadline;
+}
+
+void Condition::signal() throw () {
+  pthread_cond_signal(&condition);
+}
+
+void Condition::broadcast() throw () {
+  pthread_cond_broadcast(&condition);
+}
+
+/////////
+// Job //
+/////////
+
+Job::Job() throw ():
+  finished(false),
+  job_failed(false),
+  work(1){}
+
+Job::~Job() throw () {}
+
+bool Job::failed() const throw () {
+  return job_failed;
+}
+
+std::string Job::get_error() const throw () {
+  return error;
+}
+
+////////////////
+// ThreadPool //
+////////////////
+
+ThreadPool::ThreadPool(const unsigned int thread_count)
+  throw (Errors::GenericError):
+
+  running(0),
+  active_limit((thread_count > 0)? thread_count : 1),
+  completed_work(0),
+  completed_jobs(0),
+  stopping(false){
+
+  const unsigned int count = active_limit;
+  for (unsigned int ii = 0; ii < count; ii++){
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, thread_main, this) != 0){
+      // Shut down whatever threads were started before failing
+      {
+        MutexLocker locker(mutex);
+        stopping = true;
+        job_added.broadcast();
+      }
+
+      for (unsigned int jj = 0; jj < threads.size(); jj++){
+        pthread_join(threads[jj], NULL);
+      }
+
+      throw Errors::GenericError("Unable to start a worker thread");
+    }
+
+    threads.push_back(thread);
+  }
+}
+
+ThreadPool::~ThreadPool() throw () {
+  wait_all();
+
+  {
+    MutexLocker locker(mutex);
+    stopping = true;
+    job_added.broadcast();
+  }
+
+  for (unsigned int ii = 0; ii < threads.size(); ii++){
+    pthread_join(threads[ii], NULL);
+  }
+}
+
+void ThreadPool::add_job(Job* job) throw () {
+  MutexLocker locker(mutex);
+  job->finished = false;
+  queue.push_back(job);
+  job_added.signal();
+}
+
+void ThreadPool::wait(Job* job) throw () {
+  MutexLocker locker(mutex);
+  while (!job->finished){
+    job_finished.wait(mutex);
+  }
+}
+
+bool ThreadPool::poll(Job* job) throw () {
+  MutexLocker locker(mutex);
+  return job->finished;
+}
+
+bool ThreadPool::wait(Job* job, const double seconds) throw () {
+  const timespec deadline = Condition::deadline_after(seconds);
+  MutexLocker locker(mutex);
+  while (!job->finished){
+    if (!job_finished.wait_until(mutex, deadline)){
+      return job->finished;
+    }
+  }
+
+  return true;
+}
+
+void ThreadPool::wait_all() throw () {
+  MutexLocker locker(mutex);
+  while (!queue.empty() || running > 0){
+    job_finished.wait(mutex);
+  }
+}
+
+bool ThreadPool::wait_all(const double seconds) throw () {
+  const timespec deadline = Condition::deadline_after(seconds);
+  MutexLocker locker(mutex);
+  while (!queue.empty() || running > 0){
+    if (!job_finished.wait_until(mutex, deadline)){
+      return queue.empty() && running == 0;
+    }
+  }
+
+  return true;
+}
+
+void ThreadPool::set_active_limit(const unsigned int limit) throw () {
+  MutexLocker locker(mutex);
+  active_limit = std::max(1u, std::min(limit, thread_count()));
+
+  // Threads waiting under the old limit may now start jobs
+  job_added.broadcast();
+}
+
+unsigned int ThreadPool::get_active_limit() const throw () {
+  MutexLocker locker(mutex);
+  return active_limit;
+}
+
+unsigned int ThreadPool::queued_count() const throw () {
+  MutexLocker locker(mutex);
+  return static_cast<unsigned int>(queue.size());
+}
+
+double ThreadPool::take_completed_work(unsigned int* jobs) throw () {
+  MutexLocker locker(mutex);
+  const double work = completed_work;
+  if (jobs){
+    *jobs = completed_jobs;
+  }
+
+  completed_work = 0;
+  completed_jobs = 0;
+  return work;
+}
+
+unsigned int ThreadPool::thread_count() const throw () {
+  return static_cast<unsigned int>(threads.size());
+}
+
+unsigned int ThreadPool::processor_count() throw () {
+  long count = 1;
+
+#ifdef __unix
+  count = sysconf(_SC_NPROCESSORS_ONLN);
+#elif WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  count = info.dwNumberOfProcessors;
+#endif
+
+  return (count > 0)? static_cast<unsigned int>(count) : 1;
+}
+
+void* ThreadPool::thread_main(void* pool) throw () {
+  static_cast<ThreadPool*>(pool)->run_jobs();
+  return NULL;
+}
+
+void ThreadPool::run_jobs() throw () {
+  mutex.lock();
+
+  while (true){
+    // Threads over the active limit wait, unless there's nothing left to do
+    while ((queue.empty() || running >= active_limit) &&
+      !(stopping && queue.empty())){
+
+      job_added.wait(mutex);
+    }
+
+    if (queue.empty()){
+      // Stopping, and nothing left to do
+      break;
+    }
+
+    Job* job = queue.front();
+    queue.pop_front();
+    ++running;
+    mutex.unlock();
+
+    // Errors can't cross threads, so save the message for whoever waits
+    bool job_failed = false;
+    std::string error;
+    try {
+      job->run();
+    }
+
+    catch (const Errors::BaseError& e){
+      job_failed = true;
+      error = e.error_message();
+    }
+
+    catch (const std::exception& e){
+      job_failed = true;
+      error = e.what();
+    }
+
+    catch (...){
+      job_failed = true;
+      error = "Unknown error";
+    }
+
+    mutex.lock();
+    job->job_failed = job_failed;
+    job->error = error;
+    job->finished = true;
+    completed_work += job->work;
+    ++completed_jobs;
+    --running;
+    job_finished.broadcast();
+  }
+
+  mutex.unlock();
+}
+
+} // namespace
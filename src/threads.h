@@ -0,0 +1,342 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * threads.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_THREADS_H
+#define DRILLER_THREADS_H
+
+// Disable warnings about throw specifications in VS 2003
+#ifdef _MSC_VER
+#pragma warning(disable: 4290)
+#endif
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <pthread.h>
+#include "errors.h"
+
+namespace Driller {
+
+/**
+  A thin wrapper around a pthread mutex
+*/
+class Mutex {
+  friend class Condition;
+public:
+  /** Create an unlocked mutex */
+  Mutex() throw ();
+
+  /** Destroy the mutex. It must not be locked */
+  ~Mutex() throw ();
+
+  /** Lock the mutex, blocking until it is available */
+  void lock() throw ();
+
+  /** Unlock the mutex */
+  void unlock() throw ();
+
+protected:
+  pthread_mutex_t mutex;
+
+private:
+  // Mutexes cannot be copied
+  Mutex(const Mutex&);
+  Mutex& operator=(const Mutex&);
+};
+
+/**
+  Locks a mutex for as long as the locker exists
+*/
+class MutexLocker {
+public:
+  /**
+    Lock a mutex
+
+    @param mutex The mutex to lock. It will be unlocked when this locker is
+    destroyed
+  */
+  MutexLocker(Mutex& mutex) throw ();
+
+  /** Unlock the mutex */
+  ~MutexLocker() throw ();
+
+protected:
+  Mutex& mutex;
+};
+
+/**
+  A thin wrapper around a pthread condition variable
+*/
+class Condition {
+public:
+  /** Default constructor */
+  Condition() throw ();
+
+  /** Default destructor */
+  ~Condition() throw ();
+
+  /**
+    Wait for the condition to be signalled
+
+    @param mutex A locked mutex, which will be unlocked while waiting
+  */
+  void wait(Mutex& mutex) throw ();
+
+  /**
+    Wait for the condition to be signalled, or for a time to pass
+
+    @param mutex A locked mutex, which will be unlocked while waiting
+    @param deadline When to stop waiting, from deadline_after()
+
+    @return Whether the condition was signalled before the deadline
+  */
+  bool wait_until(Mutex& mutex, const timespec& deadline) throw ();
+
+  /**
+    Get the time a number of seconds from now, for wait_until()
+
+    @param seconds How long from now the deadline is
+
+    @return The deadline
+  */
+  static timespec deadline_after(const double seconds) throw ();
+
+  /** Wake a single waiting thread */
+  void signal() throw ();
+
+  /** Wake every waiting thread */
+  void broadcast() throw ();
+
+protected:
+  pthread_cond_t condition;
+
+private:
+  // Conditions cannot be copied
+  Condition(const Condition&);
+  Condition& operator=(const Condition&);
+};
+
+/**
+  A unit of work that can be run by a ThreadPool. Subclasses implement run(),
+  and the pool records whether it has finished and any error it threw
+*/
+class Job {
+  friend class ThreadPool;
+public:
+  /** Default constructor */
+  Job() throw ();
+
+  /** Default destructor */
+  virtual ~Job() throw ();
+
+  /** Do whatever work this job represents */
+  virtual void run() = 0;
+
+  /**
+    Get whether this job failed, by throwing an exception from run()
+
+    @return Whether the job failed
+  */
+  bool failed() const throw ();
+
+  /**
+    Get the error message of a failed job
+
+    @return The message of the exception thrown by run()
+  */
+  std::string get_error() const throw ();
+
+protected:
+  /** Set by the pool once run() has returned */
+  bool finished;
+
+  /** Set if run() threw an exception */
+  bool job_failed;
+
+  /** The message of the exception thrown by run(), if any */
+  std::string error;
+
+  /**
+    How much work this job represents, such as rows or estimated cost. The
+    pool adds it to its completed work when the job finishes. 1 by default
+  */
+  double work;
+};
+
+/**
+  A fixed set of worker threads, which run Jobs in the order they were added.
+  How many of them run jobs at once can be limited, and changed while jobs
+  are running, so a ConcurrencyController can tune the pool
+*/
+class ThreadPool {
+public:
+  /**
+    Start a new pool of threads
+
+    @param thread_count How many threads to start. If this is 0, one thread
+    will be started
+  */
+  ThreadPool(const unsigned int thread_count) throw (Errors::GenericError);
+
+  /**
+    Wait for every queued job to finish, then stop all threads
+  */
+  ~ThreadPool() throw ();
+
+  /**
+    Queue a job to be run. The job is not owned by the pool, and must not be
+    deleted until it has finished
+
+    @param job The job to run
+  */
+  void add_job(Job* job) throw ();
+
+  /**
+    Block until a job has finished
+
+    @param job A job previously passed to add_job()
+  */
+  void wait(Job* job) throw ();
+
+  /**
+    Check whether a job has finished, without blocking
+
+    @param job A job previously passed to add_job()
+
+    @return Whether the job has finished
+  */
+  bool poll(Job* job) throw ();
+
+  /**
+    Block until a job has finished, or a time has passed
+
+    @param job A job previously passed to add_job()
+    @param seconds The longest time to wait
+
+    @return Whether the job has finished
+  */
+  bool wait(Job* job, const double seconds) throw ();
+
+  /**
+    Block until every queued job has finished
+  */
+  void wait_all() throw ();
+
+  /**
+    Block until every queued job has finished, or a time has passed
+
+    @param seconds The longest time to wait
+
+    @return Whether every job has finished
+  */
+  bool wait_all(const double seconds) throw ();
+
+  /**
+    Set how many threads may run jobs at once. Lowering it lets running jobs
+    finish, and the threads over the limit then wait
+
+    @param limit The limit, from 1 up to the thread count
+  */
+  void set_active_limit(const unsigned int limit) throw ();
+
+  /**
+    Get how many threads may run jobs at once
+
+    @return The limit set by set_active_limit(), or the thread count
+  */
+  unsigned int get_active_limit() const throw ();
+
+  /**
+    Get how many jobs are waiting to start
+
+    @return How many queued jobs haven't started
+  */
+  unsigned int queued_count() const throw ();
+
+  /**
+    Get how much work has finished since this was last called, and start
+    counting again
+
+    @param jobs If not NULL, receives how many jobs finished
+    @return The summed work of every job finished since the last call
+  */
+  double take_completed_work(unsigned int* jobs = NULL) throw ();
+
+  /**
+    Get how many threads are in this pool
+
+    @return How many threads are in this pool
+  */
+  unsigned int thread_count() const throw ();
+
+  /**
+    Get the number of processors available to this process, for choosing a
+    sensible default thread count
+
+    @return The number of online processors, or 1 if it cannot be found
+  */
+  static unsigned int processor_count() throw ();
+
+protected:
+  /** Entry point for each worker thread */
+  static void* thread_main(void* pool) throw ();
+
+  /** Run queued jobs until the pool is stopped */
+  void run_jobs() throw ();
+
+  /** Protects every member below */
+  mutable Mutex mutex;
+
+  /** Signalled when a job is added or the pool is stopping */
+  Condition job_added;
+
+  /** Broadcast whenever a job finishes */
+  Condition job_finished;
+
+  /** Jobs which have not started yet */
+  std::deque<Job*> queue;
+
+  /** How many jobs are currently running */
+  unsigned int running;
+
+  /** How many jobs may run at once */
+  unsigned int active_limit;
+
+  /** The work of jobs finished since take_completed_work() was called */
+  double completed_work;
+
+  /** How many jobs finished since take_completed_work() was called */
+  unsigned int completed_jobs;
+
+  /** Set when the pool is being destroyed */
+  bool stopping;
+
+  /** The worker threads */
+  std::vector<pthread_t> threads;
+
+private:
+  // Pools cannot be copied
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+};
+
+} // namespace
+
+#endif // DRILLER_THREADS_H
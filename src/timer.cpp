@@ -0,0 +1,62 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * timer.cpp
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "timer.h"
+#include <cstddef>
+
+#ifdef __APPLE__
+  #ifndef __unix
+    #define __unix
+  #endif
+#endif
+
+#ifdef __unix
+  #include <sys/time.h>
+#elif WIN32
+  #include <windows.h>
+#endif
+
+namespace Driller {
+
+Timer::Timer() throw ():
+  start(now()){}
+
+void Timer::restart() throw (){
+  start = now();
+}
+
+double Timer::elapsed() const throw (){
+  return now() - start;
+}
+
+double Timer::now() throw (){
+#ifdef __unix
+  timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + (time.tv_usec / 1000000.0);
+#elif WIN32
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&count);
+  return static_cast<double>(count.QuadPart) / frequency.QuadPart;
+#endif
+}
+
+} // namespace
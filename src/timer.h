@@ -0,0 +1,58 @@
+/* Driller, a data extraction program
+ * Copyright (C) 2005-2006 John Millikin
+ *
+ * timer.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DRILLER_TIMER_H
+#define DRILLER_TIMER_H
+
+namespace Driller {
+
+/**
+  Measures elapsed wall-clock time, for reporting and tuning throughput
+*/
+class Timer {
+public:
+  /** Create a timer, started now */
+  Timer() throw ();
+
+  /** Start timing again from now */
+  void restart() throw ();
+
+  /**
+    Get how much time has passed since the timer was started
+
+    @return The elapsed time, in seconds
+  */
+  double elapsed() const throw ();
+
+protected:
+  /**
+    Get the current time from the system's clock
+
+    @return The current time, in seconds from some fixed point
+  */
+  static double now() throw ();
+
+  /** When the timer was started */
+  double start;
+};
+
+} // namespace
+
+#endif // DRILLER_TIMER_H
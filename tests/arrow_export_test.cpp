@@ -0,0 +1,137 @@
+#include <copper.hpp>
+#include <cstdio>
+#include "../src/database/database.h"
+#include "../src/database/arrow_export.h"
+
+using namespace Driller;
+
+TEST_SUITE(arrow_export_tests) {
+
+FIXTURE(arrow_fixture) {
+  Table table;
+
+  SET_UP {
+    // Two rows: uint32 id, currency, date, 4-byte string, enum, bool. The
+    // second string has a Latin-1 accent
+    const uint8 data[] = {
+      1, 0, 0, 0,  0x9C, 0xFF, 0xFF, 0xFF,  0x73, 0x6C, 0x01, 0x00,
+      'a', 'b', 0, 0,  1,  1,
+      2, 0, 0, 0,  0xE8, 0x03, 0x00, 0x00,  0x74, 0x6C, 0x01, 0x00,
+      'c', 0xE9, 'e', 'f',  0,  0
+    };
+
+    FILE* file = fopen("arrow_test.dat", "wb");
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    Database::set_data_path(".");
+    table = Table("Test", "arrow_test.dat", 0, 18);
+    table.add_column(Column("id", COLUMN_UINT32, 0));
+    table.add_column(Column("balance", COLUMN_CURRENCY, 4));
+    table.add_column(Column("date", COLUMN_DATE, 8));
+    table.add_column(Column("name", COLUMN_STRING, 12, 4));
+
+    Column kind("kind", COLUMN_ENUM, 16);
+    kind.enumeration.add_case(0, "A");
+    kind.enumeration.add_case(1, "B");
+    table.add_column(kind);
+
+    table.add_column(Column("flag", COLUMN_BOOL, 17));
+  }
+
+  TEAR_DOWN {
+    remove("arrow_test.dat");
+  }
+}
+
+FIXTURE_TEST(schema, arrow_fixture) {
+  ArrowSchema schema;
+  export_arrow_schema(table, &schema);
+
+  ASSERT(equal("+s", schema.format));
+  ASSERT(equal(6, schema.n_children));
+  ASSERT(equal("I", schema.children[0]->format));
+  ASSERT(equal("id", schema.children[0]->name));
+  ASSERT(equal("d:10,2", schema.children[1]->format));
+  ASSERT(equal("tdD", schema.children[2]->format));
+  ASSERT(equal("u", schema.children[3]->format));
+  ASSERT(equal("C", schema.children[4]->format));
+  ASSERT(equal("u", schema.children[4]->dictionary->format));
+  ASSERT(equal("b", schema.children[5]->format));
+
+  schema.release(&schema);
+  ASSERT(schema.release == NULL);
+}
+
+FIXTURE_TEST(array, arrow_fixture) {
+  ArrowSchema schema;
+  ArrowArray array;
+  export_arrow_table(table, &schema, &array);
+
+  ASSERT(equal(2, array.length));
+  ASSERT(equal(6, array.n_children));
+
+  for (int ii = 0; ii < array.n_children; ii++){
+    for (int buffer = 1; buffer < array.children[ii]->n_buffers; buffer++){
+      const unsigned long address = reinterpret_cast<unsigned long>(
+        array.children[ii]->buffers[buffer]);
+      ASSERT(equal(0ul, address % 64));
+    }
+  }
+
+  const uint32* ids = static_cast<const uint32*>(
+    array.children[0]->buffers[1]);
+  ASSERT(equal(1u, ids[0]));
+  ASSERT(equal(2u, ids[1]));
+
+  const int64* balances = static_cast<const int64*>(
+    array.children[1]->buffers[1]);
+  ASSERT(equal(-100, balances[0]));
+  ASSERT(equal(-1, balances[1]));
+  ASSERT(equal(1000, balances[2]));
+  ASSERT(equal(0, balances[3]));
+
+  // 1700-02-28 + 93299 days = 1955-07-03
+  const int32* dates = static_cast<const int32*>(
+    array.children[2]->buffers[1]);
+  ASSERT(equal(93299 + 2342031 - 2440588, dates[0]));
+
+  const int32* offsets = static_cast<const int32*>(
+    array.children[3]->buffers[1]);
+  const char* names = static_cast<const char*>(
+    array.children[3]->buffers[2]);
+  ASSERT(equal(0, offsets[0]));
+  ASSERT(equal(2, offsets[1]));
+  ASSERT(equal(7, offsets[2]));
+  ASSERT(equal("abc\xC3\xA9" "ef", std::string(names, 7)));
+
+  const uint8* kinds = static_cast<const uint8*>(
+    array.children[4]->buffers[1]);
+  ASSERT(equal(1u, kinds[0]));
+  ASSERT(equal(0u, kinds[1]));
+  ASSERT(equal(2, array.children[4]->dictionary->length));
+
+  const uint8* flags = static_cast<const uint8*>(
+    array.children[5]->buffers[1]);
+  ASSERT(equal(1u, flags[0] & 3u));
+
+  array.release(&array);
+  schema.release(&schema);
+  ASSERT(array.release == NULL);
+}
+
+FIXTURE_TEST(batch, arrow_fixture) {
+  const RowData* rows = table.load_rows();
+  ArrowArray array;
+  export_arrow_array(*rows, &array, 1, 5);
+  delete rows;
+
+  ASSERT(equal(1, array.length));
+  const uint32* ids = static_cast<const uint32*>(
+    array.children[0]->buffers[1]);
+  ASSERT(equal(2u, ids[0]));
+
+  array.release(&array);
+}
+
+}
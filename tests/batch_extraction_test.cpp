@@ -0,0 +1,317 @@
+#include <copper.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../src/batch_extraction.h"
+
+using namespace Driller;
+
+/** Records which tables it was given, and fails any named "Broken" */
+class RecordingSink : public DataSink {
+public:
+  RecordingSink(Mutex& _mutex, std::vector<std::string>& _tables):
+    mutex(_mutex),
+    tables(_tables){}
+
+  void output_table(const Table& table, const unsigned int){
+    if (table.get_name() == "Broken"){
+      throw Errors::GenericError("broken \"table\"");
+    }
+
+    MutexLocker lock(mutex);
+    tables.push_back(table.get_name());
+  }
+
+  Mutex& mutex;
+  std::vector<std::string>& tables;
+};
+
+class RecordingFactory : public SinkFactory {
+public:
+  RecordingFactory(const unsigned int _limit = 0):
+    limit(_limit),
+    created(0),
+    finished(0){}
+
+  virtual ~RecordingFactory() throw () {}
+
+  DataSink* create_sink(const unsigned int){
+    ++created;
+    return new RecordingSink(mutex, tables);
+  }
+
+  void finish_sink(DataSink*){
+    ++finished;
+  }
+
+  unsigned int max_workers() const throw (){
+    return limit;
+  }
+
+  const unsigned int limit;
+  unsigned int created, finished;
+  Mutex mutex;
+  std::vector<std::string> tables;
+};
+
+/**
+  Records the ranges it was given, and fails the range of the Broken table
+  which starts at row 400
+*/
+class RangeSink : public DataSink {
+public:
+  RangeSink(Mutex& _mutex, std::vector<std::string>& _calls):
+    mutex(_mutex),
+    calls(_calls){}
+
+  void output_table(const Table& table, const unsigned int){
+    record("table " + table.get_name());
+  }
+
+  bool can_output_ranges() const {
+    return true;
+  }
+
+  void output_range(const Table& table, const unsigned int first_row,
+    const unsigned int row_count, const unsigned int part){
+
+    char call[64];
+    sprintf(call, "range %u %u %u", first_row, row_count, part);
+    record(call);
+
+    if (first_row == 400 && table.get_name() == "Broken"){
+      throw Errors::GenericError("broken range");
+    }
+  }
+
+  void join_ranges(const Table&, const unsigned int parts){
+    char call[64];
+    sprintf(call, "join %u", parts);
+    record(call);
+  }
+
+  void discard_ranges(const Table&, const unsigned int parts){
+    char call[64];
+    sprintf(call, "discard %u", parts);
+    record(call);
+  }
+
+  void record(const std::string& call){
+    MutexLocker lock(mutex);
+    calls.push_back(call);
+  }
+
+  Mutex& mutex;
+  std::vector<std::string>& calls;
+};
+
+class RangeFactory : public SinkFactory {
+public:
+  virtual ~RangeFactory() throw () {}
+
+  DataSink* create_sink(const unsigned int){
+    return new RangeSink(mutex, calls);
+  }
+
+  /** Check whether a call was made */
+  bool called(const std::string& call) const {
+    for (unsigned int ii = 0; ii < calls.size(); ii++){
+      if (calls[ii] == call){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Mutex mutex;
+  std::vector<std::string> calls;
+};
+
+TEST_SUITE(batch_extraction_tests) {
+
+FIXTURE(batch_fixture) {
+  Database db;
+
+  SET_UP {
+    db.set_name("Test");
+    db.add_table(Table("People"));
+    db.add_table(Table("Broken"));
+    db.add_table(Table("Places"));
+    db.add_table(Table("Things"));
+  }
+
+  TEAR_DOWN {}
+}
+
+FIXTURE_TEST(selection, batch_fixture) {
+  RecordingFactory factory;
+  BatchExtraction batch(factory);
+  batch.include_table("People");
+  batch.include_table("Things");
+  batch.include_table("Missing");
+  batch.exclude_table("Things");
+
+  batch.extract(db);
+  batch.finish();
+
+  ASSERT(factory.tables.size() == 1);
+  ASSERT(equal("People", factory.tables[0]));
+  ASSERT(batch.get_outcomes().size() == 1);
+
+  // Only the missing table counts as a failure
+  ASSERT(batch.get_errors().size() == 1);
+  ASSERT(batch.failure_count() == 1);
+}
+
+FIXTURE_TEST(failures, batch_fixture) {
+  RecordingFactory factory;
+  BatchExtraction batch(factory, 3);
+
+  batch.extract(db);
+  batch.finish();
+
+  ASSERT(factory.created == 3);
+  ASSERT(factory.finished == 3);
+  ASSERT(factory.tables.size() == 3);
+
+  // Outcomes keep the order of the tables, which the database sorts by
+  // name, whichever finished first
+  const std::vector<TableOutcome>& outcomes = batch.get_outcomes();
+  ASSERT(outcomes.size() == 4);
+  ASSERT(equal("Broken", outcomes[0].table));
+  ASSERT(!outcomes[0].succeeded);
+  ASSERT(equal("broken \"table\"", outcomes[0].error));
+  ASSERT(equal("Things", outcomes[3].table));
+  ASSERT(outcomes[1].succeeded && outcomes[3].succeeded);
+  ASSERT(batch.failure_count() == 1);
+
+  const std::string summary = batch.summary(1.5);
+  ASSERT(summary.find("{\"succeeded\":3,\"failed\":1,\"seconds\":1.500,") == 0);
+  ASSERT(summary.find("\"error\":\"broken \\\"table\\\"\"") !=
+    std::string::npos);
+}
+
+FIXTURE_TEST(worker_limit, batch_fixture) {
+  RecordingFactory factory(1);
+  BatchExtraction batch(factory, 8);
+  batch.extract(db);
+  batch.extract(db);
+  batch.finish();
+
+  // Sinks are created once, and kept for every database
+  ASSERT(factory.created == 1);
+  ASSERT(factory.tables.size() == 6);
+  ASSERT(batch.get_outcomes().size() == 8);
+}
+
+
+FIXTURE(range_fixture) {
+  Database db;
+
+  SET_UP {
+    // 1000 rows of 4 bytes, shared by every table
+    std::vector<char> data(4000);
+    FILE* file = fopen("batch_extraction_test.dat", "wb");
+    fwrite(&data[0], 1, data.size(), file);
+    fclose(file);
+
+    Database::set_data_path(".");
+    Table big("Big", "batch_extraction_test.dat", 0, 4);
+    big.add_column(Column("id", COLUMN_UINT32, 0));
+    db.add_table(big);
+
+    // Much smaller, since only the first row is counted
+    Table small("Small", "batch_extraction_test.dat", 3996, 4);
+    small.add_column(Column("id", COLUMN_UINT32, 0));
+    db.add_table(small);
+  }
+
+  TEAR_DOWN {
+    remove("batch_extraction_test.dat");
+  }
+}
+
+FIXTURE_TEST(ranges, range_fixture) {
+  RangeFactory factory;
+  BatchExtraction batch(factory, 4);
+  batch.set_min_range_rows(100);
+  batch.extract(db);
+  batch.finish();
+
+  // The big table is split between every worker, the last range running to
+  // the end; the small one is left whole
+  ASSERT(factory.called("range 0 250 0"));
+  ASSERT(factory.called("range 250 250 1"));
+  ASSERT(factory.called("range 500 250 2"));
+  ASSERT(factory.called("range 750 0 3"));
+  ASSERT(factory.called("join 4"));
+  ASSERT(factory.called("table Small"));
+  ASSERT(factory.calls.size() == 6);
+
+  ASSERT(batch.get_outcomes().size() == 2);
+  ASSERT(batch.failure_count() == 0);
+}
+
+FIXTURE_TEST(adaptive_ranges, range_fixture) {
+  RangeFactory factory;
+  BatchExtraction batch(factory, 4);
+  batch.set_min_range_rows(100);
+  batch.set_adaptive(1);
+  batch.extract(db);
+  batch.finish();
+
+  // Tuned workers get finer ranges, down to the fewest rows allowed
+  ASSERT(factory.called("range 0 100 0"));
+  ASSERT(factory.called("range 900 0 9"));
+  ASSERT(factory.called("join 10"));
+  ASSERT(batch.failure_count() == 0);
+}
+
+FIXTURE_TEST(failed_range, range_fixture) {
+  Table broken = db.table_at(0);
+  broken.set_name("Broken");
+  db.add_table(broken);
+
+  RangeFactory factory;
+  BatchExtraction batch(factory, 4);
+  batch.set_min_range_rows(100);
+  batch.set_row_limit(800);
+  batch.extract(db);
+  batch.finish();
+
+  // Two tables of 800 rows are each split in half, the last range ending at
+  // the row limit
+  ASSERT(factory.called("range 0 400 0"));
+  ASSERT(factory.called("range 400 400 1"));
+  ASSERT(factory.called("discard 2"));
+  ASSERT(factory.called("join 2"));
+  ASSERT(batch.failure_count() == 1);
+  ASSERT(equal("broken range", batch.get_outcomes()[1].error));
+}
+
+
+FIXTURE_TEST(processes, range_fixture) {
+  Table broken = db.table_at(0);
+  broken.set_name("Broken");
+  db.add_table(broken);
+
+  RangeFactory factory;
+  BatchExtraction batch(factory);
+  batch.set_min_range_rows(100);
+  batch.set_row_limit(800);
+  batch.set_processes(2);
+  batch.extract(db);
+  batch.finish();
+
+  // Ranges are written by the workers, but joined or discarded here
+  ASSERT(factory.called("join 4"));
+  ASSERT(factory.called("discard 4"));
+  ASSERT(factory.calls.size() == 2);
+
+  ASSERT(batch.get_outcomes().size() == 3);
+  ASSERT(batch.failure_count() == 1);
+  ASSERT(equal("broken range", batch.get_outcomes()[1].error));
+  ASSERT(batch.get_worker_restarts() == 0);
+}
+
+}
@@ -0,0 +1,105 @@
+#include <copper.hpp>
+#include <unistd.h>
+#include <vector>
+#include "../src/concurrency_controller.h"
+
+using namespace Driller;
+
+/** Counts how many jobs run at once */
+class CountingJob : public Job {
+public:
+  CountingJob(Mutex& _mutex, unsigned int& _running, unsigned int& _most):
+    mutex(_mutex),
+    running(_running),
+    most(_most){}
+
+  void run(){
+    {
+      MutexLocker lock(mutex);
+      if (++running > most){
+        most = running;
+      }
+    }
+
+    usleep(2000);
+
+    MutexLocker lock(mutex);
+    --running;
+  }
+
+  Mutex& mutex;
+  unsigned int& running;
+  unsigned int& most;
+};
+
+TEST_SUITE(concurrency_controller_tests) {
+
+TEST(climbs_while_improving) {
+  ConcurrencyController controller("Test", 1, 4);
+  ASSERT(controller.get_limit() == 1);
+
+  // Throughput rises with every thread, so the limit climbs to its bound
+  ASSERT(controller.sample(100, 1, 10) == 2);
+  ASSERT(controller.sample(200, 1, 10) == 3);
+  ASSERT(controller.sample(300, 1, 10) == 4);
+  ASSERT(controller.sample(400, 1, 10) == 4);
+}
+
+TEST(steps_back_when_no_better) {
+  ConcurrencyController controller("Test", 1, 8);
+  ASSERT(controller.sample(100, 1, 10) == 2);
+  ASSERT(controller.sample(200, 1, 10) == 3);
+
+  // A third thread bought nothing, so the limit goes back and holds
+  ASSERT(controller.sample(201, 1, 10) == 2);
+  for (unsigned int ii = 0; ii < ConcurrencyController::settle_samples;
+    ii++){
+
+    ASSERT(controller.sample(200, 1, 10) == 2);
+  }
+
+  // Then it probes again, the other way
+  ASSERT(controller.sample(200, 1, 10) == 1);
+  ASSERT(controller.sample(100, 1, 10) == 2);
+}
+
+TEST(probes_when_work_changes) {
+  ConcurrencyController controller("Test", 1, 8);
+  ASSERT(controller.sample(100, 1, 10) == 2);
+  ASSERT(controller.sample(100, 1, 10) == 1);
+
+  // Held, until throughput jumps for reasons of its own
+  ASSERT(controller.sample(100, 1, 10) == 1);
+  ASSERT(controller.sample(300, 1, 10) == 2);
+}
+
+TEST(holds_when_idle) {
+  ConcurrencyController controller("Test", 2, 8);
+  ASSERT(controller.sample(100, 1, 0) == 2);
+  ASSERT(controller.sample(100, 0, 10) == 2);
+}
+
+TEST(active_limit) {
+  ThreadPool pool(4);
+  pool.set_active_limit(2);
+  ASSERT(pool.get_active_limit() == 2);
+
+  Mutex mutex;
+  unsigned int running = 0, most = 0;
+  std::vector<CountingJob*> jobs;
+  for (unsigned int ii = 0; ii < 20; ii++){
+    jobs.push_back(new CountingJob(mutex, running, most));
+    pool.add_job(jobs.back());
+  }
+
+  pool.wait_all();
+  ASSERT(most <= 2);
+  ASSERT(pool.take_completed_work() == 20);
+  ASSERT(pool.take_completed_work() == 0);
+
+  for (unsigned int ii = 0; ii < jobs.size(); ii++){
+    delete jobs[ii];
+  }
+}
+
+}
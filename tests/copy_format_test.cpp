@@ -0,0 +1,65 @@
+#include <copper.hpp>
+#include <string>
+#include "../src/copy_format.h"
+
+using namespace Driller;
+
+TEST_SUITE(copy_format_tests) {
+
+TEST(numeric) {
+  char out[16];
+
+  // ndigits, weight, sign, dscale, then the base 10000 digits
+  ASSERT(equal(std::string("\0\0\0\0\0\0\0\2", 8),
+    std::string(out, encode_numeric(0, out))));
+  ASSERT(equal(std::string("\0\1\xFF\xFF\0\0\0\2\x01\xF4", 10),
+    std::string(out, encode_numeric(5, out))));
+  ASSERT(equal(std::string("\0\1\0\0\0\0\0\2\0\x64", 10),
+    std::string(out, encode_numeric(10000, out))));
+  ASSERT(equal(std::string("\0\2\0\0\x40\0\0\2\x02\x8A\x12\xC0", 12),
+    std::string(out, encode_numeric(-65048, out))));
+
+  // -21474836.48
+  ASSERT(equal(std::string(
+    "\0\3\0\1\x40\0\0\2\x08\x63\x12\xE4\x12\xC0", 14),
+    std::string(out, encode_numeric(-2147483647 - 1, out))));
+}
+
+TEST(dates) {
+  // 1700-02-28 + 93299 days, as days since 2000-01-01
+  ASSERT(equal(93299 + 2342031 - 2440588 - 10957, copy_date(93299)));
+}
+
+TEST(values) {
+  // bool, uint8, uint32, 4-byte string
+  const uint8 row[] = {
+    1,  0xFF,  0xFF, 0xFF, 0xFF, 0xFF,  'a', 0, 'b', 0
+  };
+
+  char out[32];
+  Column flag("flag", COLUMN_BOOL, 0);
+  Column small("small", COLUMN_UINT8, 1);
+  Column large("large", COLUMN_UINT32, 2);
+  Column name("name", COLUMN_STRING, 6, 4);
+
+  ASSERT(equal(std::string("\0\0\0\1\1", 5),
+    std::string(out, write_copy_value(flag, row, out))));
+  ASSERT(equal(std::string("\0\0\0\2\0\xFF", 6),
+    std::string(out, write_copy_value(small, row, out))));
+  ASSERT(equal(std::string("\0\0\0\x08\0\0\0\0\xFF\xFF\xFF\xFF", 12),
+    std::string(out, write_copy_value(large, row, out))));
+  ASSERT(equal(std::string("\0\0\0\1a", 5),
+    std::string(out, write_copy_value(name, row, out))));
+
+  ASSERT(write_copy_value(name, row, out) <= max_copy_value_size(name, row));
+}
+
+TEST(text) {
+  char out[64];
+  ASSERT(equal("a\\\\b\\tc\\nd\\re",
+    std::string(out, write_copy_text(COLUMN_STRING, "a\\b\tc\nd\re", 9, out))));
+  ASSERT(equal("\\\\x0aff",
+    std::string(out, write_copy_text(COLUMN_BLOB, "0a ff", 5, out))));
+}
+
+}
@@ -0,0 +1,149 @@
+#include <copper.hpp>
+#include <cstdio>
+#include <string>
+#include "../src/file_sink.h"
+#include "../src/database/database.h"
+
+using namespace Driller;
+
+/** Read a whole file into a string, or "missing" if it can't be opened */
+static std::string read_file(const std::string& file_name){
+  FILE* file = fopen(file_name.c_str(), "rb");
+  if (!file){
+    return "missing";
+  }
+
+  std::string contents;
+  char chunk[4096];
+  size_t length;
+  while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0){
+    contents.append(chunk, length);
+  }
+
+  fclose(file);
+  return contents;
+}
+
+/** Get whether a file exists */
+static bool exists(const std::string& file_name){
+  FILE* file = fopen(file_name.c_str(), "rb");
+  if (file){
+    fclose(file);
+  }
+  return file != NULL;
+}
+
+static const std::string manifest_header =
+  "# file\tfirst_row\trow_count\tbytes\tcrc32\n";
+
+TEST_SUITE(file_sink_tests) {
+
+FIXTURE(shard_fixture) {
+  Table table;
+  Table empty;
+
+  SET_UP {
+    // Five rows, numbered 1 to 5
+    const uint8 data[] = {
+      1, 0, 0, 0,  2, 0, 0, 0,  3, 0, 0, 0,  4, 0, 0, 0,  5, 0, 0, 0
+    };
+
+    FILE* file = fopen("file_sink_test.dat", "wb");
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    file = fopen("file_sink_empty.dat", "wb");
+    fclose(file);
+
+    Database::set_data_path(".");
+    table = Table("Shards", "file_sink_test.dat", 0, 4);
+    table.add_column(Column("id", COLUMN_UINT32, 0));
+
+    empty = Table("Empty", "file_sink_empty.dat", 0, 4);
+    empty.add_column(Column("id", COLUMN_UINT32, 0));
+  }
+
+  TEAR_DOWN {
+    remove("file_sink_test.dat");
+    remove("file_sink_empty.dat");
+    remove("./Shards.manifest");
+    remove("./Empty.manifest");
+
+    char name[32];
+    for (unsigned int ii = 0; ii < 6; ii++){
+      sprintf(name, "./Shards.%04u.txt", ii);
+      remove(name);
+    }
+  }
+}
+
+FIXTURE_TEST(shard_rows, shard_fixture) {
+  FileSink sink(".");
+  sink.set_shard_rows(2);
+  sink.output_table(table, 0);
+
+  ASSERT(equal("1\t\n2\t\n", read_file("./Shards.0000.txt")));
+  ASSERT(equal("3\t\n4\t\n", read_file("./Shards.0001.txt")));
+  ASSERT(equal("5\t\n", read_file("./Shards.0002.txt")));
+  ASSERT(!exists("./Shards.0003.txt"));
+
+  // Each shard is listed with its rows, size and CRC-32
+  ASSERT(equal(manifest_header +
+    "Shards.0000.txt\t0\t2\t6\t0ab19417\n"
+    "Shards.0001.txt\t2\t2\t6\t43f449ae\n"
+    "Shards.0002.txt\t4\t1\t3\tecf6ac3e\n",
+    read_file("./Shards.manifest")));
+}
+
+FIXTURE_TEST(shard_bytes, shard_fixture) {
+  // A shard is only ended once it reaches the size, so rows of 3 bytes make
+  // shards of 2 rows each
+  FileSink sink(".");
+  sink.set_threads(2);
+  sink.set_shard_bytes(5);
+  sink.output_table(table, 0);
+
+  ASSERT(equal("1\t\n2\t\n", read_file("./Shards.0000.txt")));
+  ASSERT(equal("3\t\n4\t\n", read_file("./Shards.0001.txt")));
+  ASSERT(equal("5\t\n", read_file("./Shards.0002.txt")));
+  ASSERT(!exists("./Shards.0003.txt"));
+}
+
+FIXTURE_TEST(shard_both, shard_fixture) {
+  // Whichever limit is reached first ends the shard
+  FileSink sink(".");
+  sink.set_shard_rows(1);
+  sink.set_shard_bytes(100);
+  sink.output_table(table, 4);
+
+  ASSERT(equal("4\t\n", read_file("./Shards.0003.txt")));
+  ASSERT(!exists("./Shards.0004.txt"));
+}
+
+FIXTURE_TEST(stale_shards, shard_fixture) {
+  FileSink sink(".");
+  sink.set_shard_rows(1);
+  sink.output_table(table, 0);
+  ASSERT(exists("./Shards.0004.txt"));
+
+  // Fewer, larger shards replace them all
+  sink.set_shard_rows(3);
+  sink.output_table(table, 0);
+
+  ASSERT(equal("4\t\n5\t\n", read_file("./Shards.0001.txt")));
+  ASSERT(!exists("./Shards.0002.txt"));
+  ASSERT(!exists("./Shards.0003.txt"));
+  ASSERT(!exists("./Shards.0004.txt"));
+}
+
+FIXTURE_TEST(empty_table, shard_fixture) {
+  // An empty table has a manifest listing no shards
+  FileSink sink(".");
+  sink.set_shard_rows(2);
+  sink.output_table(empty, 0);
+
+  ASSERT(equal(manifest_header, read_file("./Empty.manifest")));
+  ASSERT(!exists("./Empty.0000.txt"));
+}
+
+}
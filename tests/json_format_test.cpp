@@ -0,0 +1,93 @@
+#include <copper.hpp>
+#include <string>
+#include "../src/json_format.h"
+#include "../src/string_scan.h"
+
+using namespace Driller;
+
+TEST_SUITE(json_format_tests) {
+
+TEST(scan) {
+  // Long enough that the special character is past the first 16 bytes
+  const std::string clean = "abcdefghijklmnopqrstuvwxyz";
+  ASSERT(clean.data() + clean.size() ==
+    find_json_special(clean.data(), clean.data() + clean.size()));
+
+  const char* specials = "\0\n\x1F\\\"\x80\xFF";
+  for (unsigned int ii = 0; ii < 7; ii++){
+    std::string text = clean;
+    text[20] = specials[ii];
+    ASSERT(text.data() + 20 ==
+      find_json_special(text.data(), text.data() + text.size()));
+
+    text = clean.substr(0, 3) + specials[ii];
+    ASSERT(text.data() + 3 ==
+      find_json_special(text.data(), text.data() + text.size()));
+  }
+
+  // Neither a space nor a tilde needs escaping
+  const std::string edges = "                ~~~~~~~~~~~~~~~~";
+  ASSERT(edges.data() + edges.size() ==
+    find_json_special(edges.data(), edges.data() + edges.size()));
+}
+
+TEST(escape) {
+  char out[96];
+  const std::string text("say \"hi\"\\\n\t\x01 caf\xE9\0!", 19);
+  const unsigned int length = escape_json_string(text.data(),
+    static_cast<unsigned int>(text.size()), out);
+
+  ASSERT(equal("say \\\"hi\\\"\\\\\\n\\t\\u0001 caf\xC3\xA9\\u0000!",
+    std::string(out, length)));
+}
+
+TEST(latin1_to_utf8) {
+  // The accented characters fall on both sides of a 16-byte boundary
+  const std::string text = "plain ascii text caf\xE9, na\xEFve \xFF\x80";
+  std::string out;
+  latin1_to_utf8(text.data(), static_cast<unsigned int>(text.size()), out);
+  ASSERT(equal("plain ascii text caf\xC3\xA9, na\xC3\xAFve \xC3\xBF\xC2\x80",
+    out));
+
+  ASSERT(text.data() + 20 ==
+    find_non_ascii(text.data(), text.data() + text.size()));
+
+  latin1_to_utf8("ascii", 5, out);
+  ASSERT(equal("ascii", out));
+}
+
+TEST(values) {
+  // bool, int16, date, 4-byte string, currency
+  const uint8 row[] = {
+    1,  0x9C, 0xFF,  0x73, 0x6C, 0x01, 0x00,  'a', '"', 0, 'b',
+    0x9C, 0xFF, 0xFF, 0xFF
+  };
+
+  char out[64];
+  Column flag("flag", COLUMN_BOOL, 0);
+  Column number("number", COLUMN_INT16, 1);
+  Column date("date", COLUMN_DATE, 3);
+  Column name("name", COLUMN_STRING, 7, 4);
+  Column balance("balance", COLUMN_CURRENCY, 11);
+
+  ASSERT(equal("true", std::string(out, write_json_value(flag, row, out))));
+  ASSERT(equal("-100",
+    std::string(out, write_json_value(number, row, out))));
+  ASSERT(equal("\"1955-08-10\"",
+    std::string(out, write_json_value(date, row, out))));
+  ASSERT(equal("\"a\\\"\"",
+    std::string(out, write_json_value(name, row, out))));
+  ASSERT(equal("-1.00",
+    std::string(out, write_json_value(balance, row, out))));
+
+  ASSERT(write_json_value(name, row, out) <= max_json_value_size(name, row));
+
+  ASSERT(equal("false",
+    std::string(out, write_json_text(COLUMN_BOOL, "False", 5, out))));
+  ASSERT(equal("\"1955-07-03\"",
+    std::string(out, write_json_text(COLUMN_DATE, "1955-7-3", 8, out))));
+  ASSERT(equal("\"0AFF\"",
+    std::string(out, write_json_text(COLUMN_BLOB, "0A FF ", 6, out))));
+}
+
+}
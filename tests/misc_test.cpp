@@ -12,6 +12,8 @@ TEST(integer_sizes) {
   ASSERT(equal(2u, sizeof(uint16)));
   ASSERT(equal(4u, sizeof(int32)));
   ASSERT(equal(4u, sizeof(uint32)));
+  ASSERT(equal(8u, sizeof(int64)));
+  ASSERT(equal(8u, sizeof(uint64)));
 }
 
 TEST(column_strings) {
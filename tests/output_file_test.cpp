@@ -0,0 +1,268 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <copper.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include "../src/output_file.h"
+#include "../src/threads.h"
+
+#if ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#if ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace Driller;
+
+static const char* const output_test_file = "output_file_test.out";
+
+/** Read a whole file into a string */
+static std::string read_file(const char* file_name){
+  std::string contents;
+  FILE* file = fopen(file_name, "rb");
+  if (!file){
+    return contents;
+  }
+
+  char chunk[65536];
+  size_t length;
+  while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0){
+    contents.append(chunk, length);
+  }
+
+  fclose(file);
+  return contents;
+}
+
+/**
+  Decompress a file made of one or more complete streams
+
+  @param compression The format of the file
+  @param input The file's contents
+  @param output Receives the decompressed data
+
+  @return Whether the input was entirely valid, and held at least one stream
+*/
+static bool decompress(const Compression compression,
+  const std::string& input, std::string& output){
+
+  output.clear();
+
+#if ENABLE_ZLIB
+  if (compression == COMPRESSION_GZIP){
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    if (inflateInit2(&stream, 15 + 16) != Z_OK){
+      return false;
+    }
+
+    // Each block is a separate gzip member
+    bool complete = false;
+    do {
+      char chunk[65536];
+      stream.next_out = reinterpret_cast<Bytef*>(chunk);
+      stream.avail_out = sizeof(chunk);
+
+      const int result = inflate(&stream, Z_NO_FLUSH);
+      output.append(chunk, sizeof(chunk) - stream.avail_out);
+
+      if (result == Z_STREAM_END){
+        complete = true;
+        if (stream.avail_in > 0 && inflateReset(&stream) != Z_OK){
+          complete = false;
+          break;
+        }
+      }
+
+      else if (result != Z_OK){
+        complete = false;
+        break;
+      }
+
+      else if (stream.avail_in == 0 && stream.avail_out > 0){
+        complete = false;
+        break;
+      }
+    } while (stream.avail_in > 0 || stream.avail_out == 0);
+
+    inflateEnd(&stream);
+    return complete;
+  }
+#endif
+
+#if ENABLE_ZSTD
+  if (compression == COMPRESSION_ZSTD){
+    const char* data = input.data();
+    size_t remaining = input.size();
+    if (remaining == 0){
+      return false;
+    }
+
+    // Each block is a separate frame, which records its own size
+    while (remaining > 0){
+      const size_t frame = ZSTD_findFrameCompressedSize(data, remaining);
+      const unsigned long long size = ZSTD_getFrameContentSize(data, frame);
+      if (ZSTD_isError(frame) || size == ZSTD_CONTENTSIZE_ERROR ||
+        size == ZSTD_CONTENTSIZE_UNKNOWN){
+
+        return false;
+      }
+
+      std::string block(static_cast<size_t>(size), '\0');
+      const size_t result = ZSTD_decompress(&block[0], block.size(),
+        data, frame);
+      if (ZSTD_isError(result) || result != size){
+        return false;
+      }
+
+      output += block;
+      data += frame;
+      remaining -= frame;
+    }
+
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+/** Make some data that compresses, but not to almost nothing */
+static std::string make_data(const unsigned int length){
+  std::string data;
+  data.reserve(length);
+
+  unsigned int seed = 12345;
+  while (data.size() < length){
+    seed = seed * 1103515245 + 12345;
+    char line[32];
+    sprintf(line, "row %u\t%u\n", static_cast<unsigned int>(data.size()),
+      (seed >> 16) % 1000);
+    data += line;
+  }
+
+  data.resize(length);
+  return data;
+}
+
+/**
+  Write data through an OutputFile and check it decompresses to the same
+  thing
+
+  @param compression The format to write
+  @param data The data to write
+  @param pool The pool to compress with, or NULL
+*/
+static bool round_trip(const Compression compression, const std::string& data,
+  ThreadPool* pool){
+
+  OutputFile file(output_test_file, compression, pool);
+
+  // Uneven writes, so blocks fill part way through a write
+  const unsigned int step = 70001;
+  for (unsigned int offset = 0; offset < data.size(); offset += step){
+    const unsigned int length = std::min(step,
+      static_cast<unsigned int>(data.size()) - offset);
+    file.write(data.data() + offset, length);
+  }
+
+  file.close();
+
+  const std::string contents = read_file(output_test_file);
+  if (contents.size() != file.bytes_written()){
+    return false;
+  }
+
+  std::string output;
+  return decompress(compression, contents, output) && output == data;
+}
+
+/** Check a format against several sizes of file, with and without a pool */
+static bool round_trips(const Compression compression){
+  ThreadPool pool(3);
+  const std::string sizes[] = {
+    std::string(),
+    make_data(1000),
+    make_data(OutputFile::block_size),
+    make_data(OutputFile::block_size * 3 + 123)
+  };
+
+  for (unsigned int ii = 0; ii < 4; ii++){
+    if (!round_trip(compression, sizes[ii], NULL) ||
+      !round_trip(compression, sizes[ii], &pool)){
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+TEST_SUITE(output_file_tests) {
+
+FIXTURE(output_fixture) {
+  SET_UP {}
+
+  TEAR_DOWN {
+    remove(output_test_file);
+  }
+}
+
+FIXTURE_TEST(uncompressed, output_fixture) {
+  const std::string data = make_data(OutputFile::block_size + 10);
+  OutputFile file(output_test_file);
+  file.write(data);
+  file.close();
+
+  ASSERT(read_file(output_test_file) == data);
+  ASSERT(file.bytes_written() == data.size());
+}
+
+FIXTURE_TEST(empty_uncompressed, output_fixture) {
+  OutputFile file(output_test_file);
+  file.close();
+
+  ASSERT(file.bytes_written() == 0);
+}
+
+FIXTURE_TEST(gzip, output_fixture) {
+  if (compression_available(COMPRESSION_GZIP)){
+    ASSERT(round_trips(COMPRESSION_GZIP));
+  }
+}
+
+FIXTURE_TEST(zstd, output_fixture) {
+  if (compression_available(COMPRESSION_ZSTD)){
+    ASSERT(round_trips(COMPRESSION_ZSTD));
+  }
+}
+
+FIXTURE_TEST(empty_compressed, output_fixture) {
+  // Even an empty compressed file must be a valid stream
+  for (unsigned int ii = COMPRESSION_GZIP; ii < COMPRESSION_NUM_TYPES; ii++){
+    const Compression compression = static_cast<Compression>(ii);
+    if (!compression_available(compression)){
+      continue;
+    }
+
+    OutputFile file(output_test_file, compression);
+    file.close();
+
+    ASSERT(file.bytes_written() > 0);
+
+    std::string output;
+    ASSERT(decompress(compression, read_file(output_test_file), output));
+    ASSERT(output.empty());
+  }
+}
+
+}
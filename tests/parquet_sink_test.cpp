@@ -0,0 +1,68 @@
+#include <copper.hpp>
+#include <cstdio>
+#include <string>
+#include "../src/parquet_sink.h"
+#include "../src/database/database.h"
+
+using namespace Driller;
+
+/** Read a whole file into a string */
+static std::string read_file(const std::string& file_name){
+  std::string contents;
+  FILE* file = fopen(file_name.c_str(), "rb");
+  if (!file){
+    return contents;
+  }
+
+  char chunk[4096];
+  size_t length;
+  while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0){
+    contents.append(chunk, length);
+  }
+
+  fclose(file);
+  return contents;
+}
+
+TEST_SUITE(parquet_sink_tests) {
+
+FIXTURE(parquet_fixture) {
+  Table table;
+
+  SET_UP {
+    // Two rows of a 6-byte string, one with Latin-1 accents
+    const uint8 data[] = {
+      'c', 'a', 'f', 0xE9, 0, 0,
+      'n', 0xE4, 'h', 'e', 'r', 0
+    };
+
+    FILE* file = fopen("parquet_test.dat", "wb");
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    Database::set_data_path(".");
+    table = Table("ParquetTest", "parquet_test.dat", 0, 6);
+    table.add_column(Column("name", COLUMN_STRING, 0, 6));
+  }
+
+  TEAR_DOWN {
+    remove("parquet_test.dat");
+    remove("./ParquetTest.parquet");
+  }
+}
+
+FIXTURE_TEST(utf8_strings, parquet_fixture) {
+  ParquetSink sink(".");
+  sink.output_table(table);
+
+  // Pages are uncompressed, so the strings can be found as they are stored
+  const std::string contents = read_file("./ParquetTest.parquet");
+  ASSERT(contents.find("caf\xC3\xA9") != std::string::npos);
+  ASSERT(contents.find("n\xC3\xA4her") != std::string::npos);
+
+  // Nothing is left as Latin-1
+  ASSERT(contents.find("caf\xE9") == std::string::npos);
+  ASSERT(contents.find("n\xE4her") == std::string::npos);
+}
+
+}
@@ -0,0 +1,134 @@
+#include <copper.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "../src/process_pool.h"
+
+using namespace Driller;
+
+/**
+  Doubles each unit's number. Unit 3 kills its worker the first time it's
+  run, and unit 5 every time
+*/
+class DoublingTask : public ProcessTask {
+public:
+  DoublingTask(const bool _fail_start = false):
+    fail_start(_fail_start){}
+
+  virtual ~DoublingTask() throw () {}
+
+  void start_worker(){
+    if (fail_start){
+      throw Errors::GenericError("no sink");
+    }
+  }
+
+  std::string run_unit(const unsigned int unit) throw (){
+    if (unit == 3){
+      FILE* marker = fopen("process_pool_test.marker", "r");
+      if (!marker){
+        marker = fopen("process_pool_test.marker", "w");
+        fclose(marker);
+        _exit(1);
+      }
+      fclose(marker);
+    }
+
+    if (unit == 5){
+      abort();
+    }
+
+    char result[32];
+    sprintf(result, "%u", unit * 2);
+    return result;
+  }
+
+  void unit_finished(const unsigned int unit, const std::string& result)
+    throw (){
+
+    results.push_back(std::make_pair(unit, result));
+  }
+
+  void unit_failed(const unsigned int unit, const std::string& error)
+    throw (){
+
+    failures.push_back(std::make_pair(unit, error));
+  }
+
+  /** Get what a unit returned, or "none" */
+  std::string result_of(const unsigned int unit) const {
+    for (unsigned int ii = 0; ii < results.size(); ii++){
+      if (results[ii].first == unit){
+        return results[ii].second;
+      }
+    }
+    return "none";
+  }
+
+  const bool fail_start;
+  std::vector<std::pair<unsigned int, std::string> > results;
+  std::vector<std::pair<unsigned int, std::string> > failures;
+};
+
+TEST_SUITE(process_pool_tests) {
+
+FIXTURE(process_pool_fixture) {
+  std::vector<unsigned int> units;
+
+  SET_UP {
+    remove("process_pool_test.marker");
+  }
+
+  TEAR_DOWN {
+    remove("process_pool_test.marker");
+  }
+}
+
+FIXTURE_TEST(runs_units, process_pool_fixture) {
+  for (unsigned int ii = 0; ii < 20; ii++){
+    if (ii != 3 && ii != 5){
+      units.push_back(ii);
+    }
+  }
+
+  DoublingTask task;
+  ProcessPool pool(3);
+  ASSERT(pool.run(task, units) == 0);
+  ASSERT(task.results.size() == 18);
+  ASSERT(task.failures.empty());
+  ASSERT(equal("38", task.result_of(19)));
+}
+
+FIXTURE_TEST(retries_crashes, process_pool_fixture) {
+  for (unsigned int ii = 0; ii < 8; ii++){
+    units.push_back(ii);
+  }
+
+  DoublingTask task;
+  ProcessPool pool(2, 3);
+
+  // Unit 3 crashes once, and unit 5 on each of its three attempts
+  ASSERT(pool.run(task, units) == 4);
+  ASSERT(task.results.size() == 7);
+  ASSERT(equal("6", task.result_of(3)));
+
+  ASSERT(task.failures.size() == 1);
+  ASSERT(task.failures[0].first == 5);
+  ASSERT(task.failures[0].second.find("killed by signal") !=
+    std::string::npos);
+}
+
+FIXTURE_TEST(failed_start, process_pool_fixture) {
+  units.push_back(0);
+  units.push_back(1);
+
+  DoublingTask task(true);
+  ProcessPool pool(2, 2);
+  pool.run(task, units);
+  ASSERT(task.results.empty());
+  ASSERT(task.failures.size() == 2);
+  ASSERT(equal("no sink", task.failures[0].second));
+}
+
+}
@@ -0,0 +1,96 @@
+#include <copper.hpp>
+#include <vector>
+#include "../src/database/row_sort.h"
+
+using namespace Driller;
+
+TEST_SUITE(row_sort_tests) {
+
+FIXTURE(row_sort_fixture) {
+  // Each row: int32 key, row number, 4-byte string
+  std::vector<uint8> data;
+  std::vector<const uint8*> rows;
+
+  SET_UP {
+    const unsigned int count = 10000;
+    data.resize(count * 12);
+
+    // Keys repeat, so the sort's stability can be checked
+    uint32 seed = 12345;
+    for (unsigned int ii = 0; ii < count; ii++){
+      seed = seed * 1103515245 + 12345;
+      const int32 key = static_cast<int32>((seed >> 8) % 2000) - 1000;
+
+      uint8* row = &data[ii * 12];
+      for (unsigned int byte = 0; byte < 4; byte++){
+        row[byte] = static_cast<uint8>(static_cast<uint32>(key) >> (8 * byte));
+        row[4 + byte] = static_cast<uint8>(ii >> (8 * byte));
+        row[8 + byte] = static_cast<uint8>('a' + (seed >> (4 * byte)) % 26);
+      }
+      rows.push_back(row);
+    }
+  }
+
+  TEAR_DOWN {}
+
+  /** Check that rows are ordered by key, then by their original order */
+  bool sorted_by_key() {
+    for (unsigned int ii = 1; ii < rows.size(); ii++){
+      const int32 previous = Column::get_int32(rows[ii - 1]);
+      const int32 current = Column::get_int32(rows[ii]);
+      if (previous > current || (previous == current &&
+        Column::get_uint32(rows[ii - 1] + 4) >
+        Column::get_uint32(rows[ii] + 4))){
+
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+FIXTURE_TEST(radix, row_sort_fixture) {
+  sort_rows(&rows[0], static_cast<unsigned int>(rows.size()),
+    Column("key", COLUMN_INT32, 0));
+  ASSERT(sorted_by_key());
+}
+
+FIXTURE_TEST(external, row_sort_fixture) {
+  // Small enough that the rows are sorted in three runs
+  sort_rows(&rows[0], static_cast<unsigned int>(rows.size()),
+    Column("key", COLUMN_INT32, 0), 4096 * 32);
+  ASSERT(sorted_by_key());
+}
+
+FIXTURE_TEST(already_sorted, row_sort_fixture) {
+  const Column id("id", COLUMN_UINT32, 4);
+  const std::vector<const uint8*> original = rows;
+  sort_rows(&rows[0], static_cast<unsigned int>(rows.size()), id);
+  ASSERT(rows == original);
+}
+
+FIXTURE_TEST(strings, row_sort_fixture) {
+  const Column name("name", COLUMN_STRING, 8, 4);
+  sort_rows(&rows[0], static_cast<unsigned int>(rows.size()), name);
+
+  for (unsigned int ii = 1; ii < rows.size(); ii++){
+    ASSERT(memcmp(rows[ii - 1] + 8, rows[ii] + 8, 4) <= 0);
+  }
+}
+
+TEST(keys) {
+  const uint8 negative[] = {0xFF, 0xFF, 0xFF, 0xFF};
+  const uint8 positive[] = {0x01, 0x00, 0x00, 0x00};
+  const Column signed_column("a", COLUMN_INT32, 0);
+  const Column unsigned_column("b", COLUMN_UINT32, 0);
+
+  ASSERT(integer_sort_key(signed_column, negative) <
+    integer_sort_key(signed_column, positive));
+  ASSERT(integer_sort_key(unsigned_column, negative) >
+    integer_sort_key(unsigned_column, positive));
+
+  ASSERT(has_integer_sort_key(COLUMN_DATE));
+  ASSERT(!has_integer_sort_key(COLUMN_VARSTRING));
+}
+
+}
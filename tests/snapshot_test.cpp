@@ -0,0 +1,185 @@
+#include <copper.hpp>
+#include <cstdio>
+#include <cstring>
+#include "../src/database/database.h"
+#include "../src/database/snapshot.h"
+
+using namespace Driller;
+
+TEST_SUITE(snapshot_tests) {
+
+FIXTURE(snapshot_fixture) {
+  Table table;
+
+  SET_UP {
+    // Three rows: uint32 id, currency, date, 4-byte string, enum, bool
+    const uint8 data[] = {
+      1, 0, 0, 0,  0x9C, 0xFF, 0xFF, 0xFF,  0x73, 0x6C, 0x01, 0x00,
+      'a', 'b', 0, 0,  1,  1,
+      2, 1, 0, 0,  0xE8, 0x03, 0x00, 0x00,  0x74, 0x6C, 0x01, 0x00,
+      'c', 'd', 'e', 'f',  0,  0,
+      3, 0, 0, 0,  0x00, 0x00, 0x00, 0x00,  0x73, 0x6C, 0x01, 0x00,
+      'a', 'b', 0, 0,  1,  1
+    };
+
+    FILE* file = fopen("snapshot_test.dat", "wb");
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    Database::set_data_path(".");
+    table = Table("Test", "snapshot_test.dat", 0, 18);
+    table.add_column(Column("id", COLUMN_UINT32, 0));
+    table.add_column(Column("balance", COLUMN_CURRENCY, 4));
+    table.add_column(Column("date", COLUMN_DATE, 8));
+    table.add_column(Column("name", COLUMN_STRING, 12, 4));
+
+    Column kind("kind", COLUMN_ENUM, 16);
+    kind.enumeration.add_case(0, "A");
+    kind.enumeration.add_case(1, "B");
+    table.add_column(kind);
+
+    table.add_column(Column("flag", COLUMN_BOOL, 17));
+
+    const RowData* rows = table.load_rows();
+    Snapshot::write("snapshot_test" + Snapshot::extension, *rows);
+    delete rows;
+  }
+
+  TEAR_DOWN {
+    remove("snapshot_test.dat");
+    remove(("snapshot_test" + Snapshot::extension).c_str());
+  }
+}
+
+FIXTURE_TEST(columns, snapshot_fixture) {
+  Snapshot snapshot("snapshot_test" + Snapshot::extension);
+
+  ASSERT(equal(3u, snapshot.row_count()));
+  ASSERT(equal(6u, snapshot.column_count()));
+
+  const SnapshotColumn& ids = snapshot.column_at(0);
+  ASSERT(equal(SNAPSHOT_DELTA, ids.get_encoding()));
+  ASSERT(equal(1, ids.get_integer(0)));
+  ASSERT(equal(258, ids.get_integer(1)));
+  ASSERT(equal(3, ids.get_integer(2)));
+
+  ASSERT(equal(-100, snapshot.column_at(1).get_integer(0)));
+  ASSERT(equal(93299 + 2342031 - 2440588,
+    snapshot.column_at(2).get_integer(0)));
+
+  const SnapshotColumn& names = snapshot.column_at(3);
+  ASSERT(equal(SNAPSHOT_DICTIONARY, names.get_encoding()));
+  ASSERT(equal(2u, names.dictionary_size()));
+  ASSERT(equal("cdef", names.get_string(1)));
+  ASSERT(equal(names.get_index(0), names.get_index(2)));
+
+  ASSERT(equal(1, snapshot.column_at(4).get_integer(0)));
+  ASSERT(equal(0, snapshot.column_at(5).get_integer(1)));
+}
+
+FIXTURE_TEST(definition, snapshot_fixture) {
+  Snapshot snapshot("snapshot_test" + Snapshot::extension);
+  Table stored = snapshot.get_table();
+
+  ASSERT(equal("Test", stored.get_name()));
+  ASSERT(equal(6u, stored.column_count()));
+  ASSERT(equal("B", stored.column_at(4).enumeration.get_value(1)));
+}
+
+FIXTURE_TEST(extract_data, snapshot_fixture) {
+  const ResultSet* original = table.extract_data();
+
+  Database db = Database::from_snapshot(".");
+  ASSERT(equal(1u, db.table_count()));
+
+  const ResultSet* stored = db.table_at(0).extract_data();
+
+  ASSERT(equal(original->row_count(), stored->row_count()));
+  for (unsigned int row = 0; row < original->row_count(); row++){
+    for (unsigned int col = 0; col < 6; col++){
+      ASSERT(equal((*original)[row][col], (*stored)[row][col]));
+    }
+  }
+
+  delete original;
+  delete stored;
+}
+
+FIXTURE_TEST(load_rows, snapshot_fixture) {
+  // Every byte of these rows belongs to a column, so rebuilding them from
+  // the snapshot gives back exactly the original rows
+  const RowData* original = table.load_rows();
+
+  Database db = Database::from_snapshot(".");
+  const RowData* stored = db.table_at(0).load_rows();
+
+  ASSERT(equal(original->row_count(), stored->row_count()));
+  for (unsigned int row = 0; row < original->row_count(); row++){
+    ASSERT(0 == memcmp((*original)[row], (*stored)[row], 18));
+  }
+
+  delete original;
+  delete stored;
+
+  const RowData* limited = db.table_at(0).load_rows(2);
+  ASSERT(equal(2u, limited->row_count()));
+  delete limited;
+}
+
+TEST(load_varstring_rows) {
+  // Variable-length rows: length, phone number, 2-byte blob, varstring
+  const uint8 data[] = {
+    0, 0,  21, 0, 0, 0,  '5', '5', '5', '1', '2', '3', '4', '5', '6', '7',
+    0xAB, 0x01,  'x', 'y', 'z',
+    0, 0,  18, 0, 0, 0,  '5', '5', '5', '1', '2', '3', '4', 0, 0, 0,
+    0, 0
+  };
+
+  FILE* file = fopen("snapshot_test.dat", "wb");
+  fwrite(data, 1, sizeof(data), file);
+  fclose(file);
+
+  Database::set_data_path(".");
+  Table table("Test", "snapshot_test.dat", 0, 0);
+  table.add_column(Column("phone", COLUMN_PHONE, 6, 10));
+  table.add_column(Column("data", COLUMN_BLOB, 16, 2));
+  table.add_column(Column("note", COLUMN_VARSTRING, 18));
+
+  const std::string file_name = "snapshot_test" + Snapshot::extension;
+  const RowData* original = table.load_rows();
+  Snapshot::write(file_name, *original);
+
+  Table stored = Snapshot(file_name).get_table();
+  stored.set_snapshot_file(file_name);
+  const RowData* rebuilt = stored.load_rows();
+
+  ASSERT(equal(2u, rebuilt->row_count()));
+  ASSERT(0 == memcmp((*original)[0], (*rebuilt)[0], 21));
+  ASSERT(0 == memcmp((*original)[1], (*rebuilt)[1], 18));
+
+  delete original;
+  delete rebuilt;
+  remove("snapshot_test.dat");
+  remove(file_name.c_str());
+}
+
+TEST(invalid_file) {
+  const std::string file_name = "invalid" + Snapshot::extension;
+  FILE* file = fopen(file_name.c_str(), "wb");
+  fputs("DRLSNAP1 but not really a snapshot", file);
+  fclose(file);
+
+  bool thrown = false;
+  try {
+    Snapshot snapshot(file_name);
+  }
+
+  catch (const Errors::FileParseError&) {
+    thrown = true;
+  }
+
+  remove(file_name.c_str());
+  ASSERT(thrown);
+}
+
+}
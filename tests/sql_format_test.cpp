@@ -0,0 +1,108 @@
+#include <copper.hpp>
+#include <string>
+#include "../src/sql_format.h"
+#include "../src/string_scan.h"
+
+using namespace Driller;
+
+TEST_SUITE(sql_format_tests) {
+
+TEST(scan) {
+  // Long enough that the special character is past the first 16 bytes
+  const std::string clean = "abcdefghijklmnopqrstuvwxyz";
+  ASSERT(clean.data() + clean.size() ==
+    find_sql_special(clean.data(), clean.data() + clean.size()));
+
+  const char* specials = "\0\n\r\\'\"\032";
+  for (unsigned int ii = 0; ii < 7; ii++){
+    std::string text = clean;
+    text[20] = specials[ii];
+    ASSERT(text.data() + 20 ==
+      find_sql_special(text.data(), text.data() + text.size()));
+
+    text = clean.substr(0, 3) + specials[ii];
+    ASSERT(text.data() + 3 ==
+      find_sql_special(text.data(), text.data() + text.size()));
+  }
+}
+
+TEST(escape) {
+  char out[64];
+  const std::string text("it's a \"test\"\\\n\r\032end\0!", 22);
+  const unsigned int length = escape_sql_string(text.data(),
+    static_cast<unsigned int>(text.size()), out);
+
+  ASSERT(equal("it\\'s a \\\"test\\\"\\\\\\n\\r\\Zend\\0!",
+    std::string(out, length)));
+}
+
+TEST(numbers) {
+  char out[16];
+  ASSERT(equal("0", std::string(out, format_unsigned(0, out))));
+  ASSERT(equal("4294967295",
+    std::string(out, format_unsigned(4294967295u, out))));
+
+  ASSERT(equal("-650.48", std::string(out, format_currency(-65048, out))));
+  ASSERT(equal("0.05", std::string(out, format_currency(5, out))));
+  ASSERT(equal("-21474836.48",
+    std::string(out, format_currency(-2147483647 - 1, out))));
+}
+
+TEST(values) {
+  // bool, int16, date, 4-byte string, currency
+  const uint8 row[] = {
+    1,  0x9C, 0xFF,  0x73, 0x6C, 0x01, 0x00,  'a', '\'', 0, 0,
+    0x9C, 0xFF, 0xFF, 0xFF
+  };
+
+  char out[64];
+  Column flag("flag", COLUMN_BOOL, 0);
+  Column number("number", COLUMN_INT16, 1);
+  Column date("date", COLUMN_DATE, 3);
+  Column name("name", COLUMN_STRING, 7, 4);
+  Column balance("balance", COLUMN_CURRENCY, 11);
+
+  ASSERT(equal("1", std::string(out, write_sql_value(flag, row, out))));
+  ASSERT(equal("-100", std::string(out, write_sql_value(number, row, out))));
+  ASSERT(equal("'1955-08-10'",
+    std::string(out, write_sql_value(date, row, out))));
+  ASSERT(equal("'a\\''", std::string(out, write_sql_value(name, row, out))));
+  ASSERT(equal("-1.00",
+    std::string(out, write_sql_value(balance, row, out))));
+
+  ASSERT(write_sql_value(name, row, out) <= max_sql_value_size(name, row));
+
+  ASSERT(equal("0",
+    std::string(out, write_sql_text(COLUMN_BOOL, "False", 5, out))));
+  ASSERT(equal("'1955-7-3'",
+    std::string(out, write_sql_text(COLUMN_DATE, "1955-7-3", 8, out))));
+}
+
+TEST(blobs) {
+  // Raw and extracted blobs give the same literal
+  const uint8 row[] = { 0x0A, '\'', 0xFF };
+  Column data("data", COLUMN_BLOB, 0, 3);
+
+  char out[16];
+  ASSERT(equal("X'0A27FF'", std::string(out, write_sql_value(data, row, out))));
+  ASSERT(write_sql_value(data, row, out) <= max_sql_value_size(data, row));
+  ASSERT(equal("X'0A27FF'",
+    std::string(out, write_sql_text(COLUMN_BLOB, "0A 27 FF", 8, out))));
+  ASSERT(equal("''", std::string(out, write_sql_text(COLUMN_BLOB, "", 0, out))));
+  ASSERT(equal(SQL_LITERAL_HEX, sql_literal_kind(COLUMN_BLOB)));
+}
+
+TEST(types) {
+  ASSERT(equal("TINYINT(1) UNSIGNED",
+    sql_type_from_column(Column("flag", COLUMN_BOOL, 0))));
+  ASSERT(equal("VARCHAR(4)",
+    sql_type_from_column(Column("name", COLUMN_STRING, 0, 4))));
+  ASSERT(equal("DECIMAL(10,2)",
+    sql_type_from_column(Column("balance", COLUMN_CURRENCY, 0))));
+
+  ASSERT(can_index_sql(Column("name", COLUMN_STRING, 0, 4)));
+  ASSERT(!can_index_sql(Column("note", COLUMN_STRING, 0, 300)));
+  ASSERT(!can_index_sql(Column("data", COLUMN_BLOB, 0)));
+}
+
+}
@@ -0,0 +1,65 @@
+#include <copper.hpp>
+#include <cstdio>
+#include <vector>
+#include "../src/database/database.h"
+#include "../src/database/table_cost.h"
+
+using namespace Driller;
+
+TEST_SUITE(table_cost_tests) {
+
+FIXTURE(table_cost_fixture) {
+  std::vector<Table> tables;
+
+  SET_UP {
+    // 16 bytes of header, then 1000 rows of 10 bytes
+    std::vector<char> data(16 + (1000 * 10));
+    FILE* file = fopen("table_cost_test.dat", "wb");
+    fwrite(&data[0], 1, data.size(), file);
+    fclose(file);
+
+    Database::set_data_path(".");
+
+    Table narrow("Narrow", "table_cost_test.dat", 16, 10);
+    narrow.add_column(Column("id", COLUMN_UINT32, 0));
+    tables.push_back(narrow);
+
+    Table wide("Wide", "table_cost_test.dat", 16, 10);
+    wide.add_column(Column("id", COLUMN_UINT32, 0));
+    wide.add_column(Column("name", COLUMN_STRING, 4, 6));
+    tables.push_back(wide);
+
+    tables.push_back(Table("Missing", "no_such_file.dat", 0, 10));
+  }
+
+  TEAR_DOWN {
+    remove("table_cost_test.dat");
+  }
+}
+
+FIXTURE_TEST(rows, table_cost_fixture) {
+  ASSERT(estimate_row_count(tables[0]) == 1000);
+  ASSERT(estimate_row_count(tables[2]) == 0);
+
+  // Varying rows are measured by their columns, here 10 bytes
+  Table varying = tables[1];
+  varying.set_row_length(0);
+  ASSERT(estimate_row_count(varying) == 1001);
+}
+
+FIXTURE_TEST(costs, table_cost_fixture) {
+  ASSERT(estimate_row_cost(tables[1]) > estimate_row_cost(tables[0]));
+  ASSERT(estimate_table_cost(tables[0], 10) <
+    estimate_table_cost(tables[0]));
+  ASSERT(estimate_table_cost(tables[2]) > 0);
+}
+
+FIXTURE_TEST(schedule, table_cost_fixture) {
+  const std::vector<unsigned int> order = schedule_by_cost(tables);
+  ASSERT(order.size() == 3);
+  ASSERT(order[0] == 1);
+  ASSERT(order[1] == 0);
+  ASSERT(order[2] == 2);
+}
+
+}
@@ -1,4 +1,5 @@
 #include <copper.hpp>
+#include <cstdio>
 #include "../src/database/database.h"
 
 using namespace Driller;
@@ -113,4 +114,71 @@ FIXTURE_TEST(get_columns, table_fixture) {
   ASSERT(equal("bool_col", columns.at(1).get_name()));
 }
 
+/**
+  Write a table file
+
+  @param data The file's contents
+  @param length How many bytes there are
+*/
+static void write_table_file(const uint8* data, const unsigned int length){
+  FILE* file = fopen("table_test.dat", "wb");
+  fwrite(data, 1, length, file);
+  fclose(file);
+}
+
+TEST(varstring_rows) {
+  // Each row stores its own length 2 bytes in, and the string starts at 6
+  const uint8 data[] = {
+    0, 0,  9, 0, 0, 0,  'a', 'b', 'c',
+    0, 0,  7, 0, 0, 0,  'd'
+  };
+  write_table_file(data, sizeof(data));
+
+  Database::set_data_path(".");
+  Table table("Test", "table_test.dat", 0, 0);
+  table.add_column(Column("text", COLUMN_VARSTRING, 6));
+
+  const RowData* rows = table.load_rows();
+  ASSERT(equal(2u, rows->row_count()));
+
+  const uint8* bytes;
+  ASSERT(equal(3u, table.column_at(0).get_bytes((*rows)[0], bytes)));
+  ASSERT(equal('a', static_cast<char>(bytes[0])));
+  ASSERT(equal(1u, table.column_at(0).get_bytes((*rows)[1], bytes)));
+  ASSERT(equal('d', static_cast<char>(bytes[0])));
+
+  delete rows;
+  remove("table_test.dat");
+}
+
+TEST(corrupt_varstring_rows) {
+  Database::set_data_path(".");
+  Table table("Test", "table_test.dat", 0, 0);
+  table.add_column(Column("text", COLUMN_VARSTRING, 6));
+
+  // A row running past the end of the file
+  const uint8 past_end[] = {
+    0, 0,  9, 0, 0, 0,  'a', 'b', 'c',
+    0, 0,  100, 0, 0, 0,  'd'
+  };
+  write_table_file(past_end, sizeof(past_end));
+  ASSERT(throws(Errors::CorruptFileError, table.load_rows()));
+
+  // A row ending before its string starts, which would otherwise never end
+  const uint8 too_short[] = {
+    0, 0,  0, 0, 0, 0,  'a'
+  };
+  write_table_file(too_short, sizeof(too_short));
+  ASSERT(throws(Errors::CorruptFileError, table.load_rows()));
+
+  // Too little left for a row's length
+  const uint8 truncated[] = {
+    0, 0,  7, 0, 0, 0,  'a',  0, 0
+  };
+  write_table_file(truncated, sizeof(truncated));
+  ASSERT(throws(Errors::CorruptFileError, table.load_rows()));
+
+  remove("table_test.dat");
+}
+
 }